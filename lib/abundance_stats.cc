@@ -0,0 +1,211 @@
+#include <assert.h>
+#include <math.h>
+#include <vector>
+
+#include "abundance_stats.hh"
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+AbundanceStatsEngine::AbundanceStatsEngine(
+  const Hashtable &ht, unsigned int max_read_len,
+  BoundedCounterType limit_by_count, uint32_t const number_of_threads
+) :
+  _ht(ht), _max_read_len(max_read_len), _limit_by_count(limit_by_count),
+  _number_of_threads(number_of_threads), _parser(NULL),
+  _invalid_file_format(false), _n_reads(0), _n_kmers(0)
+{
+  assert(_number_of_threads > 0);
+  pthread_mutex_init(&_lock, NULL);
+}
+
+AbundanceStatsEngine::~AbundanceStatsEngine()
+{
+  pthread_mutex_destroy(&_lock);
+}
+
+void AbundanceStatsEngine::gather(const std::string &infilename)
+{
+  Config &the_config = get_active_config( );
+
+  _n_reads = _n_kmers = 0;
+  _histogram.clear();
+  _by_position.assign(_max_read_len, 0);
+  _invalid_file_format = false;
+
+  _parser = IParser::get_parser(
+    infilename, _number_of_threads, the_config.get_reads_input_buffer_size( ),
+    the_config.get_reads_parser_trace_level( )
+  );
+
+  run_on_threads(_run_thread, this, _number_of_threads);
+
+  delete _parser;
+  _parser = NULL;
+
+  if (_invalid_file_format) {
+    throw InvalidReadFileFormat();
+  }
+}
+
+void AbundanceStatsEngine::_run_thread(void * engine, uint32_t thread_n)
+{
+  ((AbundanceStatsEngine *) engine)->_gather_reads();
+}
+
+void AbundanceStatsEngine::_gather_reads()
+{
+  Read				  read;
+  std::vector<HashIntoType>	  kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+  std::vector<unsigned long long> histogram;
+  std::vector<unsigned long long> by_position(_max_read_len, 0);
+  unsigned long long		  n_reads   = 0;
+  unsigned long long		  n_kmers   = 0;
+
+  while (next_read_or_done(_parser, read, !n_reads, _invalid_file_format)) {
+    n_reads++;
+
+    std::string &seq = read.sequence;
+    if (!_ht.check_and_normalize_read(seq)) {
+      continue;
+    }
+
+    kmer_hashes.clear();
+    KMerIterator kmers(seq.c_str(), _ht.ksize());
+    while (!kmers.done()) {
+      kmer_hashes.push_back(kmers.next());
+    }
+    counts.resize(kmer_hashes.size());
+    _ht.get_count_batch(&kmer_hashes[0], kmer_hashes.size(), &counts[0]);
+
+    for (size_t i = 0; i < counts.size(); i++) {
+      BoundedCounterType n = counts[i];
+
+      if (n >= histogram.size()) {
+	histogram.resize(n + 1, 0);
+      }
+      histogram[n]++;
+
+      if (i < _max_read_len && (!_limit_by_count || n == _limit_by_count)) {
+	by_position[i]++;
+      }
+    }
+    n_kmers += counts.size();
+  }
+
+  pthread_mutex_lock(&_lock);
+  _n_reads += n_reads;
+  _n_kmers += n_kmers;
+  if (histogram.size() > _histogram.size()) {
+    _histogram.resize(histogram.size(), 0);
+  }
+  for (size_t i = 0; i < histogram.size(); i++) {
+    _histogram[i] += histogram[i];
+  }
+  for (unsigned int i = 0; i < _max_read_len; i++) {
+    _by_position[i] += by_position[i];
+  }
+  pthread_mutex_unlock(&_lock);
+}
+
+unsigned long long AbundanceStatsEngine::get_total() const
+{
+  unsigned long long total = 0;
+  for (size_t i = 0; i < _histogram.size(); i++) {
+    total += i * _histogram[i];
+  }
+  return total;
+}
+
+double AbundanceStatsEngine::get_mean() const
+{
+  if (!_n_kmers) {
+    return 0;
+  }
+  return double(get_total()) / double(_n_kmers);
+}
+
+double AbundanceStatsEngine::get_variance() const
+{
+  if (!_n_kmers) {
+    return 0;
+  }
+
+  double mean = get_mean();
+  double sum_sq = 0;
+  for (size_t i = 0; i < _histogram.size(); i++) {
+    double diff = double(i) - mean;
+    sum_sq += diff * diff * _histogram[i];
+  }
+  return sum_sq / double(_n_kmers);
+}
+
+double AbundanceStatsEngine::get_abs_deviation(double about) const
+{
+  if (!_n_kmers) {
+    return 0;
+  }
+
+  double total = 0;
+  for (size_t i = 0; i < _histogram.size(); i++) {
+    total += fabs(double(i) - about) * _histogram[i];
+  }
+  return total / double(_n_kmers);
+}
+
+unsigned long long AbundanceStatsEngine::_rank(double q) const
+{
+  unsigned long long rank = (unsigned long long) ceil(q * _n_kmers);
+  if (rank < 1) {
+    rank = 1;
+  }
+  if (rank > _n_kmers) {
+    rank = _n_kmers;
+  }
+  return rank;
+}
+
+BoundedCounterType AbundanceStatsEngine::get_quantile(double q) const
+{
+  if (!_n_kmers) {
+    return 0;
+  }
+
+  unsigned long long rank = _rank(q);
+  unsigned long long seen = 0;
+  size_t i;
+  for (i = 0; i < _histogram.size() - 1; i++) {
+    seen += _histogram[i];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  return i;
+}
+
+unsigned int AbundanceStatsEngine::get_median_abs_deviation() const
+{
+  if (!_n_kmers) {
+    return 0;
+  }
+
+  // take in the counts on both sides of the median, one step at a time.
+  const size_t median = get_median();
+  const unsigned long long rank = _rank(0.5);
+  unsigned long long seen = _histogram[median];
+  unsigned int deviation = 0;
+  while (seen < rank) {
+    deviation++;
+    if (median + deviation < _histogram.size()) {
+      seen += _histogram[median + deviation];
+    }
+    if (deviation <= median) {
+      seen += _histogram[median - deviation];
+    }
+  }
+  return deviation;
+}
+
+// vim: set sts=2 sw=2:
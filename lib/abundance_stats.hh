@@ -0,0 +1,101 @@
+#ifndef ABUNDANCE_STATS_HH
+#define ABUNDANCE_STATS_HH
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "khmer.hh"
+#include "khmer_config.hh"
+#include "threads.hh"
+#include "hashtable.hh"
+#include "read_parsers.hh"
+
+namespace khmer {
+
+  // Statistics of the counts of the k-mers in a file of reads, in one pass
+  // over it: the mean, variance, and absolute deviations of the counts,
+  // their quantiles, and, as in fasta_count_kmers_by_position(), how many
+  // k-mers (with a given count, or with any) start at each position of a
+  // read.
+  //
+  // Counts are at most MAX_BIGCOUNT, so each thread keeps a histogram of
+  // the counts it has looked up -- the number of k-mers seen at each count
+  // -- and its own per-position tallies.  These add up exactly when the
+  // threads are done, and everything else comes from the one histogram,
+  // with no second pass for the deviations.
+  //
+  // Each thread takes reads from one shared IParser, and the table is only
+  // read.  Reads with non-ACGT bases, or shorter than k, are counted in
+  // get_n_reads() but not looked at.
+  class AbundanceStatsEngine {
+  protected:
+    const Hashtable &	      _ht;
+    unsigned int	      _max_read_len;
+    BoundedCounterType	      _limit_by_count;
+    uint32_t		      _number_of_threads;
+
+    // state for the current call to gather()
+    read_parsers:: IParser *  _parser;
+    pthread_mutex_t	      _lock;
+    bool		      _invalid_file_format;
+
+    unsigned long long	      _n_reads;
+    unsigned long long	      _n_kmers;
+    std::vector<unsigned long long> _histogram;	   // k-mers at each count
+    std::vector<unsigned long long> _by_position;
+
+    static void _run_thread(void * engine, uint32_t thread_n);
+    void _gather_reads();
+
+    // the rank of quantile q among the k-mers, from 1.
+    unsigned long long _rank(double q) const;
+
+  public:
+    // Tally k-mers by position up to max_read_len, and only those with a
+    // count of limit_by_count, unless it is 0.
+    AbundanceStatsEngine(
+      const Hashtable &ht, unsigned int max_read_len = 0,
+      BoundedCounterType limit_by_count = 0,
+      uint32_t const number_of_threads =
+      get_active_config( ).get_number_of_threads( )
+    );
+    ~AbundanceStatsEngine();
+
+    // Look up every k-mer in infilename.  The statistics are for this call.
+    void gather(const std::string &infilename);
+
+    unsigned long long get_n_reads() const { return _n_reads; }
+    unsigned long long get_n_kmers() const { return _n_kmers; }
+
+    // the number of k-mers seen at each count, up to the largest seen.
+    const std::vector<unsigned long long> &get_histogram() const {
+      return _histogram;
+    }
+
+    const std::vector<unsigned long long> &get_by_position() const {
+      return _by_position;
+    }
+
+    // the sum of the counts.
+    unsigned long long get_total() const;
+
+    double get_mean() const;
+    double get_variance() const;
+
+    // the mean of |count - about|.
+    double get_abs_deviation(double about) const;
+    double get_abs_deviation() const { return get_abs_deviation(get_mean()); }
+
+    // The smallest count at least a fraction q of the k-mers have no more
+    // than (0 < q <= 1), or 0 if there were no k-mers.
+    BoundedCounterType get_quantile(double q) const;
+    BoundedCounterType get_median() const { return get_quantile(0.5); }
+
+    // the median of |count - median count|.
+    unsigned int get_median_abs_deviation() const;
+  };
+};
+
+#endif // ABUNDANCE_STATS_HH
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,208 @@
+// Compare plain and conservative-update counting: memory, accuracy, speed.
+//
+// For a range of table sizes, count every k-mer of the input with each
+// update rule, using all of the OpenMP threads, and report the counting
+// rate along with how far the counts overestimate the exact k-mer counts.
+// Conservative update at a fraction of the memory should show the same
+// error as plain counting with bigger tables.
+
+
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include <omp.h>
+
+#include "error.hh"
+#include "read_parsers.hh"
+#include "counting.hh"
+#include "primes.hh"
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+
+static const char *	    SHORT_OPTS		= "k:N:x:s:r:";
+
+typedef map< HashIntoType, unsigned long >  ExactCounts;
+
+
+static double
+get_time( )
+{
+    struct timeval  tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1.0E6;
+}
+
+
+static void
+count_exactly(
+    string const	&ifile_name,
+    unsigned long const	kmer_length,
+    ExactCounts		&exact
+)
+{
+    CountingHash    ht( kmer_length, 1, 1 );
+    IParser *	    parser  = IParser:: get_parser( ifile_name, 1 );
+    Read	    read;
+
+    while (!parser->is_complete( ))
+    {
+	read = parser->get_next_read( );
+	if (!ht.check_and_normalize_read( read.sequence )) continue;
+
+	KMerIterator kmers( read.sequence.c_str( ), kmer_length );
+	while (!kmers.done( ))
+	    exact[ kmers.next( ) ]++;
+    }
+
+    delete parser;
+}
+
+
+int main( int argc, char * argv[ ] )
+{
+    unsigned long	kmer_length	    = 20;
+    float		ht_size_FP	    = 1.0E6;
+    unsigned long	ht_count	    = 4;
+    unsigned long	n_rounds	    = 4;
+    uint64_t		cache_size	    = 4L * 1024 * 1024 * 1024;
+
+    int			rc		    = 0;
+    int			opt		    = -1;
+    char *		conv_residue	    = NULL;
+    string		ifile_name;
+
+    while (-1 != (opt = getopt( argc, argv, SHORT_OPTS )))
+    {
+
+	switch (opt)
+	{
+
+	case 'k':
+	    kmer_length = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid kmer length" );
+	    break;
+
+	case 'N':
+	    ht_count = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid number of hashtables" );
+	    break;
+
+	case 'x':
+	    ht_size_FP = strtof( optarg, &conv_residue );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid hashtable size" );
+	    break;
+
+	case 's':
+	    cache_size = strtoull( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid cache size" );
+	    break;
+
+	case 'r':
+	    n_rounds = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid number of halvings" );
+	    break;
+
+	default:
+	    error( 0, 0, "Skipping unknown arg, '%c'", optopt );
+	}
+
+    }
+
+    if (optind < argc) ifile_name = string( argv[ optind++ ] );
+    else error( EINVAL, 0, "Input file name required" );
+
+    Config		    &the_config		= get_active_config( );
+    the_config.set_number_of_threads( omp_get_max_threads( ) );
+
+    ExactCounts		    exact;
+    count_exactly( ifile_name, kmer_length, exact );
+
+    fprintf(
+	stdout, "%lu distinct k-mers; %d threads\n\n",
+	(unsigned long)exact.size( ), omp_get_max_threads( )
+    );
+    fprintf(
+	stdout, "%-12s %12s %10s %10s %12s %10s\n",
+	"update", "bytes", "seconds", "Mk-mers/s", "mean error", "% wrong"
+    );
+
+    // Halve the table size each round.
+    HashIntoType	    ht_size		= (HashIntoType)ht_size_FP;
+    for (unsigned long round = 0; round < n_rounds; ++round, ht_size /= 2)
+    {
+	Primes primetab( ht_size );
+	vector<HashIntoType> ht_sizes;
+	for ( unsigned int i = 0; i < ht_count; ++i )
+	    ht_sizes.push_back( primetab.get_next_prime( ) );
+
+	HashIntoType n_bytes = 0;
+	for ( unsigned int i = 0; i < ht_count; ++i )
+	    n_bytes += ht_sizes[ i ];
+
+	for (int conservative = 0; conservative < 2; ++conservative)
+	{
+	    CountingHash ht(
+		kmer_length, ht_sizes, the_config.get_number_of_threads( ),
+		false, 8, conservative
+	    );
+	    ht.set_use_bigcount( true );
+
+	    unsigned int	    reads_total		= 0;
+	    unsigned long long int  n_consumed		= 0;
+	    IParser * parser = IParser:: get_parser(
+		ifile_name, the_config.get_number_of_threads( ), cache_size
+	    );
+
+	    double start = get_time( );
+#pragma omp parallel shared( reads_total, n_consumed )
+	    {
+	    ht.consume_fasta( parser, reads_total, n_consumed );
+	    }
+	    double seconds = get_time( ) - start;
+
+	    delete parser;
+
+	    double	    total_error	= 0;
+	    unsigned long   n_wrong	= 0;
+	    for (ExactCounts:: const_iterator it = exact.begin( );
+		 it != exact.end( ); ++it)
+	    {
+		unsigned long count = ht.get_count( it->first );
+		if (count != it->second)
+		{
+		    total_error += (double)count - (double)it->second;
+		    n_wrong++;
+		}
+	    }
+
+	    fprintf(
+		stdout, "%-12s %12llu %10.3f %10.2f %12.4f %10.2f\n",
+		conservative ? "conservative" : "plain",
+		(unsigned long long)n_bytes, seconds,
+		n_consumed / seconds / 1.0E6,
+		total_error / exact.size( ),
+		100.0 * n_wrong / exact.size( )
+	    );
+	}
+    }
+
+    return rc;
+}
+
+
+// vim: set sts=4 sw=4 tw=80:
@@ -0,0 +1,187 @@
+// Time bin indexing: the hardware modulus against FastModulus, and then
+// count() and get_count() on CountingHash and Hashbits tables that index
+// with FastModulus.
+//
+// Hashes come from a xorshift generator rather than from reads, so that
+// the timings are of the tables alone.  Use -x to pick table sizes that
+// fit in cache (the indexing cost dominates) or that don't (the cache
+// misses dominate).
+
+
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "error.hh"
+#include "counting.hh"
+#include "hashbits.hh"
+#include "fastmod.hh"
+#include "primes.hh"
+
+using namespace std;
+using namespace khmer;
+
+
+static const char *	    SHORT_OPTS		= "k:N:x:n:";
+
+
+static double
+get_time( )
+{
+    struct timeval  tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1.0E6;
+}
+
+
+// Fill hashes with pseudo-random k-mer hashes of 2 * kmer_length bits.
+static void
+make_hashes(
+    vector< HashIntoType >  &hashes,
+    unsigned long const	    kmer_length
+)
+{
+    HashIntoType    x	    = 88172645463325252ULL;
+    HashIntoType    mask    =
+	kmer_length < 32 ? (1ULL << (2 * kmer_length)) - 1 : ~0ULL;
+
+    for (size_t i = 0; i < hashes.size( ); ++i)
+    {
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	hashes[ i ] = x & mask;
+    }
+}
+
+
+static void
+report( char const * what, double seconds, size_t n )
+{
+    fprintf( stdout, "%-28s %10.3f %10.2f\n", what, seconds, seconds / n * 1.0E9 );
+}
+
+
+int main( int argc, char * argv[ ] )
+{
+    unsigned long	kmer_length	    = 20;
+    float		ht_size_FP	    = 1.0E8;
+    unsigned long	ht_count	    = 4;
+    unsigned long	n_hashes	    = 10000000;
+
+    int			rc		    = 0;
+    int			opt		    = -1;
+    char *		conv_residue	    = NULL;
+
+    while (-1 != (opt = getopt( argc, argv, SHORT_OPTS )))
+    {
+
+	switch (opt)
+	{
+
+	case 'k':
+	    kmer_length = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid kmer length" );
+	    break;
+
+	case 'N':
+	    ht_count = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid number of hashtables" );
+	    break;
+
+	case 'x':
+	    ht_size_FP = strtof( optarg, &conv_residue );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid hashtable size" );
+	    break;
+
+	case 'n':
+	    n_hashes = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid number of hashes" );
+	    break;
+
+	default:
+	    error( 0, 0, "Skipping unknown arg, '%c'", optopt );
+	}
+
+    }
+
+    Primes primetab( (HashIntoType)ht_size_FP );
+    vector< HashIntoType > ht_sizes;
+    for ( unsigned int i = 0; i < ht_count; ++i )
+	ht_sizes.push_back( primetab.get_next_prime( ) );
+
+    vector< FastModulus > ht_mods;
+    for ( unsigned int i = 0; i < ht_count; ++i )
+	ht_mods.push_back( FastModulus( ht_sizes[ i ] ) );
+
+    vector< HashIntoType > hashes( n_hashes );
+    make_hashes( hashes, kmer_length );
+
+    fprintf(
+	stdout, "%lu hashes; %lu tables of about %.0f bins\n\n",
+	n_hashes, ht_count, ht_size_FP
+    );
+    fprintf( stdout, "%-28s %10s %10s\n", "operation", "seconds", "ns/k-mer" );
+
+    // The sums keep the compiler from throwing the bins away.
+    HashIntoType    sum	    = 0;
+    double	    start;
+
+    start = get_time( );
+    for (size_t i = 0; i < n_hashes; ++i)
+	for (unsigned int j = 0; j < ht_count; ++j)
+	    sum += hashes[ i ] % ht_sizes[ j ];
+    report( "bins, hardware modulus", get_time( ) - start, n_hashes );
+
+    HashIntoType    fast_sum	= 0;
+    start = get_time( );
+    for (size_t i = 0; i < n_hashes; ++i)
+	for (unsigned int j = 0; j < ht_count; ++j)
+	    fast_sum += ht_mods[ j ].mod( hashes[ i ] );
+    report( "bins, FastModulus", get_time( ) - start, n_hashes );
+
+    if (sum != fast_sum)
+	error( EINVAL, 0, "FastModulus disagrees with the hardware modulus" );
+
+    {
+	CountingHash ht( kmer_length, ht_sizes, 1 );
+
+	start = get_time( );
+	for (size_t i = 0; i < n_hashes; ++i)
+	    ht.count( hashes[ i ] );
+	report( "CountingHash::count", get_time( ) - start, n_hashes );
+
+	start = get_time( );
+	for (size_t i = 0; i < n_hashes; ++i)
+	    sum += ht.get_count( hashes[ i ] );
+	report( "CountingHash::get_count", get_time( ) - start, n_hashes );
+    }
+
+    {
+	Hashbits ht( kmer_length, ht_sizes );
+
+	start = get_time( );
+	for (size_t i = 0; i < n_hashes; ++i)
+	    ht.count( hashes[ i ] );
+	report( "Hashbits::count", get_time( ) - start, n_hashes );
+
+	start = get_time( );
+	for (size_t i = 0; i < n_hashes; ++i)
+	    sum += ht.get_count( hashes[ i ] );
+	report( "Hashbits::get_count", get_time( ) - start, n_hashes );
+    }
+
+    fprintf( stdout, "\n(checksum %llu)\n", (unsigned long long)sum );
+
+    return rc;
+}
+
+
+// vim: set sts=4 sw=4 tw=80:
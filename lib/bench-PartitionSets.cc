@@ -0,0 +1,297 @@
+// Compare std::set and std::map against the flat containers that SeenSet
+// and PartitionMap are, in memory and time, on the work partitioning does.
+//
+// Reads are sampled from a random genome and tagged into a Hashbits, as
+// for partitioning.  Then, for each kind of container:
+//
+//   - the tags go into a set, as all_tags, and each into a map to a
+//     partition, as partition_map;
+//   - the k-mers of each read go into a set cleared between reads, as the
+//     keeper of a traversal; each is looked up among the tags, and the
+//     tags found are looked up in the partition map, as find_all_tags()
+//     and assign_partition_id() do.
+//
+// Memory is what the containers asked for: for std::set and std::map that
+// leaves out what malloc adds to each node, so their figures are low.
+// Last, the Hashbits is partitioned for real, with the flat containers.
+
+
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <set>
+#include <map>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "error.hh"
+#include "hashbits.hh"
+#include "primes.hh"
+
+using namespace std;
+using namespace khmer;
+
+
+static const char *	    SHORT_OPTS		= "k:g:l:c:x:";
+
+static size_t		    bytes_allocated	= 0;
+
+
+// An allocator that keeps a tally of what the std containers ask for.
+template< typename T >
+struct CountingAllocator : public allocator< T >
+{
+    template< typename U > struct rebind { typedef CountingAllocator< U > other; };
+
+    CountingAllocator( ) { }
+    template< typename U >
+    CountingAllocator( CountingAllocator< U > const &other ) { }
+
+    T * allocate( size_t n, void const * hint = 0 )
+    {
+	bytes_allocated += n * sizeof( T );
+	return allocator< T >::allocate( n );
+    }
+
+    void deallocate( T * p, size_t n )
+    {
+	bytes_allocated -= n * sizeof( T );
+	allocator< T >::deallocate( p, n );
+    }
+};
+
+typedef set< HashIntoType, less< HashIntoType >,
+	     CountingAllocator< HashIntoType > > StdSeenSet;
+typedef map< HashIntoType, PartitionID *, less< HashIntoType >,
+	     CountingAllocator< pair< const HashIntoType, PartitionID * > > >
+	StdPartitionMap;
+
+
+static double
+get_time( )
+{
+    struct timeval  tv;
+
+    gettimeofday( &tv, NULL );
+    return tv.tv_sec + tv.tv_usec / 1.0E6;
+}
+
+
+static size_t
+memory_used( StdSeenSet const &s )
+{ (void)s; return bytes_allocated; }
+
+static size_t
+memory_used( StdPartitionMap const &m )
+{ (void)m; return bytes_allocated; }
+
+template< typename C >
+static size_t
+memory_used( C const &c )
+{ return c.memory_used( ); }
+
+
+static void
+make_reads(
+    vector< string >	&reads,
+    unsigned long const genome_length,
+    unsigned long const read_length,
+    float const		coverage
+)
+{
+    static char const	bases[ ]    = "ACGT";
+    HashIntoType	x	    = 88172645463325252ULL;
+    string		genome( genome_length, 'A' );
+
+    for (size_t i = 0; i < genome_length; ++i)
+    {
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	genome[ i ] = bases[ x & 3 ];
+    }
+
+    size_t n_reads = (size_t)(coverage * genome_length / read_length);
+    for (size_t i = 0; i < n_reads; ++i)
+    {
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	reads.push_back(
+	    genome.substr( x % (genome_length - read_length + 1), read_length )
+	);
+    }
+}
+
+
+// Run the workload on one kind of container, and report on it.
+template< typename Set, typename Map >
+static void
+run(
+    char const *		    name,
+    vector< HashIntoType > const    &tags,
+    vector< string > const	    &reads,
+    WordLength const		    ksize
+)
+{
+    size_t	    mem_tags, mem_pmap;
+    double	    t_build, t_traverse;
+    unsigned long   n_found	= 0;
+    PartitionID	    partition	= 1;
+    double	    start	= get_time( );
+
+    {
+	Set	all_tags;
+	Map	partition_map;
+
+	bytes_allocated = 0;
+	for (size_t i = 0; i < tags.size( ); ++i)
+	    all_tags.insert( tags[ i ] );
+	mem_tags = memory_used( all_tags );
+
+	bytes_allocated = 0;
+	for (size_t i = 0; i < tags.size( ); ++i)
+	    partition_map[ tags[ i ] ] = &partition;
+	mem_pmap = memory_used( partition_map );
+
+	t_build = get_time( ) - start;
+
+	start = get_time( );
+	Set keeper;
+	for (size_t i = 0; i < reads.size( ); ++i)
+	{
+	    keeper.clear( );
+	    KMerIterator kmers( reads[ i ].c_str( ), ksize );
+	    while (!kmers.done( ))
+	    {
+		HashIntoType kmer = kmers.next( );
+		if (!keeper.insert( kmer ).second)
+		    continue;
+		if (set_contains( all_tags, kmer ))
+		{
+		    typename Map::iterator pi = partition_map.find( kmer );
+		    if (pi != partition_map.end( ) && pi->second)
+			n_found++;
+		}
+	    }
+	}
+	t_traverse = get_time( ) - start;
+    }
+
+    fprintf(
+	stdout, "%-20s %10.1f %10.1f %10.3f %10.3f %10lu\n",
+	name, (double)mem_tags / tags.size( ), (double)mem_pmap / tags.size( ),
+	t_build, t_traverse, n_found
+    );
+}
+
+
+int main( int argc, char * argv[ ] )
+{
+    unsigned long	kmer_length	    = 20;
+    unsigned long	genome_length	    = 1000000;
+    unsigned long	read_length	    = 100;
+    float		coverage	    = 10.0;
+    float		ht_size_FP	    = 1.0E8;
+
+    int			rc		    = 0;
+    int			opt		    = -1;
+    char *		conv_residue	    = NULL;
+
+    while (-1 != (opt = getopt( argc, argv, SHORT_OPTS )))
+    {
+
+	switch (opt)
+	{
+
+	case 'k':
+	    kmer_length = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid kmer length" );
+	    break;
+
+	case 'g':
+	    genome_length = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid genome length" );
+	    break;
+
+	case 'l':
+	    read_length = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid read length" );
+	    break;
+
+	case 'c':
+	    coverage = strtof( optarg, &conv_residue );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid coverage" );
+	    break;
+
+	case 'x':
+	    ht_size_FP = strtof( optarg, &conv_residue );
+	    if (!strcmp( optarg, conv_residue ))
+		error( EINVAL, EINVAL, "Invalid hashtable size" );
+	    break;
+
+	default:
+	    error( 0, 0, "Skipping unknown arg, '%c'", optopt );
+	}
+
+    }
+
+    if (read_length < kmer_length || genome_length < read_length)
+	error( EINVAL, EINVAL, "Reads must be longer than k, and the genome than reads" );
+
+    vector< string > reads;
+    make_reads( reads, genome_length, read_length, coverage );
+
+    Primes primetab( (HashIntoType)ht_size_FP );
+    vector< HashIntoType > ht_sizes;
+    for ( unsigned int i = 0; i < 4; ++i )
+	ht_sizes.push_back( primetab.get_next_prime( ) );
+
+    Hashbits ht( kmer_length, ht_sizes );
+
+    double start = get_time( );
+    for (size_t i = 0; i < reads.size( ); ++i)
+    {
+	unsigned long long n_consumed = 0;
+	ht.consume_sequence_and_tag( reads[ i ], n_consumed );
+    }
+    double t_tag = get_time( ) - start;
+
+    SortedSeenSet const &sorted_tags = ht.get_sorted_tags( );
+    vector< HashIntoType > tags( sorted_tags.begin( ), sorted_tags.end( ) );
+
+    fprintf(
+	stdout, "%lu reads of %lu bases; %lu tags, tagged in %.3f s\n\n",
+	(unsigned long)reads.size( ), read_length,
+	(unsigned long)tags.size( ), t_tag
+    );
+    fprintf(
+	stdout, "%-20s %10s %10s %10s %10s %10s\n",
+	"containers", "B/tag", "B/map ent", "build s", "traverse s", "found"
+    );
+
+    run< StdSeenSet, StdPartitionMap >( "std::set, std::map", tags, reads,
+					kmer_length );
+    run< SeenSet, PartitionMap >( "FlatSet, FlatMap", tags, reads,
+				  kmer_length );
+
+    start = get_time( );
+    ht.partition->do_partition( 0, 0, false, false );
+    double t_partition = get_time( ) - start;
+
+    unsigned int n_partitions = 0, n_unassigned = 0;
+    ht.partition->count_partitions( n_partitions, n_unassigned );
+    fprintf(
+	stdout,
+	"\ndo_partition: %.3f s; %u partitions; all_tags %.1f B/tag\n",
+	t_partition, n_partitions,
+	(double)ht.all_tags.memory_used( ) / tags.size( )
+    );
+
+    return rc;
+}
+
+
+// vim: set sts=4 sw=4 tw=80:
@@ -0,0 +1,326 @@
+#ifndef BIGCOUNT_HH
+#define BIGCOUNT_HH
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "khmer.hh"
+#include "threads.hh"
+
+namespace khmer {
+
+  // Exact counts for a set of k-mers that isn't known up front, spread
+  // over N_SHARDS independent open-addressing tables, so that threads
+  // counting different k-mers rarely contend for the same lock.  Writers
+  // take a per-shard spin lock; readers take no lock at all.
+  //
+  // A shard's k-mers and counts are kept in separate arrays, and the
+  // shard doubles when it is 3/4 full.  Slot arrays that a shard has
+  // grown out of are kept until clear() or load(), so that a concurrent
+  // reader never follows a pointer into freed memory; they come to less
+  // than the live ones.
+  //
+  // BigCountTable holds the k-mers whose CountingHash counters are all
+  // saturated; ExactCountingHash keeps all of its counts in one.
+  template <typename CountType, unsigned int SHARD_BITS = 6>
+  class ShardedCountTable {
+  public:
+    static const unsigned int	N_SHARDS = 1 << SHARD_BITS;
+    static const HashIntoType	EMPTY = ~((HashIntoType) 0);
+    static const HashIntoType	MIN_SLOTS = 16;
+
+  protected:
+    // One allocation: the header, then mask + 1 k-mers, then as many
+    // counts.
+    struct Slots {
+      HashIntoType	mask;	// number of slots - 1
+      HashIntoType *	kmers;
+      CountType *	counts;
+    };
+
+    struct Shard {
+      Slots * volatile	    slots;
+      HashIntoType	    n_kmers;
+      uint32_t		    lock;
+      std::vector<Slots *>  retired;
+    };
+
+    Shard _shards[N_SHARDS];
+
+    static inline HashIntoType _mix(HashIntoType kmer) {
+      kmer ^= kmer >> 33;
+      kmer *= 0xff51afd7ed558ccdULL;
+      kmer ^= kmer >> 33;
+      return kmer;
+    }
+
+    static inline unsigned int _shard_of(HashIntoType mixed) {
+      return (unsigned int) (mixed >> (64 - SHARD_BITS));
+    }
+
+    static Slots * _allocate_slots(HashIntoType n_slots) {
+      size_t size = sizeof(Slots) +
+	n_slots * (sizeof(HashIntoType) + sizeof(CountType));
+      Slots * slots = (Slots *) malloc(size);
+      if (!slots) {
+	throw std::bad_alloc();
+      }
+
+      slots->mask = n_slots - 1;
+      slots->kmers = (HashIntoType *) (slots + 1);
+      slots->counts = (CountType *) (slots->kmers + n_slots);
+      for (HashIntoType i = 0; i < n_slots; i++) {
+	slots->kmers[i] = EMPTY;
+      }
+      memset(slots->counts, 0, n_slots * sizeof(CountType));
+      return slots;
+    }
+
+    // The slot kmer is in, or the empty slot where it would go.
+    static inline HashIntoType _probe(const Slots * slots, HashIntoType kmer,
+				      HashIntoType mixed) {
+      HashIntoType i = mixed & slots->mask;
+      while (slots->kmers[i] != kmer && slots->kmers[i] != EMPTY) {
+	i = (i + 1) & slots->mask;
+      }
+      return i;
+    }
+
+    // Make room for n_kmers in the shard.  Caller holds the shard's lock
+    // (or has the table to itself).
+    static void _reserve(Shard &shard, HashIntoType n_kmers) {
+      HashIntoType n_slots = MIN_SLOTS;
+      while (n_slots * 3 < n_kmers * 4) {
+	n_slots <<= 1;
+      }
+
+      Slots * old = shard.slots;
+      if (old && old->mask + 1 >= n_slots) {
+	return;
+      }
+
+      // doubling at least, so that a shard grows a logarithmic number of
+      // times.
+      if (old && n_slots < 2 * (old->mask + 1)) {
+	n_slots = 2 * (old->mask + 1);
+      }
+
+      Slots * slots = _allocate_slots(n_slots);
+      if (old) {
+	for (HashIntoType i = 0; i <= old->mask; i++) {
+	  HashIntoType kmer = old->kmers[i];
+	  if (kmer != EMPTY) {
+	    HashIntoType j = _probe(slots, kmer, _mix(kmer));
+	    slots->kmers[j] = kmer;
+	    slots->counts[j] = old->counts[i];
+	  }
+	}
+	shard.retired.push_back(old);
+      }
+
+      // make sure the copy is visible before the new slots are.
+      __sync_synchronize();
+      shard.slots = slots;
+    }
+
+    // The count of kmer, inserted at first_count if it is new, in which
+    // case is_new is set.  Caller holds the shard's lock.
+    static inline CountType * _find_or_insert(Shard &shard, HashIntoType kmer,
+					      HashIntoType mixed,
+					      CountType first_count,
+					      bool &is_new) {
+      if (!shard.slots ||
+	  (shard.n_kmers + 1) * 4 > (shard.slots->mask + 1) * 3) {
+	_reserve(shard, shard.n_kmers + 1);
+      }
+
+      Slots * slots = shard.slots;
+      HashIntoType i = _probe(slots, kmer, mixed);
+      is_new = slots->kmers[i] == EMPTY;
+      if (is_new) {
+	// publish the count before the k-mer, for lock-free readers.
+	slots->counts[i] = first_count;
+	__sync_synchronize();
+	slots->kmers[i] = kmer;
+	shard.n_kmers++;
+      }
+      return slots->counts + i;
+    }
+
+  private:
+    ShardedCountTable(const ShardedCountTable &);
+    ShardedCountTable &operator=(const ShardedCountTable &);
+
+  public:
+    // expected_kmers sizes the shards up front, to save growing them.
+    ShardedCountTable(HashIntoType expected_kmers = 0) {
+      for (unsigned int i = 0; i < N_SHARDS; i++) {
+	_shards[i].slots = NULL;
+	_shards[i].n_kmers = 0;
+	_shards[i].lock = 0;
+	if (expected_kmers) {
+	  _reserve(_shards[i], expected_kmers / N_SHARDS);
+	}
+      }
+    }
+
+    ~ShardedCountTable() {
+      clear();
+    }
+
+    // Not safe to call while other threads are using the table.
+    void clear() {
+      for (unsigned int i = 0; i < N_SHARDS; i++) {
+	Shard &shard = _shards[i];
+
+	free(shard.slots);
+	shard.slots = NULL;
+	for (size_t j = 0; j < shard.retired.size(); j++) {
+	  free(shard.retired[j]);
+	}
+	shard.retired.clear();
+	shard.n_kmers = 0;
+      }
+    }
+
+    // the number of distinct k-mers.
+    HashIntoType size() const {
+      HashIntoType n = 0;
+      for (unsigned int i = 0; i < N_SHARDS; i++) {
+	n += _shards[i].n_kmers;
+      }
+      return n;
+    }
+
+    // Returns 0 for k-mers that aren't in the table.  Takes no lock.
+    CountType get(HashIntoType kmer) const {
+      HashIntoType mixed = _mix(kmer);
+      const Slots * slots = _shards[_shard_of(mixed)].slots;
+      if (!slots) {
+	return 0;
+      }
+
+      const volatile HashIntoType * kmers = slots->kmers;
+      HashIntoType i = mixed & slots->mask;
+      while (true) {
+	HashIntoType key = kmers[i];
+	if (key == kmer) {
+	  return ((const volatile CountType *) slots->counts)[i];
+	}
+	if (key == EMPTY) {
+	  return 0;
+	}
+	i = (i + 1) & slots->mask;
+      }
+    }
+
+    // Bring the k-mer's home slot into cache.
+    inline void prefetch(HashIntoType kmer) const {
+      HashIntoType mixed = _mix(kmer);
+      const Slots * slots = _shards[_shard_of(mixed)].slots;
+      if (slots) {
+	__builtin_prefetch(slots->kmers + (mixed & slots->mask));
+      }
+    }
+
+    // Start a k-mer at first_count, or bump it by one, up to max_count.
+    void increment(HashIntoType kmer, CountType first_count,
+		   CountType max_count) {
+      assert(kmer != EMPTY);
+      HashIntoType mixed = _mix(kmer);
+      Shard &shard = _shards[_shard_of(mixed)];
+      bool is_new;
+
+      spin_lock(&shard.lock);
+      CountType * count = _find_or_insert(shard, kmer, mixed, first_count,
+					  is_new);
+      if (!is_new && *count < max_count) {
+	*count += 1;
+      }
+      spin_unlock(&shard.lock);
+    }
+
+    void set(HashIntoType kmer, CountType count) {
+      assert(kmer != EMPTY);
+      HashIntoType mixed = _mix(kmer);
+      Shard &shard = _shards[_shard_of(mixed)];
+      bool is_new;
+
+      spin_lock(&shard.lock);
+      *_find_or_insert(shard, kmer, mixed, count, is_new) = count;
+      spin_unlock(&shard.lock);
+    }
+
+    // Replace the contents with n (k-mer, count) pairs, sizing each shard
+    // once up front.  Not safe to call while other threads are using the
+    // table.
+    void load(const HashIntoType * kmers, const CountType * counts,
+	      HashIntoType n) {
+      HashIntoType per_shard[N_SHARDS];
+
+      clear();
+      memset(per_shard, 0, sizeof(per_shard));
+      for (HashIntoType i = 0; i < n; i++) {
+	per_shard[_shard_of(_mix(kmers[i]))]++;
+      }
+      for (unsigned int i = 0; i < N_SHARDS; i++) {
+	if (per_shard[i]) {
+	  _reserve(_shards[i], per_shard[i]);
+	}
+      }
+
+      for (HashIntoType i = 0; i < n; i++) {
+	assert(kmers[i] != EMPTY);
+	HashIntoType mixed = _mix(kmers[i]);
+	Shard &shard = _shards[_shard_of(mixed)];
+	Slots * slots = shard.slots;
+	HashIntoType j = _probe(slots, kmers[i], mixed);
+
+	if (slots->kmers[j] == EMPTY) {
+	  slots->kmers[j] = kmers[i];
+	  shard.n_kmers++;
+	}
+	slots->counts[j] = counts[i];
+      }
+    }
+
+    // All (k-mer, count) pairs, sorted by k-mer.  Not safe to call while
+    // other threads are counting.
+    void get_sorted(std::vector<HashIntoType> &kmers,
+		    std::vector<CountType> &counts) const {
+      std::vector< std::pair<HashIntoType, CountType> > entries;
+
+      entries.reserve(size());
+      for (unsigned int i = 0; i < N_SHARDS; i++) {
+	const Slots * slots = _shards[i].slots;
+	if (!slots) {
+	  continue;
+	}
+
+	for (HashIntoType j = 0; j <= slots->mask; j++) {
+	  if (slots->kmers[j] != EMPTY) {
+	    entries.push_back(std::make_pair(slots->kmers[j],
+					     slots->counts[j]));
+	  }
+	}
+      }
+      std::sort(entries.begin(), entries.end());
+
+      kmers.resize(entries.size());
+      counts.resize(entries.size());
+      for (size_t i = 0; i < entries.size(); i++) {
+	kmers[i] = entries[i].first;
+	counts[i] = entries[i].second;
+      }
+    }
+  };
+
+  typedef ShardedCountTable<BoundedCounterType> BigCountTable;
+};
+
+#endif // BIGCOUNT_HH
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,418 @@
+#include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "zlib/zlib.h"
+#include "block_compressed.hh"
+#include "threads.hh"
+
+using namespace std;
+
+namespace khmer {
+
+static const char	_magic[8] = { 'k', 'h', 'm', 'e', 'r', 'k', 'z',
+				      BLOCK_COMPRESSED_VERSION };
+static const size_t	_header_size = sizeof(_magic) + sizeof(uint32_t);
+static const size_t	_trailer_size = 3 * sizeof(uint64_t) + sizeof(_magic);
+
+bool is_block_compressed_filename(const std::string &filename)
+{
+  size_t found = filename.find_last_of(".");
+  if (found == std::string::npos) {
+    return false;
+  }
+  return filename.substr(found + 1) == BLOCK_COMPRESSED_EXT;
+}
+
+//
+// Run jobs 0..n_jobs-1 on as many threads as there are cores.  Each thread
+// takes the next job number until there are none left.
+//
+
+struct ParallelJobs {
+  void		       (*run)(void * data, unsigned int job);
+  void *		data;
+  unsigned int		n_jobs;
+  unsigned int		next_job;
+};
+
+static void _run_jobs(void * arg, uint32_t thread_n)
+{
+  ParallelJobs * jobs = (ParallelJobs *) arg;
+  unsigned int job;
+
+  while ((job = __sync_fetch_and_add(&jobs->next_job, 1)) < jobs->n_jobs) {
+    jobs->run(jobs->data, job);
+  }
+}
+
+static unsigned int _n_cores()
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) {
+    return 1;
+  }
+  return n > 64 ? 64 : (unsigned int) n;
+}
+
+static void _run_in_parallel(void (*run)(void *, unsigned int), void * data,
+			     unsigned int n_jobs)
+{
+  if (!n_jobs) {
+    return;
+  }
+
+  ParallelJobs jobs = { run, data, n_jobs, 0 };
+  unsigned int n_threads = _n_cores();
+  if (n_threads > n_jobs) {
+    n_threads = n_jobs;
+  }
+
+  run_on_threads(_run_jobs, &jobs, n_threads);
+}
+
+//
+// BlockCompressedOutBuf
+//
+
+struct DeflateJob {
+  const char *	    src;
+  uLong		    src_length;
+  std::vector<Bytef> dest;
+  uLongf	    dest_length;
+};
+
+static void _deflate_chunk(void * data, unsigned int i)
+{
+  DeflateJob * job = ((DeflateJob *) data) + i;
+
+  job->dest.resize(compressBound(job->src_length));
+  job->dest_length = job->dest.size();
+  int rc = compress2(&job->dest[0], &job->dest_length,
+		     (const Bytef *) job->src, job->src_length,
+		     Z_DEFAULT_COMPRESSION);
+  assert(rc == Z_OK);
+}
+
+BlockCompressedOutBuf::BlockCompressedOutBuf(const std::string &filename,
+					     uint32_t chunk_size) :
+  _chunk_size(chunk_size), _length(0), _file_offset(0)
+{
+  _file = fopen(filename.c_str(), "wb");
+  if (!_file) {
+    return;
+  }
+
+  fwrite(_magic, sizeof(_magic), 1, _file);
+  fwrite(&_chunk_size, sizeof(_chunk_size), 1, _file);
+  _file_offset = _header_size;
+
+  _batch.resize((size_t) _n_cores() * _chunk_size);
+  setp(&_batch[0], &_batch[0] + _batch.size());
+}
+
+BlockCompressedOutBuf::~BlockCompressedOutBuf()
+{
+  close();
+}
+
+// Compress the filled part of the batch, one chunk per job, and write the
+// chunks out in order.  Only the last batch may end in a short chunk.
+void BlockCompressedOutBuf::_write_batch()
+{
+  size_t filled = pptr() - pbase();
+  unsigned int n_chunks = (filled + _chunk_size - 1) / _chunk_size;
+
+  if (n_chunks) {
+    std::vector<DeflateJob> jobs(n_chunks);
+    for (unsigned int i = 0; i < n_chunks; i++) {
+      size_t start = (size_t) i * _chunk_size;
+
+      jobs[i].src = pbase() + start;
+      jobs[i].src_length = filled - start < _chunk_size ?
+	filled - start : _chunk_size;
+    }
+
+    _run_in_parallel(_deflate_chunk, &jobs[0], n_chunks);
+
+    for (unsigned int i = 0; i < n_chunks; i++) {
+      _chunk_offsets.push_back(_file_offset);
+      fwrite(&jobs[i].dest[0], 1, jobs[i].dest_length, _file);
+      _file_offset += jobs[i].dest_length;
+    }
+  }
+
+  _length += filled;
+  setp(&_batch[0], &_batch[0] + _batch.size());
+}
+
+BlockCompressedOutBuf::int_type BlockCompressedOutBuf::overflow(int_type c)
+{
+  if (!_file) {
+    return traits_type::eof();
+  }
+
+  _write_batch();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+// Only reports the current position, for tellp().
+BlockCompressedOutBuf::pos_type
+BlockCompressedOutBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+			       std::ios_base::openmode which)
+{
+  if (!_file || off != 0 || dir != std::ios_base::cur ||
+      !(which & std::ios_base::out)) {
+    return pos_type(off_type(-1));
+  }
+  return pos_type(_length + (pptr() - pbase()));
+}
+
+void BlockCompressedOutBuf::close()
+{
+  if (!_file) {
+    return;
+  }
+
+  _write_batch();
+
+  uint64_t n_chunks = _chunk_offsets.size();
+  uint64_t index_offset = _file_offset;
+
+  if (n_chunks) {
+    fwrite(&_chunk_offsets[0], sizeof(uint64_t), n_chunks, _file);
+  }
+  fwrite(&n_chunks, sizeof(n_chunks), 1, _file);
+  fwrite(&_length, sizeof(_length), 1, _file);
+  fwrite(&index_offset, sizeof(index_offset), 1, _file);
+  fwrite(_magic, sizeof(_magic), 1, _file);
+
+  fclose(_file);
+  _file = NULL;
+  std::vector<char>().swap(_batch);
+  setp(NULL, NULL);
+}
+
+//
+// BlockCompressedInBuf
+//
+
+struct InflateJob {
+  int		    fd;
+  uint64_t	    src_offset;
+  uLong		    src_length;
+  char *	    dest;
+  uLongf	    dest_length;
+};
+
+static void _inflate_chunk(void * data, unsigned int i)
+{
+  InflateJob * job = ((InflateJob *) data) + i;
+  std::vector<Bytef> src(job->src_length);
+
+  ssize_t n_read = pread(job->fd, &src[0], job->src_length, job->src_offset);
+  assert(n_read == (ssize_t) job->src_length);
+
+  uLongf dest_length = job->dest_length;
+  int rc = uncompress((Bytef *) job->dest, &dest_length, &src[0],
+		      job->src_length);
+  assert(rc == Z_OK && dest_length == job->dest_length);
+}
+
+BlockCompressedInBuf::BlockCompressedInBuf(const std::string &filename) :
+  _chunk_size(0), _length(0), _chunk_start(0)
+{
+  char magic[sizeof(_magic)];
+  struct stat st;
+
+  _fd = open(filename.c_str(), O_RDONLY);
+  if (_fd < 0) {
+    return;
+  }
+
+  if (fstat(_fd, &st) != 0 ||
+      (size_t) st.st_size < _header_size + _trailer_size ||
+      pread(_fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+      memcmp(magic, _magic, sizeof(magic)) ||
+      pread(_fd, &_chunk_size, sizeof(_chunk_size), sizeof(magic)) !=
+	sizeof(_chunk_size) ||
+      _chunk_size == 0) {
+    close();
+    return;
+  }
+
+  uint64_t trailer[3];
+  off_t trailer_offset = st.st_size - _trailer_size;
+  if (pread(_fd, trailer, sizeof(trailer), trailer_offset) != sizeof(trailer) ||
+      pread(_fd, magic, sizeof(magic), trailer_offset + sizeof(trailer)) !=
+	sizeof(magic) ||
+      memcmp(magic, _magic, sizeof(magic))) {
+    close();
+    return;
+  }
+
+  uint64_t n_chunks = trailer[0];
+  _length = trailer[1];
+
+  // keep the index offset on the end, as the end of the last chunk.
+  _chunk_offsets.resize(n_chunks + 1);
+  _chunk_offsets[n_chunks] = trailer[2];
+  if (n_chunks) {
+    ssize_t index_bytes = n_chunks * sizeof(uint64_t);
+    if (pread(_fd, &_chunk_offsets[0], index_bytes, trailer[2]) !=
+	index_bytes) {
+      close();
+      return;
+    }
+  }
+
+  _chunk.resize(_chunk_size);
+  setg(&_chunk[0], &_chunk[0], &_chunk[0]);
+}
+
+BlockCompressedInBuf::~BlockCompressedInBuf()
+{
+  close();
+}
+
+void BlockCompressedInBuf::close()
+{
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+uint32_t BlockCompressedInBuf::_chunk_length(uint64_t i) const
+{
+  uint64_t start = i * _chunk_size;
+  return _length - start < _chunk_size ? _length - start : _chunk_size;
+}
+
+void BlockCompressedInBuf::_inflate_chunks(uint64_t first, uint64_t n,
+					   char * dest)
+{
+  std::vector<InflateJob> jobs(n);
+
+  for (uint64_t i = 0; i < n; i++) {
+    uint64_t chunk = first + i;
+
+    jobs[i].fd = _fd;
+    jobs[i].src_offset = _chunk_offsets[chunk];
+    jobs[i].src_length = _chunk_offsets[chunk + 1] - _chunk_offsets[chunk];
+    jobs[i].dest = dest + i * _chunk_size;
+    jobs[i].dest_length = _chunk_length(chunk);
+  }
+
+  _run_in_parallel(_inflate_chunk, &jobs[0], n);
+}
+
+// Inflate the chunk holding the current position.
+BlockCompressedInBuf::int_type BlockCompressedInBuf::underflow()
+{
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  uint64_t position = _position();
+  if (_fd < 0 || position >= _length) {
+    return traits_type::eof();
+  }
+
+  uint64_t chunk = position / _chunk_size;
+  _inflate_chunks(chunk, 1, &_chunk[0]);
+
+  _chunk_start = chunk * _chunk_size;
+  setg(&_chunk[0], &_chunk[0] + (position - _chunk_start),
+       &_chunk[0] + _chunk_length(chunk));
+  return traits_type::to_int_type(*gptr());
+}
+
+// Big reads that start on a chunk boundary inflate whole chunks straight
+// into dest, all at once; the rest goes through the chunk buffer.
+std::streamsize BlockCompressedInBuf::xsgetn(char * dest, std::streamsize n)
+{
+  std::streamsize got = 0;
+
+  while (got < n) {
+    std::streamsize buffered = egptr() - gptr();
+    if (buffered) {
+      std::streamsize take = n - got < buffered ? n - got : buffered;
+      memcpy(dest + got, gptr(), take);
+      gbump(take);
+      got += take;
+      continue;
+    }
+
+    uint64_t position = _position();
+    uint64_t n_whole = (n - got) / _chunk_size;
+    uint64_t chunk = position / _chunk_size;
+    uint64_t n_chunks = _chunk_offsets.size() - 1;
+
+    if (position % _chunk_size == 0 && n_whole && chunk < n_chunks) {
+      if (n_whole > n_chunks - chunk) {
+	n_whole = n_chunks - chunk;
+      }
+      _inflate_chunks(chunk, n_whole, dest + got);
+
+      uint64_t end = (chunk + n_whole - 1) * _chunk_size +
+	_chunk_length(chunk + n_whole - 1);
+      got += end - position;
+
+      _chunk_start = end;
+      setg(&_chunk[0], &_chunk[0], &_chunk[0]);
+      continue;
+    }
+
+    if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+      break;
+    }
+  }
+
+  return got;
+}
+
+BlockCompressedInBuf::pos_type
+BlockCompressedInBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+			      std::ios_base::openmode which)
+{
+  off_type base = 0;
+  if (dir == std::ios_base::cur) {
+    base = _position();
+  } else if (dir == std::ios_base::end) {
+    base = _length;
+  }
+  return seekpos(pos_type(base + off), which);
+}
+
+// Seeking doesn't inflate anything; the next read does.
+BlockCompressedInBuf::pos_type
+BlockCompressedInBuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+  off_type target = off_type(pos);
+
+  if (_fd < 0 || !(which & std::ios_base::in) ||
+      target < 0 || (uint64_t) target > _length) {
+    return pos_type(off_type(-1));
+  }
+
+  if ((uint64_t) target >= _chunk_start &&
+      (uint64_t) target < _chunk_start + (egptr() - eback())) {
+    setg(eback(), eback() + (target - _chunk_start), egptr());
+  } else {
+    _chunk_start = target;
+    setg(&_chunk[0], &_chunk[0], &_chunk[0]);
+  }
+  return pos;
+}
+
+};
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,126 @@
+#ifndef BLOCK_COMPRESSED_HH
+#define BLOCK_COMPRESSED_HH
+
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <istream>
+#include <ostream>
+#include <stdio.h>
+#include <stdint.h>
+
+#   define BLOCK_COMPRESSED_EXT "kz"
+#   define BLOCK_COMPRESSED_VERSION 1
+#   define BLOCK_COMPRESSED_CHUNK_SIZE (4 * 1024 * 1024)
+
+namespace khmer {
+
+  // A seekable compressed container for saved tables.  The data is cut
+  // into fixed-size chunks and each chunk is deflated on its own, so that
+  // every core can compress or inflate a chunk at once, and so that a
+  // reader can start anywhere in the data by inflating only the chunk
+  // that holds it.  The file is laid out as
+  //
+  //   magic "khmerkz" | version (1) | chunk size (4)
+  //   chunk 0 | chunk 1 | ... | chunk n-1		  (zlib streams)
+  //   offset of each chunk in the file (8 each)
+  //   n (8) | uncompressed length (8) | offset of the offsets (8)
+  //   magic "khmerkz" | version (1)
+  //
+  // All of the integers are in host byte order, as in the other saved
+  // files.
+
+  // Does the name end in "." BLOCK_COMPRESSED_EXT?
+  bool is_block_compressed_filename(const std::string &filename);
+
+  class BlockCompressedOutBuf : public std::streambuf {
+  protected:
+    FILE *		      _file;
+    uint32_t		      _chunk_size;
+    std::vector<char>	      _batch;	    // up to one chunk per thread
+    uint64_t		      _length;	    // bytes handed to earlier batches
+    uint64_t		      _file_offset;
+    std::vector<uint64_t>     _chunk_offsets;
+
+    void _write_batch();
+
+    virtual int_type overflow(int_type c);
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+			     std::ios_base::openmode which);
+
+  public:
+    BlockCompressedOutBuf(const std::string &filename,
+			  uint32_t chunk_size = BLOCK_COMPRESSED_CHUNK_SIZE);
+    ~BlockCompressedOutBuf();
+
+    bool is_open() const { return _file != NULL; }
+    // Compress whatever is left, and write the index.
+    void close();
+  };
+
+  class BlockCompressedInBuf : public std::streambuf {
+  protected:
+    int			      _fd;
+    uint32_t		      _chunk_size;
+    uint64_t		      _length;
+    std::vector<uint64_t>     _chunk_offsets;   // plus the index offset
+    std::vector<char>	      _chunk;	    // the inflated chunk, if any
+    uint64_t		      _chunk_start;	    // data offset of eback()
+
+    uint64_t _position() const {
+      return _chunk_start + (gptr() - eback());
+    }
+    uint32_t _chunk_length(uint64_t i) const;
+    void _inflate_chunks(uint64_t first, uint64_t n, char * dest);
+
+    virtual int_type underflow();
+    virtual std::streamsize xsgetn(char * dest, std::streamsize n);
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+			     std::ios_base::openmode which);
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+  public:
+    BlockCompressedInBuf(const std::string &filename);
+    ~BlockCompressedInBuf();
+
+    bool is_open() const { return _fd >= 0; }
+    void close();
+    uint64_t length() const { return _length; }
+  };
+
+  class BlockCompressedOFStream : public std::ostream {
+  protected:
+    BlockCompressedOutBuf _buf;
+
+  public:
+    BlockCompressedOFStream(const std::string &filename) :
+      std::ostream(&_buf), _buf(filename) {
+      if (!_buf.is_open()) {
+	setstate(std::ios_base::failbit);
+      }
+    }
+
+    bool is_open() const { return _buf.is_open(); }
+    void close() { _buf.close(); }
+  };
+
+  class BlockCompressedIFStream : public std::istream {
+  protected:
+    BlockCompressedInBuf _buf;
+
+  public:
+    BlockCompressedIFStream(const std::string &filename) :
+      std::istream(&_buf), _buf(filename) {
+      if (!_buf.is_open()) {
+	setstate(std::ios_base::failbit);
+      }
+    }
+
+    bool is_open() const { return _buf.is_open(); }
+    void close() { _buf.close(); }
+  };
+};
+
+#endif // BLOCK_COMPRESSED_HH
+
+// vim: set sts=2 sw=2:
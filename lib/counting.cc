@@ -2,10 +2,18 @@
 #include "counting.hh"
 #include "hashbits.hh"
 #include "read_parsers.hh"
+#include "block_compressed.hh"
+#include "abundance_stats.hh"
 
 #include "zlib/zlib.h"
 #include <math.h>
 #include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace khmer;
@@ -141,65 +149,6 @@ BoundedCounterType CountingHash::get_max_count(const std::string &s,
   return max_count;
 }
 
-HashIntoType * CountingHash::abundance_distribution(std::string filename,
-						    Hashbits * tracking,
-			    CallbackFn callback,
-			    void * callback_data) const
-{
-  HashIntoType * dist = new HashIntoType[MAX_BIGCOUNT + 1];
-  HashIntoType i;
-  
-  for (i = 0; i <= MAX_BIGCOUNT; i++) {
-    dist[i] = 0;
-  }
-
-  Read read;
-  IParser* parser = IParser::get_parser(filename.c_str());
-  string name;
-  string seq;
-  unsigned long long read_num = 0;
-
-  // if not, could lead to overflow.
-  assert(sizeof(BoundedCounterType) == 2);
-
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.sequence;
-
-    if (check_and_normalize_read(seq)) {
-      HashIntoType kmer;
-      KMerIterator kmers(seq.c_str(), _ksize);
-
-      while(!kmers.done()) {
-	kmer = kmers.next();
-
-	if (!tracking->get_count(kmer)) {
-	  tracking->count(kmer);
-
-	  BoundedCounterType n = get_count(kmer);
-	  dist[n]++;
-	}
-      }
-
-      name.clear();
-      seq.clear();
-    }
-
-    read_num += 1;
-
-    // run callback, if specified
-    if (read_num % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("abundance_distribution", callback_data, read_num, 0);
-      } catch (...) {
-        throw;
-      }
-    }
-  }
-
-  return dist;
-}
-
 HashIntoType * CountingHash::fasta_count_kmers_by_position(const std::string &inputfile,
 					     const unsigned int max_read_len,
 					     BoundedCounterType limit_by_count,
@@ -315,6 +264,11 @@ void CountingHash::load(std::string infilename)
   CountingHashFile::load(infilename, *this);
 }
 
+void CountingHash::load(std::string infilename, bool use_mmap)
+{
+  CountingHashFile::load(infilename, *this, use_mmap);
+}
+
 void CountingHash::get_kadian_count(const std::string &s,
 				    BoundedCounterType &kadian,
 				    unsigned int nk)
@@ -356,97 +310,22 @@ void CountingHash::get_kmer_abund_mean(const std::string &filename,
 				       unsigned long long &count,
 				       float &mean) const
 {
-  total = 0;
-  count = 0;
-  mean = 0.0;
-
-  Read read;
-  IParser* parser = IParser::get_parser(filename.c_str());
-  string name;
-  string seq;
-  unsigned long long read_num = 0;
-
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.sequence;
+  AbundanceStatsEngine stats(*this, 0, 0, 1);
+  stats.gather(filename);
 
-    if (check_and_normalize_read(seq)) {
-      for (unsigned int i = 0; i < seq.length() - _ksize + 1; i++) {
-	string kmer = seq.substr(i, i + _ksize);
-	BoundedCounterType n = get_count(kmer.c_str());
-
-	total += n;
-	count ++;
-      }
-
-      name.clear();
-      seq.clear();
-    }
-
-    read_num += 1;
-
-#if 0
-    // run callback, if specified
-    if (read_num % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("abundance_distribution", callback_data, read_num, 0);
-      } catch (...) {
-        throw;
-      }
-    }
-#endif // 0
-  }
-
-  mean = float(total) / float(count);
+  total = stats.get_total();
+  count = stats.get_n_kmers();
+  mean = stats.get_mean();
 }
 
 void CountingHash::get_kmer_abund_abs_deviation(const std::string &filename,
 						float mean,
 						float &abs_deviation) const
 {
-  float total = 0.0;
-  unsigned long long count = 0;
-
-  Read read;
-  IParser* parser = IParser::get_parser(filename.c_str());
-  string name;
-  string seq;
-  unsigned long long read_num = 0;
-
-  while(!parser->is_complete()) {
-    read = parser->get_next_read();
-    seq = read.sequence;
-
-    if (check_and_normalize_read(seq)) {
-      for (unsigned int i = 0; i < seq.length() - _ksize + 1; i++) {
-	string kmer = seq.substr(i, i + _ksize);
-	BoundedCounterType n = get_count(kmer.c_str());
-
-	float diff = mean - (unsigned int)n;
-	if (diff < 0) { diff = -diff; }
-	total += diff;
-	count ++;
-      }
-
-      name.clear();
-      seq.clear();
-    }
+  AbundanceStatsEngine stats(*this, 0, 0, 1);
+  stats.gather(filename);
 
-    read_num += 1;
-
-#if 0
-    // run callback, if specified
-    if (read_num % CALLBACK_PERIOD == 0 && callback) {
-      try {
-        callback("abundance_distribution", callback_data, read_num, 0);
-      } catch (...) {
-        throw;
-      }
-    }
-#endif // 0
-  }
-
-  abs_deviation = total / float(count);
+  abs_deviation = stats.get_abs_deviation(mean);
 }
 
 unsigned int CountingHash::max_hamming1_count(const std::string kmer_s)
@@ -478,191 +357,314 @@ unsigned int CountingHash::max_hamming1_count(const std::string kmer_s)
   return max_count;
 }
 
-unsigned int CountingHash::trim_on_abundance(std::string seq,
-					     BoundedCounterType min_abund)
-  const
+void CountingHashFile::load(const std::string &infilename, CountingHash &ht,
+			    bool use_mmap)
 {
-  if (!check_and_normalize_read(seq)) {
-    return 0;
-  }
-
-  KMerIterator kmers(seq.c_str(), _ksize);
-
-  SeenSet path;
+   std::string filename(infilename);
+   int found = filename.find_last_of(".");
+   std::string type = filename.substr(found+1);
 
-  HashIntoType kmer;
+   if (type == "gz") { CountingHashGzFileReader(filename, ht); }
+   else if (type == BLOCK_COMPRESSED_EXT) {
+     CountingHashBlockFileReader(filename, ht);
+   }
+   else if (use_mmap) { CountingHashMmapFileReader(filename, ht); }
+   else { CountingHashFileReader(filename, ht); }
+}
 
-  if (kmers.done()) { return 0; }
-  kmer = kmers.next();
+// From version 6 on, each counter array starts on a SAVED_PAGE_SIZE
+// boundary in the (uncompressed) file, so that it can be mapped in place.
+static unsigned long long _page_padding(unsigned long long offset)
+{
+  return (SAVED_PAGE_SIZE - offset % SAVED_PAGE_SIZE) % SAVED_PAGE_SIZE;
+}
 
-  if (kmers.done() || get_count(kmer) < min_abund) {
-    return 0;
-  }
+static const char _zero_page[SAVED_PAGE_SIZE] = { 0 };
 
-  unsigned int i = _ksize;
-  while (!kmers.done()) {
-    kmer = kmers.next();
 
-    if (get_count(kmer) < min_abund) {
-      return i;
-    }
-    i++;
-  }
+void CountingHashFile::save(const std::string &outfilename, const CountingHash &ht)
+{
+   std::string filename(outfilename);
+   int found = filename.find_last_of(".");
+   std::string type = filename.substr(found+1);
 
-  return seq.length();
+   if (type == "gz") { CountingHashGzFileWriter(filename, ht); }
+   else if (type == BLOCK_COMPRESSED_EXT) {
+     CountingHashBlockFileWriter(filename, ht);
+   }
+   else { CountingHashFileWriter(filename, ht); }
 }
 
 
-unsigned int CountingHash::trim_below_abundance(std::string seq,
-						BoundedCounterType max_abund)
-  const
+void CountingHashFile::_read(std::istream &infile, CountingHash &ht)
 {
-  if (!check_and_normalize_read(seq)) {
-    return 0;
+  ht._deallocate_counters();
+  ht._tablesizes.clear();
+  
+  unsigned int save_ksize = 0;
+  unsigned char save_n_tables = 0;
+  unsigned long long save_tablesize = 0;
+  unsigned char version, ht_type, use_bigcount;
+  unsigned char counter_bits = 8;	// version 3 files are all 8-bit
+
+  infile.read((char *) &version, 1);
+  infile.read((char *) &ht_type, 1);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
+  assert(ht_type == SAVED_COUNTING_HT || ht_type == SAVED_BLOCKED_COUNTING_HT);
+
+  infile.read((char *) &use_bigcount, 1);
+  if (version >= 4) {
+    infile.read((char *) &counter_bits, 1);
   }
+  infile.read((char *) &save_ksize, sizeof(save_ksize));
+  infile.read((char *) &save_n_tables, sizeof(save_n_tables));
 
-  KMerIterator kmers(seq.c_str(), _ksize);
+  ht._ksize = (WordLength) save_ksize;
+  ht._n_tables = (unsigned int) save_n_tables;
+  ht._init_bitstuff();
 
-  SeenSet path;
+  ht._use_bigcount = use_bigcount;
+  ht._set_counter_bits(counter_bits);
+  ht._blocked = (ht_type == SAVED_BLOCKED_COUNTING_HT);
+
+  if (ht._blocked) {
+    unsigned long long save_n_blocks = 0;
+    infile.read((char *) &save_n_blocks, sizeof(save_n_blocks));
+    if (version >= 6) {
+      infile.seekg(_page_padding(infile.tellg()), ios::cur);
+    }
 
-  HashIntoType kmer;
+    ht._allocate_blocks((HashIntoType) save_n_blocks);
+
+    unsigned long long blockbytes = save_n_blocks * COUNTING_BLOCK_SIZE;
+    unsigned long long loaded = 0;
+    while (loaded != blockbytes) {
+      infile.read((char *) ht._blocks + loaded, blockbytes - loaded);
+      loaded += infile.gcount();
+    }
+  } else {
+    ht._counts = new Byte*[ht._n_tables];
+    for (unsigned int i = 0; i < ht._n_tables; i++) {
+      HashIntoType tablesize, tablebytes;
+
+      infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+      if (version >= 6) {
+	infile.seekg(_page_padding(infile.tellg()), ios::cur);
+      }
 
-  if (kmers.done()) { return 0; }
-  kmer = kmers.next();
+      tablesize = (HashIntoType) save_tablesize;
+      ht._tablesizes.push_back(tablesize);
 
-  if (kmers.done() || get_count(kmer) > max_abund) {
-    return 0;
+      tablebytes = ht._table_bytes(tablesize);
+      ht._counts[i] = allocate_table(tablebytes);
+
+      unsigned long long loaded = 0;
+      while (loaded != tablebytes) {
+	infile.read((char *) ht._counts[i] + loaded, tablebytes - loaded);
+	loaded += infile.gcount();	// do I need to do this loop?
+      }
+    }
+    ht._init_moduli();
   }
 
-  unsigned int i = _ksize;
-  while (!kmers.done()) {
-    kmer = kmers.next();
+  HashIntoType n_counts = 0;
+  infile.read((char *) &n_counts, sizeof(n_counts));
 
-    if (get_count(kmer) > max_abund) {
-      return i;
+  ht._bigcounts.clear();
+  if (n_counts) {
+    std::vector<HashIntoType> kmers(n_counts);
+    std::vector<BoundedCounterType> counts(n_counts);
+
+    if (version >= 5) {
+      infile.read((char *) &kmers[0], n_counts * sizeof(HashIntoType));
+      infile.read((char *) &counts[0], n_counts * sizeof(BoundedCounterType));
+    } else {
+      for (HashIntoType n = 0; n < n_counts; n++) {
+	infile.read((char *) &kmers[n], sizeof(kmers[n]));
+	infile.read((char *) &counts[n], sizeof(counts[n]));
+      }
     }
-    i++;
+
+    ht._bigcounts.load(&kmers[0], &counts[0], n_counts);
   }
 
-  return seq.length();
+  unsigned long long overflow_size = 0;
+  if (version >= 7) {
+    infile.read((char *) &overflow_size, sizeof(overflow_size));
+  }
+  ht._allocate_overflow(overflow_size);
+  if (overflow_size) {
+    infile.read((char *) ht._overflow, overflow_size * sizeof(uint16_t));
+  }
 }
 
-
-void CountingHashFile::load(const std::string &infilename, CountingHash &ht)
+CountingHashFileReader::CountingHashFileReader(const std::string &infilename, CountingHash &ht)
 {
-   std::string filename(infilename);
-   int found = filename.find_last_of(".");
-   std::string type = filename.substr(found+1);
+  ifstream infile(infilename.c_str(), ios::binary);
+  assert(infile.is_open());
 
-   if (type == "gz") { CountingHashGzFileReader(filename, ht); }
-   else { CountingHashFileReader(filename, ht); }
+  _read(infile, ht);
+  infile.close();
 }
 
-
-void CountingHashFile::save(const std::string &outfilename, const CountingHash &ht)
+CountingHashBlockFileReader::CountingHashBlockFileReader(const std::string &infilename, CountingHash &ht)
 {
-   std::string filename(outfilename);
-   int found = filename.find_last_of(".");
-   std::string type = filename.substr(found+1);
+  BlockCompressedIFStream infile(infilename);
+  assert(infile.is_open());
 
-   if (type == "gz") { CountingHashGzFileWriter(filename, ht); }
-   else { CountingHashFileWriter(filename, ht); }
+  _read(infile, ht);
+  infile.close();
 }
 
+// Read n bytes at the cursor into dest, and advance it.
+static void _read_mapped(const Byte *&cursor, const Byte * end,
+			 void * dest, size_t n)
+{
+  assert(cursor + n <= end);
+  memcpy(dest, cursor, n);
+  cursor += n;
+}
 
-CountingHashFileReader::CountingHashFileReader(const std::string &infilename, CountingHash &ht)
+CountingHashMmapFileReader::CountingHashMmapFileReader(const std::string &infilename, CountingHash &ht)
 {
-  if (ht._counts) {
-    for (unsigned int i = 0; i < ht._n_tables; i++) {
-      delete ht._counts[i]; ht._counts[i] = NULL;
-    }
-    delete ht._counts; ht._counts = NULL;
+  unsigned char version = 0;
+
+  int fd = open(infilename.c_str(), O_RDONLY);
+  assert(fd >= 0);
+
+  // Older files don't have their tables page-aligned; read them in.
+  if (pread(fd, &version, 1, 0) != 1 || version < 6) {
+    close(fd);
+    CountingHashFileReader(infilename, ht);
+    return;
   }
+
+  struct stat st;
+  int stat_rc = fstat(fd, &st);
+  assert(stat_rc == 0);
+
+  size_t length = st.st_size;
+  void * base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  assert(base != MAP_FAILED);
+
+  // hash table lookups land all over the file; don't read ahead.
+  madvise(base, length, MADV_RANDOM);
+
+  ht._deallocate_counters();
   ht._tablesizes.clear();
-  
+  ht._mmap_base = base;
+  ht._mmap_length = length;
+
+  const Byte * start = (const Byte *) base;
+  const Byte * end = start + length;
+  const Byte * cursor = start;
+
   unsigned int save_ksize = 0;
   unsigned char save_n_tables = 0;
   unsigned long long save_tablesize = 0;
-  unsigned char version, ht_type, use_bigcount;
+  unsigned char ht_type, use_bigcount, counter_bits;
 
-  ifstream infile(infilename.c_str(), ios::binary);
-  assert(infile.is_open());
-
-  infile.read((char *) &version, 1);
-  infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
-  assert(ht_type == SAVED_COUNTING_HT);
+  _read_mapped(cursor, end, &version, 1);
+  _read_mapped(cursor, end, &ht_type, 1);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
+  assert(ht_type == SAVED_COUNTING_HT || ht_type == SAVED_BLOCKED_COUNTING_HT);
 
-  infile.read((char *) &use_bigcount, 1);
-  infile.read((char *) &save_ksize, sizeof(save_ksize));
-  infile.read((char *) &save_n_tables, sizeof(save_n_tables));
+  _read_mapped(cursor, end, &use_bigcount, 1);
+  _read_mapped(cursor, end, &counter_bits, 1);
+  _read_mapped(cursor, end, &save_ksize, sizeof(save_ksize));
+  _read_mapped(cursor, end, &save_n_tables, sizeof(save_n_tables));
 
   ht._ksize = (WordLength) save_ksize;
   ht._n_tables = (unsigned int) save_n_tables;
   ht._init_bitstuff();
 
   ht._use_bigcount = use_bigcount;
+  ht._set_counter_bits(counter_bits);
+  ht._blocked = (ht_type == SAVED_BLOCKED_COUNTING_HT);
 
-  ht._counts = new Byte*[ht._n_tables];
-  for (unsigned int i = 0; i < ht._n_tables; i++) {
-    HashIntoType tablesize;
+  if (ht._blocked) {
+    unsigned long long save_n_blocks = 0;
+    _read_mapped(cursor, end, &save_n_blocks, sizeof(save_n_blocks));
+    cursor += _page_padding(cursor - start);
 
-    infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+    unsigned long long blockbytes = save_n_blocks * COUNTING_BLOCK_SIZE;
+    assert(cursor + blockbytes <= end);
 
-    tablesize = (HashIntoType) save_tablesize;
-    ht._tablesizes.push_back(tablesize);
+    ht._allocate_blocks((HashIntoType) save_n_blocks, (Byte *) cursor);
+    cursor += blockbytes;
+  } else {
+    ht._counts = new Byte*[ht._n_tables];
+    for (unsigned int i = 0; i < ht._n_tables; i++) {
+      HashIntoType tablesize, tablebytes;
 
-    ht._counts[i] = new Byte[tablesize];
+      _read_mapped(cursor, end, &save_tablesize, sizeof(save_tablesize));
+      cursor += _page_padding(cursor - start);
 
-    unsigned long long loaded = 0;
-    while (loaded != tablesize) {
-      infile.read((char *) ht._counts[i], tablesize - loaded);
-      loaded += infile.gcount();	// do I need to do this loop?
+      tablesize = (HashIntoType) save_tablesize;
+      ht._tablesizes.push_back(tablesize);
+
+      tablebytes = ht._table_bytes(tablesize);
+      assert(cursor + tablebytes <= end);
+
+      ht._counts[i] = (Byte *) cursor;
+      cursor += tablebytes;
     }
+    ht._init_moduli();
   }
 
   HashIntoType n_counts = 0;
-  infile.read((char *) &n_counts, sizeof(n_counts));
+  _read_mapped(cursor, end, &n_counts, sizeof(n_counts));
 
+  ht._bigcounts.clear();
   if (n_counts) {
-    ht._bigcounts.clear();
+    std::vector<HashIntoType> kmers(n_counts);
+    std::vector<BoundedCounterType> counts(n_counts);
 
-    HashIntoType kmer;
-    BoundedCounterType count;
+    _read_mapped(cursor, end, &kmers[0], n_counts * sizeof(HashIntoType));
+    _read_mapped(cursor, end, &counts[0],
+		 n_counts * sizeof(BoundedCounterType));
 
-    for (HashIntoType n = 0; n < n_counts; n++) {
-      infile.read((char *) &kmer, sizeof(kmer));
-      infile.read((char *) &count, sizeof(count));
-      ht._bigcounts[kmer] = count;
-    }
+    ht._bigcounts.load(&kmers[0], &counts[0], n_counts);
   }
 
-  infile.close();
+  // the overflow counters are small, and needn't be aligned; copy them.
+  unsigned long long overflow_size = 0;
+  if (version >= 7) {
+    _read_mapped(cursor, end, &overflow_size, sizeof(overflow_size));
+  }
+  ht._allocate_overflow(overflow_size);
+  if (overflow_size) {
+    _read_mapped(cursor, end, ht._overflow,
+		 overflow_size * sizeof(uint16_t));
+  }
 }
 
 CountingHashGzFileReader::CountingHashGzFileReader(const std::string &infilename, CountingHash &ht)
 {
-  if (ht._counts) {
-    for (unsigned int i = 0; i < ht._n_tables; i++) {
-      delete ht._counts[i]; ht._counts[i] = NULL;
-    }
-    delete ht._counts; ht._counts = NULL;
-  }
+  ht._deallocate_counters();
   ht._tablesizes.clear();
   
   unsigned int save_ksize = 0;
   unsigned char save_n_tables = 0;
   unsigned long long save_tablesize = 0;
   unsigned char version, ht_type, use_bigcount;
+  unsigned char counter_bits = 8;	// version 3 files are all 8-bit
 
   gzFile infile = gzopen(infilename.c_str(), "rb");
 
   gzread(infile, (char *) &version, 1);
   gzread(infile, (char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
-  assert(ht_type == SAVED_COUNTING_HT);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
+  assert(ht_type == SAVED_COUNTING_HT || ht_type == SAVED_BLOCKED_COUNTING_HT);
 
   gzread(infile, (char *) &use_bigcount, 1);
+  if (version >= 4) {
+    gzread(infile, (char *) &counter_bits, 1);
+  }
   gzread(infile, (char *) &save_ksize, sizeof(save_ksize));
   gzread(infile, (char *) &save_n_tables, sizeof(save_n_tables));
 
@@ -671,57 +673,97 @@ CountingHashGzFileReader::CountingHashGzFileReader(const std::string &infilename
   ht._init_bitstuff();
 
   ht._use_bigcount = use_bigcount;
+  ht._set_counter_bits(counter_bits);
+  ht._blocked = (ht_type == SAVED_BLOCKED_COUNTING_HT);
+
+  if (ht._blocked) {
+    unsigned long long save_n_blocks = 0;
+    gzread(infile, (char *) &save_n_blocks, sizeof(save_n_blocks));
+    if (version >= 6) {
+      gzseek(infile, _page_padding(gztell(infile)), SEEK_CUR);
+    }
+
+    ht._allocate_blocks((HashIntoType) save_n_blocks);
 
-  ht._counts = new Byte*[ht._n_tables];
-  for (unsigned int i = 0; i < ht._n_tables; i++) {
-    HashIntoType tablesize;
+    unsigned long long blockbytes = save_n_blocks * COUNTING_BLOCK_SIZE;
+    unsigned long long loaded = 0;
+    while (loaded != blockbytes) {
+      loaded += gzread(infile, (char *) ht._blocks + loaded,
+		       blockbytes - loaded);
+    }
+  } else {
+    ht._counts = new Byte*[ht._n_tables];
+    for (unsigned int i = 0; i < ht._n_tables; i++) {
+      HashIntoType tablesize, tablebytes;
 
-    gzread(infile, (char *) &save_tablesize, sizeof(save_tablesize));
+      gzread(infile, (char *) &save_tablesize, sizeof(save_tablesize));
+      if (version >= 6) {
+	gzseek(infile, _page_padding(gztell(infile)), SEEK_CUR);
+      }
 
-    tablesize = (HashIntoType) save_tablesize;
-    ht._tablesizes.push_back(tablesize);
+      tablesize = (HashIntoType) save_tablesize;
+      ht._tablesizes.push_back(tablesize);
 
-    ht._counts[i] = new Byte[tablesize];
+      tablebytes = ht._table_bytes(tablesize);
+      ht._counts[i] = allocate_table(tablebytes);
 
-    unsigned long long loaded = 0;
-    while (loaded != tablesize) {
-      loaded += gzread(infile, (char *) ht._counts[i], tablesize - loaded);
+      unsigned long long loaded = 0;
+      while (loaded != tablebytes) {
+	loaded += gzread(infile, (char *) ht._counts[i], tablebytes - loaded);
+      }
     }
+    ht._init_moduli();
   }
 
   HashIntoType n_counts = 0;
   gzread(infile, (char *) &n_counts, sizeof(n_counts));
 
+  ht._bigcounts.clear();
   if (n_counts) {
-    ht._bigcounts.clear();
+    std::vector<HashIntoType> kmers(n_counts);
+    std::vector<BoundedCounterType> counts(n_counts);
+
+    if (version >= 5) {
+      gzread(infile, (char *) &kmers[0], n_counts * sizeof(HashIntoType));
+      gzread(infile, (char *) &counts[0],
+	     n_counts * sizeof(BoundedCounterType));
+    } else {
+      for (HashIntoType n = 0; n < n_counts; n++) {
+	gzread(infile, (char *) &kmers[n], sizeof(kmers[n]));
+	gzread(infile, (char *) &counts[n], sizeof(counts[n]));
+      }
+    }
 
-    HashIntoType kmer;
-    BoundedCounterType count;
+    ht._bigcounts.load(&kmers[0], &counts[0], n_counts);
+  }
 
-    for (HashIntoType n = 0; n < n_counts; n++) {
-      gzread(infile, (char *) &kmer, sizeof(kmer));
-      gzread(infile, (char *) &count, sizeof(count));
-      ht._bigcounts[kmer] = count;
-    }
+  unsigned long long overflow_size = 0;
+  if (version >= 7) {
+    gzread(infile, (char *) &overflow_size, sizeof(overflow_size));
+  }
+  ht._allocate_overflow(overflow_size);
+  if (overflow_size) {
+    gzread(infile, (char *) ht._overflow, overflow_size * sizeof(uint16_t));
   }
 
   gzclose(infile);
 }
 
-CountingHashFileWriter::CountingHashFileWriter(const std::string &outfilename, const CountingHash &ht)
+void CountingHashFile::_write(std::ostream &outfile, const CountingHash &ht)
 {
-  assert(ht._counts[0]);
+  assert(ht._blocked ? ht._blocks != NULL : ht._counts[0] != NULL);
 
   unsigned int save_ksize = ht._ksize;
   unsigned char save_n_tables = ht._n_tables;
   unsigned long long save_tablesize;
 
-  ofstream outfile(outfilename.c_str(), ios::binary);
-
   unsigned char version = SAVED_FORMAT_VERSION;
   outfile.write((const char *) &version, 1);
 
   unsigned char ht_type = SAVED_COUNTING_HT;
+  if (ht._blocked) {
+    ht_type = SAVED_BLOCKED_COUNTING_HT;
+  }
   outfile.write((const char *) &ht_type, 1);
 
   unsigned char use_bigcount = 0;
@@ -730,34 +772,74 @@ CountingHashFileWriter::CountingHashFileWriter(const std::string &outfilename, c
   }
   outfile.write((const char *) &use_bigcount, 1);
 
+  unsigned char counter_bits = ht._counter_bits;
+  outfile.write((const char *) &counter_bits, 1);
+
   outfile.write((const char *) &save_ksize, sizeof(save_ksize));
   outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
 
-  for (unsigned int i = 0; i < save_n_tables; i++) {
-    save_tablesize = ht._tablesizes[i];
-
-    outfile.write((const char *) &save_tablesize, sizeof(save_tablesize));
-    outfile.write((const char *) ht._counts[i], save_tablesize);
+  if (ht._blocked) {
+    unsigned long long save_n_blocks = ht._n_blocks;
+
+    outfile.write((const char *) &save_n_blocks, sizeof(save_n_blocks));
+    outfile.write(_zero_page, _page_padding(outfile.tellp()));
+    outfile.write((const char *) ht._blocks,
+		  save_n_blocks * COUNTING_BLOCK_SIZE);
+  } else {
+    for (unsigned int i = 0; i < save_n_tables; i++) {
+      save_tablesize = ht._tablesizes[i];
+
+      outfile.write((const char *) &save_tablesize, sizeof(save_tablesize));
+      outfile.write(_zero_page, _page_padding(outfile.tellp()));
+      outfile.write((const char *) ht._counts[i],
+		    ht._table_bytes(save_tablesize));
+    }
   }
 
-  HashIntoType n_counts = ht._bigcounts.size();
+  // bigcounts go out sorted by k-mer, as one array of k-mers followed
+  // by one array of counts.
+  std::vector<HashIntoType> kmers;
+  std::vector<BoundedCounterType> counts;
+  ht._bigcounts.get_sorted(kmers, counts);
+
+  HashIntoType n_counts = kmers.size();
   outfile.write((const char *) &n_counts, sizeof(n_counts));
 
   if (n_counts) {
-    KmerCountMap::const_iterator it = ht._bigcounts.begin();
-    
-    for (; it != ht._bigcounts.end(); it++) {
-      outfile.write((const char *) &it->first, sizeof(it->first));
-      outfile.write((const char *) &it->second, sizeof(it->second));
-    }
+    outfile.write((const char *) &kmers[0], n_counts * sizeof(HashIntoType));
+    outfile.write((const char *) &counts[0],
+		  n_counts * sizeof(BoundedCounterType));
   }
 
+  // from version 7 on, the overflow tier: its size, then its counters.
+  unsigned long long overflow_size = ht._overflow_size;
+  outfile.write((const char *) &overflow_size, sizeof(overflow_size));
+  if (overflow_size) {
+    outfile.write((const char *) ht._overflow,
+		  overflow_size * sizeof(uint16_t));
+  }
+}
+
+CountingHashFileWriter::CountingHashFileWriter(const std::string &outfilename, const CountingHash &ht)
+{
+  ofstream outfile(outfilename.c_str(), ios::binary);
+
+  _write(outfile, ht);
+  outfile.close();
+}
+
+CountingHashBlockFileWriter::CountingHashBlockFileWriter(const std::string &outfilename, const CountingHash &ht)
+{
+  BlockCompressedOFStream outfile(outfilename);
+  assert(outfile.is_open());
+
+  _write(outfile, ht);
   outfile.close();
 }
 
 CountingHashGzFileWriter::CountingHashGzFileWriter(const std::string &outfilename, const CountingHash &ht)
 {
-  assert(ht._counts[0]);
+  assert(ht._blocked ? ht._blocks != NULL : ht._counts[0] != NULL);
 
   unsigned int save_ksize = ht._ksize;
   unsigned char save_n_tables = ht._n_tables;
@@ -769,6 +851,9 @@ CountingHashGzFileWriter::CountingHashGzFileWriter(const std::string &outfilenam
   gzwrite(outfile, (const char *) &version, 1);
 
   unsigned char ht_type = SAVED_COUNTING_HT;
+  if (ht._blocked) {
+    ht_type = SAVED_BLOCKED_COUNTING_HT;
+  }
   gzwrite(outfile, (const char *) &ht_type, 1);
 
   unsigned char use_bigcount = 0;
@@ -777,120 +862,453 @@ CountingHashGzFileWriter::CountingHashGzFileWriter(const std::string &outfilenam
   }
   gzwrite(outfile, (const char *) &use_bigcount, 1);
 
+  unsigned char counter_bits = ht._counter_bits;
+  gzwrite(outfile, (const char *) &counter_bits, 1);
+
   gzwrite(outfile, (const char *) &save_ksize, sizeof(save_ksize));
   gzwrite(outfile, (const char *) &save_n_tables, sizeof(save_n_tables));
 
-  for (unsigned int i = 0; i < save_n_tables; i++) {
-    save_tablesize = ht._tablesizes[i];
-
-    gzwrite(outfile, (const char *) &save_tablesize, sizeof(save_tablesize));
-    gzwrite(outfile, (const char *) ht._counts[i], save_tablesize);
+  if (ht._blocked) {
+    unsigned long long save_n_blocks = ht._n_blocks;
+
+    gzwrite(outfile, (const char *) &save_n_blocks, sizeof(save_n_blocks));
+    gzwrite(outfile, _zero_page, _page_padding(gztell(outfile)));
+    gzwrite(outfile, (const char *) ht._blocks,
+	    save_n_blocks * COUNTING_BLOCK_SIZE);
+  } else {
+    for (unsigned int i = 0; i < save_n_tables; i++) {
+      save_tablesize = ht._tablesizes[i];
+
+      gzwrite(outfile, (const char *) &save_tablesize, sizeof(save_tablesize));
+      gzwrite(outfile, _zero_page, _page_padding(gztell(outfile)));
+      gzwrite(outfile, (const char *) ht._counts[i],
+	      ht._table_bytes(save_tablesize));
+    }
   }
 
-  HashIntoType n_counts = ht._bigcounts.size();
+  // bigcounts go out sorted by k-mer, as one array of k-mers followed
+  // by one array of counts.
+  std::vector<HashIntoType> kmers;
+  std::vector<BoundedCounterType> counts;
+  ht._bigcounts.get_sorted(kmers, counts);
+
+  HashIntoType n_counts = kmers.size();
   gzwrite(outfile, (const char *) &n_counts, sizeof(n_counts));
 
   if (n_counts) {
-    KmerCountMap::const_iterator it = ht._bigcounts.begin();
-    
-    for (; it != ht._bigcounts.end(); it++) {
-      gzwrite(outfile, (const char *) &it->first, sizeof(it->first));
-      gzwrite(outfile, (const char *) &it->second, sizeof(it->second));
-    }
+    gzwrite(outfile, (const char *) &kmers[0],
+	    n_counts * sizeof(HashIntoType));
+    gzwrite(outfile, (const char *) &counts[0],
+	    n_counts * sizeof(BoundedCounterType));
+  }
+
+  unsigned long long overflow_size = ht._overflow_size;
+  gzwrite(outfile, (const char *) &overflow_size, sizeof(overflow_size));
+  if (overflow_size) {
+    gzwrite(outfile, (const char *) ht._overflow,
+	    overflow_size * sizeof(uint16_t));
   }
 
   gzclose(outfile);
 }
 
-void CountingHash::collect_high_abundance_kmers(const std::string &filename,
-						unsigned int lower_count,
-						unsigned int upper_count,
-						SeenSet& found_kmers)
+//
+// CountingHashFileMerger
+//
+
+// Where the pieces of a saved counting table are in its (uncompressed)
+// file.  The counter arrays are the tables, or the one array of blocks.
+struct SavedCountingLayout {
+  unsigned char			  version;
+  unsigned char			  ht_type;
+  unsigned char			  use_bigcount;
+  unsigned char			  counter_bits;
+  unsigned int			  ksize;
+  unsigned char			  n_tables;
+  std::vector<unsigned long long> sizes;	// bins, or blocks
+  std::vector<unsigned long long> offsets;	// of each counter array
+  std::vector<unsigned long long> bytes;
+  std::vector<HashIntoType>	  big_kmers;	// sorted
+  std::vector<BoundedCounterType> big_counts;
+  std::vector<uint16_t>		  overflow;	// empty if none
+};
+
+// Read the header and the bigcounts, and seek past the counters.
+static void _read_layout(std::istream &infile, SavedCountingLayout &layout)
 {
-  unsigned long long total_reads = 0;
+  layout.counter_bits = 8;	// version 3 files are all 8-bit
+
+  infile.read((char *) &layout.version, 1);
+  infile.read((char *) &layout.ht_type, 1);
+  assert(layout.version >= SAVED_FORMAT_MIN_VERSION &&
+	 layout.version <= SAVED_FORMAT_VERSION);
+  assert(layout.ht_type == SAVED_COUNTING_HT ||
+	 layout.ht_type == SAVED_BLOCKED_COUNTING_HT);
+
+  infile.read((char *) &layout.use_bigcount, 1);
+  if (layout.version >= 4) {
+    infile.read((char *) &layout.counter_bits, 1);
+  }
+  infile.read((char *) &layout.ksize, sizeof(layout.ksize));
+  infile.read((char *) &layout.n_tables, sizeof(layout.n_tables));
 
-  IParser* parser = IParser::get_parser(filename.c_str());
-  Read read;
+  bool blocked = (layout.ht_type == SAVED_BLOCKED_COUNTING_HT);
+  unsigned int n_arrays = blocked ? 1 : layout.n_tables;
 
-  string currName = "";
-  string currSeq = "";
+  for (unsigned int i = 0; i < n_arrays; i++) {
+    unsigned long long size = 0;
+    infile.read((char *) &size, sizeof(size));
+    if (layout.version >= 6) {
+      infile.seekg(_page_padding(infile.tellg()), ios::cur);
+    }
 
-  //
-  // iterate through the FASTA file & consume the reads, until we hit
-  // upper_count.
-  //
+    unsigned long long bytes = blocked ? size * COUNTING_BLOCK_SIZE :
+      (size * layout.counter_bits + 7) / 8;
 
-  bool done = false;
-  while(!parser->is_complete() && !done)  {
-    read = parser->get_next_read();
-    currSeq = read.sequence;
-    currName = read.name; 
+    layout.sizes.push_back(size);
+    layout.offsets.push_back(infile.tellg());
+    layout.bytes.push_back(bytes);
+    infile.seekg(bytes, ios::cur);
+  }
 
-    // do we want to process it?
-    if (check_and_normalize_read(currSeq)) {
-      const char * sp = currSeq.c_str();
+  HashIntoType n_counts = 0;
+  infile.read((char *) &n_counts, sizeof(n_counts));
+  assert(infile.good());
 
-      KMerIterator kmers(sp, _ksize);
-      HashIntoType kmer;
+  layout.big_kmers.resize(n_counts);
+  layout.big_counts.resize(n_counts);
 
-      while(!kmers.done()) {
-	kmer = kmers.next();
+  if (n_counts && layout.version >= 5) {
+    infile.read((char *) &layout.big_kmers[0], n_counts * sizeof(HashIntoType));
+    infile.read((char *) &layout.big_counts[0],
+		n_counts * sizeof(BoundedCounterType));
+  } else if (n_counts) {
+    std::vector< std::pair<HashIntoType, BoundedCounterType> > pairs(n_counts);
+    for (HashIntoType n = 0; n < n_counts; n++) {
+      infile.read((char *) &pairs[n].first, sizeof(pairs[n].first));
+      infile.read((char *) &pairs[n].second, sizeof(pairs[n].second));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    for (HashIntoType n = 0; n < n_counts; n++) {
+      layout.big_kmers[n] = pairs[n].first;
+      layout.big_counts[n] = pairs[n].second;
+    }
+  }
 
-	count(kmer);
-	if (get_count(kmer) >= upper_count) {
-	  done = true;
-	}
+  unsigned long long overflow_size = 0;
+  if (layout.version >= 7) {
+    infile.read((char *) &overflow_size, sizeof(overflow_size));
+  }
+  layout.overflow.resize(overflow_size);
+  if (overflow_size) {
+    infile.read((char *) &layout.overflow[0],
+		overflow_size * sizeof(uint16_t));
+  }
+  assert(infile.good());
+}
+
+// Move the count a set of input counters have past full into the merged
+// overflow tier: for each counter in the window whose inputs add up to
+// more than counter_mask, the rest goes to the overflow counter its key
+// hashes to (see CountingHash::_overflow_key).
+void CountingHashFileMerger::_merge_overflow(
+  const std::vector< std::vector<Byte> > &windows,
+  unsigned long long start, size_t length, unsigned int counter_bits,
+  bool blocked, unsigned int n_tables, unsigned int table,
+  std::vector<unsigned int> &overflow, const FastModulus &overflowmod
+)
+{
+  Byte counter_mask = (Byte) ((1 << counter_bits) - 1);
+
+  for (size_t b = 0; b < length; b++) {
+    for (unsigned int shift = 0; shift < 8; shift += counter_bits) {
+      unsigned int total = 0;
+      for (size_t j = 0; j < windows.size(); j++) {
+	total += (windows[j][b] >> shift) & counter_mask;
+      }
+      if (total <= counter_mask) {
+	continue;
       }
+
+      HashIntoType counter = ((start + b) * 8 + shift) / counter_bits;
+      HashIntoType key = blocked ? counter : counter * n_tables + table;
+      overflow[overflowmod.mod(CountingHash::_block_mix(key))] +=
+	total - counter_mask;
+    }
+  }
+}
+
+// a + b for each bits-wide counter packed into a word, saturating at all
+// ones.  high has the top bit of every counter set.  The low bits of each
+// counter are added with the top bits masked off, so no carry crosses
+// into the next counter; the top bit and its carry out are then worked
+// out by hand, and a counter that carried out is set to all ones.
+static inline uint64_t _swar_saturating_add(uint64_t a, uint64_t b,
+					    uint64_t high, unsigned int bits)
+{
+  uint64_t low_sum = (a & ~high) + (b & ~high);
+  uint64_t carry = ((a & b) | ((a | b) & low_sum)) & high;
+  uint64_t sum = low_sum ^ ((a ^ b) & high);
+  uint64_t full = carry >> (bits - 1);
+
+  return sum | ((full << bits) - full);
+}
+
+// dest += src, counter by counter, for n bytes of packed counters.
+static void _saturating_add(Byte * dest, const Byte * src, size_t n,
+			    unsigned int counter_bits)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  if (counter_bits == 8) {
+    for (; i + 16 <= n; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i *) (dest + i));
+      __m128i b = _mm_loadu_si128((const __m128i *) (src + i));
+      _mm_storeu_si128((__m128i *) (dest + i), _mm_adds_epu8(a, b));
+    }
+  }
+#endif
+
+  uint64_t high = (~0ULL / ((1ULL << counter_bits) - 1)) << (counter_bits - 1);
+
+  for (; i + 8 <= n; i += 8) {
+    uint64_t a, b;
+    memcpy(&a, dest + i, 8);
+    memcpy(&b, src + i, 8);
+    a = _swar_saturating_add(a, b, high, counter_bits);
+    memcpy(dest + i, &a, 8);
+  }
+  for (; i < n; i++) {
+    dest[i] = (Byte) _swar_saturating_add(dest[i], src[i], high, counter_bits);
+  }
+}
+
+// Where one of a bigcount k-mer's counters is, in one counter array.
+struct MergeProbe {
+  unsigned long long  offset;
+  unsigned int	      shift;
+  size_t	      kmer;	// index into the merged bigcount k-mers
+
+  bool operator<(const MergeProbe &other) const {
+    return offset < other.offset;
+  }
+};
+
+static std::string _file_type(const std::string &filename)
+{
+  return filename.substr(filename.find_last_of(".") + 1);
+}
+
+CountingHashFileMerger::CountingHashFileMerger(const std::vector<std::string> &infilenames, const std::string &outfilename)
+{
+  const unsigned int n_inputs = infilenames.size();
+  assert(n_inputs > 0);
+
+  std::vector<std::istream *> infiles;
+  std::vector<SavedCountingLayout> layouts(n_inputs);
+
+  for (unsigned int j = 0; j < n_inputs; j++) {
+    const std::string &filename = infilenames[j];
+    assert(_file_type(filename) != "gz");
+
+    if (_file_type(filename) == BLOCK_COMPRESSED_EXT) {
+      infiles.push_back(new BlockCompressedIFStream(filename));
+    } else {
+      infiles.push_back(new ifstream(filename.c_str(), ios::binary));
     }
-	       
-    // increment read number
-    total_reads++;
+    assert(infiles[j]->good());
+
+    _read_layout(*infiles[j], layouts[j]);
+  }
+
+  const SavedCountingLayout &first = layouts[0];
+  bool blocked = (first.ht_type == SAVED_BLOCKED_COUNTING_HT);
+  unsigned int counter_bits = first.counter_bits;
+  Byte counter_mask = (Byte) ((1 << counter_bits) - 1);
+  unsigned char use_bigcount = 0;
 
-    if (total_reads % 100000 == 0) {
-      std::cout << "..." << total_reads << "\n";
+  for (unsigned int j = 0; j < n_inputs; j++) {
+    assert(layouts[j].ht_type == first.ht_type);
+    assert(layouts[j].counter_bits == counter_bits);
+    assert(layouts[j].ksize == first.ksize);
+    assert(layouts[j].n_tables == first.n_tables);
+    assert(layouts[j].sizes == first.sizes);
+    assert(layouts[j].overflow.size() == first.overflow.size());
+
+    use_bigcount |= layouts[j].use_bigcount;
+  }
+
+  // The overflow tiers add up, along with whatever the counters spill.
+  unsigned long long overflow_size = first.overflow.size();
+  std::vector<unsigned int> overflow(overflow_size, 0);
+  FastModulus overflowmod(overflow_size ? overflow_size : 1);
+  for (unsigned int j = 0; j < n_inputs; j++) {
+    for (unsigned long long k = 0; k < overflow_size; k++) {
+      overflow[k] += layouts[j].overflow[k];
     }
   }
 
-  delete parser; parser = NULL;
+  // Every k-mer in any bigcount store, and the smallest of its counters
+  // in each input, for the inputs where it has no bigcount of its own.
+  std::vector<HashIntoType> big_kmers;
+  for (unsigned int j = 0; j < n_inputs; j++) {
+    big_kmers.insert(big_kmers.end(), layouts[j].big_kmers.begin(),
+		     layouts[j].big_kmers.end());
+  }
+  std::sort(big_kmers.begin(), big_kmers.end());
+  big_kmers.erase(std::unique(big_kmers.begin(), big_kmers.end()),
+		  big_kmers.end());
+
+  std::vector<BoundedCounterType> min_counters(big_kmers.size() * n_inputs,
+					       counter_mask);
+  std::vector< std::vector<MergeProbe> > probes(first.sizes.size());
+
+  for (size_t q = 0; q < big_kmers.size(); q++) {
+    HashIntoType khash = big_kmers[q];
+    MergeProbe probe;
+    probe.kmer = q;
+
+    if (blocked) {
+      unsigned int block_stride =
+	(COUNTING_BLOCK_SIZE * 8 / counter_bits) / first.n_tables;
+      unsigned long long block = khash % first.sizes[0];
+      HashIntoType offsets = CountingHash::_block_mix(khash);
+
+      for (unsigned int i = 0; i < first.n_tables; i++) {
+	unsigned long long bitpos = block * COUNTING_BLOCK_SIZE * 8 +
+	  CountingHash::_block_offset(i, offsets, block_stride) * counter_bits;
+	offsets = (offsets >> 8) | (offsets << 56);
+
+	probe.offset = bitpos >> 3;
+	probe.shift = bitpos & 7;
+	probes[0].push_back(probe);
+      }
+    } else {
+      for (unsigned int i = 0; i < first.n_tables; i++) {
+	unsigned long long bitpos = (khash % first.sizes[i]) * counter_bits;
 
-  unsigned long long stop_at_read = total_reads;
+	probe.offset = bitpos >> 3;
+	probe.shift = bitpos & 7;
+	probes[i].push_back(probe);
+      }
+    }
+  }
 
-  //
-  // go back through the file again, and store all k-mers >= lower_count
-  //
+  std::ostream * outfile;
+  if (_file_type(outfilename) == BLOCK_COMPRESSED_EXT) {
+    outfile = new BlockCompressedOFStream(outfilename);
+  } else {
+    assert(_file_type(outfilename) != "gz");
+    outfile = new ofstream(outfilename.c_str(), ios::binary);
+  }
+  assert(outfile->good());
 
-  parser = IParser::get_parser(filename.c_str());
+  unsigned char version = SAVED_FORMAT_VERSION;
+  outfile->write((const char *) &version, 1);
+  outfile->write((const char *) &first.ht_type, 1);
+  outfile->write((const char *) &use_bigcount, 1);
+  outfile->write((const char *) &first.counter_bits, 1);
+  outfile->write((const char *) &first.ksize, sizeof(first.ksize));
+  outfile->write((const char *) &first.n_tables, sizeof(first.n_tables));
 
-  total_reads = 0;
-  while(!parser->is_complete() && total_reads != stop_at_read)  {
-    read = parser->get_next_read();
-    currSeq = read.sequence;
-    currName = read.name; 
+  std::vector< std::vector<Byte> > windows(n_inputs,
+					   std::vector<Byte>(MERGE_WINDOW_SIZE));
 
-    // do we want to process it?
-    if (check_and_normalize_read(currSeq)) {
-      const char * sp = currSeq.c_str();
+  for (unsigned int r = 0; r < first.sizes.size(); r++) {
+    unsigned long long size = first.sizes[r];
+    unsigned long long bytes = first.bytes[r];
 
-      KMerIterator kmers(sp, _ksize);
-      HashIntoType kmer;
+    outfile->write((const char *) &size, sizeof(size));
+    outfile->write(_zero_page, _page_padding(outfile->tellp()));
 
-      while(!kmers.done()) {
-	kmer = kmers.next();
+    for (unsigned int j = 0; j < n_inputs; j++) {
+      infiles[j]->seekg(layouts[j].offsets[r]);
+    }
 
-	if (get_count(kmer) >= lower_count) {
-	  found_kmers.insert(kmer);
+    std::sort(probes[r].begin(), probes[r].end());
+    size_t p = 0;
+
+    for (unsigned long long start = 0; start < bytes;
+	 start += MERGE_WINDOW_SIZE) {
+      size_t length = MIN(bytes - start, (unsigned long long) MERGE_WINDOW_SIZE);
+
+      for (unsigned int j = 0; j < n_inputs; j++) {
+	infiles[j]->read((char *) &windows[j][0], length);
+	assert((size_t) infiles[j]->gcount() == length);
+      }
+
+      for (; p < probes[r].size() && probes[r][p].offset < start + length;
+	   p++) {
+	const MergeProbe &probe = probes[r][p];
+	for (unsigned int j = 0; j < n_inputs; j++) {
+	  BoundedCounterType counter =
+	    (windows[j][probe.offset - start] >> probe.shift) & counter_mask;
+	  BoundedCounterType &min_counter =
+	    min_counters[probe.kmer * n_inputs + j];
+	  if (counter < min_counter) {
+	    min_counter = counter;
+	  }
 	}
       }
+
+      if (overflow_size) {
+	_merge_overflow(windows, start, length, counter_bits, blocked,
+			first.n_tables, r, overflow, overflowmod);
+      }
+
+      for (unsigned int j = 1; j < n_inputs; j++) {
+	_saturating_add(&windows[0][0], &windows[j][0], length, counter_bits);
+      }
+      outfile->write((const char *) &windows[0][0], length);
     }
-	       
-    // increment read number
-    total_reads++;
+  }
 
-    if (total_reads % 100000 == 0) {
-      std::cout << "... x 2 " << total_reads << "\n";
+  // An input's count for a k-mer is its bigcount if it has one, and its
+  // smallest counter if not.
+  std::vector<BoundedCounterType> big_counts(big_kmers.size());
+  for (size_t q = 0; q < big_kmers.size(); q++) {
+    unsigned long long total = 0;
+
+    for (unsigned int j = 0; j < n_inputs; j++) {
+      const SavedCountingLayout &layout = layouts[j];
+      std::vector<HashIntoType>::const_iterator found =
+	std::lower_bound(layout.big_kmers.begin(), layout.big_kmers.end(),
+			 big_kmers[q]);
+
+      if (found != layout.big_kmers.end() && *found == big_kmers[q]) {
+	total += layout.big_counts[found - layout.big_kmers.begin()];
+      } else {
+	total += min_counters[q * n_inputs + j];
+      }
     }
+    big_counts[q] = (BoundedCounterType) MIN(total, MAX_BIGCOUNT);
+  }
+
+  HashIntoType n_counts = use_bigcount ? big_kmers.size() : 0;
+  outfile->write((const char *) &n_counts, sizeof(n_counts));
+  if (n_counts) {
+    outfile->write((const char *) &big_kmers[0],
+		   n_counts * sizeof(HashIntoType));
+    outfile->write((const char *) &big_counts[0],
+		   n_counts * sizeof(BoundedCounterType));
+  }
+
+  std::vector<uint16_t> merged_overflow(overflow_size);
+  for (unsigned long long k = 0; k < overflow_size; k++) {
+    merged_overflow[k] = (uint16_t)
+      MIN(overflow[k], CountingHash::_max_overflow(counter_mask));
+  }
+  outfile->write((const char *) &overflow_size, sizeof(overflow_size));
+  if (overflow_size) {
+    outfile->write((const char *) &merged_overflow[0],
+		   overflow_size * sizeof(uint16_t));
+  }
+
+  delete outfile;
+  for (unsigned int j = 0; j < n_inputs; j++) {
+    delete infiles[j];
   }
-  delete parser; parser = NULL;
 }
 
 /* vim: set ft=cpp ts=8 sts=4 sw=4 et tw=79 */
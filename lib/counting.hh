@@ -2,47 +2,607 @@
 #define COUNTING_HH
 
 #include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include "khmer_config.hh"
 #include "hashtable.hh"
 #include "hashbits.hh"
+#include "primes.hh"
+#include "bigcount.hh"
+#include "table_alloc.hh"
+#include "threads.hh"
+#include "fastmod.hh"
+#include "occupancy.hh"
 
 namespace khmer {
-  typedef std::map<HashIntoType, BoundedCounterType> KmerCountMap;
-
   class CountingHashIntersect;
   class CountingHashFile;
   class CountingHashFileReader;
+  class CountingHashMmapFileReader;
+  class CountingHashBlockFileReader;
   class CountingHashFileWriter;
   class CountingHashGzFileReader;
   class CountingHashGzFileWriter;
+  class CountingHashBlockFileWriter;
+  class CountingHashFileMerger;
 
   class CountingHash : public khmer::Hashtable {
     friend class CountingHashIntersect;
     friend class CountingHashFile;
     friend class CountingHashFileReader;
+    friend class CountingHashMmapFileReader;
     friend class CountingHashFileWriter;
     friend class CountingHashGzFileReader;
     friend class CountingHashGzFileWriter;
+    friend class CountingHashFileMerger;
 
   protected:
     bool _use_bigcount;		// keep track of counts > Bloom filter hash count threshold?
-    uint32_t _bigcount_spin_lock;
+    bool _conservative;		// only increment the smallest counters?
+
+    // A conservative update reads a k-mer's counters and then raises them,
+    // so two threads counting the same k-mer at once must not overlap, or
+    // both would raise it to the same value.  Each k-mer takes the spin
+    // lock its hash picks out of these first.
+    uint32_t _update_locks[CONSERVATIVE_UPDATE_LOCKS];
     std::vector<HashIntoType> _tablesizes;
+    std::vector<FastModulus> _tablemods;  // k-mer hash % _tablesizes[i]
     unsigned int _n_tables;
 
     Byte ** _counts;
 
+    // Counters are 8, 4, or 2 bits wide; narrower counters are packed
+    // several to a byte, so a table of n bins takes n * _counter_bits / 8
+    // bytes.
+    unsigned int _counter_bits;
+    Byte _counter_mask;
+
+    // Blocked layout: instead of _n_tables separate arrays, all of the
+    // counters for a k-mer live in a single COUNTING_BLOCK_SIZE block,
+    // chosen by one modulus.  "Table" i of the sketch is the i'th
+    // _block_stride-wide slice of every block.
+    bool _blocked;
+    HashIntoType _n_blocks;
+    FastModulus _blockmod;		// k-mer hash % _n_blocks
+    unsigned int _block_stride;
+    Byte * _blocks;
+
+    // Set when the counters were mapped straight from a saved file (see
+    // CountingHashMmapFileReader) rather than allocated; _counts[i] or
+    // _blocks then point into the mapping.
+    void * _mmap_base;
+    size_t _mmap_length;
+
+    // Overflow tier (see set_overflow_size): a fixed array of 16-bit
+    // counters that take the counts past a full counter.  Counter i of
+    // the sketch for a k-mer has a key, its position in the counter
+    // arrays (see _overflow_key), and the full counter's extra count is
+    // kept in the overflow counter that the key hashes to.  Keys that
+    // hash alike share an overflow counter, so, as with the counters
+    // themselves, counts can only come out high.
+    uint16_t * _overflow;
+    HashIntoType _overflow_size;
+    FastModulus _overflowmod;		// mixed key % _overflow_size
+
     virtual void _allocate_counters() {
       _n_tables = _tablesizes.size();
 
+      if (_blocked) {
+	_allocate_blocks();
+	return;
+      }
+
       _counts = new Byte*[_n_tables];
       for (unsigned int i = 0; i < _n_tables; i++) {
-	_counts[i] = new Byte[_tablesizes[i]];
-	memset(_counts[i], 0, _tablesizes[i]);
+	HashIntoType tablebytes = _table_bytes(_tablesizes[i]);
+
+	_counts[i] = allocate_table(tablebytes);
+      }
+      _init_moduli();
+    }
+
+    // Call whenever _tablesizes or _n_blocks change.
+    void _init_moduli() {
+      _tablemods.clear();
+      for (unsigned int i = 0; i < _tablesizes.size(); i++) {
+	_tablemods.push_back(FastModulus(_tablesizes[i]));
+      }
+      if (_n_blocks) {
+	_blockmod.set_divisor(_n_blocks);
+      }
+    }
+
+    void _set_counter_bits(unsigned int counter_bits) {
+      assert(counter_bits == 2 || counter_bits == 4 || counter_bits == 8);
+
+      _counter_bits = counter_bits;
+      _counter_mask = (Byte) ((1 << counter_bits) - 1);
+
+      // Packed counters are incremented with a compare-and-swap on the
+      // whole byte, so they saturate exactly and need no slop for threads.
+      // With an overflow tier, so are 8-bit ones: a counter is full at
+      // exactly its maximum, and no count is lost on the way over.
+      if (_counter_bits < 8 || _overflow) {
+	_max_count = _counter_mask;
+      } else {
+	_max_count = MAX_COUNT - _number_of_threads + 1;
+      }
+    }
+
+    // Raise a counter to target, unless it is already at least that high.
+    inline void _raise_counter(Byte * table, HashIntoType bin,
+			       BoundedCounterType target) {
+      if (_counter_bits == 8) {
+	Byte old = table[ bin ];
+	while (old < target) {
+	  Byte seen = __sync_val_compare_and_swap( table + bin, old,
+						    (Byte) target );
+	  if (seen == old) {
+	    break;
+	  }
+	  old = seen;
+	}
+	return;
+      }
+
+      HashIntoType  bitpos  = bin * _counter_bits;
+      Byte *	    byte    = table + (bitpos >> 3);
+      unsigned int  shift   = bitpos & 7;
+      Byte	    old	    = *byte;
+
+      while (((old >> shift) & _counter_mask) < target) {
+	Byte raised = (Byte) ((old & ~(_counter_mask << shift)) |
+			      (target << shift));
+	Byte seen = __sync_val_compare_and_swap( byte, old, raised );
+	if (seen == old) {
+	  break;
+	}
+	old = seen;
+      }
+    }
+
+    inline HashIntoType _table_bytes(HashIntoType tablesize) const {
+      return (tablesize * _counter_bits + 7) / 8;
+    }
+
+    // the nonzero counters of table i, over bins as in n_occupied().
+    HashIntoType _n_occupied(unsigned int i, HashIntoType start,
+			     HashIntoType stop,
+			     uint32_t number_of_threads) const {
+      if (_blocked) {
+	return count_nonzero_counters_blocked(_blocks, _n_blocks, _counter_bits,
+					      _block_stride, i, start, stop,
+					      number_of_threads);
+      }
+      return count_nonzero_counters(_counts[i], _counter_bits, _tablesizes[i],
+				    start, stop, number_of_threads);
+    }
+
+    inline BoundedCounterType _get_counter(const Byte * table,
+					   HashIntoType bin) const {
+      if (_counter_bits == 8) {
+	return table[bin];
+      }
+
+      HashIntoType bitpos = bin * _counter_bits;
+      return (table[bitpos >> 3] >> (bitpos & 7)) & _counter_mask;
+    }
+
+    // Increment a counter unless it is already at _max_count;
+    // returns false if it was full.
+    inline bool _increment_counter(Byte * table, HashIntoType bin) {
+      if (_counter_bits == 8 && !_overflow) {
+	// NOTE: Technically, multiple threads can cause the bin to spill 
+	//	 over max_count a little, if they all read it as less than 
+	//	 max_count before any of them increment it.
+	//	 However, do we actually care if there is a little 
+	//	 bit of slop here? It can always be trimmed off later, if 
+	//	 that would help with stats.
+	if ( _max_count > table[ bin ] ) {
+	  __sync_add_and_fetch( table + bin, 1 );
+	  return true;
+	}
+	return false;
+      }
+
+      HashIntoType  bitpos  = bin * _counter_bits;
+      Byte *	    byte    = table + (bitpos >> 3);
+      unsigned int  shift   = bitpos & 7;
+      Byte	    old	    = *byte;
+
+      while (true) {
+	if ( ((old >> shift) & _counter_mask) >= _max_count ) {
+	  return false;
+	}
+
+	Byte seen = __sync_val_compare_and_swap( byte, old,
+						  (Byte) (old + (1 << shift)) );
+	if (seen == old) {
+	  return true;
+	}
+	old = seen;
+      }
+    }
+
+    // Spend the same total number of bytes as the unblocked layout would,
+    // rounded up to a prime number of blocks.
+    void _allocate_blocks() {
+      assert(_n_tables > 0 && _n_tables <= _counters_per_block());
+
+      HashIntoType total_bytes = 0;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	total_bytes += _table_bytes(_tablesizes[i]);
+      }
+
+      HashIntoType min_blocks =
+	(total_bytes + COUNTING_BLOCK_SIZE - 1) / COUNTING_BLOCK_SIZE;
+      Primes primetab(min_blocks - 1);
+
+      _allocate_blocks(primetab.get_next_prime());
+    }
+
+    // Use the given (COUNTING_BLOCK_SIZE-aligned) blocks if there are
+    // any; otherwise allocate zeroed ones.
+    void _allocate_blocks(HashIntoType n_blocks, Byte * given = NULL) {
+      _n_blocks = n_blocks;
+      _block_stride = _counters_per_block() / _n_tables;
+      _blocks = given ? given :
+	allocate_table(_n_blocks * COUNTING_BLOCK_SIZE);
+
+      // each slice acts as one table of _n_blocks * _block_stride bins.
+      _tablesizes.assign(_n_tables, _n_blocks * _block_stride);
+      _init_moduli();
+    }
+
+    void _deallocate_counters() {
+      if (_counts) {
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  if (!_mmap_base) {
+	    free_table(_counts[i]);
+	  }
+	  _counts[i] = NULL;
+	}
+
+	delete [] _counts;
+	_counts = NULL;
+      }
+
+      if (_blocks) {
+	if (!_mmap_base) {
+	  free_table(_blocks);
+	}
+	_blocks = NULL;
+      }
+      _n_blocks = 0;
+
+      if (_mmap_base) {
+	munmap(_mmap_base, _mmap_length);
+	_mmap_base = NULL;
+	_mmap_length = 0;
+      }
+
+      _allocate_overflow(0);
+    }
+
+    // Replace the overflow tier with size zeroed counters, or none.
+    void _allocate_overflow(HashIntoType size) {
+      delete [] _overflow;
+      _overflow = NULL;
+      _overflow_size = size;
+
+      if (size) {
+	_overflow = new uint16_t[size];
+	memset(_overflow, 0, size * sizeof(uint16_t));
+	_overflowmod.set_divisor(size);
+      }
+      _set_counter_bits(_counter_bits);
+    }
+
+    inline unsigned int _counters_per_block() const {
+      return COUNTING_BLOCK_SIZE * 8 / _counter_bits;
+    }
+
+    // A counter's key is its index in the one array of blocks, or
+    // interleaved across the tables: bin * _n_tables + table.
+    inline HashIntoType _overflow_key(HashIntoType bin, unsigned int i) const {
+      return bin * _n_tables + i;
+    }
+
+    inline HashIntoType _overflow_block_key(HashIntoType block,
+					    unsigned int offset) const {
+      return block * _counters_per_block() + offset;
+    }
+
+    static inline uint16_t * _overflow_counter(uint16_t * overflow,
+					       const FastModulus &mod,
+					       HashIntoType key) {
+      return overflow + mod.mod(_block_mix(key));
+    }
+
+    inline uint16_t * _overflow_counter(HashIntoType key) const {
+      return _overflow_counter(_overflow, _overflowmod, key);
+    }
+
+    // The most an overflow counter holds on top of a full counter.
+    static inline unsigned int _max_overflow(Byte counter_mask) {
+      return MAX_BIGCOUNT - counter_mask;
+    }
+
+    inline void _increment_overflow(HashIntoType key) {
+      uint16_t * counter = _overflow_counter(key);
+      uint16_t old = *counter;
+
+      while (old < _max_overflow(_counter_mask)) {
+	uint16_t seen = __sync_val_compare_and_swap( counter, old,
+						     (uint16_t) (old + 1) );
+	if (seen == old) {
+	  break;
+	}
+	old = seen;
+      }
+    }
+
+    // Each full counter's count, with its overflow, into counts.
+    inline void _get_overflow_counts(HashIntoType khash,
+				     const HashIntoType * bins,
+				     BoundedCounterType * counts) const {
+      if (_blocked) {
+	HashIntoType block = bins ? bins[0] : _blockmod.mod(khash);
+	HashIntoType offsets = _block_mix(khash);
+
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  HashIntoType key =
+	    _overflow_block_key(block, _block_offset(i, offsets));
+	  offsets = (offsets >> 8) | (offsets << 56);
+	  counts[i] = _counter_mask + *_overflow_counter(key);
+	}
+	return;
+      }
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	HashIntoType key = _overflow_key(_get_bin(khash, bins, i), i);
+	counts[i] = _counter_mask + *_overflow_counter(key);
+      }
+    }
+
+    // Count a k-mer whose counters are all full.  Conservatively, only
+    // the overflow counters giving its smallest count go up.
+    inline void _count_overflow(HashIntoType khash, const HashIntoType * bins) {
+      BoundedCounterType counts[COUNTING_BLOCK_SIZE * 4];
+      HashIntoType block = 0, offsets = 0;
+      BoundedCounterType min_count = MAX_BIGCOUNT;
+
+      _get_overflow_counts(khash, bins, counts);
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	min_count = counts[i] < min_count ? counts[i] : min_count;
+      }
+
+      if (_blocked) {
+	block = bins ? bins[0] : _blockmod.mod(khash);
+	offsets = _block_mix(khash);
+      }
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	HashIntoType key;
+	if (_blocked) {
+	  key = _overflow_block_key(block, _block_offset(i, offsets));
+	  offsets = (offsets >> 8) | (offsets << 56);
+	} else {
+	  key = _overflow_key(_get_bin(khash, bins, i), i);
+	}
+
+	if (!_conservative || counts[i] == min_count) {
+	  _increment_overflow(key);
+	}
+      }
+    }
+
+    inline BoundedCounterType _get_overflow_count(HashIntoType khash,
+						  const HashIntoType * bins)
+      const {
+      BoundedCounterType counts[COUNTING_BLOCK_SIZE * 4];
+      BoundedCounterType min_count = MAX_BIGCOUNT;
+
+      _get_overflow_counts(khash, bins, counts);
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	min_count = counts[i] < min_count ? counts[i] : min_count;
       }
+      return min_count;
+    }
+
+    // The batched calls work out a k-mer's bins once, prefetch them, and
+    // pass them back in here; everything else passes bins = NULL and the
+    // bins are worked out on the spot.  In the blocked layout the only
+    // "bin" is the block number.
+    inline unsigned int _n_bins() const {
+      return _blocked ? 1 : _n_tables;
+    }
+
+    // Work out the k-mer's bins into bins, and start loading them.
+    inline void _prefetch_bins(HashIntoType khash, HashIntoType * bins) const {
+      if (_blocked) {
+	bins[0] = _blockmod.mod(khash);
+	__builtin_prefetch(_blocks + bins[0] * COUNTING_BLOCK_SIZE);
+	return;
+      }
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	bins[i] = _tablemods[i].mod(khash);
+	__builtin_prefetch(_counts[i] + ((bins[i] * _counter_bits) >> 3));
+      }
+    }
+
+    inline HashIntoType _get_bin(HashIntoType khash, const HashIntoType * bins,
+				 unsigned int i) const {
+      return bins ? bins[i] : _tablemods[i].mod(khash);
+    }
+
+    inline Byte * _get_block(HashIntoType khash,
+			     const HashIntoType * bins = NULL) const {
+      HashIntoType block = bins ? bins[0] : _blockmod.mod(khash);
+      return _blocks + block * COUNTING_BLOCK_SIZE;
+    }
+
+    // Position of table i's counter within a block, scaled from the low
+    // byte of the mixed hash without a divide.
+    static inline unsigned int _block_offset(unsigned int i,
+					     HashIntoType offsets,
+					     unsigned int block_stride) {
+      return i * block_stride +
+	(((unsigned int)(offsets & 0xff) * block_stride) >> 8);
     }
+
+    inline unsigned int _block_offset(unsigned int i,
+				      HashIntoType offsets) const {
+      return _block_offset(i, offsets, _block_stride);
+    }
+
+    // Increment each of the k-mer's counters in its block;
+    // returns the number of counters that were already full.
+    inline unsigned int _count_in_block(HashIntoType khash,
+					const HashIntoType * bins) {
+      unsigned int  n_full	= 0;
+      Byte *	    block	= _get_block(khash, bins);
+      HashIntoType  offsets	= _block_mix(khash);
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	unsigned int bin = _block_offset(i, offsets);
+	offsets = (offsets >> 8) | (offsets << 56);
+
+	if (!_increment_counter(block, bin)) {
+	  n_full++;
+	}
+      }
+
+      return n_full;
+    }
+
+    inline BoundedCounterType _get_count_in_block(HashIntoType khash,
+						  const HashIntoType * bins)
+      const {
+      BoundedCounterType  min_count = _max_count;
+      const Byte *	  block	    = _get_block(khash, bins);
+      HashIntoType	  offsets   = _block_mix(khash);
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	BoundedCounterType the_count =
+	  _get_counter(block, _block_offset(i, offsets));
+	offsets = (offsets >> 8) | (offsets << 56);
+
+	if (the_count < min_count) {
+	  min_count = the_count;
+	}
+      }
+
+      return min_count;
+    }
+
+    // Smallest of the k-mer's counters, ignoring bigcounts.
+    inline BoundedCounterType _get_min_counter(HashIntoType khash,
+					       const HashIntoType * bins)
+      const {
+      if (_blocked) {
+	return _get_count_in_block(khash, bins);
+      }
+
+      BoundedCounterType min_count = _max_count;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	BoundedCounterType the_count =
+	  _get_counter(_counts[i], _get_bin(khash, bins, i));
+	if (the_count < min_count) {
+	  min_count = the_count;
+	}
+      }
+      return min_count;
+    }
+
+    // Conservative update: only raise the k-mer's smallest counters, to
+    // one more than the current minimum.  The others already overestimate
+    // its count, so incrementing them would only add to the error.  Each
+    // raise is a compare-and-swap that never lowers a counter, so other
+    // k-mers sharing a counter can only push it higher in the meantime;
+    // the same k-mer counted on another thread waits on its update lock.
+    // (Compare-and-swap alone can't keep two updates of one k-mer apart:
+    // the second can read the counters the first has yet to raise, and
+    // raise them to the same value, losing a count.)
+    // Returns the number of counters that were already full.
+    inline unsigned int _count_conservative(HashIntoType khash,
+					    const HashIntoType * bins) {
+      uint32_t * lock =
+	_update_locks + _block_mix(khash) % CONSERVATIVE_UPDATE_LOCKS;
+      spin_lock(lock);
+
+      BoundedCounterType min_count = _get_min_counter(khash, bins);
+      if (min_count >= _max_count) {
+	spin_unlock(lock);
+	return _n_tables;
+      }
+
+      BoundedCounterType target = min_count + 1;
+      if (_blocked) {
+	Byte *	      block	= _get_block(khash, bins);
+	HashIntoType  offsets	= _block_mix(khash);
+
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  _raise_counter(block, _block_offset(i, offsets), target);
+	  offsets = (offsets >> 8) | (offsets << 56);
+	}
+      } else {
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  _raise_counter(_counts[i], _get_bin(khash, bins, i), target);
+	}
+      }
+
+      spin_unlock(lock);
+      return 0;
+    }
+
+    inline void _count(HashIntoType khash, const HashIntoType * bins) {
+
+      unsigned int  n_full	  = 0;
+
+      if (_conservative) {
+	n_full = _count_conservative(khash, bins);
+      } else if (_blocked) {
+	n_full = _count_in_block(khash, bins);
+      } else {
+	// TODO: Time how long this loop takes with PerformanceMetrics.
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  if (!_increment_counter(_counts[i], _get_bin(khash, bins, i))) {
+	    n_full++;
+	  }
+	} // for each table
+      }
+
+      if (n_full == _n_tables) {
+	if (_overflow) {
+	  _count_overflow(khash, bins);
+	} else if (_use_bigcount) {
+	  _bigcounts.increment(khash, _max_count + 1, _max_bigcount);
+	}
+      }
+
+    } // _count
+
+    inline BoundedCounterType _get_count(HashIntoType khash,
+					 const HashIntoType * bins) const {
+      unsigned int	  max_count	= _max_count;
+      BoundedCounterType  min_count	= _get_min_counter(khash, bins);
+
+      if (min_count == max_count && _overflow) {
+	return _get_overflow_count(khash, bins);
+      }
+      if (min_count == max_count && _use_bigcount) {
+	BoundedCounterType big_count = _bigcounts.get(khash);
+	if (big_count) {
+	  min_count = big_count;
+	}
+      }
+      return min_count;
+    }
+
   public:
-    KmerCountMap _bigcounts;
+    BigCountTable _bigcounts;
 
     CountingHash(
       WordLength ksize, HashIntoType single_tablesize,
@@ -50,8 +610,13 @@ namespace khmer {
       get_active_config( ).get_number_of_threads( )
     ) :
       khmer::Hashtable(ksize, number_of_threads), 
-      _use_bigcount(false), _bigcount_spin_lock(false) {
+      _use_bigcount(false), _conservative(false),
+      _counts(NULL), _blocked(false), _n_blocks(0), _block_stride(0),
+      _blocks(NULL), _mmap_base(NULL), _mmap_length(0), _overflow(NULL),
+      _overflow_size(0) {
       _tablesizes.push_back(single_tablesize);
+      _set_counter_bits(8);
+      memset(_update_locks, 0, sizeof(_update_locks));
       
       _allocate_counters();
     }
@@ -59,27 +624,25 @@ namespace khmer {
     CountingHash(
       WordLength ksize, std::vector<HashIntoType>& tablesizes,
       uint32_t const number_of_threads =
-      get_active_config( ).get_number_of_threads( )
+      get_active_config( ).get_number_of_threads( ),
+      bool blocked = false,
+      unsigned int counter_bits = 8,
+      bool conservative = false
     ) :
       khmer::Hashtable(ksize, number_of_threads), 
-      _use_bigcount(false), _bigcount_spin_lock(false),
-      _tablesizes(tablesizes) {
+      _use_bigcount(false), _conservative(conservative),
+      _tablesizes(tablesizes), _counts(NULL), _blocked(blocked),
+      _n_blocks(0), _block_stride(0), _blocks(NULL), _mmap_base(NULL),
+      _mmap_length(0), _overflow(NULL), _overflow_size(0) {
+      _set_counter_bits(counter_bits);
+      memset(_update_locks, 0, sizeof(_update_locks));
 
       _allocate_counters();
     }
 
     virtual ~CountingHash() {
-      if (_counts) {
-	for (unsigned int i = 0; i < _n_tables; i++) {
-	  delete _counts[i];
-	  _counts[i] = NULL;
-	}
-
-	delete _counts;
-	_counts = NULL;
-
-	_n_tables = 0;
-      }
+      _deallocate_counters();
+      _n_tables = 0;
     }
 
     std::vector<HashIntoType> get_tablesizes() const {
@@ -89,23 +652,56 @@ namespace khmer {
     void set_use_bigcount(bool b) { _use_bigcount = b; }
     bool get_use_bigcount() { return _use_bigcount; }
 
+    // Conservative update is not saved with the table.
+    void set_use_conservative(bool b) { _conservative = b; }
+    bool get_use_conservative() const { return _conservative; }
+
+    bool is_blocked() const { return _blocked; }
+    unsigned int get_counter_bits() const { return _counter_bits; }
+
+    // Count past a full counter, up to MAX_BIGCOUNT, in a fixed array of
+    // size 16-bit counters (see _overflow) instead of the bigcount store,
+    // which then goes unused; zero goes back to stopping at the counter
+    // maximum.  Memory is fixed, updates are lock-free, and a lookup is
+    // one more probe per table, but counts are estimates, like the rest
+    // of the sketch, instead of exact.  Call this before counting
+    // anything.
+    void set_overflow_size(HashIntoType size) { _allocate_overflow(size); }
+    HashIntoType get_overflow_size() const { return _overflow_size; }
+
     virtual void save(std::string);
     virtual void load(std::string);
 
+    // With use_mmap, map the counters of an uncompressed version 6+ file
+    // copy-on-write instead of reading them in: pages load as they are
+    // touched, and processes that load the same file share them until
+    // they count into them.  Other files are read in as usual.
+    void load(std::string, bool use_mmap);
+    bool is_mmapped() const { return _mmap_base != NULL; }
+
     // accessors to get table info
     const HashIntoType n_entries() const { return _tablesizes[0]; }
 
-    // count number of occupied bins
+    // count number of occupied bins, in the first table.
     virtual const HashIntoType n_occupied(HashIntoType start=0,
 					  HashIntoType stop=0) const {
-      HashIntoType n = 0;
-      if (stop == 0) { stop = _tablesizes[0]; }
-      for (HashIntoType i = start; i < stop; i++) {
-	if (_counts[0][i % _tablesizes[0]]) {
-	  n++;
-	}
+      return n_occupied(start, stop, 1);
+    }
+
+    const HashIntoType n_occupied(HashIntoType start, HashIntoType stop,
+				  uint32_t number_of_threads) const {
+      return _n_occupied(0, start, stop, number_of_threads);
+    }
+
+    // the occupied bins of every table, counted on number_of_threads
+    // threads.
+    TableOccupancy get_occupancy(uint32_t number_of_threads = 1) const {
+      TableOccupancy occupancy;
+      occupancy.sizes = _tablesizes;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	occupancy.occupied.push_back(_n_occupied(i, 0, 0, number_of_threads));
       }
-      return n;
+      return occupancy;
     }
 
     virtual void count(const char * kmer) {
@@ -114,37 +710,8 @@ namespace khmer {
     }
 
     virtual void count(HashIntoType khash) {
-
-      unsigned int  n_full	  = 0;
-
-      // TODO: Time how long this loop takes with PerformanceMetrics.
-      for (unsigned int i = 0; i < _n_tables; i++) {
-	const HashIntoType bin = khash % _tablesizes[i];
-	// NOTE: Technically, multiple threads can cause the bin to spill 
-	//	 over max_count a little, if they all read it as less than 
-	//	 max_count before any of them increment it.
-	//	 However, do we actually care if there is a little 
-	//	 bit of slop here? It can always be trimmed off later, if 
-	//	 that would help with stats.
-	if ( _max_count > _counts[ i ][ bin ] )
-	  __sync_add_and_fetch( *(_counts + i) + bin, 1 );
-	else
-	  n_full++;
-      } // for each table
-
-      if (n_full == _n_tables && _use_bigcount) {
-	while (!__sync_bool_compare_and_swap( &_bigcount_spin_lock, 0, 1 ));
-	if (_bigcounts[khash] == 0) {
-	  _bigcounts[khash] = _max_count + 1;
-	} else {
-	  if (_bigcounts[khash] < _max_bigcount) {
-	    _bigcounts[khash] += 1;
-	  }
-	}
-	__sync_bool_compare_and_swap( &_bigcount_spin_lock, 1, 0 );
-      }
-
-    } // count
+      _count(khash, NULL);
+    }
 
     // get the count for the given k-mer.
     virtual const BoundedCounterType get_count(const char * kmer) const {
@@ -154,21 +721,48 @@ namespace khmer {
 
     // get the count for the given k-mer hash.
     virtual const BoundedCounterType get_count(HashIntoType khash) const {
-      unsigned int	  max_count	= _max_count;
-      BoundedCounterType  min_count	= max_count;
-      for (unsigned int i = 0; i < _n_tables; i++) {
-	BoundedCounterType the_count = _counts[i][khash % _tablesizes[i]];
-	if (the_count < min_count) {
-	  min_count = the_count;
+      return _get_count(khash, NULL);
+    }
+
+    // Work out the bins for the k-mer PREFETCH_DISTANCE ahead and prefetch
+    // them, then count the current k-mer from its saved bins.  The bins
+    // live in a ring of 2 * PREFETCH_DISTANCE slots, so that the slot being
+    // filled is never the one being read.
+    virtual void count_batch(const HashIntoType * khashes, unsigned int n) {
+      const unsigned int n_bins = _n_bins();
+      const unsigned int ring = 2 * PREFETCH_DISTANCE;
+      std::vector<HashIntoType> bins(ring * n_bins);
+
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_prefetch_bins(khashes[i], &bins[i * n_bins]);
+      }
+
+      for (unsigned int i = 0; i < n; i++) {
+	unsigned int ahead = i + PREFETCH_DISTANCE;
+	if (ahead < n) {
+	  _prefetch_bins(khashes[ahead], &bins[(ahead % ring) * n_bins]);
 	}
+	_count(khashes[i], &bins[(i % ring) * n_bins]);
       }
-      if (min_count == max_count && _use_bigcount) {
-	KmerCountMap::const_iterator it = _bigcounts.find(khash);
-	if (it != _bigcounts.end()) {
-	  min_count = it->second;
+    }
+
+    virtual void get_count_batch(const HashIntoType * khashes, unsigned int n,
+				 BoundedCounterType * counts) const {
+      const unsigned int n_bins = _n_bins();
+      const unsigned int ring = 2 * PREFETCH_DISTANCE;
+      std::vector<HashIntoType> bins(ring * n_bins);
+
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_prefetch_bins(khashes[i], &bins[i * n_bins]);
+      }
+
+      for (unsigned int i = 0; i < n; i++) {
+	unsigned int ahead = i + PREFETCH_DISTANCE;
+	if (ahead < n) {
+	  _prefetch_bins(khashes[ahead], &bins[(ahead % ring) * n_bins]);
 	}
+	counts[i] = _get_count(khashes[i], &bins[(i % ring) * n_bins]);
       }
-      return min_count;
     }
 
     MinMaxTable * fasta_file_to_minmax(const std::string &inputfile,
@@ -191,11 +785,6 @@ namespace khmer {
 			  BoundedCounterType &kadian,
 			  unsigned int nk = 1);
 
-    HashIntoType * abundance_distribution(std::string filename,
-					  Hashbits * tracking,
-					  CallbackFn callback = NULL,
-					  void * callback_data = NULL) const;
-
     HashIntoType * fasta_count_kmers_by_position(const std::string &inputfile,
 					 const unsigned int max_read_len,
 					 BoundedCounterType limit_by_count=0,
@@ -207,6 +796,8 @@ namespace khmer {
 				       CallbackFn callback = NULL,
 				       void * callback_data = NULL);
 
+    // Both of these look up every k-mer in the file; an
+    // AbundanceStatsEngine gets these and more in one threaded pass.
     void get_kmer_abund_mean(const std::string &inputfile,
 			     unsigned long long &total,
 			     unsigned long long &count,
@@ -216,22 +807,21 @@ namespace khmer {
 				      float mean, float &abs_deviation) const;
 
     unsigned int max_hamming1_count(const std::string kmer);
-
-    unsigned int trim_on_abundance(std::string seq,
-				   BoundedCounterType min_abund) const;
-    unsigned int trim_below_abundance(std::string seq,
-				      BoundedCounterType max_abund) const;
-
-    void collect_high_abundance_kmers(const std::string &infilename,
-				      unsigned int lower_count,
-				      unsigned int upper_count,
-				      SeenSet& kmers);
   };
 
 
+  // Files ending in ".gz" are gzipped, and files ending in "."
+  // BLOCK_COMPRESSED_EXT are block-compressed (see block_compressed.hh);
+  // anything else is written as is.
   class CountingHashFile {
+  protected:
+    // the uncompressed format, from or to any stream.
+    static void _read(std::istream &infile, CountingHash &ht);
+    static void _write(std::ostream &outfile, const CountingHash &ht);
+
   public:
-    static void load(const std::string &infilename, CountingHash &ht);
+    static void load(const std::string &infilename, CountingHash &ht,
+		     bool use_mmap = false);
     static void save(const std::string &outfilename, const CountingHash &ht);
   };
 
@@ -240,11 +830,21 @@ namespace khmer {
     CountingHashFileReader(const std::string &infilename, CountingHash &ht);
   };
 
+  class CountingHashMmapFileReader : public CountingHashFile {
+  public:
+    CountingHashMmapFileReader(const std::string &infilename, CountingHash &ht);
+  };
+
   class CountingHashGzFileReader : public CountingHashFile {
   public:
     CountingHashGzFileReader(const std::string &infilename, CountingHash &ht);
   };
 
+  class CountingHashBlockFileReader : public CountingHashFile {
+  public:
+    CountingHashBlockFileReader(const std::string &infilename, CountingHash &ht);
+  };
+
 
   class CountingHashFileWriter : public CountingHashFile {
   public:
@@ -255,6 +855,36 @@ namespace khmer {
   public:
     CountingHashGzFileWriter(const std::string &outfilename, const CountingHash &ht);
   };
+
+  class CountingHashBlockFileWriter : public CountingHashFile {
+  public:
+    CountingHashBlockFileWriter(const std::string &outfilename, const CountingHash &ht);
+  };
+
+  // Sum saved tables that were built separately, say from shards of the
+  // input, into one saved table, as if all of the input had been counted
+  // into it.  The tables must agree in k, layout, counter width, and table
+  // sizes.  They are streamed side by side MERGE_WINDOW_SIZE bytes at a
+  // time, so only a window of each is ever in memory.  Counters saturate
+  // rather than wrap.  A k-mer that is in any input's bigcount store gets
+  // the sum of its counts in the output's; other k-mers whose counters
+  // saturate only in the sum can't be named, and stop at the counter
+  // maximum, unless the tables have overflow tiers (which must be the same
+  // size), where the excess goes on into the summed overflow counters.
+  // Gzipped files can't be merged.
+  class CountingHashFileMerger : public CountingHashFile {
+  protected:
+    static void _merge_overflow(
+      const std::vector< std::vector<Byte> > &windows,
+      unsigned long long start, size_t length, unsigned int counter_bits,
+      bool blocked, unsigned int n_tables, unsigned int table,
+      std::vector<unsigned int> &overflow, const FastModulus &overflowmod
+    );
+
+  public:
+    CountingHashFileMerger(const std::vector<std::string> &infilenames,
+			   const std::string &outfilename);
+  };
 };
 
 #endif // COUNTING_HH
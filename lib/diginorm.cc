@@ -0,0 +1,382 @@
+#include <assert.h>
+#include <vector>
+
+#include "diginorm.hh"
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+DiginormEngine::DiginormEngine(
+  Hashtable &ht, BoundedCounterType cutoff, bool paired,
+  uint32_t const number_of_threads
+) :
+  _ht(ht), _cutoff(cutoff), _paired(paired),
+  _number_of_threads(number_of_threads), _parser(NULL), _outfile(NULL),
+  _callback(NULL), _callback_data(NULL),
+  _improperly_paired(false), _invalid_file_format(false), _aborted(false),
+  _reading_done(false), _n_reads(0), _n_kept(0), _n_unpaired(0)
+{
+  assert(_number_of_threads > 0);
+  pthread_mutex_init(&_output_lock, NULL);
+  pthread_mutex_init(&_batch_lock, NULL);
+  pthread_cond_init(&_batch_ready, NULL);
+  pthread_cond_init(&_batch_taken, NULL);
+}
+
+DiginormEngine::~DiginormEngine()
+{
+  pthread_cond_destroy(&_batch_taken);
+  pthread_cond_destroy(&_batch_ready);
+  pthread_mutex_destroy(&_batch_lock);
+  pthread_mutex_destroy(&_output_lock);
+}
+
+void DiginormEngine::normalize(const std::string &infilename,
+			       const std::string &outfilename,
+			       CallbackFn callback,
+			       void * callback_data)
+{
+  Config &the_config = get_active_config( );
+
+  _n_reads = _n_kept = _n_unpaired = 0;
+  _improperly_paired = _invalid_file_format = _aborted = false;
+  _reading_done = false;
+
+  _outfile = fopen(outfilename.c_str(), "w");
+  assert(_outfile != NULL);
+
+  // in paired mode, only the calling thread reads.
+  _parser = IParser::get_parser(
+    infilename, _paired ? 1 : _number_of_threads,
+    the_config.get_reads_input_buffer_size( ),
+    the_config.get_reads_parser_trace_level( )
+  );
+  _parser->set_keep_reads_with_n(true);
+  _callback = callback;
+  _callback_data = callback_data;
+
+  try {
+    run_on_threads(_run_thread, this,
+		   _paired ? _number_of_threads + 1 : _number_of_threads,
+		   _abort);
+  } catch (...) {
+    _clear_batches();
+    delete _parser;
+    _parser = NULL;
+    fclose(_outfile);
+    _outfile = NULL;
+    throw;
+  }
+
+  delete _parser;
+  _parser = NULL;
+  fclose(_outfile);
+  _outfile = NULL;
+
+  if (_invalid_file_format) {
+    throw InvalidReadFileFormat();
+  }
+  if (_improperly_paired) {
+    throw ImproperlyPairedReads();
+  }
+}
+
+// Only the calling thread calls back.
+void DiginormEngine::_run_thread(void * engine, uint32_t thread_n)
+{
+  DiginormEngine * me = (DiginormEngine *) engine;
+
+  if (me->_paired) {
+    if (thread_n == 0) {
+      me->_read_pairs(me->_callback, me->_callback_data);
+    } else {
+      me->_normalize_pairs();
+    }
+  } else if (thread_n == 0) {
+    me->_normalize_reads(me->_callback, me->_callback_data);
+  } else {
+    me->_normalize_reads(NULL, NULL);
+  }
+}
+
+// The callback threw: stop the other threads.  Unpaired, take this
+// thread's share of the reads left, without looking at them; paired, wake
+// the workers waiting for a batch.
+void DiginormEngine::_abort(void * engine)
+{
+  DiginormEngine * me = (DiginormEngine *) engine;
+  Read read;
+  bool invalid_file_format = false;
+
+  me->_aborted = true;
+  if (me->_paired) {
+    pthread_mutex_lock(&me->_batch_lock);
+    me->_reading_done = true;
+    pthread_cond_broadcast(&me->_batch_ready);
+    pthread_mutex_unlock(&me->_batch_lock);
+    return;
+  }
+
+  while (next_read_or_done(me->_parser, read, false, invalid_file_format)) {
+  }
+}
+
+// Mates are named the same but for a final 1 and 2.
+static bool _is_mate(const Read &first, const Read &second)
+{
+  size_t n = first.name.length();
+
+  return n == second.name.length() && first.name[n - 1] == '1' &&
+    second.name[n - 1] == '2' &&
+    first.name.compare(0, n - 1, second.name, 0, n - 1) == 0;
+}
+
+void DiginormEngine::_normalize_reads(CallbackFn callback,
+				      void * callback_data)
+{
+  std::string	      output;
+  Read		      read;
+  unsigned long long  n_reads	    = 0;
+  unsigned long long  next_report   = CALLBACK_PERIOD;
+  std::vector<HashIntoType>	  kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+
+  output.reserve(DIGINORM_OUTPUT_BUFFER_SIZE);
+
+  while (!_aborted) {
+    if (callback && _n_reads >= next_report) {
+      callback("normalize_by_median", callback_data, _n_reads, _n_kept);
+      next_report = _n_reads - _n_reads % CALLBACK_PERIOD + CALLBACK_PERIOD;
+    }
+
+    if (!next_read_or_done(_parser, read, !n_reads, _invalid_file_format)) {
+      break;
+    }
+
+    // only the name is written out, not the rest of the header line.
+    read.name = read.name.substr(0, read.name.find_first_of(" \t"));
+
+    n_reads++;
+    __sync_add_and_fetch(&_n_reads, 1);
+    if (_keep(&read, 1, kmer_hashes, counts)) {
+      __sync_add_and_fetch(&_n_kept, 1);
+      _write(output, read);
+    }
+  }
+
+  _flush(output);
+}
+
+// Paired mode's reader, on the calling thread: pair adjacent mates, and
+// hand them out a batch at a time.
+void DiginormEngine::_read_pairs(CallbackFn callback, void * callback_data)
+{
+  std::vector<Read>   pairs;
+  Read		      first;
+  Read		      read;
+  bool		      have_first    = false;
+  bool		      nothing_read  = true;
+  unsigned long long  next_report   = CALLBACK_PERIOD;
+
+  pairs.reserve(2 * DIGINORM_BATCH_SIZE);
+
+  while (!_improperly_paired) {
+    if (callback && _n_reads >= next_report) {
+      callback("normalize_by_median", callback_data, _n_reads, _n_kept);
+      next_report = _n_reads - _n_reads % CALLBACK_PERIOD + CALLBACK_PERIOD;
+    }
+
+    if (!next_read_or_done(_parser, read, nothing_read,
+			   _invalid_file_format)) {
+      break;
+    }
+    nothing_read = false;
+
+    read.name = read.name.substr(0, read.name.find_first_of(" \t"));
+
+    char end = read.name.empty() ? 0 : read.name[read.name.length() - 1];
+    if (end != '1' && end != '2') {
+      _improperly_paired = true;
+      break;
+    }
+
+    if (have_first && _is_mate(first, read)) {
+      have_first = false;
+      pairs.push_back(first);
+      pairs.push_back(read);
+      if (pairs.size() >= 2 * DIGINORM_BATCH_SIZE) {
+	_hand_out(pairs);
+      }
+      continue;
+    }
+
+    // the first read, or this one, has no mate next to it.
+    if (have_first) {
+      _n_unpaired++;
+      have_first = false;
+    }
+    if (end == '1') {
+      first = read;
+      have_first = true;
+    } else {
+      _n_unpaired++;
+    }
+  }
+
+  if (have_first) {
+    _n_unpaired++;
+  }
+  if (!pairs.empty()) {
+    _hand_out(pairs);
+  }
+
+  pthread_mutex_lock(&_batch_lock);
+  _reading_done = true;
+  pthread_cond_broadcast(&_batch_ready);
+  pthread_mutex_unlock(&_batch_lock);
+}
+
+// Queue the pairs for a worker, and leave pairs empty.
+void DiginormEngine::_hand_out(std::vector<Read> &pairs)
+{
+  std::vector<Read> * batch = new std::vector<Read>;
+  batch->swap(pairs);
+  pairs.reserve(2 * DIGINORM_BATCH_SIZE);
+
+  // read no more than a couple of batches ahead of the workers.
+  pthread_mutex_lock(&_batch_lock);
+  while (_batches.size() >= 2 * _number_of_threads) {
+    pthread_cond_wait(&_batch_taken, &_batch_lock);
+  }
+  _batches.push_back(batch);
+  pthread_cond_signal(&_batch_ready);
+  pthread_mutex_unlock(&_batch_lock);
+}
+
+void DiginormEngine::_normalize_pairs()
+{
+  std::string	      output;
+  std::vector<HashIntoType>	  kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+
+  output.reserve(DIGINORM_OUTPUT_BUFFER_SIZE);
+
+  while (true) {
+    pthread_mutex_lock(&_batch_lock);
+    while (_batches.empty() && !_reading_done) {
+      pthread_cond_wait(&_batch_ready, &_batch_lock);
+    }
+    if (_batches.empty() || _aborted) {
+      pthread_mutex_unlock(&_batch_lock);
+      break;
+    }
+    std::vector<Read> * batch = _batches.front();
+    _batches.pop_front();
+    pthread_cond_signal(&_batch_taken);
+    pthread_mutex_unlock(&_batch_lock);
+
+    std::vector<Read> &pairs = *batch;
+    for (size_t i = 0; i < pairs.size() && !_aborted; i += 2) {
+      __sync_add_and_fetch(&_n_reads, 2);
+      if (_keep(&pairs[i], 2, kmer_hashes, counts)) {
+	__sync_add_and_fetch(&_n_kept, 2);
+	_write(output, pairs[i]);
+	_write(output, pairs[i + 1]);
+      }
+    }
+
+    delete batch;
+  }
+
+  _flush(output);
+}
+
+// Free the batches the workers didn't get to.
+void DiginormEngine::_clear_batches()
+{
+  while (!_batches.empty()) {
+    delete _batches.front();
+    _batches.pop_front();
+  }
+}
+
+// Keep the reads if any of them has a median count below the cutoff, and
+// count the k-mers of each one that does.  Reads shorter than k aren't
+// looked at, and their batch isn't kept.  Ns are looked up and counted
+// as As, in a copy, so that the read is written out as it was.
+bool DiginormEngine::_keep(Read * reads, unsigned int n_reads,
+			   std::vector<HashIntoType> &kmer_hashes,
+			   std::vector<BoundedCounterType> &counts)
+{
+  bool passed_filter = false;
+  bool passed_length = true;
+  std::string with_as;
+
+  for (unsigned int i = 0; i < n_reads; i++) {
+    const std::string * seq = &reads[i].sequence;
+
+    size_t n_at = seq->find_first_of("Nn");
+    if (n_at != std::string::npos) {
+      with_as = *seq;
+      for (; n_at != std::string::npos;
+	   n_at = with_as.find_first_of("Nn", n_at + 1)) {
+	with_as[n_at] = 'A';
+      }
+      seq = &with_as;
+    }
+
+    if (seq->length() < _ht.ksize()) {
+      passed_length = false;
+      continue;
+    }
+
+    BoundedCounterType median = 0;
+    float average = 0, stddev = 0;
+    _ht.get_median_count(*seq, median, average, stddev, kmer_hashes, counts);
+
+    if (median < _cutoff) {
+      _ht.consume_string(*seq);
+      passed_filter = true;
+    }
+  }
+
+  return passed_length && passed_filter;
+}
+
+void DiginormEngine::_write(std::string &output, const Read &read)
+{
+  if (read.accuracy.empty()) {
+    output += '>';
+    output += read.name;
+    output += '\n';
+    output += read.sequence;
+    output += '\n';
+  } else {
+    output += '@';
+    output += read.name;
+    output += '\n';
+    output += read.sequence;
+    output += "\n+\n";
+    output += read.accuracy;
+    output += '\n';
+  }
+
+  // a pair goes out together: the second read is written before the
+  // buffer is checked again.
+  if (output.length() >= DIGINORM_OUTPUT_BUFFER_SIZE &&
+      (!_paired || read.name[read.name.length() - 1] == '2')) {
+    _flush(output);
+  }
+}
+
+void DiginormEngine::_flush(std::string &output)
+{
+  pthread_mutex_lock(&_output_lock);
+  fwrite(output.data(), 1, output.length(), _outfile);
+  pthread_mutex_unlock(&_output_lock);
+
+  output.clear();
+}
+
+// vim: set sts=2 sw=2:
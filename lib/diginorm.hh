@@ -0,0 +1,118 @@
+#ifndef DIGINORM_HH
+#define DIGINORM_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <exception>
+#include <stdio.h>
+#include <pthread.h>
+#include "khmer.hh"
+#include "khmer_config.hh"
+#include "threads.hh"
+#include "hashtable.hh"
+#include "read_parsers.hh"
+
+#   define DIGINORM_OUTPUT_BUFFER_SIZE (1024 * 1024) // per thread, before a write
+#   define DIGINORM_BATCH_SIZE 10000 // pairs handed to a worker at a time
+
+namespace khmer {
+
+  struct ImproperlyPairedReads : public std:: exception
+  { };
+
+  // Digital normalization, as in scripts/normalize-by-median.py: a read is
+  // kept if the median count of its k-mers is below the cutoff, and then
+  // its k-mers are counted, so that later reads from the same region are
+  // thrown away.  In paired mode, both reads of a pair are kept if either
+  // passes, and neither if either is shorter than k.
+  //
+  // Each thread takes reads from one shared IParser, counts into the
+  // table (a CountingHash or an ExactCountingHash, both of which threads
+  // can count into at once), and writes the reads it keeps
+  // to its own buffer, which goes out to the file a whole buffer at a time;
+  // a pair is never split across buffers.  With more than one thread,
+  // which reads are kept depends on the order the threads get to them in,
+  // as it would for any other order of the input.
+  //
+  // Reads that contain Ns are kept: their k-mers are looked up and
+  // counted with the Ns read as As, as the script always did, and the
+  // reads are written out as they were.
+  //
+  // In paired mode, mates must be next to each other in the file, which a
+  // parser shared by several threads can't promise: each thread parses
+  // its own part of the input, and a pair can straddle two of them.  So
+  // the calling thread reads the file on its own, pairs the reads, and
+  // hands batches of pairs to number_of_threads other threads.  A read
+  // whose mate isn't next to it is skipped, and counted in
+  // get_n_unpaired(); reads whose names don't end in 1 or 2 are an error
+  // (ImproperlyPairedReads).
+  //
+  // The thread that calls normalize() is the only one to call back, every
+  // CALLBACK_PERIOD reads, with the reads and kept reads so far.
+  class DiginormEngine {
+  protected:
+    Hashtable &		      _ht;
+    BoundedCounterType	      _cutoff;
+    bool		      _paired;
+    uint32_t		      _number_of_threads;
+
+    // state for the current call to normalize()
+    read_parsers:: IParser *  _parser;
+    FILE *		      _outfile;
+    CallbackFn		      _callback;
+    void *		      _callback_data;
+    pthread_mutex_t	      _output_lock;
+    bool		      _improperly_paired;
+    bool		      _invalid_file_format;
+    volatile bool	      _aborted;
+
+    // paired mode: batches of pairs, waiting for a worker
+    std::deque< std::vector<read_parsers:: Read> * > _batches;
+    pthread_mutex_t	      _batch_lock;
+    pthread_cond_t	      _batch_ready;
+    pthread_cond_t	      _batch_taken;
+    bool		      _reading_done;
+
+    unsigned long long	      _n_reads;
+    unsigned long long	      _n_kept;
+    unsigned long long	      _n_unpaired;
+
+    static void _run_thread(void * engine, uint32_t thread_n);
+    static void _abort(void * engine);
+    void _normalize_reads(CallbackFn callback, void * callback_data);
+    void _read_pairs(CallbackFn callback, void * callback_data);
+    void _hand_out(std::vector<read_parsers:: Read> &pairs);
+    void _normalize_pairs();
+    void _clear_batches();
+
+    bool _keep(read_parsers:: Read * reads, unsigned int n_reads,
+	       std::vector<HashIntoType> &kmer_hashes,
+	       std::vector<BoundedCounterType> &counts);
+    void _write(std::string &output, const read_parsers:: Read &read);
+    void _flush(std::string &output);
+
+  public:
+    DiginormEngine(
+      Hashtable &ht, BoundedCounterType cutoff, bool paired = false,
+      uint32_t const number_of_threads =
+      get_active_config( ).get_number_of_threads( )
+    );
+    ~DiginormEngine();
+
+    // Normalize the reads in infilename, and write the ones kept to
+    // outfilename.  The counts are for this call.
+    void normalize(const std::string &infilename,
+		   const std::string &outfilename,
+		   CallbackFn callback = NULL,
+		   void * callback_data = NULL);
+
+    unsigned long long get_n_reads() const { return _n_reads; }
+    unsigned long long get_n_kept() const { return _n_kept; }
+    unsigned long long get_n_unpaired() const { return _n_unpaired; }
+  };
+};
+
+#endif // DIGINORM_HH
+
+// vim: set sts=2 sw=2:
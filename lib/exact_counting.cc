@@ -0,0 +1,110 @@
+#include <iostream>
+#include <fstream>
+#include "exact_counting.hh"
+#include "block_compressed.hh"
+
+using namespace std;
+using namespace khmer;
+
+ExactCountingHash::ExactCountingHash(
+  WordLength	    ksize,
+  HashIntoType	    expected_kmers,
+  uint32_t const    number_of_threads
+)
+: khmer::Hashtable(ksize, number_of_threads),
+  _table(expected_kmers)
+{
+}
+
+ExactCountingHash::~ExactCountingHash()
+{
+}
+
+void ExactCountingHash::save(std::string outfilename)
+{
+  if (is_block_compressed_filename(outfilename)) {
+    BlockCompressedOFStream outfile(outfilename);
+    assert(outfile.is_open());
+
+    _save(outfile);
+    outfile.close();
+  } else {
+    ofstream outfile(outfilename.c_str(), ios::binary);
+
+    _save(outfile);
+    outfile.close();
+  }
+}
+
+// version | type | k | n, then the n k-mers, sorted, then their counts.
+void ExactCountingHash::_save(std::ostream &outfile) const
+{
+  unsigned char version = SAVED_FORMAT_VERSION;
+  outfile.write((const char *) &version, 1);
+
+  unsigned char ht_type = SAVED_EXACT_COUNTING_HT;
+  outfile.write((const char *) &ht_type, 1);
+
+  unsigned int save_ksize = _ksize;
+  outfile.write((const char *) &save_ksize, sizeof(save_ksize));
+
+  std::vector<HashIntoType> kmers;
+  std::vector<BoundedCounterType> counts;
+  get_sorted(kmers, counts);
+
+  HashIntoType n_kmers = kmers.size();
+  outfile.write((const char *) &n_kmers, sizeof(n_kmers));
+
+  if (n_kmers) {
+    outfile.write((const char *) &kmers[0], n_kmers * sizeof(HashIntoType));
+    outfile.write((const char *) &counts[0],
+		  n_kmers * sizeof(BoundedCounterType));
+  }
+}
+
+void ExactCountingHash::load(std::string infilename)
+{
+  if (is_block_compressed_filename(infilename)) {
+    BlockCompressedIFStream infile(infilename);
+    assert(infile.is_open());
+
+    _load(infile);
+    infile.close();
+  } else {
+    ifstream infile(infilename.c_str(), ios::binary);
+    assert(infile.is_open());
+
+    _load(infile);
+    infile.close();
+  }
+}
+
+void ExactCountingHash::_load(std::istream &infile)
+{
+  unsigned char version, ht_type;
+  unsigned int save_ksize = 0;
+  HashIntoType n_kmers = 0;
+
+  infile.read((char *) &version, 1);
+  infile.read((char *) &ht_type, 1);
+  assert(version == SAVED_FORMAT_VERSION);
+  assert(ht_type == SAVED_EXACT_COUNTING_HT);
+
+  infile.read((char *) &save_ksize, sizeof(save_ksize));
+  infile.read((char *) &n_kmers, sizeof(n_kmers));
+
+  _ksize = (WordLength) save_ksize;
+  _init_bitstuff();
+
+  std::vector<HashIntoType> kmers(n_kmers);
+  std::vector<BoundedCounterType> counts(n_kmers);
+  if (n_kmers) {
+    infile.read((char *) &kmers[0], n_kmers * sizeof(HashIntoType));
+    infile.read((char *) &counts[0], n_kmers * sizeof(BoundedCounterType));
+  }
+
+  _table.load(n_kmers ? &kmers[0] : NULL, n_kmers ? &counts[0] : NULL,
+	      n_kmers);
+}
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,113 @@
+#ifndef EXACT_COUNTING_HH
+#define EXACT_COUNTING_HH
+
+#include <assert.h>
+#include <string>
+#include <vector>
+#include "hashtable.hh"
+#include "bigcount.hh"
+
+namespace khmer {
+
+  // Exact k-mer counts, in memory proportional to the number of distinct
+  // k-mers rather than fixed up front: no false positives, and no table
+  // size to guess.  Each count is 16 bits, and stops at MAX_BIGCOUNT.
+  //
+  // The counts are kept in a BigCountTable: counting takes the k-mer's
+  // shard's spin lock, getting a count takes no lock, and each slot costs
+  // 10 bytes.
+  //
+  // Anything that takes a Hashtable (get_median_count, trim_on_abundance,
+  // abundance_distribution, DiginormEngine, AbundanceFilterEngine, the
+  // partitioning traversals) takes one of these in place of a
+  // CountingHash.
+  class ExactCountingHash : public khmer::Hashtable {
+  protected:
+    BigCountTable _table;
+
+    // save() and load() in the uncompressed format, to or from any stream.
+    void _save(std::ostream &outfile) const;
+    void _load(std::istream &infile);
+
+  private:
+    ExactCountingHash(const ExactCountingHash &);
+    ExactCountingHash &operator=(const ExactCountingHash &);
+
+  public:
+    // expected_kmers sizes the shards up front, to save growing them.
+    ExactCountingHash(
+      WordLength	ksize,
+      HashIntoType	expected_kmers	    = 0,
+      uint32_t const	number_of_threads   =
+      get_active_config( ).get_number_of_threads( )
+    );
+
+    virtual ~ExactCountingHash();
+
+    // the number of distinct k-mers counted.
+    HashIntoType n_unique_kmers() const {
+      return _table.size();
+    }
+
+    virtual void count(const char * kmer) {
+      count(_hash(kmer, _ksize));
+    }
+
+    virtual void count(HashIntoType khash) {
+      _table.increment(khash, 1, MAX_BIGCOUNT);
+    }
+
+    virtual const BoundedCounterType get_count(const char * kmer) const {
+      return get_count(_hash(kmer, _ksize));
+    }
+
+    // Takes no lock.
+    virtual const BoundedCounterType get_count(HashIntoType khash) const {
+      return _table.get(khash);
+    }
+
+    // Prefetch the home slot of the k-mer PREFETCH_DISTANCE ahead before
+    // touching each one.
+    virtual void count_batch(const HashIntoType * khashes, unsigned int n) {
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_table.prefetch(khashes[i]);
+      }
+      for (unsigned int i = 0; i < n; i++) {
+	if (i + PREFETCH_DISTANCE < n) {
+	  _table.prefetch(khashes[i + PREFETCH_DISTANCE]);
+	}
+	count(khashes[i]);
+      }
+    }
+
+    virtual void get_count_batch(const HashIntoType * khashes, unsigned int n,
+				 BoundedCounterType * counts) const {
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_table.prefetch(khashes[i]);
+      }
+      for (unsigned int i = 0; i < n; i++) {
+	if (i + PREFETCH_DISTANCE < n) {
+	  _table.prefetch(khashes[i + PREFETCH_DISTANCE]);
+	}
+	counts[i] = get_count(khashes[i]);
+      }
+    }
+
+    // All (k-mer, count) pairs, sorted by k-mer.  Not safe to call while
+    // other threads are counting.
+    void get_sorted(std::vector<HashIntoType> &kmers,
+		    std::vector<BoundedCounterType> &counts) const {
+      _table.get_sorted(kmers, counts);
+    }
+
+    // Files ending in "." BLOCK_COMPRESSED_EXT are block-compressed.
+    // load() replaces everything, k included, and is not safe to call
+    // while other threads are using the table.
+    virtual void save(std::string);
+    virtual void load(std::string);
+  };
+};
+
+#endif // EXACT_COUNTING_HH
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,85 @@
+#ifndef FASTMOD_HH
+#define FASTMOD_HH
+
+#include <assert.h>
+#include "khmer.hh"
+
+namespace khmer {
+
+  // x % d for a divisor d that is fixed for the life of a table, without a
+  // hardware divide.  The quotient is the high half of x times a
+  // precomputed 65-bit reciprocal, shifted (Granlund & Montgomery; this is
+  // libdivide's branch-free form), so the remainder is exactly x % d for
+  // every 64-bit x: bins don't move, and saved tables load the same as
+  // before.  There are no branches, which matters when the lookups that
+  // follow miss the cache: a mispredicted branch throws away the loads
+  // already in flight.
+  class FastModulus {
+  protected:
+    HashIntoType  _divisor;
+    HashIntoType  _magic;	// low 64 bits of the reciprocal; 0 for 2**n
+    unsigned int  _shift;
+    HashIntoType  _mask;	// 0 when _divisor is 1, all ones otherwise
+
+    // x / _divisor, except when _divisor is 1.
+    inline HashIntoType _divide(HashIntoType x) const {
+      HashIntoType q = (HashIntoType) (((unsigned __int128) _magic * x) >> 64);
+      return (((x - q) >> 1) + q) >> _shift;
+    }
+
+  public:
+    FastModulus(HashIntoType divisor = 1) {
+      set_divisor(divisor);
+    }
+
+    void set_divisor(HashIntoType divisor) {
+      assert(divisor > 0);
+
+      unsigned int log2 = 63 - __builtin_clzll(divisor);
+
+      _divisor = divisor;
+      _mask = ~((HashIntoType) 0);
+
+      if (divisor == 1) {
+	// x - x * 1 is 0 whatever _divide() says; the mask makes sure.
+	_magic = 0;
+	_shift = 0;
+	_mask = 0;
+	return;
+      }
+
+      if ((divisor & (divisor - 1)) == 0) {
+	// ((x >> 1) + 0) >> (log2 - 1) is x >> log2.
+	_magic = 0;
+	_shift = log2 - 1;
+	return;
+      }
+
+      // 2**(64 + log2) / divisor fits in 64 bits, since divisor > 2**log2;
+      // double it, and round up, for the 65-bit reciprocal.
+      unsigned __int128 power = ((unsigned __int128) 1) << (64 + log2);
+      HashIntoType magic = (HashIntoType) (power / divisor);
+      HashIntoType rem = (HashIntoType) (power % divisor);
+      HashIntoType twice_rem = rem + rem;
+
+      magic += magic;
+      if (twice_rem >= divisor || twice_rem < rem) {
+	magic += 1;
+      }
+      _magic = magic + 1;
+      _shift = log2;
+    }
+
+    HashIntoType get_divisor() const {
+      return _divisor;
+    }
+
+    inline HashIntoType mod(HashIntoType x) const {
+      return (x - _divide(x) * _divisor) & _mask;
+    }
+  };
+};
+
+#endif // FASTMOD_HH
+
+// vim: set sts=2 sw=2:
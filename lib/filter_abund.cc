@@ -0,0 +1,243 @@
+#include <assert.h>
+
+#include "filter_abund.hh"
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+AbundanceFilterEngine::AbundanceFilterEngine(
+  const Hashtable &ht, BoundedCounterType cutoff,
+  uint32_t const number_of_threads, bool ordered
+) :
+  _ht(ht), _cutoff(cutoff), _number_of_threads(number_of_threads),
+  _ordered(ordered), _parser(NULL), _outfile(NULL),
+  _invalid_file_format(false), _reading_done(false), _next_to_write(0),
+  _n_reads(0), _n_kept(0), _n_bp_read(0), _n_bp_kept(0)
+{
+  assert(_number_of_threads > 0);
+  pthread_mutex_init(&_batch_lock, NULL);
+  pthread_cond_init(&_batch_ready, NULL);
+  pthread_cond_init(&_batch_taken, NULL);
+  pthread_mutex_init(&_output_lock, NULL);
+  pthread_cond_init(&_output_turn, NULL);
+}
+
+AbundanceFilterEngine::~AbundanceFilterEngine()
+{
+  pthread_cond_destroy(&_output_turn);
+  pthread_mutex_destroy(&_output_lock);
+  pthread_cond_destroy(&_batch_taken);
+  pthread_cond_destroy(&_batch_ready);
+  pthread_mutex_destroy(&_batch_lock);
+}
+
+void AbundanceFilterEngine::filter(const std::string &infilename,
+				   const std::string &outfilename)
+{
+  Config &the_config = get_active_config( );
+
+  _n_reads = _n_kept = _n_bp_read = _n_bp_kept = 0;
+  _invalid_file_format = false;
+  _reading_done = false;
+  _next_to_write = 0;
+
+  _outfile = fopen(outfilename.c_str(), "w");
+  assert(_outfile != NULL);
+
+  // in order, only the reading thread uses the parser.
+  _parser = IParser::get_parser(
+    infilename, _ordered ? 1 : _number_of_threads,
+    the_config.get_reads_input_buffer_size( ),
+    the_config.get_reads_parser_trace_level( )
+  );
+
+  // in order, the calling thread reads, as well as all of the workers.
+  run_on_threads(_run_thread, this,
+		 _ordered ? _number_of_threads + 1 : _number_of_threads);
+
+  delete _parser;
+  _parser = NULL;
+  fclose(_outfile);
+  _outfile = NULL;
+
+  if (_invalid_file_format) {
+    throw InvalidReadFileFormat();
+  }
+}
+
+void AbundanceFilterEngine::_run_thread(void * engine, uint32_t thread_n)
+{
+  AbundanceFilterEngine * me = (AbundanceFilterEngine *) engine;
+
+  if (!me->_ordered) {
+    me->_filter_reads();
+  } else if (thread_n == 0) {
+    me->_read_batches();
+  } else {
+    me->_filter_batches();
+  }
+}
+
+void AbundanceFilterEngine::_read_batches()
+{
+  uint64_t  number	= 0;
+  bool	    last	= false;
+  Read	    read;
+
+  while (!last) {
+    ReadBatch * batch = new ReadBatch;
+    batch->number = number;
+    batch->reads.reserve(FILTER_ABUND_BATCH_SIZE);
+
+    while (batch->reads.size() < FILTER_ABUND_BATCH_SIZE &&
+	   next_read_or_done(_parser, read,
+			     number == 0 && batch->reads.empty(),
+			     _invalid_file_format)) {
+      batch->reads.push_back(read);
+    }
+    last = batch->reads.size() < FILTER_ABUND_BATCH_SIZE;
+
+    if (batch->reads.empty()) {
+      delete batch;
+      break;
+    }
+    number++;
+
+    // read no more than a couple of batches ahead of the workers.
+    pthread_mutex_lock(&_batch_lock);
+    while (_batches.size() >= 2 * _number_of_threads) {
+      pthread_cond_wait(&_batch_taken, &_batch_lock);
+    }
+    _batches.push_back(batch);
+    pthread_cond_signal(&_batch_ready);
+    pthread_mutex_unlock(&_batch_lock);
+  }
+
+  pthread_mutex_lock(&_batch_lock);
+  _reading_done = true;
+  pthread_cond_broadcast(&_batch_ready);
+  pthread_mutex_unlock(&_batch_lock);
+}
+
+void AbundanceFilterEngine::_filter_batches()
+{
+  std::string	      output;
+  std::vector<HashIntoType>	  kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+  unsigned long long  n_reads	    = 0;
+  unsigned long long  n_kept	    = 0;
+  unsigned long long  n_bp_read	    = 0;
+  unsigned long long  n_bp_kept	    = 0;
+
+  while (true) {
+    pthread_mutex_lock(&_batch_lock);
+    while (_batches.empty() && !_reading_done) {
+      pthread_cond_wait(&_batch_ready, &_batch_lock);
+    }
+    if (_batches.empty()) {
+      pthread_mutex_unlock(&_batch_lock);
+      break;
+    }
+    ReadBatch * batch = _batches.front();
+    _batches.pop_front();
+    pthread_cond_signal(&_batch_taken);
+    pthread_mutex_unlock(&_batch_lock);
+
+    output.clear();
+    for (size_t i = 0; i < batch->reads.size(); i++) {
+      n_reads++;
+      n_bp_read += batch->reads[i].sequence.length();
+      _filter(batch->reads[i], output, n_kept, n_bp_kept, kmer_hashes,
+	      counts);
+    }
+
+    // the batches before this one are all with other workers, so they
+    // will get written.
+    pthread_mutex_lock(&_output_lock);
+    while (_next_to_write != batch->number) {
+      pthread_cond_wait(&_output_turn, &_output_lock);
+    }
+    fwrite(output.data(), 1, output.length(), _outfile);
+    _next_to_write++;
+    pthread_cond_broadcast(&_output_turn);
+    pthread_mutex_unlock(&_output_lock);
+
+    delete batch;
+  }
+
+  _add_counts(n_reads, n_kept, n_bp_read, n_bp_kept);
+}
+
+void AbundanceFilterEngine::_filter_reads()
+{
+  std::string	      output;
+  std::vector<HashIntoType>	  kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+  Read		      read;
+  unsigned long long  n_reads	    = 0;
+  unsigned long long  n_kept	    = 0;
+  unsigned long long  n_bp_read	    = 0;
+  unsigned long long  n_bp_kept	    = 0;
+
+  output.reserve(FILTER_ABUND_OUTPUT_BUFFER_SIZE);
+
+  while (next_read_or_done(_parser, read, n_reads == 0,
+			   _invalid_file_format)) {
+    n_reads++;
+    n_bp_read += read.sequence.length();
+    _filter(read, output, n_kept, n_bp_kept, kmer_hashes, counts);
+
+    if (output.length() >= FILTER_ABUND_OUTPUT_BUFFER_SIZE) {
+      pthread_mutex_lock(&_output_lock);
+      fwrite(output.data(), 1, output.length(), _outfile);
+      pthread_mutex_unlock(&_output_lock);
+      output.clear();
+    }
+  }
+
+  pthread_mutex_lock(&_output_lock);
+  fwrite(output.data(), 1, output.length(), _outfile);
+  pthread_mutex_unlock(&_output_lock);
+
+  _add_counts(n_reads, n_kept, n_bp_read, n_bp_kept);
+}
+
+// Trim the read at its first k-mer below the cutoff; what is left is
+// kept if it holds at least one k-mer.
+void AbundanceFilterEngine::_filter(Read &read, std::string &output,
+				    unsigned long long &n_kept,
+				    unsigned long long &n_bp_kept,
+				    std::vector<HashIntoType> &kmer_hashes,
+				    std::vector<BoundedCounterType> &counts)
+{
+  unsigned int trim_at = _ht.trim_on_abundance(read.sequence, _cutoff,
+					       kmer_hashes, counts);
+
+  if (trim_at < _ht.ksize()) {
+    return;
+  }
+
+  // only the name is written out, not the rest of the header line.
+  output += '>';
+  output.append(read.name, 0, read.name.find_first_of(" \t"));
+  output += '\n';
+  output.append(read.sequence, 0, trim_at);
+  output += '\n';
+
+  n_kept++;
+  n_bp_kept += trim_at;
+}
+
+void AbundanceFilterEngine::_add_counts(unsigned long long n_reads,
+					unsigned long long n_kept,
+					unsigned long long n_bp_read,
+					unsigned long long n_bp_kept)
+{
+  __sync_add_and_fetch(&_n_reads, n_reads);
+  __sync_add_and_fetch(&_n_kept, n_kept);
+  __sync_add_and_fetch(&_n_bp_read, n_bp_read);
+  __sync_add_and_fetch(&_n_bp_kept, n_bp_kept);
+}
+
+// vim: set sts=2 sw=2:
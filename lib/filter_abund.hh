@@ -0,0 +1,102 @@
+#ifndef FILTER_ABUND_HH
+#define FILTER_ABUND_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdio.h>
+#include <pthread.h>
+#include "khmer.hh"
+#include "khmer_config.hh"
+#include "threads.hh"
+#include "hashtable.hh"
+#include "read_parsers.hh"
+
+#   define FILTER_ABUND_BATCH_SIZE 4096 // reads handed to a thread at once
+#   define FILTER_ABUND_OUTPUT_BUFFER_SIZE (1024 * 1024) // unordered, per thread
+
+namespace khmer {
+
+  // Abundance filtering, as in scripts/filter-abund.py: each read is cut
+  // off at its first k-mer with a count below the cutoff, and written out
+  // (as FASTA) only if at least k bases are left.  The table is only read,
+  // so any number of threads can trim at once.
+  //
+  // By default the reads are written in input order.  One thread reads
+  // batches of reads from the parser and numbers them, the workers trim
+  // the batches, and each batch goes out when the one before it has.  If
+  // the order doesn't matter, every thread takes its reads straight from a
+  // multi-threaded IParser and writes out a whole buffer at a time, with
+  // no waiting on the others.
+  //
+  // The parser skips reads that contain Ns; they aren't counted either.
+  class AbundanceFilterEngine {
+  protected:
+    struct ReadBatch {
+      uint64_t			    number;
+      std::vector<read_parsers:: Read> reads;
+    };
+
+    const Hashtable &	      _ht;
+    BoundedCounterType	      _cutoff;
+    uint32_t		      _number_of_threads;
+    bool		      _ordered;
+
+    // state for the current call to filter()
+    read_parsers:: IParser *  _parser;
+    FILE *		      _outfile;
+    bool		      _invalid_file_format;
+
+    // ordered: the batches read but not yet taken by a worker, and the
+    // number of the next batch to be written.
+    std::deque<ReadBatch *>   _batches;
+    bool		      _reading_done;
+    uint64_t		      _next_to_write;
+    pthread_mutex_t	      _batch_lock;
+    pthread_cond_t	      _batch_ready;
+    pthread_cond_t	      _batch_taken;
+    pthread_mutex_t	      _output_lock;
+    pthread_cond_t	      _output_turn;
+
+    unsigned long long	      _n_reads;
+    unsigned long long	      _n_kept;
+    unsigned long long	      _n_bp_read;
+    unsigned long long	      _n_bp_kept;
+
+    static void _run_thread(void * engine, uint32_t thread_n);
+    void _read_batches();
+    void _filter_batches();
+    void _filter_reads();
+
+    void _filter(read_parsers:: Read &read, std::string &output,
+		 unsigned long long &n_kept, unsigned long long &n_bp_kept,
+		 std::vector<HashIntoType> &kmer_hashes,
+		 std::vector<BoundedCounterType> &counts);
+    void _add_counts(unsigned long long n_reads, unsigned long long n_kept,
+		     unsigned long long n_bp_read,
+		     unsigned long long n_bp_kept);
+
+  public:
+    AbundanceFilterEngine(
+      const Hashtable &ht, BoundedCounterType cutoff,
+      uint32_t const number_of_threads =
+      get_active_config( ).get_number_of_threads( ),
+      bool ordered = true
+    );
+    ~AbundanceFilterEngine();
+
+    // Trim the reads in infilename, and write the ones kept to
+    // outfilename.  The counts are for this call.
+    void filter(const std::string &infilename,
+		const std::string &outfilename);
+
+    unsigned long long get_n_reads() const { return _n_reads; }
+    unsigned long long get_n_kept() const { return _n_kept; }
+    unsigned long long get_n_bp_read() const { return _n_bp_read; }
+    unsigned long long get_n_bp_kept() const { return _n_bp_kept; }
+  };
+};
+
+#endif // FILTER_ABUND_HH
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,395 @@
+#ifndef FLAT_HASH_HH
+#define FLAT_HASH_HH
+
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace khmer {
+
+  // Compact containers for sets of tags and k-mers, and for maps from
+  // them, in place of std::set and std::map.  Those spend 40-64 bytes on
+  // each entry, in nodes scattered over the heap; these keep entries in
+  // one array.
+  //
+  // FlatSet and FlatMap are open-addressing hash tables with linear
+  // probing, for integer keys.  Each slot has a state byte -- empty,
+  // full, or deleted -- beside it, and erase() leaves a deleted slot
+  // behind, so erasing the entry an iterator is on doesn't disturb the
+  // iteration.  A FlatMap's entries are std::pair<const K, V>, as in
+  // std::map, so that a key can't be changed in place.  The table doubles when more than 3/4 of its slots are in
+  // use, which invalidates iterators, as insertion does; a table doesn't
+  // allocate until the first insertion.  Iteration is in no particular
+  // order: where order matters, copy the keys into a SortedVectorSet.
+  //
+  // SortedVectorSet is for sets built once and then only read: the keys,
+  // sorted, in a vector, searched by bisection.
+
+  // Mix the bits of a key, since k-mer hashes have most of their entropy
+  // in a few bits.  (The finalizer of MurmurHash3.)
+  inline uint64_t _flat_hash_mix(uint64_t k)
+  {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+  }
+
+  template <typename K> struct _FlatSetKey {
+    const K &operator()(const K &v) const { return v; }
+  };
+
+  template <typename K, typename V> struct _FlatMapKey {
+    const K &operator()(const std::pair<const K, V> &v) const {
+      return v.first;
+    }
+  };
+
+  // The table under FlatSet and FlatMap: slots of Value, found by the Key
+  // that KeyOf takes from them.
+  template <typename Value, typename Key, typename KeyOf>
+  class _FlatTable {
+  protected:
+    enum { EMPTY = 0, FULL = 1, DELETED = 2 };
+
+    std::vector<Value>		_slots;
+    std::vector<unsigned char>	_states;
+    size_t			_size;
+    size_t			_n_deleted;
+
+  public:
+    template <typename V, typename T>
+    class basic_iterator {
+      friend class _FlatTable;
+      template <typename V2, typename T2> friend class basic_iterator;
+
+      T *			_table;
+      size_t			_i;
+
+      void _skip() {
+	while (_i < _table->_states.size() && _table->_states[_i] != FULL) {
+	  _i++;
+	}
+      }
+
+      basic_iterator(T * table, size_t i) : _table(table), _i(i) { }
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef Value value_type;
+      typedef ptrdiff_t difference_type;
+      typedef V * pointer;
+      typedef V & reference;
+
+      basic_iterator() : _table(NULL), _i(0) { }
+
+      // an iterator converts to a const_iterator.
+      template <typename V2, typename T2>
+      basic_iterator(const basic_iterator<V2, T2> &other) :
+	_table(other._table), _i(other._i) { }
+
+      V &operator*() const { return _table->_slots[_i]; }
+      V *operator->() const { return &_table->_slots[_i]; }
+
+      basic_iterator &operator++() { _i++; _skip(); return *this; }
+      basic_iterator operator++(int) {
+	basic_iterator prev = *this;
+	++*this;
+	return prev;
+      }
+
+      template <typename V2, typename T2>
+      bool operator==(const basic_iterator<V2, T2> &other) const {
+	return _i == other._i;
+      }
+      template <typename V2, typename T2>
+      bool operator!=(const basic_iterator<V2, T2> &other) const {
+	return _i != other._i;
+      }
+    };
+
+    typedef basic_iterator<Value, _FlatTable> iterator;
+    typedef basic_iterator<const Value, const _FlatTable> const_iterator;
+    typedef Key key_type;
+    typedef Value value_type;
+    typedef size_t size_type;
+
+  protected:
+    size_t _mask() const { return _states.size() - 1; }
+
+    // Slots are overwritten by replacing their Value, rather than by
+    // assigning to it, since a FlatMap's has a const key.
+    static void _put(Value &slot, const Value &value) {
+      slot.~Value();
+      new (&slot) Value(value);
+    }
+
+    // The slot key is in, or the empty slot it would go in: the first
+    // deleted slot passed on the way there, if any.
+    size_t _probe(const Key &key, bool &found) const {
+      KeyOf key_of;
+      size_t i = _flat_hash_mix(key) & _mask();
+      size_t deleted = _states.size();
+
+      while (true) {
+	unsigned char state = _states[i];
+	if (state == EMPTY) {
+	  found = false;
+	  return deleted < _states.size() ? deleted : i;
+	}
+	if (state == FULL && key_of(_slots[i]) == key) {
+	  found = true;
+	  return i;
+	}
+	if (state == DELETED && deleted == _states.size()) {
+	  deleted = i;
+	}
+	i = (i + 1) & _mask();
+      }
+    }
+
+    size_t _find(const Key &key) const {
+      if (!_size) {
+	return _states.size();
+      }
+      bool found;
+      size_t i = _probe(key, found);
+      return found ? i : _states.size();
+    }
+
+    void _rehash(size_t capacity) {
+      std::vector<Value> slots(capacity);
+      std::vector<unsigned char> states(capacity, (unsigned char) EMPTY);
+      slots.swap(_slots);
+      states.swap(_states);
+      _n_deleted = 0;
+
+      for (size_t i = 0; i < states.size(); i++) {
+	if (states[i] == FULL) {
+	  bool found;
+	  size_t j = _probe(KeyOf()(slots[i]), found);
+	  _put(_slots[j], slots[i]);
+	  _states[j] = FULL;
+	}
+      }
+    }
+
+    // Make room for one more entry.
+    void _grow() {
+      if ((_size + _n_deleted + 1) * 4 <= _states.size() * 3) {
+	return;
+      }
+      size_t capacity = 16;
+      while ((_size + 1) * 2 > capacity) {
+	capacity *= 2;
+      }
+      _rehash(capacity);
+    }
+
+    std::pair<iterator, bool> _insert(const Value &value) {
+      _grow();
+
+      bool found;
+      size_t i = _probe(KeyOf()(value), found);
+      if (!found) {
+	if (_states[i] == DELETED) {
+	  _n_deleted--;
+	}
+	_put(_slots[i], value);
+	_states[i] = FULL;
+	_size++;
+      }
+      return std::make_pair(iterator(this, i), !found);
+    }
+
+  public:
+    _FlatTable() : _size(0), _n_deleted(0) { }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    iterator begin() {
+      iterator it(this, 0);
+      it._skip();
+      return it;
+    }
+    iterator end() { return iterator(this, _states.size()); }
+    const_iterator begin() const {
+      const_iterator it(this, 0);
+      it._skip();
+      return it;
+    }
+    const_iterator end() const { return const_iterator(this, _states.size()); }
+
+    iterator find(const Key &key) { return iterator(this, _find(key)); }
+    const_iterator find(const Key &key) const {
+      return const_iterator(this, _find(key));
+    }
+    size_t count(const Key &key) const {
+      return _find(key) != _states.size() ? 1 : 0;
+    }
+
+    void erase(iterator it) {
+      assert(_states[it._i] == FULL);
+      _states[it._i] = DELETED;
+      _put(_slots[it._i], Value());
+      _size--;
+      _n_deleted++;
+    }
+
+    size_t erase(const Key &key) {
+      size_t i = _find(key);
+      if (i == _states.size()) {
+	return 0;
+      }
+      erase(iterator(this, i));
+      return 1;
+    }
+
+    // Empty the table.  A table emptied of a few entries keeps its slots
+    // for reuse, as the BFS keepers are; one much bigger than it had to
+    // be gives them back.
+    void clear() {
+      if (_states.size() > 1024 && _size * 8 < _states.size()) {
+	std::vector<Value>().swap(_slots);
+	std::vector<unsigned char>().swap(_states);
+      } else {
+	for (size_t i = 0; i < _slots.size(); i++) {
+	  _put(_slots[i], Value());
+	}
+	std::fill(_states.begin(), _states.end(), (unsigned char) EMPTY);
+      }
+      _size = _n_deleted = 0;
+    }
+
+    // Make room for n entries without growing.
+    void reserve(size_t n) {
+      size_t capacity = 16;
+      while (n * 4 > capacity * 3) {
+	capacity *= 2;
+      }
+      if (capacity > _states.size()) {
+	_rehash(capacity);
+      }
+    }
+
+    void swap(_FlatTable &other) {
+      _slots.swap(other._slots);
+      _states.swap(other._states);
+      std::swap(_size, other._size);
+      std::swap(_n_deleted, other._n_deleted);
+    }
+
+    // the bytes the table has allocated.
+    size_t memory_used() const {
+      return _slots.capacity() * sizeof(Value) + _states.capacity();
+    }
+  };
+
+  template <typename K>
+  class FlatSet : public _FlatTable<K, K, _FlatSetKey<K> > {
+    typedef _FlatTable<K, K, _FlatSetKey<K> > Base;
+
+  public:
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+
+    FlatSet() { }
+
+    template <typename InputIterator>
+    FlatSet(InputIterator first, InputIterator last) {
+      insert(first, last);
+    }
+
+    std::pair<iterator, bool> insert(const K &key) {
+      return Base::_insert(key);
+    }
+
+    template <typename InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+      for (; first != last; ++first) {
+	Base::_insert(*first);
+      }
+    }
+  };
+
+  template <typename K, typename V>
+  class FlatMap :
+    public _FlatTable<std::pair<const K, V>, K, _FlatMapKey<K, V> > {
+    typedef _FlatTable<std::pair<const K, V>, K, _FlatMapKey<K, V> > Base;
+
+  public:
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+    typedef V mapped_type;
+
+    std::pair<iterator, bool> insert(const std::pair<const K, V> &entry) {
+      return Base::_insert(entry);
+    }
+
+    // the value for key, inserting V() first if there isn't one.
+    V &operator[](const K &key) {
+      return Base::_insert(std::make_pair(key, V())).first->second;
+    }
+  };
+
+  template <typename T>
+  class SortedVectorSet {
+  protected:
+    std::vector<T>	_items;
+
+  public:
+    typedef typename std::vector<T>::const_iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+    typedef T key_type;
+    typedef T value_type;
+
+    SortedVectorSet() { }
+
+    template <typename InputIterator>
+    SortedVectorSet(InputIterator first, InputIterator last) {
+      assign(first, last);
+    }
+
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last) {
+      _items.assign(first, last);
+      std::sort(_items.begin(), _items.end());
+      _items.erase(std::unique(_items.begin(), _items.end()), _items.end());
+    }
+
+    size_t size() const { return _items.size(); }
+    bool empty() const { return _items.empty(); }
+    void clear() { std::vector<T>().swap(_items); }
+    void swap(SortedVectorSet &other) { _items.swap(other._items); }
+
+    const_iterator begin() const { return _items.begin(); }
+    const_iterator end() const { return _items.end(); }
+
+    // the first item not less than key.
+    const_iterator lower_bound(const T &key) const {
+      return std::lower_bound(_items.begin(), _items.end(), key);
+    }
+
+    const_iterator find(const T &key) const {
+      const_iterator it = lower_bound(key);
+      return (it != _items.end() && *it == key) ? it : _items.end();
+    }
+    size_t count(const T &key) const { return find(key) != end() ? 1 : 0; }
+
+    const std::vector<T> &items() const { return _items; }
+
+    size_t memory_used() const { return _items.capacity() * sizeof(T); }
+  };
+};
+
+#endif // FLAT_HASH_HH
+
+// vim: set sts=2 sw=2:
@@ -1,7 +1,15 @@
 #include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "hashtable.hh"
 #include "hashbits.hh"
 #include "read_parsers.hh"
+#include "block_compressed.hh"
+#include "threads.hh"
 #define MAX_KEEPER_SIZE int(1e6)
 
 using namespace std;
@@ -9,56 +17,204 @@ using namespace khmer;
 
 void Hashbits::save(std::string outfilename)
 {
-  assert(_counts[0]);
+  if (is_block_compressed_filename(outfilename)) {
+    BlockCompressedOFStream outfile(outfilename);
+    assert(outfile.is_open());
+
+    _save(outfile);
+    outfile.close();
+  } else {
+    ofstream outfile(outfilename.c_str(), ios::binary);
+
+    _save(outfile);
+    outfile.close();
+  }
+}
+
+// In SAVED_PAGED_HASHBITS files, each table starts on a SAVED_PAGE_SIZE
+// boundary, so that it can be mapped in place; in SAVED_BLOCKED_HASHBITS
+// files, the one array of blocks does.
+static unsigned long long _page_padding(unsigned long long offset)
+{
+  return (SAVED_PAGE_SIZE - offset % SAVED_PAGE_SIZE) % SAVED_PAGE_SIZE;
+}
+
+static const char _zero_page[SAVED_PAGE_SIZE] = { 0 };
+
+// Read n bytes at the cursor into dest, and advance it.
+static void _read_mapped(const Byte *&cursor, const Byte * end,
+			 void * dest, size_t n)
+{
+  assert(cursor + n <= end);
+  memcpy(dest, cursor, n);
+  cursor += n;
+}
+
+void Hashbits::_save(std::ostream &outfile)
+{
+  assert(_blocked ? _blocks != NULL : _counts[0] != NULL);
 
   unsigned int save_ksize = _ksize;
   unsigned char save_n_tables = _n_tables;
   unsigned long long save_tablesize;
 
-  ofstream outfile(outfilename.c_str(), ios::binary);
-
   unsigned char version = SAVED_FORMAT_VERSION;
   outfile.write((const char *) &version, 1);
 
-  unsigned char ht_type = SAVED_HASHBITS;
+  unsigned char ht_type = SAVED_PAGED_HASHBITS;
+  if (_blocked) {
+    ht_type = SAVED_BLOCKED_HASHBITS;
+  }
   outfile.write((const char *) &ht_type, 1);
 
   outfile.write((const char *) &save_ksize, sizeof(save_ksize));
   outfile.write((const char *) &save_n_tables, sizeof(save_n_tables));
 
+  if (_blocked) {
+    unsigned long long save_n_blocks = _n_blocks;
+
+    outfile.write((const char *) &save_n_blocks, sizeof(save_n_blocks));
+    outfile.write(_zero_page, _page_padding(outfile.tellp()));
+    outfile.write((const char *) _blocks, save_n_blocks * COUNTING_BLOCK_SIZE);
+    return;
+  }
+
   for (unsigned int i = 0; i < _n_tables; i++) {
     save_tablesize = _tablesizes[i];
     unsigned long long tablebytes = save_tablesize / 8 + 1;
 
     outfile.write((const char *) &save_tablesize, sizeof(save_tablesize));
+    outfile.write(_zero_page, _page_padding(outfile.tellp()));
 
     outfile.write((const char *) _counts[i], tablebytes);
   }
-  outfile.close();
 }
 
 void Hashbits::load(std::string infilename)
 {
-  if (_counts) {
-    for (unsigned int i = 0; i < _n_tables; i++) {
-      delete _counts[i]; _counts[i] = NULL;
-    }
-    delete _counts; _counts = NULL;
+  if (is_block_compressed_filename(infilename)) {
+    BlockCompressedIFStream infile(infilename);
+    assert(infile.is_open());
+
+    _load(infile);
+    infile.close();
+  } else {
+    ifstream infile(infilename.c_str(), ios::binary);
+    assert(infile.is_open());
+
+    _load(infile);
+    infile.close();
+  }
+}
+
+void Hashbits::load(std::string infilename, bool use_mmap)
+{
+  if (!use_mmap || is_block_compressed_filename(infilename)) {
+    load(infilename);
+    return;
+  }
+
+  unsigned char header[2] = { 0, 0 };
+
+  int fd = open(infilename.c_str(), O_RDONLY);
+  assert(fd >= 0);
+
+  // SAVED_HASHBITS files don't have their tables page-aligned; read them in.
+  if (pread(fd, header, 2, 0) != 2 ||
+      (header[1] != SAVED_PAGED_HASHBITS &&
+       header[1] != SAVED_BLOCKED_HASHBITS)) {
+    close(fd);
+    load(infilename);
+    return;
   }
+
+  struct stat st;
+  int stat_rc = fstat(fd, &st);
+  assert(stat_rc == 0);
+
+  size_t length = st.st_size;
+  void * base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  assert(base != MAP_FAILED);
+
+  // graph lookups land all over the file; don't read ahead.
+  madvise(base, length, MADV_RANDOM);
+
+  _deallocate_counters();
   _tablesizes.clear();
-  
+  _mmap_base = base;
+  _mmap_length = length;
+
+  const Byte * start = (const Byte *) base;
+  const Byte * end = start + length;
+  const Byte * cursor = start;
+
   unsigned int save_ksize = 0;
   unsigned char save_n_tables = 0;
   unsigned long long save_tablesize = 0;
   unsigned char version, ht_type;
 
-  ifstream infile(infilename.c_str(), ios::binary);
-  assert(infile.is_open());
+  _read_mapped(cursor, end, &version, 1);
+  _read_mapped(cursor, end, &ht_type, 1);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
+
+  _read_mapped(cursor, end, &save_ksize, sizeof(save_ksize));
+  _read_mapped(cursor, end, &save_n_tables, sizeof(save_n_tables));
+
+  _ksize = (WordLength) save_ksize;
+  _n_tables = (unsigned int) save_n_tables;
+  _init_bitstuff();
+
+  _blocked = (ht_type == SAVED_BLOCKED_HASHBITS);
+  if (_blocked) {
+    unsigned long long save_n_blocks = 0;
+    _read_mapped(cursor, end, &save_n_blocks, sizeof(save_n_blocks));
+    cursor += _page_padding(cursor - start);
+
+    unsigned long long blockbytes = save_n_blocks * COUNTING_BLOCK_SIZE;
+    assert(cursor + blockbytes <= end);
+
+    _allocate_blocks((HashIntoType) save_n_blocks, (Byte *) cursor);
+    return;
+  }
+
+  _counts = new Byte*[_n_tables];
+  for (unsigned int i = 0; i < _n_tables; i++) {
+    HashIntoType tablesize;
+    unsigned long long tablebytes;
+
+    _read_mapped(cursor, end, &save_tablesize, sizeof(save_tablesize));
+    cursor += _page_padding(cursor - start);
+
+    tablesize = (HashIntoType) save_tablesize;
+    _tablesizes.push_back(tablesize);
+
+    tablebytes = tablesize / 8 + 1;
+    assert(cursor + tablebytes <= end);
+
+    _counts[i] = (Byte *) cursor;
+    cursor += tablebytes;
+  }
+  _init_moduli();
+}
+
+void Hashbits::_load(std::istream &infile)
+{
+  _deallocate_counters();
+  _tablesizes.clear();
+  
+  unsigned int save_ksize = 0;
+  unsigned char save_n_tables = 0;
+  unsigned long long save_tablesize = 0;
+  unsigned char version, ht_type;
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
-  assert(ht_type == SAVED_HASHBITS);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
+  assert(ht_type == SAVED_HASHBITS || ht_type == SAVED_PAGED_HASHBITS ||
+	 ht_type == SAVED_BLOCKED_HASHBITS);
 
   infile.read((char *) &save_ksize, sizeof(save_ksize));
   infile.read((char *) &save_n_tables, sizeof(save_n_tables));
@@ -67,31 +223,93 @@ void Hashbits::load(std::string infilename)
   _n_tables = (unsigned int) save_n_tables;
   _init_bitstuff();
 
+  _blocked = (ht_type == SAVED_BLOCKED_HASHBITS);
+  if (_blocked) {
+    unsigned long long save_n_blocks = 0;
+    infile.read((char *) &save_n_blocks, sizeof(save_n_blocks));
+    infile.seekg(_page_padding(infile.tellg()), ios::cur);
+
+    _allocate_blocks((HashIntoType) save_n_blocks);
+
+    unsigned long long blockbytes = save_n_blocks * COUNTING_BLOCK_SIZE;
+    unsigned long long loaded = 0;
+    while (loaded != blockbytes) {
+      infile.read((char *) _blocks + loaded, blockbytes - loaded);
+      loaded += infile.gcount();
+    }
+    return;
+  }
+
   _counts = new Byte*[_n_tables];
   for (unsigned int i = 0; i < _n_tables; i++) {
     HashIntoType tablesize;
     unsigned long long tablebytes;
 
     infile.read((char *) &save_tablesize, sizeof(save_tablesize));
+    if (ht_type == SAVED_PAGED_HASHBITS) {
+      infile.seekg(_page_padding(infile.tellg()), ios::cur);
+    }
 
     tablesize = (HashIntoType) save_tablesize;
     _tablesizes.push_back(tablesize);
 
     tablebytes = tablesize / 8 + 1;
-    _counts[i] = new Byte[tablebytes];
+    _counts[i] = allocate_table(tablebytes);
 
     unsigned long long loaded = 0;
     while (loaded != tablebytes) {
-      infile.read((char *) _counts[i], tablebytes - loaded);
+      infile.read((char *) _counts[i] + loaded, tablebytes - loaded);
       loaded += infile.gcount();	// do I need to do this loop?
     }
   }
-  infile.close();
+  _init_moduli();
 }
 
 //////////////////////////////////////////////////////////////////////
 // graph stuff
 
+// Visits the k-mers connected to a start, for calc_connected_graph_size().
+struct ConnectedSizeVisitor : public TraversalVisitor {
+  const Hashbits &ht;
+  SeenSet * keeper;
+  unsigned long long &count;
+  const unsigned long long threshold;
+  const bool break_on_circum;
+
+  ConnectedSizeVisitor(const Hashbits &ht_, SeenSet * keeper_,
+		       unsigned long long &count_,
+		       unsigned long long threshold_, bool break_on_circum_) :
+    ht(ht_), keeper(keeper_), count(count_), threshold(threshold_),
+    break_on_circum(break_on_circum_) { }
+
+  bool enter(HashIntoType kmer, unsigned int breadth) {
+    return !(keeper && set_contains(*keeper, kmer)) &&
+      !set_contains(ht.stop_tags, kmer);
+  }
+
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
+    if (keeper) {
+      keeper->insert(kmer);
+    }
+
+    // is this a high-circumference k-mer? if so, don't count it, and
+    // don't go through it.
+    if (break_on_circum && ht.kmer_degree(kmer_f, kmer_r) > 4) {
+      return TRAVERSE_DONT_EXPAND;
+    }
+
+    count += 1;
+
+    // are we at the threshold? truncate search.
+    if (threshold && count >= threshold) {
+      return TRAVERSE_STOP;
+    }
+    return TRAVERSE_EXPAND;
+  }
+};
+
 void Hashbits::calc_connected_graph_size(const HashIntoType kmer_f,
 					 const HashIntoType kmer_r,
 					 unsigned long long& count,
@@ -100,80 +318,29 @@ void Hashbits::calc_connected_graph_size(const HashIntoType kmer_f,
 					 bool break_on_circum)
 const
 {
-  HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-  const BoundedCounterType val = get_count(kmer);
-
-  if (val == 0) {
-    return;
-  }
-
-  // have we already seen me? don't count; exit.
-  if (set_contains(keeper, kmer)) {
-    return;
-  }
-
-  // is this in stop_tags?
-  if (set_contains(stop_tags, kmer)) {
-    return;
-  }
-
-  // keep track of both seen kmers, and counts.
-  keeper.insert(kmer);
-
-  // is this a high-circumference k-mer? if so, don't count it; get outta here!
-  if (break_on_circum && \
-      kmer_degree(kmer_f, kmer_r) > 4) {
+  if (get_count(uniqify_rc(kmer_f, kmer_r)) == 0) {
     return;
   }
 
-  count += 1;
+  ConnectedSizeVisitor visitor(*this, &keeper, count, threshold,
+			       break_on_circum);
+  traverse_breadth_first(kmer_f, kmer_r, visitor);
+}
 
-  // are we past the threshold? truncate search.
-  if (threshold && count >= threshold) {
+void Hashbits::calc_connected_graph_size(const HashIntoType kmer_f,
+					 const HashIntoType kmer_r,
+					 unsigned long long& count,
+					 const unsigned long long threshold,
+					 bool break_on_circum)
+const
+{
+  if (get_count(uniqify_rc(kmer_f, kmer_r)) == 0) {
     return;
   }
 
-  // otherwise, explore in all directions.
-
-  // NEXT.
-
-  HashIntoType f, r;
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-
-  f = next_f(kmer_f, 'A');
-  r = next_r(kmer_r, 'A');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'C');
-  r = next_r(kmer_r, 'C');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'G');
-  r = next_r(kmer_r, 'G');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  f = next_f(kmer_f, 'T');
-  r = next_r(kmer_r, 'T');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  // PREVIOUS.
-
-  
-  r = prev_r(kmer_r, 'A');
-  f = prev_f(kmer_f, 'A');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'C');
-  f = prev_f(kmer_f, 'C');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'G');
-  f = prev_f(kmer_f, 'G');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
-
-  r = prev_r(kmer_r, 'T');
-  f = prev_f(kmer_f, 'T');
-  calc_connected_graph_size(f, r, count, keeper, threshold, break_on_circum);
+  ConnectedSizeVisitor visitor(*this, NULL, count, threshold,
+			       break_on_circum);
+  traverse_breadth_first(kmer_f, kmer_r, visitor);
 }
 
 void Hashbits::save_tagset(std::string outfilename)
@@ -194,11 +361,9 @@ void Hashbits::save_tagset(std::string outfilename)
   outfile.write((const char *) &tagset_size, sizeof(tagset_size));
   outfile.write((const char *) &_tag_density, sizeof(_tag_density));
 
-  unsigned int i = 0;
-  for (SeenSet::iterator pi = all_tags.begin(); pi != all_tags.end();
-	 pi++, i++) {
-    buf[i] = *pi;
-  }
+  // in order, so that the same tags always make the same file.
+  const SortedSeenSet &tags = get_sorted_tags();
+  std::copy(tags.begin(), tags.end(), buf);
 
   outfile.write((const char *) buf, sizeof(HashIntoType) * tagset_size);
   outfile.close();
@@ -208,21 +373,70 @@ void Hashbits::save_tagset(std::string outfilename)
 
 void Hashbits::load_tagset(std::string infilename, bool clear_tags)
 {
-  ifstream infile(infilename.c_str(), ios::binary);
-  assert(infile.is_open());
+  load_tagset(infilename, clear_tags, false);
+}
 
+void Hashbits::load_tagset(std::string infilename, bool clear_tags,
+			   bool use_mmap)
+{
   if (clear_tags) {
     all_tags.clear();
   }
+  _tags_changed();
 
   unsigned char version, ht_type;
   unsigned int save_ksize = 0;
 
   unsigned int tagset_size = 0;
 
+  if (use_mmap) {
+    int fd = open(infilename.c_str(), O_RDONLY);
+    assert(fd >= 0);
+
+    struct stat st;
+    int stat_rc = fstat(fd, &st);
+    assert(stat_rc == 0);
+
+    size_t length = st.st_size;
+    void * base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(base != MAP_FAILED);
+
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    const Byte * cursor = (const Byte *) base;
+    const Byte * end = cursor + length;
+
+    _read_mapped(cursor, end, &version, 1);
+    _read_mapped(cursor, end, &ht_type, 1);
+    assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	   version <= SAVED_FORMAT_VERSION);
+    assert(ht_type == SAVED_TAGS);
+
+    _read_mapped(cursor, end, &save_ksize, sizeof(save_ksize));
+    assert(save_ksize == _ksize);
+
+    _read_mapped(cursor, end, &tagset_size, sizeof(tagset_size));
+    _read_mapped(cursor, end, &_tag_density, sizeof(_tag_density));
+
+    all_tags.reserve(all_tags.size() + tagset_size);
+    for (unsigned int i = 0; i < tagset_size; i++) {
+      HashIntoType tag;
+      _read_mapped(cursor, end, &tag, sizeof(tag));
+      all_tags.insert(tag);
+    }
+
+    munmap(base, length);
+    return;
+  }
+
+  ifstream infile(infilename.c_str(), ios::binary);
+  assert(infile.is_open());
+
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_TAGS);
   
   infile.read((char *) &save_ksize, sizeof(save_ksize));
@@ -235,6 +449,7 @@ void Hashbits::load_tagset(std::string infilename, bool clear_tags)
 
   infile.read((char *) buf, sizeof(HashIntoType) * tagset_size);
 
+  all_tags.reserve(all_tags.size() + tagset_size);
   for (unsigned int i = 0; i < tagset_size; i++) {
     all_tags.insert(buf[i]);
   }
@@ -294,112 +509,214 @@ const
 //     so often.
 //
 
-void Hashbits::consume_fasta_and_tag(const std::string &filename,
-				      unsigned int &total_reads,
-				      unsigned long long &n_consumed,
-				      CallbackFn callback,
-				      void * callback_data)
+// Shared by the threads of one call to consume_fasta_and_tag.
+struct TaggingPass {
+  Hashbits *				ht;
+  read_parsers:: IParser *		parser;
+  unsigned int *			total_reads;
+  unsigned long long *			n_consumed;
+  CallbackFn				callback;
+  void *				callback_data;
+  volatile bool				aborted;
+  std::vector<SeenSet>			pending_tags;	// one per thread
+};
+
+static void _drain(read_parsers:: IParser * parser)
 {
   using namespace khmer:: read_parsers;
 
-  total_reads = 0;
-  n_consumed = 0;
+  while (!parser->is_complete()) {
+    try {
+      parser->get_next_read();
+    } catch (NoMoreReadsAvailable &exc) {
+      break;
+    }
+  }
+}
 
-  unsigned int total_reads_TL = 0;
+static void _consume_and_tag_reads(TaggingPass &pass, uint32_t thread_n,
+				   CallbackFn callback, void * callback_data)
+{
+  using namespace khmer:: read_parsers;
 
-  IParser *		    parser  = IParser::get_parser(filename.c_str());
   Read read;
+  SeenSet &pending_tags = pass.pending_tags[thread_n];
 
-  string seq = "";
+  while (!pass.parser->is_complete() && !pass.aborted) {
+    try {
+      read = pass.parser->get_next_read();
+    } catch (NoMoreReadsAvailable &exc) {
+      break;
+    }
 
-  //
-  // iterate through the FASTA file & consume the reads.
-  //
+    if (pass.ht->check_and_normalize_read(read.sequence)) {
+      pass.ht->consume_sequence_and_tag(read.sequence, *pass.n_consumed,
+					NULL, &pending_tags);
+    }
 
-  while(!parser->is_complete())  {
-    read = parser->get_next_read();
-    seq = read.sequence;
+    unsigned int total_reads_TL = __sync_add_and_fetch( pass.total_reads, 1 );
 
-    // n_consumed += this_n_consumed;
+    // run callback, if specified
+    if (total_reads_TL % CALLBACK_PERIOD == 0 && callback) {
+      callback("consume_fasta_and_tag", callback_data, total_reads_TL,
+	       *pass.n_consumed);
+    }
+  }
 
-      if (check_and_normalize_read(seq)) {	// process?
-	// TODO? Place spinlock here.
-	consume_sequence_and_tag(seq, n_consumed);
-      }
+  // the others need this thread to take its share of the rest.
+  if (pass.aborted) {
+    _drain(pass.parser);
+  }
+}
 
-      // reset the sequence info, increment read number
-      total_reads_TL = __sync_add_and_fetch( &total_reads, 1 );
+// Only the calling thread calls back.
+static void _consume_and_tag_thread(void * arg, uint32_t thread_n)
+{
+  TaggingPass &pass = *(TaggingPass *) arg;
 
-      // run callback, if specified
-      if (total_reads_TL % CALLBACK_PERIOD == 0 && callback) {
-	std::cout << "n tags: " << all_tags.size() << "\n";
-	try {
-	  callback("consume_fasta_and_tag", callback_data, total_reads_TL,
-		   n_consumed);
-	} catch (...) {
-	  delete parser;
-	  throw;
-	}
-      }
+  if (thread_n == 0) {
+    _consume_and_tag_reads(pass, thread_n, pass.callback, pass.callback_data);
+  } else {
+    _consume_and_tag_reads(pass, thread_n, NULL, NULL);
+  }
+}
 
-  } // while reads left for parser
+static void _abort_tagging(void * arg)
+{
+  TaggingPass &pass = *(TaggingPass *) arg;
 
-  delete parser;
+  pass.aborted = true;
+  _drain(pass.parser);
+}
 
+void Hashbits::consume_fasta_and_tag(const std::string &filename,
+				      unsigned int &total_reads,
+				      unsigned long long &n_consumed,
+				      CallbackFn callback,
+				      void * callback_data,
+				      uint32_t number_of_threads)
+{
+  using namespace khmer:: read_parsers;
+
+  assert(number_of_threads > 0);
+  Config &the_config = get_active_config( );
+
+  total_reads = 0;
+  n_consumed = 0;
+
+  TaggingPass pass;
+  pass.ht = this;
+  pass.parser = IParser::get_parser(
+    filename, number_of_threads, the_config.get_reads_input_buffer_size( ),
+    the_config.get_reads_parser_trace_level( )
+  );
+  pass.total_reads = &total_reads;
+  pass.n_consumed = &n_consumed;
+  pass.callback = callback;
+  pass.callback_data = callback_data;
+  pass.aborted = false;
+  pass.pending_tags.resize(number_of_threads);
+
+  try {
+    run_on_threads(_consume_and_tag_thread, &pass, number_of_threads,
+		   _abort_tagging);
+  } catch (...) {
+    delete pass.parser;
+    throw;
+  }
+  delete pass.parser;
+
+  // each thread kept its new tags to itself; add them all at once.
+  pthread_rwlock_wrlock(&_all_tags_lock);
+  for (uint32_t i = 0; i < number_of_threads; i++) {
+    all_tags.insert(pass.pending_tags[i].begin(), pass.pending_tags[i].end());
+  }
+  _tags_changed();
+  pthread_rwlock_unlock(&_all_tags_lock);
 }
 
 void Hashbits::consume_sequence_and_tag(const std::string& seq,
 					unsigned long long& n_consumed,
-					SeenSet * found_tags)
+					SeenSet * found_tags,
+					SeenSet * pending_tags)
 {
-  bool is_new_kmer;
-
+  std::vector<HashIntoType> kmer_hashes;
   KMerIterator kmers(seq.c_str(), _ksize);
   HashIntoType kmer;
 
+  while(!kmers.done()) {
+    kmer_hashes.push_back(kmers.next());
+  }
+  if (kmer_hashes.empty()) {
+    return;
+  }
+
   unsigned int since = _tag_density / 2 + 1;
+  unsigned int n_kmers = kmer_hashes.size();
+  std::vector<bool> is_new_kmer(n_kmers);
 
-  while(!kmers.done()) {
-    kmer = kmers.next();
+  // as in count_batch: prefetch the bins PREFETCH_DISTANCE k-mers ahead.
+  const unsigned int ring = 2 * PREFETCH_DISTANCE;
+  std::vector<HashIntoType> bins(ring * _n_tables);
 
-    // Set the bits for the kmer in the various hashtables,
-    // and report on whether or not they had already been set.
-    // This is probably better than first testing and then setting the bits, 
-    // as a failed test essentially results in doing the same amount of work 
-    // twice. This way is also easier to add thread safety at an atomic level.
-#if (1)
-    if ((is_new_kmer = test_and_set_bits( kmer )))
-      __sync_add_and_fetch( &n_consumed, 1 );
-#else
-    is_new_kmer = (bool) !get_count(kmer);
-    if (is_new_kmer) {
-      count(kmer);
-      n_consumed++;
+  for (unsigned int i = 0; i < n_kmers && i < PREFETCH_DISTANCE; i++) {
+    _prefetch_bins(kmer_hashes[i], &bins[i * _n_tables]);
+  }
+
+  // Set the bits for each k-mer in the various hashtables, and note
+  // whether or not they had already been set.  Setting them is atomic,
+  // and needs no lock.
+  for (unsigned int i = 0; i < n_kmers; i++) {
+    unsigned int ahead = i + PREFETCH_DISTANCE;
+    if (ahead < n_kmers) {
+      _prefetch_bins(kmer_hashes[ahead], &bins[(ahead % ring) * _n_tables]);
     }
-#endif
 
-    // TODO? Place spinlock here.
-    {
-      if (!is_new_kmer && set_contains(all_tags, kmer)) {
-	since = 1;
-	if (found_tags) { found_tags->insert(kmer); }
-      } else {
-	since++;
-      }
+    if ((is_new_kmer[i] = _test_and_set_bits( kmer_hashes[i],
+					      &bins[(i % ring) * _n_tables] )))
+      __sync_add_and_fetch( &n_consumed, 1 );
+  }
 
-      if (since >= _tag_density) {
-	all_tags.insert(kmer);
-	if (found_tags) { found_tags->insert(kmer); }
-	since = 1;
-      }
-    } // critical section
+  // Then pick the tags, under the read lock: the k-mers already tagged,
+  // and one at least every _tag_density k-mers.  The new ones go in
+  // together afterwards, or into pending_tags.
+  std::vector<HashIntoType> new_tags;
+
+  pthread_rwlock_rdlock(&_all_tags_lock);
+  for (unsigned int i = 0; i < n_kmers; i++) {
+    kmer = kmer_hashes[i];
+
+    if (!is_new_kmer[i] &&
+	(set_contains(all_tags, kmer) ||
+	 (pending_tags && set_contains(*pending_tags, kmer)) ||
+	 std::find(new_tags.begin(), new_tags.end(), kmer) != new_tags.end())) {
+      since = 1;
+      if (found_tags) { found_tags->insert(kmer); }
+    } else {
+      since++;
+    }
+
+    if (since >= _tag_density) {
+      new_tags.push_back(kmer);
+      if (found_tags) { found_tags->insert(kmer); }
+      since = 1;
+    }
   } // iteration over kmers
+  pthread_rwlock_unlock(&_all_tags_lock);
 
-  // TODO? Place spinlock here.
   if (since >= _tag_density/2 - 1) {
-    all_tags.insert(kmer);	// insert the last k-mer, too.
+    new_tags.push_back(kmer);	// insert the last k-mer, too.
     if (found_tags) { found_tags->insert(kmer); }
   }
+
+  if (pending_tags) {
+    pending_tags->insert(new_tags.begin(), new_tags.end());
+  } else if (!new_tags.empty()) {
+    pthread_rwlock_wrlock(&_all_tags_lock);
+    all_tags.insert(new_tags.begin(), new_tags.end());
+    _tags_changed();
+    pthread_rwlock_unlock(&_all_tags_lock);
+  }
 }
 
 //
@@ -465,6 +782,7 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
 
 	  if (since >= _tag_density) {
 	    all_tags.insert(kmer);
+	    _tags_changed();
 	    read_tags.insert(kmer);
 	    since = 1;
 	  }
@@ -473,6 +791,7 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
 	  if (!is_first_kmer && read_tags.size() == 0) {
 	    read_tags.insert(last_kmer);
 	    all_tags.insert(last_kmer);
+	    _tags_changed();
 	  }
 	  
 	  since = _tag_density - 1; // insert next kmer, too.
@@ -491,6 +810,7 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
 
 	if (since >= _tag_density/2 - 1) {
 	  all_tags.insert(kmer);	// insert the last k-mer, too.
+	  _tags_changed();
 	  read_tags.insert(kmer);
 	}
       }
@@ -518,20 +838,33 @@ void Hashbits::consume_fasta_and_tag_with_stoptags(const std::string &filename,
   delete parser;
 }
 
+const SortedSeenSet& Hashbits::get_sorted_tags()
+{
+  pthread_mutex_lock(&_sorted_tags_lock);
+  if (!_sorted_tags_valid) {
+    _sorted_tags.assign(all_tags.begin(), all_tags.end());
+    _sorted_tags_valid = true;
+  }
+  pthread_mutex_unlock(&_sorted_tags_lock);
+
+  return _sorted_tags;
+}
+
 //
 // divide_tags_into_subsets - take all of the tags in 'all_tags', and
 //   divide them into subsets (based on starting tag) of <= given size.
 //
 
 void Hashbits::divide_tags_into_subsets(unsigned int subset_size,
-					 SeenSet& divvy)
+					 std::vector<HashIntoType>& divvy)
 {
   unsigned int i = 0;
+  const SortedSeenSet &tags = get_sorted_tags();
 
-  for (SeenSet::const_iterator si = all_tags.begin(); si != all_tags.end();
+  for (SortedSeenSet::const_iterator si = tags.begin(); si != tags.end();
        si++) {
     if (i % subset_size == 0) {
-      divvy.insert(*si);
+      divvy.push_back(*si);
       i = 0;
     }
     i++;
@@ -600,6 +933,7 @@ void Hashbits::consume_partitioned_fasta(const std::string &filename,
       // Next, compute the tag & set the partition, if nonzero
       HashIntoType kmer = _hash(seq.c_str(), _ksize);
       all_tags.insert(kmer);
+      _tags_changed();
       if (p > 0) {
 	partition->set_partition_id(kmer, p);
       }
@@ -685,6 +1019,35 @@ void Hashbits::filter_if_present(const std::string infilename,
 }
 
 
+// Counts the k-mers within radius of a start, for
+// count_kmers_within_radius().
+struct WithinRadiusVisitor : public TraversalVisitor {
+  const unsigned int radius;
+  const unsigned int max_count;
+  const SeenSet * seen;
+
+  WithinRadiusVisitor(unsigned int radius_, unsigned int max_count_,
+		      const SeenSet * seen_) :
+    radius(radius_), max_count(max_count_), seen(seen_) { }
+
+  bool stop(unsigned int breadth, size_t n_visited) {
+    return breadth > radius;
+  }
+
+  bool enter(HashIntoType kmer, unsigned int breadth) {
+    return !(seen && set_contains(*seen, kmer));
+  }
+
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
+    if (max_count && n_visited > max_count) {
+      return TRAVERSE_STOP;
+    }
+    return TRAVERSE_EXPAND;
+  }
+};
+
 unsigned int Hashbits::count_kmers_within_radius(HashIntoType kmer_f,
 						 HashIntoType kmer_r,
 						 unsigned int radius,
@@ -692,117 +1055,40 @@ unsigned int Hashbits::count_kmers_within_radius(HashIntoType kmer_f,
 						 const SeenSet * seen)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
-  unsigned int cur_breadth = 0;
-  unsigned int breadth = 0;
-
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-  unsigned int total = 0;
-
-  SeenSet keeper;		// keep track of traversed kmers
-  if (seen) { keeper = *seen; }
-
-  // start breadth-first search.
-
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
-
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
-
-    if (breadth > radius) {
-      break;
-    }
-
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
-      continue;
-    }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
-    total++;
-
-    if (max_count && total > max_count) {
-      break;
-    }
-
-    assert(breadth >= cur_breadth); // keep track of watermark, for debugging.
-    if (breadth > cur_breadth) { cur_breadth = breadth; }
-
-    //
-    // Enqueue next set of nodes.
-    //
-
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  WithinRadiusVisitor visitor(radius, max_count, seen);
+  return traverse_breadth_first(kmer_f, kmer_r, visitor);
+}
 
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+// Counts the k-mers fewer than depth steps from a start, and not seen
+// before, for count_kmers_within_depth().
+struct WithinDepthVisitor : public TraversalVisitor {
+  const unsigned int depth;
+  const unsigned int max_count;
+  SeenSet * seen;
 
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  WithinDepthVisitor(unsigned int depth_, unsigned int max_count_,
+		     SeenSet * seen_) :
+    depth(depth_), max_count(max_count_), seen(seen_) { }
 
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  bool stop(unsigned int breadth, size_t n_visited) {
+    return breadth >= depth;
+  }
 
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  // the start counts, seen or not.
+  bool enter(HashIntoType kmer, unsigned int breadth) {
+    return breadth == 0 || !set_contains(*seen, kmer);
+  }
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f, r))){
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
+    seen->insert(kmer);
+    if (n_visited >= max_count) {
+      return TRAVERSE_STOP;
     }
+    return TRAVERSE_EXPAND;
   }
-
-  return total;
-}
+};
 
 unsigned int Hashbits::count_kmers_within_depth(HashIntoType kmer_f,
 						HashIntoType kmer_r,
@@ -811,90 +1097,43 @@ unsigned int Hashbits::count_kmers_within_depth(HashIntoType kmer_f,
 						SeenSet * seen)
 const
 {
-  HashIntoType f, r;
-  unsigned int count = 1;
-
-  if (depth == 0) { return 0; }
-
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-
-  seen->insert(uniqify_rc(kmer_f, kmer_r));
-
-  // NEXT.
-  f = next_f(kmer_f, 'A');
-  r = next_r(kmer_r, 'A');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth - 1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-  }
-
-  f = next_f(kmer_f, 'C');
-  r = next_r(kmer_r, 'C');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
+  WithinDepthVisitor visitor(depth, max_count, seen);
+  return traverse_breadth_first(kmer_f, kmer_r, visitor);
+}
 
-  f = next_f(kmer_f, 'G');
-  r = next_r(kmer_r, 'G');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
+// Finds how far from a start max_count k-mers are, for
+// find_radius_for_volume().
+struct RadiusForVolumeVisitor : public TraversalVisitor {
+  const unsigned int max_count;
+  const unsigned int max_radius;
+  unsigned int breadth;		// of the last node taken off the queue
 
-  f = next_f(kmer_f, 'T');
-  r = next_r(kmer_r, 'T');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
+  RadiusForVolumeVisitor(unsigned int max_count_, unsigned int max_radius_) :
+    max_count(max_count_), max_radius(max_radius_), breadth(0) { }
 
-  // PREVIOUS.
-  r = prev_r(kmer_r, 'A');
-  f = prev_f(kmer_f, 'A');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
+  bool stop(unsigned int breadth_, size_t n_visited) {
+    breadth = breadth_;
+    return false;
   }
 
-  r = prev_r(kmer_r, 'C');
-  f = prev_f(kmer_f, 'C');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
-  }
-    
-  r = prev_r(kmer_r, 'G');
-  f = prev_f(kmer_f, 'G');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth_, size_t n_visited) {
+    if (n_visited >= max_count || breadth_ >= max_radius) {
+      return TRAVERSE_STOP;
+    }
+    return TRAVERSE_EXPAND;
   }
 
-  r = prev_r(kmer_r, 'T');
-  f = prev_f(kmer_f, 'T');
-  if (get_count(uniqify_rc(f,r)) && !set_contains(*seen, uniqify_rc(f, r))) {
-    count += count_kmers_within_depth(f, r, depth -1, max_count - count,
-				      seen);
-    if (count >= max_count) { return count; }
-    ;
+  // ran out of graph first: the volume is beyond any radius.
+  bool expanded(bool queue_empty) {
+    if (queue_empty) {
+      breadth = max_radius;
+      return false;
+    }
+    return true;
   }
-
-  return count;
-}
+};
 
 unsigned int Hashbits::find_radius_for_volume(HashIntoType kmer_f,
 					      HashIntoType kmer_r,
@@ -902,113 +1141,37 @@ unsigned int Hashbits::find_radius_for_volume(HashIntoType kmer_f,
 					      unsigned int max_radius)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
-  unsigned int breadth = 0;
-
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-  unsigned int total = 0;
-
-  SeenSet keeper;		// keep track of traversed kmers
-
-  // start breadth-first search.
-
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
-
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
-
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
-      continue;
-    }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
-    total++;
-
-    if (total >= max_count || breadth >= max_radius) {
-      break;
-    }
-
-    //
-    // Enqueue next set of nodes.
-    //
-
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  RadiusForVolumeVisitor visitor(max_count, max_radius);
+  traverse_breadth_first(kmer_f, kmer_r, visitor);
+  return visitor.breadth;
+}
 
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+// Counts the k-mers exactly radius from a start, for
+// count_kmers_on_radius().
+struct OnRadiusVisitor : public TraversalVisitor {
+  const unsigned int radius;
+  const unsigned int max_volume;
+  unsigned int count;
 
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  OnRadiusVisitor(unsigned int radius_, unsigned int max_volume_) :
+    radius(radius_), max_volume(max_volume_), count(0) { }
 
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
+  bool stop(unsigned int breadth, size_t n_visited) {
+    return breadth > radius;
+  }
 
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
+    if (breadth == radius) {
+      count++;
     }
-
-    if (node_q.empty()) {
-      breadth = max_radius;
-      break;
+    if (max_volume && n_visited > max_volume) {
+      return TRAVERSE_STOP;
     }
+    return TRAVERSE_EXPAND;
   }
-
-  return breadth;
-}
+};
 
 unsigned int Hashbits::count_kmers_on_radius(HashIntoType kmer_f,
 					     HashIntoType kmer_r,
@@ -1016,120 +1179,9 @@ unsigned int Hashbits::count_kmers_on_radius(HashIntoType kmer_f,
 					     unsigned int max_volume)
 const
 {
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
-  unsigned int cur_breadth = 0;
-  unsigned int breadth = 0;
-  unsigned int count = 0;
-
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-  unsigned int total = 0;
-
-  SeenSet keeper;		// keep track of traversed kmers
-
-  // start breadth-first search.
-
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
-
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
-
-    if (breadth > radius) {
-      break;
-    }
-
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
-      continue;
-    }
-
-    if (breadth == radius) {
-      count++;
-    }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
-    total++;
-
-    if (max_volume && total > max_volume) {
-      break;
-    }
-
-    assert(breadth >= cur_breadth); // keep track of watermark, for debugging.
-    if (breadth > cur_breadth) { cur_breadth = breadth; }
-
-    //
-    // Enqueue next set of nodes.
-    //
-
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-  }
-
-  return count;
+  OnRadiusVisitor visitor(radius, max_volume);
+  traverse_breadth_first(kmer_f, kmer_r, visitor);
+  return visitor.count;
 }
 
 unsigned int Hashbits::trim_on_degree(std::string seq, unsigned int max_degree)
@@ -1253,7 +1305,7 @@ unsigned int Hashbits::trim_on_stoptags(std::string seq) const
 void Hashbits::traverse_from_tags(unsigned int distance,
 				  unsigned int threshold,
 				  unsigned int frequency,
-				  CountingHash &counting)
+				  Hashtable &counting)
 {
   unsigned int i = 0;
   unsigned int n = 0;
@@ -1297,140 +1349,48 @@ void Hashbits::traverse_from_tags(unsigned int distance,
   }
 }
 
-unsigned int Hashbits::traverse_from_kmer(HashIntoType start,
-					  unsigned int radius,
-					  SeenSet &keeper)
-const
-{
-  std::string kmer_s = _revhash(start, _ksize);
-  HashIntoType kmer, kmer_f, kmer_r;
-  kmer = _hash(kmer_s.c_str(), _ksize, kmer_f, kmer_r);
-
-  HashIntoType f, r;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
-  unsigned int cur_breadth = 0;
-  unsigned int breadth = 0;
-  bool is_first_kmer = true;
-
-  const unsigned int rc_left_shift = _ksize*2 - 2;
-  unsigned int total = 0;
-
-  // start breadth-first search.
+// Collects the k-mers within radius of a start, short of the stop tags,
+// for traverse_from_kmer().
+struct KeeperVisitor : public TraversalVisitor {
+  const Hashbits &ht;
+  const unsigned int radius;
+  SeenSet &keeper;
 
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
+  KeeperVisitor(const Hashbits &ht_, unsigned int radius_,
+		SeenSet &keeper_) :
+    ht(ht_), radius(radius_), keeper(keeper_) { }
 
-  while(!node_q.empty()) {
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
-
-    if (breadth > radius) {
-      break;
-    }
-
-    if (total > MAX_KEEPER_SIZE) {
-      break;
-    }
-
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-    if (set_contains(keeper, kmer)) {
-      continue;
-    }
+  bool stop(unsigned int breadth, size_t n_visited) {
+    return breadth > radius || n_visited > (size_t) MAX_KEEPER_SIZE;
+  }
 
-    if (set_contains(stop_tags, kmer)) {
-      continue;
-    }
+  bool enter(HashIntoType kmer, unsigned int breadth) {
+    return !set_contains(keeper, kmer) && !set_contains(ht.stop_tags, kmer);
+  }
 
-    // keep track of seen kmers
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
     keeper.insert(kmer);
-    total++;
-
-    if (false && !is_first_kmer && set_contains(all_tags, kmer)) {
-      continue;
-    }
-
-    assert(breadth >= cur_breadth); // keep track of watermark, for debugging.
-    if (breadth > cur_breadth) { cur_breadth = breadth; }
-
-    //
-    // Enqueue next set of nodes.
-    //
-
-    // NEXT.
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-      
-    // f = ((kmer_f << 2) & bitmask) | twobit_repr('A');
-    r = next_r(kmer_r, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (get_count(uniqify_rc(f,r)) && !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    is_first_kmer = false;
+    return TRAVERSE_EXPAND;
   }
+};
 
-  return total;
+unsigned int Hashbits::traverse_from_kmer(HashIntoType start,
+					  unsigned int radius,
+					  SeenSet &keeper)
+const
+{
+  std::string kmer_s = _revhash(start, _ksize);
+  HashIntoType kmer_f, kmer_r;
+  _hash(kmer_s.c_str(), _ksize, kmer_f, kmer_r);
+
+  KeeperVisitor visitor(*this, radius, keeper);
+  return traverse_breadth_first(kmer_f, kmer_r, visitor);
 }
 
 void Hashbits::hitraverse_to_stoptags(std::string filename,
-				      CountingHash &counting,
+				      Hashtable &counting,
 				      unsigned int cutoff)
 {
   using namespace khmer:: read_parsers;
@@ -1484,7 +1444,8 @@ void Hashbits::load_stop_tags(std::string infilename, bool clear_tags)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_STOPTAGS);
   
   infile.read((char *) &save_ksize, sizeof(save_ksize));
@@ -1504,10 +1465,16 @@ void Hashbits::load_stop_tags(std::string infilename, bool clear_tags)
 
 void Hashbits::save_stop_tags(std::string outfilename)
 {
-  ofstream outfile(outfilename.c_str(), ios::binary);
-  const unsigned int tagset_size = stop_tags.size();
+  std::vector<HashIntoType> tags(stop_tags.begin(), stop_tags.end());
+  std::sort(tags.begin(), tags.end());
+  write_stop_tags(outfilename, _ksize, tags);
+}
 
-  HashIntoType * buf = new HashIntoType[tagset_size];
+void khmer::write_stop_tags(const std::string &outfilename, WordLength ksize,
+			    const std::vector<HashIntoType> &tags)
+{
+  ofstream outfile(outfilename.c_str(), ios::binary);
+  const unsigned int tagset_size = tags.size();
 
   unsigned char version = SAVED_FORMAT_VERSION;
   outfile.write((const char *) &version, 1);
@@ -1515,20 +1482,15 @@ void Hashbits::save_stop_tags(std::string outfilename)
   unsigned char ht_type = SAVED_STOPTAGS;
   outfile.write((const char *) &ht_type, 1);
 
-  unsigned int save_ksize = _ksize;
+  unsigned int save_ksize = ksize;
   outfile.write((const char *) &save_ksize, sizeof(save_ksize));
   outfile.write((const char *) &tagset_size, sizeof(tagset_size));
 
-  unsigned int i = 0;
-  for (SeenSet::iterator pi = stop_tags.begin(); pi != stop_tags.end();
-	 pi++, i++) {
-    buf[i] = *pi;
+  if (tagset_size) {
+    outfile.write((const char *) &tags[0],
+		  sizeof(HashIntoType) * tagset_size);
   }
-
-  outfile.write((const char *) buf, sizeof(HashIntoType) * tagset_size);
   outfile.close();
-
-  delete buf;
 }
 
 void Hashbits::print_stop_tags(std::string infilename)
@@ -1561,7 +1523,7 @@ void Hashbits::print_tagset(std::string infilename)
 
 unsigned int Hashbits::count_and_transfer_to_stoptags(SeenSet &keeper,
 						      unsigned int threshold,
-						      CountingHash &counting)
+						      Hashtable &counting)
 {
   unsigned int n_inserted = 0;
 
@@ -1582,7 +1544,7 @@ void Hashbits::traverse_from_reads(std::string filename,
 				   unsigned int radius,
 				   unsigned int big_threshold,
 				   unsigned int transfer_threshold,
-				   CountingHash &counting)
+				   Hashtable &counting)
 {
   using namespace khmer:: read_parsers;
 
@@ -1640,7 +1602,7 @@ void Hashbits::consume_fasta_and_traverse(const std::string &filename,
 					  unsigned int radius,
 					  unsigned int big_threshold,
 					  unsigned int transfer_threshold,
-					  CountingHash &counting)
+					  Hashtable &counting)
 {
   using namespace khmer:: read_parsers;
 
@@ -1820,6 +1782,63 @@ void Hashbits::extract_unique_paths(std::string seq,
   }
 }
 
+void Hashbits::combine(const Hashbits &a, const Hashbits &b, BitOp op,
+		       uint32_t number_of_threads)
+{
+  assert(is_compatible(a) && is_compatible(b));
+
+  TableOccupancy occupancy;
+  if (_blocked) {
+    combine_bits(_blocks, a._blocks, b._blocks,
+		 _n_blocks * COUNTING_BLOCK_SIZE, op, number_of_threads);
+    occupancy = get_occupancy(number_of_threads);
+  } else {
+    occupancy.sizes = _tablesizes;
+    for (unsigned int i = 0; i < _n_tables; i++) {
+      occupancy.occupied.push_back(
+	combine_bits(_counts[i], a._counts[i], b._counts[i],
+		     _tablesizes[i] / 8 + 1, op, number_of_threads));
+    }
+  }
+
+  // a full table gives no estimate, only that there are at least as many
+  // k-mers as bins.
+  double n_kmers = occupancy.estimate_n_kmers();
+  if (isinf(n_kmers)) {
+    _n_unique_kmers = *max_element(_tablesizes.begin(), _tablesizes.end());
+  } else {
+    _n_unique_kmers = (HashIntoType) (n_kmers + 0.5);
+  }
+}
+
+SetComparison Hashbits::compare(const Hashbits &other,
+				uint32_t number_of_threads) const
+{
+  assert(is_compatible(other));
+
+  SetComparison comparison;
+  comparison.first = get_occupancy(number_of_threads);
+  comparison.second = other.get_occupancy(number_of_threads);
+  comparison.either.sizes = _tablesizes;
+
+  // the union's bits aren't counted slice by slice when blocked, but the
+  // slices fill alike, so each is given an equal share.
+  if (_blocked) {
+    HashIntoType n_set =
+      combine_bits(NULL, _blocks, other._blocks,
+		   _n_blocks * COUNTING_BLOCK_SIZE, BIT_OR, number_of_threads);
+    comparison.either.occupied.assign(_n_tables, n_set / _n_tables);
+    return comparison;
+  }
+
+  for (unsigned int i = 0; i < _n_tables; i++) {
+    comparison.either.occupied.push_back(
+      combine_bits(NULL, _counts[i], other._counts[i],
+		   _tablesizes[i] / 8 + 1, BIT_OR, number_of_threads));
+  }
+  return comparison;
+}
+
 // for counting overlap k-mers specifically!!
 
 //
@@ -2,8 +2,15 @@
 #define HASHBITS_HH
 
 #include <vector>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "hashtable.hh"
 #include "subset.hh"
+#include "fastmod.hh"
+#include "primes.hh"
+#include "table_alloc.hh"
+#include "occupancy.hh"
+#include "traversal.hh"
 
 #define next_f(kmer_f, ch) ((((kmer_f) << 2) & bitmask) | (twobit_repr(ch)))
 #define next_r(kmer_r, ch) (((kmer_r) >> 2) | (twobit_comp(ch) << rc_left_shift))
@@ -14,22 +21,58 @@
 #define set_contains(s, e) ((s).find(e) != (s).end())
 
 namespace khmer {
-  class CountingHash;
 
   class Hashbits : public khmer::Hashtable {
     friend class SubsetPartition;
   protected:
     std::vector<HashIntoType> _tablesizes;
+    std::vector<FastModulus> _tablemods;  // k-mer hash % _tablesizes[i]
     unsigned int _n_tables;
     unsigned int _tag_density;
-    HashIntoType _occupied_bins;
     HashIntoType _n_unique_kmers;
 	HashIntoType _n_overlap_kmers;
     Byte ** _counts;
 
+    // Blocked layout: instead of _n_tables separate bit arrays, all of
+    // the bits for a k-mer live in a single COUNTING_BLOCK_SIZE block,
+    // chosen by one modulus, so that a lookup is one cache miss instead of
+    // _n_tables.  "Table" i is the i'th _block_stride-bit slice of every
+    // block, as in CountingHash.  The bits are more crowded than in
+    // separate tables, since blocks fill unevenly, so the false positive
+    // rate is higher for the same memory; get_occupancy() reports the
+    // real one.
+    bool _blocked;
+    HashIntoType _n_blocks;
+    FastModulus _blockmod;		// k-mer hash % _n_blocks
+    unsigned int _block_stride;
+    Byte * _blocks;
+
+    // the file the tables are mapped from, if load() mapped them.
+    void * _mmap_base;
+    size_t _mmap_length;
+
+    // consume_sequence_and_tag() looks tags up under the read lock, and
+    // adds them under the write lock, so that threads can tag at once;
+    // consume_fasta_and_tag() has each thread keep its new tags to
+    // itself, and adds them when the threads are done.
+    pthread_rwlock_t _all_tags_lock;
+
+    // all_tags, sorted, for walking the tags in order; rebuilt by
+    // get_sorted_tags() after they change.
+    SortedSeenSet _sorted_tags;
+    bool _sorted_tags_valid;
+    pthread_mutex_t _sorted_tags_lock;
+
+    void _tags_changed() { _sorted_tags_valid = false; }
+
     virtual void _allocate_counters() {
       _n_tables = _tablesizes.size();
 
+      if (_blocked) {
+	_allocate_blocks();
+	return;
+      }
+
       HashIntoType tablebytes;
       HashIntoType tablesize;
 
@@ -39,11 +82,152 @@ namespace khmer {
 	tablesize = _tablesizes[i];
 	tablebytes = tablesize / 8 + 1;
 
-	_counts[i] = new Byte[tablebytes];
-	memset(_counts[i], 0, tablebytes);
+	_counts[i] = allocate_table(tablebytes);
+      }
+      _init_moduli();
+    }
+
+    void _deallocate_counters() {
+      if (_counts) {
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  if (!_mmap_base) {
+	    free_table(_counts[i]);
+	  }
+	  _counts[i] = NULL;
+	}
+	delete [] _counts;
+	_counts = NULL;
+      }
+
+      if (_blocks) {
+	if (!_mmap_base) {
+	  free_table(_blocks);
+	}
+	_blocks = NULL;
+      }
+      _n_blocks = 0;
+
+      if (_mmap_base) {
+	munmap(_mmap_base, _mmap_length);
+	_mmap_base = NULL;
+	_mmap_length = 0;
+      }
+    }
+
+    // Spend the same number of bytes as separate tables would, rounded up
+    // to a prime number of blocks.
+    void _allocate_blocks() {
+      assert(_n_tables > 0 && _n_tables <= COUNTING_BLOCK_SIZE * 8);
+
+      HashIntoType total_bytes = 0;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	total_bytes += (_tablesizes[i] + 7) / 8;
+      }
+
+      HashIntoType min_blocks =
+	(total_bytes + COUNTING_BLOCK_SIZE - 1) / COUNTING_BLOCK_SIZE;
+      Primes primetab(min_blocks - 1);
+
+      _allocate_blocks(primetab.get_next_prime());
+    }
+
+    // Use the given (COUNTING_BLOCK_SIZE-aligned) blocks if there are
+    // any; otherwise allocate zeroed ones.
+    void _allocate_blocks(HashIntoType n_blocks, Byte * given = NULL) {
+      _n_blocks = n_blocks;
+      _block_stride = COUNTING_BLOCK_SIZE * 8 / _n_tables;
+      _blocks = given ? given :
+	allocate_table(_n_blocks * COUNTING_BLOCK_SIZE);
+
+      // each slice acts as one table of _n_blocks * _block_stride bits.
+      _tablesizes.assign(_n_tables, _n_blocks * _block_stride);
+      _init_moduli();
+    }
+
+    // Call whenever _tablesizes or _n_blocks change.
+    void _init_moduli() {
+      _tablemods.clear();
+      for (unsigned int i = 0; i < _tablesizes.size(); i++) {
+	_tablemods.push_back(FastModulus(_tablesizes[i]));
+      }
+      if (_n_blocks) {
+	_blockmod.set_divisor(_n_blocks);
+      }
+    }
+
+    // The batched calls work out a k-mer's bins once, prefetch them, and
+    // pass them back in; everything else passes bins = NULL.  In the
+    // blocked layout the only "bin" is the block number.
+    inline void _prefetch_bins(HashIntoType khash, HashIntoType * bins) const {
+      if (_blocked) {
+	bins[0] = _blockmod.mod(khash);
+	__builtin_prefetch(_blocks + bins[0] * COUNTING_BLOCK_SIZE);
+	return;
+      }
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	bins[i] = _tablemods[i].mod(khash);
+	__builtin_prefetch(_counts[i] + bins[i] / 8);
+      }
+    }
+
+    inline HashIntoType _get_bin(HashIntoType khash, const HashIntoType * bins,
+				 unsigned int i) const {
+      return bins ? bins[i] : _tablemods[i].mod(khash);
+    }
+
+    inline Byte * _get_block(HashIntoType khash,
+			     const HashIntoType * bins = NULL) const {
+      HashIntoType block = bins ? bins[0] : _blockmod.mod(khash);
+      return _blocks + block * COUNTING_BLOCK_SIZE;
+    }
+
+    // Position of table i's bit within a block, scaled from a byte of
+    // the mixed hash without a divide.
+    inline unsigned int _block_bit(unsigned int i,
+				   HashIntoType offsets) const {
+      unsigned int low = (unsigned int) (offsets >> (8 * (i % 8))) & 0xff;
+      return i * _block_stride + ((low * _block_stride) >> 8);
+    }
+
+    // Set each of the k-mer's bits in its block; true if any was unset.
+    inline bool _set_bits_in_block(HashIntoType khash,
+				   const HashIntoType * bins) {
+      Byte *	    block	= _get_block(khash, bins);
+      HashIntoType  offsets	= _block_mix(khash);
+      bool	    is_new_kmer	= false;
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	unsigned int bit = _block_bit(i, offsets);
+	unsigned char mask = (unsigned char) (1 << (bit % 8));
+
+	if (!(__sync_fetch_and_or(block + bit / 8, mask) & mask)) {
+	  is_new_kmer = true;
+	}
+      }
+      return is_new_kmer;
+    }
+
+    inline BoundedCounterType _get_count_in_block(HashIntoType khash,
+						  const HashIntoType * bins)
+      const {
+      const Byte *  block	= _get_block(khash, bins);
+      HashIntoType  offsets	= _block_mix(khash);
+
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	unsigned int bit = _block_bit(i, offsets);
+
+	if (!(block[bit / 8] & (1 << (bit % 8)))) {
+	  return 0;
+	}
       }
+      return 1;
     }
             
+    // save() and load() in the uncompressed format, to or from any stream.
+    void _save(std::ostream &outfile);
+    void _load(std::istream &infile);
+
     void _clear_all_partitions() {
       if (partition != NULL) {
 	partition->_clear_all_partitions();
@@ -60,29 +244,29 @@ namespace khmer {
       if (partition) { partition->_validate_pmap(); }
     }
 
-    Hashbits(WordLength ksize, std::vector<HashIntoType>& tablesizes) :
-      khmer::Hashtable(ksize), _tablesizes(tablesizes) {
+    Hashbits(WordLength ksize, std::vector<HashIntoType>& tablesizes,
+	     bool blocked = false) :
+      khmer::Hashtable(ksize), _tablesizes(tablesizes), _counts(NULL),
+      _blocked(blocked), _n_blocks(0), _block_stride(0), _blocks(NULL),
+      _mmap_base(NULL), _mmap_length(0) {
       _tag_density = DEFAULT_TAG_DENSITY;
       assert(_tag_density % 2 == 0);
       partition = new SubsetPartition(this);
-      _occupied_bins = 0;
       _n_unique_kmers = 0;
 	  _n_overlap_kmers = 0;
+      pthread_rwlock_init(&_all_tags_lock, NULL);
+      _sorted_tags_valid = false;
+      pthread_mutex_init(&_sorted_tags_lock, NULL);
 
       _allocate_counters();
     }
 
     ~Hashbits() {
-      if (_counts) {
-	for (unsigned int i = 0; i < _n_tables; i++) {
-	  delete _counts[i];
-	  _counts[i] = NULL;
-	}
-	delete _counts;
-	_counts = NULL;
+      pthread_rwlock_destroy(&_all_tags_lock);
+      pthread_mutex_destroy(&_sorted_tags_lock);
 
-	_n_tables = 0;
-      }
+      _deallocate_counters();
+      _n_tables = 0;
 
       _clear_all_partitions();
     }
@@ -91,11 +275,26 @@ namespace khmer {
       return _tablesizes;
     }
 
+    bool is_blocked() const { return _blocked; }
+
     virtual void save(std::string);
     virtual void load(std::string);
+
+    // With use_mmap, map the tables of an uncompressed SAVED_PAGED_HASHBITS
+    // or SAVED_BLOCKED_HASHBITS file copy-on-write instead of reading them in: pages load as they
+    // are touched, and the processes that load the same graph -- the
+    // partitioning workers -- share one copy of it in the page cache,
+    // until they write to it.  Other files are read in as usual.
+    void load(std::string, bool use_mmap);
+    bool is_mmapped() const { return _mmap_base != NULL; }
+
     virtual void save_tagset(std::string);
     virtual void load_tagset(std::string, bool clear_tags=true);
 
+    // With use_mmap, take the tags straight from the file, mapped, rather
+    // than reading it into a buffer first.
+    void load_tagset(std::string, bool clear_tags, bool use_mmap);
+
     // for debugging/testing purposes only!
     void _set_tag_density(unsigned int d) {
       assert(d % 2 == 0);	// must be even
@@ -107,7 +306,7 @@ namespace khmer {
       return _tag_density;
     }
 
-    void add_tag(HashIntoType tag) { all_tags.insert(tag); }
+    void add_tag(HashIntoType tag) { all_tags.insert(tag); _tags_changed(); }
     void add_stop_tag(HashIntoType tag) { stop_tags.insert(tag); }
 
     void calc_connected_graph_size(const char * kmer,
@@ -127,29 +326,121 @@ namespace khmer {
 				   const unsigned long long threshold=0,
 				   bool break_on_circum=false) const;
 
+    // the same, for a caller that doesn't want the k-mers traversed.
+    void calc_connected_graph_size(const HashIntoType kmer_f,
+				   const HashIntoType kmer_r,
+				   unsigned long long& count,
+				   const unsigned long long threshold=0,
+				   bool break_on_circum=false) const;
+
+    // Breadth-first search of the graph from kmer_f/kmer_r, calling the
+    // hooks of visitor (see TraversalVisitor) on the way; returns the
+    // number of k-mers visited.  The queue and the visited set are the
+    // calling thread's scratch, reused from one search to the next.
+    template <typename Visitor>
+    size_t traverse_breadth_first(HashIntoType kmer_f, HashIntoType kmer_r,
+				  Visitor &visitor) const
+    {
+      TraversalScratchLease scratch;
+      TraversalQueue &node_q = scratch->queue;
+      EpochSet &visited = scratch->visited;
+      const unsigned int rc_left_shift = _ksize*2 - 2;
+
+      node_q.push(kmer_f, kmer_r, 0);
+
+      while (!node_q.empty()) {
+	TraversalNode node = node_q.pop();
+	if (visitor.stop(node.breadth, visited.size())) {
+	  break;
+	}
+
+	HashIntoType kmer = uniqify_rc(node.kmer_f, node.kmer_r);
+	if (visited.contains(kmer) || !visitor.enter(kmer, node.breadth)) {
+	  continue;
+	}
+	visited.insert(kmer);
+
+	TraversalAction action = visitor.visit(kmer, node.kmer_f, node.kmer_r,
+					       node.breadth, visited.size());
+	if (action == TRAVERSE_STOP) {
+	  break;
+	} else if (action == TRAVERSE_DONT_EXPAND) {
+	  continue;
+	}
+
+	HashIntoType f = node.kmer_f, r = node.kmer_r;
+	unsigned int breadth = node.breadth + 1;
+
+	// NEXT.
+	_queue_neighbor(next_f(f, 'A'), next_r(r, 'A'), breadth, scratch);
+	_queue_neighbor(next_f(f, 'C'), next_r(r, 'C'), breadth, scratch);
+	_queue_neighbor(next_f(f, 'G'), next_r(r, 'G'), breadth, scratch);
+	_queue_neighbor(next_f(f, 'T'), next_r(r, 'T'), breadth, scratch);
+
+	// PREVIOUS.
+	_queue_neighbor(prev_f(f, 'A'), prev_r(r, 'A'), breadth, scratch);
+	_queue_neighbor(prev_f(f, 'C'), prev_r(r, 'C'), breadth, scratch);
+	_queue_neighbor(prev_f(f, 'G'), prev_r(r, 'G'), breadth, scratch);
+	_queue_neighbor(prev_f(f, 'T'), prev_r(r, 'T'), breadth, scratch);
+
+	if (!visitor.expanded(node_q.empty())) {
+	  break;
+	}
+      }
+
+      return visited.size();
+    }
+
+    // Queue a neighbor in the graph, if it hasn't been visited yet.
+    void _queue_neighbor(HashIntoType f, HashIntoType r, unsigned int breadth,
+			 const TraversalScratchLease &scratch) const {
+      HashIntoType kmer = uniqify_rc(f, r);
+      if (!scratch->visited.contains(kmer) && _get_count(kmer, NULL)) {
+	scratch->queue.push(f, r, breadth);
+      }
+    }
+
     typedef void (*kmer_cb)(const char * k, unsigned int n_reads, void *data);
 
     // Partitioning stuff.
 
     unsigned int n_tags() const { return all_tags.size(); }
 
-    void divide_tags_into_subsets(unsigned int subset_size, SeenSet& divvy);
+    // all_tags in order.  Safe to call from several threads at once, as
+    // long as none is changing the tags.
+    const SortedSeenSet& get_sorted_tags();
+
+    // every subset_size'th tag, in order.
+    void divide_tags_into_subsets(unsigned int subset_size,
+				  std::vector<HashIntoType>& divvy);
 
     void add_kmer_to_tags(HashIntoType kmer) {
       all_tags.insert(kmer);
+      _tags_changed();
     }
 
-    void clear_tags() { all_tags.clear(); }
+    void clear_tags() { all_tags.clear(); _tags_changed(); }
 
+    // Load the reads and tag them on number_of_threads threads sharing a
+    // parser.  Which k-mers become tags depends on the order the threads
+    // get to the reads in, and a thread doesn't see the others' new tags
+    // until they are all done, but every read is still tagged at least
+    // every _tag_density k-mers, and the graph the partitions come from is
+    // the same.  The callback is only called on this thread.
     void consume_fasta_and_tag(const std::string &filename,
 			       unsigned int &total_reads,
 			       unsigned long long &n_consumed,
 			       CallbackFn callback = 0,
-			       void * callback_data = 0);
+			       void * callback_data = 0,
+			       uint32_t number_of_threads = 1);
 
+    // Safe to call from several threads at once.  Given pending_tags,
+    // the new tags go there instead of into all_tags, and the k-mers in
+    // it count as tags.
     void consume_sequence_and_tag(const std::string& seq,
 				  unsigned long long& n_consumed,
-				  SeenSet * new_tags = 0);
+				  SeenSet * new_tags = 0,
+				  SeenSet * pending_tags = 0);
 
 
     void consume_fasta_and_tag_with_stoptags(const std::string &filename,
@@ -162,7 +453,7 @@ namespace khmer {
 				    unsigned int distance,
 				    unsigned int big_threshold,
 				    unsigned int transfer_threshold,
-				    CountingHash &counting);
+				    Hashtable &counting);
 
     void consume_partitioned_fasta(const std::string &filename,
 				   unsigned int &total_reads,
@@ -203,12 +494,71 @@ namespace khmer {
       return kmer_degree(kmer_f, kmer_r);
     }
 
-    // count number of occupied bins
+    // count number of occupied bins: the mean over the tables, counted
+    // from the tables themselves, so it is right after load() too.
     virtual const HashIntoType n_occupied(HashIntoType start=0,
 				  HashIntoType stop=0) const {
-      // @@ CTB need to be able to *save* this...
-      return _occupied_bins/_n_tables;
+      return n_occupied(start, stop, 1);
+    }
+
+    const HashIntoType n_occupied(HashIntoType start, HashIntoType stop,
+				  uint32_t number_of_threads) const {
+      HashIntoType n = 0;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	n += _n_occupied(i, start, stop, number_of_threads);
+      }
+      return n / _n_tables;
     }
+
+    // the set bits of every table, counted on number_of_threads threads.
+    TableOccupancy get_occupancy(uint32_t number_of_threads = 1) const {
+      TableOccupancy occupancy;
+      occupancy.sizes = _tablesizes;
+      for (unsigned int i = 0; i < _n_tables; i++) {
+	occupancy.occupied.push_back(_n_occupied(i, 0, 0, number_of_threads));
+      }
+      if (_blocked) {
+	occupancy.blocked_fp_rate =
+	  blocked_fp_rate(_blocks, _n_blocks, 1, _block_stride, _n_tables,
+			  number_of_threads);
+      }
+      return occupancy;
+    }
+
+    // the set bits of table i, over bins as in n_occupied().
+    HashIntoType _n_occupied(unsigned int i, HashIntoType start,
+			     HashIntoType stop,
+			     uint32_t number_of_threads) const {
+      if (_blocked) {
+	return count_nonzero_counters_blocked(_blocks, _n_blocks, 1,
+					      _block_stride, i, start, stop,
+					      number_of_threads);
+      }
+      return count_nonzero_counters(_counts[i], 1, _tablesizes[i], start, stop,
+				    number_of_threads);
+    }
+
+    // Can other be combined with this bit by bit: the same k, layout and
+    // table sizes?
+    bool is_compatible(const Hashbits &other) const {
+      return _ksize == other._ksize && _blocked == other._blocked &&
+	_tablesizes == other._tablesizes;
+    }
+
+    // Make the tables a op b, table by table; a and b must be compatible
+    // with this, and may be this.  As Bloom filters, OR gives exactly the
+    // filter of the union of the k-mers; AND holds every k-mer in both,
+    // with more false positives than a filter of just those; AND NOT
+    // drops the k-mers of b, and also any k-mer of a that b has a false
+    // positive for in one of its tables.  Tags and partitions are left
+    // alone, and n_unique_kmers() becomes the estimate from occupancy.
+    void combine(const Hashbits &a, const Hashbits &b, BitOp op,
+		 uint32_t number_of_threads = 1);
+
+    // Estimates of how the k-mers in this and a compatible other overlap,
+    // without building their union.
+    SetComparison compare(const Hashbits &other,
+			  uint32_t number_of_threads = 1) const;
       
     virtual const HashIntoType n_kmers(HashIntoType start=0,
                   HashIntoType stop=0) const {
@@ -236,22 +586,36 @@ namespace khmer {
     const
     bool
     test_and_set_bits( HashIntoType khash ) 
+    {
+      return _test_and_set_bits( khash, NULL );
+    } // test_and_set_bits
+
+    inline
+    bool
+    _test_and_set_bits( HashIntoType khash, const HashIntoType * bins )
     {
       bool is_new_kmer = false;
 
-      for (unsigned int i = 0; i < _n_tables; i++)
+      if (_blocked)
       {
-        HashIntoType bin = khash % _tablesizes[i];
-	HashIntoType byte = bin / 8;
-	unsigned char bit = (unsigned char)(1 << (bin % 8));
-
-	unsigned char bits_orig = __sync_fetch_and_or( *(_counts + i) + byte, bit );
-	if (!(bits_orig & bit))
+	is_new_kmer = _set_bits_in_block( khash, bins );
+      }
+      else
+      {
+	for (unsigned int i = 0; i < _n_tables; i++)
 	{
-	  __sync_add_and_fetch( &_occupied_bins, 1 );
-	  is_new_kmer = true;
-	}
-      } // iteration over hashtables
+	  HashIntoType bin = _get_bin( khash, bins, i );
+	  HashIntoType byte = bin / 8;
+	  unsigned char bit = (unsigned char)(1 << (bin % 8));
+
+	  unsigned char bits_orig =
+	    __sync_fetch_and_or( *(_counts + i) + byte, bit );
+	  if (!(bits_orig & bit))
+	  {
+	    is_new_kmer = true;
+	  }
+	} // iteration over hashtables
+      }
 
       if (is_new_kmer)
       {
@@ -260,7 +624,7 @@ namespace khmer {
       }
 
       return false; // kmer already seen
-    } // test_and_set_bits
+    } // _test_and_set_bits
 
     virtual const HashIntoType n_overlap_kmers(HashIntoType start=0,
                   HashIntoType stop=0) const {
@@ -273,14 +637,24 @@ namespace khmer {
     }
 
     virtual void count(HashIntoType khash) {
+      _count(khash, NULL);
+    }
+
+    inline void _count(HashIntoType khash, const HashIntoType * bins) {
       bool is_new_kmer = false;
 
+      if (_blocked) {
+	if (_set_bits_in_block(khash, bins)) {
+	  _n_unique_kmers +=1;
+	}
+	return;
+      }
+
       for (unsigned int i = 0; i < _n_tables; i++) {
-	HashIntoType bin = khash % _tablesizes[i];
+	HashIntoType bin = _get_bin(khash, bins, i);
 	HashIntoType byte = bin / 8;
 	unsigned char bit = bin % 8;
 	if (!( _counts[i][byte] & (1<<bit))) {
-	  _occupied_bins += 1;
 	  is_new_kmer = true;
 	}
 	_counts[i][byte] |= (1 << bit);
@@ -292,8 +666,12 @@ namespace khmer {
 
 	virtual bool check_overlap(HashIntoType khash, Hashbits &ht2) {
 
+	  if (ht2._blocked) {
+	    return ht2._get_count_in_block(khash, NULL);
+	  }
+
 	  for (unsigned int i = 0; i < ht2._n_tables; i++) {
-		HashIntoType bin = khash % ht2._tablesizes[i];
+		HashIntoType bin = ht2._tablemods[i].mod(khash);
 		HashIntoType byte = bin / 8;
 		unsigned char bit = bin % 8;
 		if (!( ht2._counts[i][byte] & (1<<bit))) {
@@ -311,15 +689,18 @@ namespace khmer {
     virtual void count_overlap(HashIntoType khash, Hashbits &ht2) {
       bool is_new_kmer = false;
 
-      for (unsigned int i = 0; i < _n_tables; i++) {
-	HashIntoType bin = khash % _tablesizes[i];
-	HashIntoType byte = bin / 8;
-	unsigned char bit = bin % 8;
-	if (!( _counts[i][byte] & (1<<bit))) {
-	  _occupied_bins += 1;
-	  is_new_kmer = true;
+      if (_blocked) {
+	is_new_kmer = _set_bits_in_block(khash, NULL);
+      } else {
+	for (unsigned int i = 0; i < _n_tables; i++) {
+	  HashIntoType bin = _tablemods[i].mod(khash);
+	  HashIntoType byte = bin / 8;
+	  unsigned char bit = bin % 8;
+	  if (!( _counts[i][byte] & (1<<bit))) {
+	    is_new_kmer = true;
+	  }
+	  _counts[i][byte] |= (1 << bit);
 	}
-	_counts[i][byte] |= (1 << bit);
       }
       if (is_new_kmer) {
 	_n_unique_kmers +=1;
@@ -329,6 +710,43 @@ namespace khmer {
     }
 	}
 
+    // Work out the bins for the k-mer PREFETCH_DISTANCE ahead and prefetch
+    // them, then handle the current k-mer from its saved bins.
+    virtual void count_batch(const HashIntoType * khashes, unsigned int n) {
+      const unsigned int ring = 2 * PREFETCH_DISTANCE;
+      std::vector<HashIntoType> bins(ring * _n_tables);
+
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_prefetch_bins(khashes[i], &bins[i * _n_tables]);
+      }
+
+      for (unsigned int i = 0; i < n; i++) {
+	unsigned int ahead = i + PREFETCH_DISTANCE;
+	if (ahead < n) {
+	  _prefetch_bins(khashes[ahead], &bins[(ahead % ring) * _n_tables]);
+	}
+	_count(khashes[i], &bins[(i % ring) * _n_tables]);
+      }
+    }
+
+    virtual void get_count_batch(const HashIntoType * khashes, unsigned int n,
+				 BoundedCounterType * counts) const {
+      const unsigned int ring = 2 * PREFETCH_DISTANCE;
+      std::vector<HashIntoType> bins(ring * _n_tables);
+
+      for (unsigned int i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+	_prefetch_bins(khashes[i], &bins[i * _n_tables]);
+      }
+
+      for (unsigned int i = 0; i < n; i++) {
+	unsigned int ahead = i + PREFETCH_DISTANCE;
+	if (ahead < n) {
+	  _prefetch_bins(khashes[ahead], &bins[(ahead % ring) * _n_tables]);
+	}
+	counts[i] = _get_count(khashes[i], &bins[(i % ring) * _n_tables]);
+      }
+    }
+
     // get the count for the given k-mer.
     virtual const BoundedCounterType get_count(const char * kmer) const {
       HashIntoType hash = _hash(kmer, _ksize);
@@ -337,8 +755,17 @@ namespace khmer {
 
     // get the count for the given k-mer hash.
     virtual const BoundedCounterType get_count(HashIntoType khash) const {
+      return _get_count(khash, NULL);
+    }
+
+    inline BoundedCounterType _get_count(HashIntoType khash,
+					 const HashIntoType * bins) const {
+      if (_blocked) {
+	return _get_count_in_block(khash, bins);
+      }
+
       for (unsigned int i = 0; i < _n_tables; i++) {
-	HashIntoType bin = khash % _tablesizes[i];
+	HashIntoType bin = _get_bin(khash, bins, i);
 	HashIntoType byte = bin / 8;
 	unsigned char bit = bin % 8;
       
@@ -388,7 +815,7 @@ namespace khmer {
     void traverse_from_tags(unsigned int distance,
 			    unsigned int threshold,
 			    unsigned int num_high_todo,
-			    CountingHash &counting);
+			    Hashtable &counting);
 
     unsigned int traverse_from_kmer(HashIntoType start,
 				    unsigned int radius,
@@ -396,16 +823,16 @@ namespace khmer {
 
     unsigned int count_and_transfer_to_stoptags(SeenSet &keeper,
 						unsigned int threshold,
-						CountingHash &counting);
+						Hashtable &counting);
 
     void traverse_from_reads(std::string filename,
 			     unsigned int radius,
 			     unsigned int big_threshold,
 			     unsigned int transfer_threshold,
-			     CountingHash &counting);
+			     Hashtable &counting);
 
     void hitraverse_to_stoptags(std::string filename,
-				CountingHash &counting,
+				Hashtable &counting,
 				unsigned int cutoff);
 
     virtual void print_tagset(std::string);
@@ -422,6 +849,11 @@ namespace khmer {
 			      float min_unique_f,
 			      std::vector<std::string> &results);
   };
+
+  // Write sorted tags out as Hashbits::save_stop_tags() does, for
+  // load_stop_tags() to read.
+  void write_stop_tags(const std::string &outfilename, WordLength ksize,
+		       const std::vector<HashIntoType> &tags);
 };
 
 #include "counting.hh"
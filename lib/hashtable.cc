@@ -1,10 +1,13 @@
 #include "khmer.hh"
 #include "hashtable.hh"
 #include "read_parsers.hh"
+#include "hashbits.hh"
+#include "threads.hh"
 
 #include <algorithm>
 
 using namespace khmer;
+using namespace khmer:: read_parsers;
 using namespace std;
 
 
@@ -233,6 +236,26 @@ consume_fasta(
 
 } // consume_fasta
 
+//
+// count_batch, get_count_batch: generic versions, for tables that don't
+//     provide their own.
+//
+
+void Hashtable::count_batch(const HashIntoType * khashes, unsigned int n)
+{
+  for (unsigned int i = 0; i < n; i++) {
+    count(khashes[i]);
+  }
+}
+
+void Hashtable::get_count_batch(const HashIntoType * khashes, unsigned int n,
+				BoundedCounterType * counts) const
+{
+  for (unsigned int i = 0; i < n; i++) {
+    counts[i] = get_count(khashes[i]);
+  }
+}
+
 //
 // consume_string: run through every k-mer in the given string, & hash it.
 //
@@ -249,6 +272,9 @@ unsigned int Hashtable::consume_string(const std::string &s,
   KMerIterator kmers(sp, _ksize);
   HashIntoType kmer;
 
+  HashIntoType batch[KMER_BATCH_SIZE];
+  unsigned int n_batch = 0;
+
   if (lower_bound == upper_bound && upper_bound == 0) {
     bounded = false;
   }
@@ -258,15 +284,41 @@ unsigned int Hashtable::consume_string(const std::string &s,
   
     if (!bounded || (kmer >= lower_bound && kmer < upper_bound)) {
 
-      count(kmer);
+      batch[n_batch++] = kmer;
       n_consumed++;
 
+      if (n_batch == KMER_BATCH_SIZE) {
+	count_batch(batch, n_batch);
+	n_batch = 0;
+      }
+
     }
   }
 
+  if (n_batch) {
+    count_batch(batch, n_batch);
+  }
+
   return n_consumed;
 }
 
+void Hashtable::_get_kmer_counts(const std::string &seq,
+				 std::vector<HashIntoType> &kmer_hashes,
+				 std::vector<BoundedCounterType> &counts) const
+{
+  KMerIterator kmers(seq.c_str(), _ksize);
+
+  kmer_hashes.clear();
+  while (!kmers.done()) {
+    kmer_hashes.push_back(kmers.next());
+  }
+
+  counts.resize(kmer_hashes.size());
+  if (kmer_hashes.size()) {
+    get_count_batch(&kmer_hashes[0], kmer_hashes.size(), &counts[0]);
+  }
+}
+
 // technically, get medioid count... our "median" is always a member of the
 // population.
 
@@ -275,15 +327,20 @@ void Hashtable::get_median_count(const std::string &s,
 				 float &average,
 				 float &stddev)
 {
-  BoundedCounterType count;
+  std::vector<HashIntoType> kmer_hashes;
   std::vector<BoundedCounterType> counts;
-  KMerIterator kmers(s.c_str(), _ksize);
 
-  while(!kmers.done()) {
-    HashIntoType kmer = kmers.next();
-    count = this->get_count(kmer);
-    counts.push_back(count);
-  }
+  get_median_count(s, median, average, stddev, kmer_hashes, counts);
+}
+
+void Hashtable::get_median_count(const std::string &s,
+				 BoundedCounterType &median,
+				 float &average,
+				 float &stddev,
+				 std::vector<HashIntoType> &kmer_hashes,
+				 std::vector<BoundedCounterType> &counts)
+{
+  _get_kmer_counts(s, kmer_hashes, counts);
 
   assert(counts.size());
 
@@ -314,4 +371,420 @@ void Hashtable::get_median_count(const std::string &s,
   median = counts[counts.size() / 2]; // rounds down
 }
 
+//
+// collect_high_abundance_kmers
+//
+
+// Shared by the threads of one pass of collect_high_abundance_kmers.
+struct HighAbundancePass {
+  Hashtable *				    ht;
+  IParser *				    parser;
+  unsigned int				    lower_count;
+  unsigned int				    upper_count;
+  unsigned long long			    stop_at_read; // 0 for no limit
+  unsigned long long			    n_reads;
+  volatile bool				    done;
+  std::vector< std::vector<HashIntoType> >  found;	  // one per thread
+  uint32_t				    n_threads;
+};
+
+// Keep a thread's k-mers from growing past this before they're deduped.
+#define HIGH_ABUNDANCE_COMPACT_SIZE (1024 * 1024)
+
+static void _sort_unique(std::vector<HashIntoType> &kmers)
+{
+  std::sort(kmers.begin(), kmers.end());
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+}
+
+// Pass 1 (no stop_at_read): count reads until a k-mer reaches
+// upper_count.  Pass 2: collect the k-mers of the first stop_at_read
+// reads that have reached lower_count.
+static void _high_abundance_thread(void * arg, uint32_t thread_n)
+{
+  HighAbundancePass * pass = (HighAbundancePass *) arg;
+  const Hashtable * ht = pass->ht;
+  std::vector<HashIntoType> &found = pass->found[thread_n];
+  const bool collecting = pass->stop_at_read != 0;
+
+  std::vector<HashIntoType> kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+  Read read;
+
+  while (!pass->parser->is_complete()) {
+    // a threaded parser needs every thread to go on to the end of the
+    // input once the pass is done; only a lone thread can stop there.
+    if (pass->done && pass->n_threads == 1) {
+      break;
+    }
+
+    try {
+      read = pass->parser->get_next_read();
+    } catch (NoMoreReadsAvailable &exc) {
+      break;
+    }
+    if (pass->done) {
+      continue;
+    }
+
+    unsigned long long n_reads = __sync_add_and_fetch(&pass->n_reads, 1);
+    if (collecting && n_reads > pass->stop_at_read) {
+      pass->done = true;
+      continue;
+    }
+    if (n_reads % 100000 == 0) {
+      std::cout << (collecting ? "... x 2 " : "...") << n_reads << "\n";
+    }
+
+    std::string &seq = read.sequence;
+    if (!ht->check_and_normalize_read(seq)) {
+      continue;
+    }
+
+    if (!collecting) {
+      pass->ht->consume_string(seq);
+    }
+
+    kmer_hashes.clear();
+    KMerIterator kmers(seq.c_str(), ht->ksize());
+    while (!kmers.done()) {
+      kmer_hashes.push_back(kmers.next());
+    }
+    counts.resize(kmer_hashes.size());
+    ht->get_count_batch(&kmer_hashes[0], kmer_hashes.size(), &counts[0]);
+
+    for (size_t i = 0; i < counts.size(); i++) {
+      if (!collecting && counts[i] >= pass->upper_count) {
+	pass->done = true;
+      } else if (collecting && counts[i] >= pass->lower_count) {
+	found.push_back(kmer_hashes[i]);
+      }
+    }
+
+    if (found.size() >= HIGH_ABUNDANCE_COMPACT_SIZE) {
+      _sort_unique(found);
+    }
+  }
+
+  // each thread sorts its own k-mers, in parallel with the others.
+  _sort_unique(found);
+}
+
+static void _run_high_abundance_pass(HighAbundancePass &pass,
+				     const std::string &filename,
+				     uint32_t n_threads)
+{
+  Config &the_config = get_active_config( );
+
+  pass.parser = IParser::get_parser(
+    filename, n_threads, the_config.get_reads_input_buffer_size( ),
+    the_config.get_reads_parser_trace_level( )
+  );
+  pass.n_reads = 0;
+  pass.done = false;
+  pass.found.assign(n_threads, std::vector<HashIntoType>());
+  pass.n_threads = n_threads;
+
+  run_on_threads(_high_abundance_thread, &pass, n_threads);
+
+  delete pass.parser;
+  pass.parser = NULL;
+}
+
+void Hashtable::collect_high_abundance_kmers(const std::string &filename,
+					     unsigned int lower_count,
+					     unsigned int upper_count,
+					     std::vector<HashIntoType> &kmers,
+					     uint32_t n_threads)
+{
+  assert(n_threads > 0);
+
+  HighAbundancePass pass;
+  pass.ht = this;
+  pass.lower_count = lower_count;
+  pass.upper_count = upper_count;
+  pass.stop_at_read = 0;
+
+  _run_high_abundance_pass(pass, filename, n_threads);
+
+  // every read taken in the first pass was counted, including those the
+  // other threads took before they saw that one of them was done.
+  pass.stop_at_read = pass.n_reads;
+  if (!pass.stop_at_read) {
+    kmers.clear();
+    return;
+  }
+
+  _run_high_abundance_pass(pass, filename, n_threads);
+
+  // merge the threads' sorted runs, and drop the k-mers found by more
+  // than one.
+  kmers.clear();
+  for (unsigned int i = 0; i < n_threads; i++) {
+    size_t middle = kmers.size();
+    kmers.insert(kmers.end(), pass.found[i].begin(), pass.found[i].end());
+    std::vector<HashIntoType>().swap(pass.found[i]);
+    std::inplace_merge(kmers.begin(), kmers.begin() + middle, kmers.end());
+  }
+  kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+}
+
+HashIntoType * Hashtable::abundance_distribution(std::string filename,
+						 Hashbits * tracking,
+			 CallbackFn callback,
+			 void * callback_data) const
+{
+  HashIntoType * dist = new HashIntoType[MAX_BIGCOUNT + 1];
+  HashIntoType i;
+  
+  for (i = 0; i <= MAX_BIGCOUNT; i++) {
+    dist[i] = 0;
+  }
+
+  Read read;
+  IParser* parser = IParser::get_parser(filename.c_str());
+  string seq;
+  unsigned long long read_num = 0;
+  std::vector<HashIntoType> kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+
+  // if not, could lead to overflow.
+  assert(sizeof(BoundedCounterType) == 2);
+
+  while(!parser->is_complete()) {
+    read = parser->get_next_read();
+    seq = read.sequence;
+
+    if (check_and_normalize_read(seq)) {
+      if (tracking) {
+	_add_new_kmer_abundances(seq, tracking, kmer_hashes, counts, dist);
+      } else {
+	_add_kmer_occurrences(seq, kmer_hashes, counts, dist);
+      }
+    }
+
+    read_num += 1;
+
+    // run callback, if specified
+    if (read_num % CALLBACK_PERIOD == 0 && callback) {
+      try {
+        callback("abundance_distribution", callback_data, read_num, 0);
+      } catch (...) {
+        throw;
+      }
+    }
+  }
+
+  delete parser;
+
+  if (!tracking) {
+    occurrences_to_distribution(dist);
+  }
+
+  return dist;
+}
+
+// Count the k-mers that tracking hasn't seen yet into dist at their
+// abundance, and mark them seen.  test_and_set_bits() is atomic, so each
+// k-mer is counted by only one thread.
+void Hashtable::_add_new_kmer_abundances(const std::string &seq,
+					 Hashbits * tracking,
+					 std::vector<HashIntoType> &kmer_hashes,
+					 std::vector<BoundedCounterType> &counts,
+					 HashIntoType * dist) const
+{
+  KMerIterator kmers(seq.c_str(), _ksize);
+
+  kmer_hashes.clear();
+  while(!kmers.done()) {
+    HashIntoType kmer = kmers.next();
+    if (tracking->test_and_set_bits(kmer)) {
+      kmer_hashes.push_back(kmer);
+    }
+  }
+
+  if (kmer_hashes.empty()) {
+    return;
+  }
+
+  counts.resize(kmer_hashes.size());
+  get_count_batch(&kmer_hashes[0], kmer_hashes.size(), &counts[0]);
+  for (unsigned int i = 0; i < counts.size(); i++) {
+    dist[counts[i]]++;
+  }
+}
+
+// Count every k-mer in the read into occurrences at its abundance.
+void Hashtable::_add_kmer_occurrences(const std::string &seq,
+				      std::vector<HashIntoType> &kmer_hashes,
+				      std::vector<BoundedCounterType> &counts,
+				      HashIntoType * occurrences) const
+{
+  KMerIterator kmers(seq.c_str(), _ksize);
+
+  kmer_hashes.clear();
+  while(!kmers.done()) {
+    kmer_hashes.push_back(kmers.next());
+  }
+
+  if (kmer_hashes.empty()) {
+    return;
+  }
+
+  counts.resize(kmer_hashes.size());
+  get_count_batch(&kmer_hashes[0], kmer_hashes.size(), &counts[0]);
+  for (unsigned int i = 0; i < counts.size(); i++) {
+    occurrences[counts[i]]++;
+  }
+}
+
+struct AbundanceDistributionPass {
+  const Hashtable *	ht;
+  IParser *		parser;
+  Hashbits *		tracking;
+  HashIntoType *	dist;
+};
+
+void Hashtable::_abundance_distribution_thread(void * arg, uint32_t thread_n)
+{
+  AbundanceDistributionPass * pass = (AbundanceDistributionPass *) arg;
+
+  pass->ht->_abundance_distribution(pass->parser, pass->tracking, pass->dist);
+}
+
+void Hashtable::abundance_distribution(IParser * parser,
+				       Hashbits * tracking,
+				       HashIntoType * dist,
+				       uint32_t n_threads) const
+{
+  assert(n_threads > 0);
+
+  AbundanceDistributionPass pass = { this, parser, tracking, dist };
+  run_on_threads(_abundance_distribution_thread, &pass, n_threads);
+
+  if (!tracking) {
+    occurrences_to_distribution(dist);
+  }
+}
+
+// Each thread fills its own histogram, and adds it to dist at the end.
+void Hashtable::_abundance_distribution(IParser * parser,
+					Hashbits * tracking,
+					HashIntoType * dist) const
+{
+  std::vector<HashIntoType> local_dist(MAX_BIGCOUNT + 1, 0);
+  std::vector<HashIntoType> kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+  Read read;
+
+  while (!parser->is_complete()) {
+    read = parser->get_next_read();
+
+    if (check_and_normalize_read(read.sequence)) {
+      if (tracking) {
+	_add_new_kmer_abundances(read.sequence, tracking, kmer_hashes, counts,
+				 &local_dist[0]);
+      } else {
+	_add_kmer_occurrences(read.sequence, kmer_hashes, counts,
+			      &local_dist[0]);
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i <= MAX_BIGCOUNT; i++) {
+    if (local_dist[i]) {
+      __sync_add_and_fetch(dist + i, local_dist[i]);
+    }
+  }
+}
+
+// A k-mer of abundance n occurs n times in the reads that were counted,
+// so n occurrences at abundance n are one distinct k-mer.  Abundance 0
+// k-mers weren't counted at all, and are left as occurrences.  This is
+// only an estimate: a k-mer whose count collisions have inflated, or
+// that has saturated at MAX_COUNT, is divided by the wrong abundance.
+void Hashtable::occurrences_to_distribution(HashIntoType * occurrences)
+{
+  for (unsigned int n = 1; n <= MAX_BIGCOUNT; n++) {
+    occurrences[n] = (occurrences[n] + n / 2) / n;
+  }
+}
+
+unsigned int Hashtable::trim_on_abundance(std::string seq,
+					  BoundedCounterType min_abund)
+  const
+{
+  std::vector<HashIntoType> kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+
+  return trim_on_abundance(seq, min_abund, kmer_hashes, counts);
+}
+
+unsigned int Hashtable::trim_on_abundance(std::string seq,
+					  BoundedCounterType min_abund,
+					  std::vector<HashIntoType> &kmer_hashes,
+					  std::vector<BoundedCounterType> &counts)
+  const
+{
+  if (!check_and_normalize_read(seq)) {
+    return 0;
+  }
+
+  _get_kmer_counts(seq, kmer_hashes, counts);
+
+  // a read with only one k-mer is always trimmed away.
+  if (kmer_hashes.size() < 2) { return 0; }
+
+  if (counts[0] < min_abund) {
+    return 0;
+  }
+
+  for (unsigned int i = 1; i < counts.size(); i++) {
+    if (counts[i] < min_abund) {
+      return _ksize + i - 1;
+    }
+  }
+
+  return seq.length();
+}
+
+
+unsigned int Hashtable::trim_below_abundance(std::string seq,
+					     BoundedCounterType max_abund)
+  const
+{
+  std::vector<HashIntoType> kmer_hashes;
+  std::vector<BoundedCounterType> counts;
+
+  return trim_below_abundance(seq, max_abund, kmer_hashes, counts);
+}
+
+unsigned int Hashtable::trim_below_abundance(std::string seq,
+					     BoundedCounterType max_abund,
+					     std::vector<HashIntoType> &kmer_hashes,
+					     std::vector<BoundedCounterType> &counts)
+  const
+{
+  if (!check_and_normalize_read(seq)) {
+    return 0;
+  }
+
+  _get_kmer_counts(seq, kmer_hashes, counts);
+
+  // a read with only one k-mer is always trimmed away.
+  if (kmer_hashes.size() < 2) { return 0; }
+
+  if (counts[0] > max_abund) {
+    return 0;
+  }
+
+  for (unsigned int i = 1; i < counts.size(); i++) {
+    if (counts[i] > max_abund) {
+      return _ksize + i - 1;
+    }
+  }
+
+  return seq.length();
+}
+
 // vim: set sts=2 sw=2:
@@ -13,24 +13,27 @@
 #include <queue>
 
 #include "khmer.hh"
+#include "flat_hash.hh"
 #include "storage.hh"
 #include "read_parsers.hh"
 
 #define CALLBACK_PERIOD 100000
 
 namespace khmer {
+  class Hashbits;
 
   typedef unsigned int PartitionID;
-  typedef std::set<HashIntoType> SeenSet;
+  typedef FlatSet<HashIntoType> SeenSet;
+  typedef SortedVectorSet<HashIntoType> SortedSeenSet;
   typedef std::set<PartitionID> PartitionSet;
-  typedef std::map<HashIntoType, PartitionID*> PartitionMap;
+  typedef FlatMap<HashIntoType, PartitionID*> PartitionMap;
   typedef std::map<PartitionID, PartitionID*> PartitionPtrMap;
   typedef std::map<PartitionID, SeenSet*> PartitionsToTagsMap;
   typedef std::set<PartitionID *> PartitionPtrSet;
   typedef std::map<PartitionID, PartitionPtrSet*> ReversePartitionMap;
   typedef std::queue<HashIntoType> NodeQueue;
   typedef std::map<PartitionID, PartitionID*> PartitionToPartitionPMap;
-  typedef std::map<HashIntoType, unsigned int> TagCountMap;
+  typedef FlatMap<HashIntoType, unsigned int> TagCountMap;
   typedef std::map<PartitionID, unsigned int> PartitionCountMap;
   typedef std::map<unsigned long long, unsigned long long> PartitionCountDistribution;
 
@@ -262,6 +265,14 @@ namespace khmer {
     virtual const BoundedCounterType get_count(const char * kmer) const = 0;
     virtual const BoundedCounterType get_count(HashIntoType khash) const = 0;
 
+    // Count, or get the counts of, an array of k-mer hashes.  Tables
+    // override these to prefetch the bins of the k-mer PREFETCH_DISTANCE
+    // ahead before touching each one, so that several cache misses are in
+    // flight at once.
+    virtual void count_batch(const HashIntoType * khashes, unsigned int n);
+    virtual void get_count_batch(const HashIntoType * khashes, unsigned int n,
+				 BoundedCounterType * counts) const;
+
     virtual void save(std::string) = 0;
     virtual void load(std::string) = 0;
 
@@ -309,6 +320,105 @@ namespace khmer {
 			  float &average,
 			  float &stddev);
 
+    // the same, looking the k-mers up in kmer_hashes and counts, which a
+    // caller going through read after read keeps, so that they are
+    // reused instead of allocated for each read.
+    void get_median_count(const std::string &s,
+			  BoundedCounterType &median,
+			  float &average,
+			  float &stddev,
+			  std::vector<HashIntoType> &kmer_hashes,
+			  std::vector<BoundedCounterType> &counts);
+
+    // Count the reads in filename until some k-mer reaches upper_count,
+    // then go back over the reads counted and collect the k-mers that
+    // have reached lower_count, sorted, each once.  Both passes run on
+    // n_threads threads sharing a parser; with more than one, the second
+    // pass takes as many reads from the start of the file as the first
+    // counted, which may not be quite the same ones, and each pass reads
+    // on to the end of the file (without counting) as the parser needs.
+    void collect_high_abundance_kmers(const std::string &infilename,
+				      unsigned int lower_count,
+				      unsigned int upper_count,
+				      std::vector<HashIntoType> &kmers,
+				      uint32_t n_threads = 1);
+
+    // The rest only need get_count_batch, and so work on any table.
+
+    // The number of distinct k-mers in the reads at each abundance, from
+    // 0 to MAX_BIGCOUNT.  tracking marks the k-mers already seen, so that
+    // each is counted once; without it, every occurrence of each k-mer is
+    // counted and then divided by its abundance (see
+    // occurrences_to_distribution), which needs no memory beyond the
+    // histogram but is approximate: collisions inflate the counts, so
+    // occurrences are divided by the wrong abundance, and, without
+    // bigcount, the counts saturate at MAX_COUNT.
+    HashIntoType * abundance_distribution(std::string filename,
+					  Hashbits * tracking,
+					  CallbackFn callback = NULL,
+					  void * callback_data = NULL) const;
+
+    // The same, added to dist, with n_threads threads sharing parser.
+    // Without tracking, the occurrences are divided once all of the
+    // threads are done.
+    void abundance_distribution(read_parsers::IParser * parser,
+				Hashbits * tracking,
+				HashIntoType * dist,
+				uint32_t n_threads = 1) const;
+
+    static void occurrences_to_distribution(HashIntoType * occurrences);
+
+    unsigned int trim_on_abundance(std::string seq,
+				   BoundedCounterType min_abund) const;
+    unsigned int trim_below_abundance(std::string seq,
+				      BoundedCounterType max_abund) const;
+
+    // the same, with caller-owned scratch, as for get_median_count.
+    unsigned int trim_on_abundance(std::string seq,
+				   BoundedCounterType min_abund,
+				   std::vector<HashIntoType> &kmer_hashes,
+				   std::vector<BoundedCounterType> &counts)
+      const;
+    unsigned int trim_below_abundance(std::string seq,
+				      BoundedCounterType max_abund,
+				      std::vector<HashIntoType> &kmer_hashes,
+				      std::vector<BoundedCounterType> &counts)
+      const;
+
+  protected:
+    // The blocked layouts of CountingHash and Hashbits pick a k-mer's
+    // block by its hash modulo a prime, which only consumes part of it,
+    // so they scramble the bits before picking positions within the block.
+    static inline HashIntoType _block_mix(HashIntoType khash) {
+      khash ^= khash >> 33;
+      khash *= 0xff51afd7ed558ccdULL;
+      khash ^= khash >> 33;
+      khash *= 0xc4ceb9fe1a85ec53ULL;
+      khash ^= khash >> 33;
+      return khash;
+    }
+
+    // Put the hashes of the k-mers of seq in kmer_hashes, and their
+    // counts in counts.
+    void _get_kmer_counts(const std::string &seq,
+			  std::vector<HashIntoType> &kmer_hashes,
+			  std::vector<BoundedCounterType> &counts) const;
+
+    void _add_new_kmer_abundances(const std::string &seq,
+				  Hashbits * tracking,
+				  std::vector<HashIntoType> &kmer_hashes,
+				  std::vector<BoundedCounterType> &counts,
+				  HashIntoType * dist) const;
+    void _abundance_distribution(read_parsers::IParser * parser,
+				 Hashbits * tracking,
+				 HashIntoType * dist) const;
+    static void _abundance_distribution_thread(void * pass,
+					       uint32_t thread_n);
+
+    void _add_kmer_occurrences(const std::string &seq,
+			       std::vector<HashIntoType> &kmer_hashes,
+			       std::vector<BoundedCounterType> &counts,
+			       HashIntoType * occurrences) const;
   };
 };
 
@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <math.h>
+
+#include "hllcounter.hh"
+#include "hashtable.hh"
+#include "primes.hh"
+
+#   define SIZED_MAX_TABLES 8 // past this, more tables only cost time
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+HLLCounter::HLLCounter(WordLength ksize, double error_rate) : _ksize(ksize)
+{
+  assert(error_rate > 0 && error_rate < 1);
+
+  // the relative error is about 1.04 / sqrt(2^p).
+  double registers = pow(1.04 / error_rate, 2);
+  _p = (unsigned int) ceil(log(registers) / log(2.0));
+  if (_p < HLL_MIN_PRECISION) { _p = HLL_MIN_PRECISION; }
+  if (_p > HLL_MAX_PRECISION) { _p = HLL_MAX_PRECISION; }
+
+  _registers.resize(1 << _p, 0);
+}
+
+// The k-mer hashes are the bases two bits apiece, so mix them up before
+// taking bits off the top (the MurmurHash3 finalizer).
+static inline HashIntoType _mix(HashIntoType h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+void HLLCounter::_add(uint8_t * registers, HashIntoType kmer) const
+{
+  HashIntoType h = _mix(kmer);
+  HashIntoType rest = h << _p;
+  uint8_t rank = rest ? __builtin_clzll(rest) + 1 : 64 - _p + 1;
+  unsigned int i = h >> (64 - _p);
+
+  if (rank > registers[i]) {
+    registers[i] = rank;
+  }
+}
+
+unsigned long long HLLCounter::_consume_string(uint8_t * registers,
+					       const std::string &s) const
+{
+  if (s.length() < _ksize) {
+    return 0;
+  }
+
+  // as Hashtable::check_and_normalize_read.
+  std::string seq = s;
+  for (unsigned int i = 0; i < seq.length(); i++) {
+    seq[i] &= 0xdf;
+    if (!is_valid_dna(seq[i])) {
+      return 0;
+    }
+  }
+
+  unsigned long long n = 0;
+  KMerIterator kmers(seq.c_str(), _ksize);
+  while (!kmers.done()) {
+    _add(registers, kmers.next());
+    n++;
+  }
+
+  return n;
+}
+
+unsigned long long HLLCounter::consume_string(const std::string &s)
+{
+  return _consume_string(&_registers[0], s);
+}
+
+void HLLCounter::consume_fasta(IParser * parser, unsigned int &total_reads,
+			       unsigned long long &n_consumed)
+{
+  std::vector<uint8_t>	registers(_registers.size(), 0);
+  unsigned int		total_reads_LOCAL = 0;
+  unsigned long long	n_consumed_LOCAL  = 0;
+  Read			read;
+  bool			invalid_file_format = false;
+
+  while (next_read_or_done(parser, read, !total_reads_LOCAL,
+			   invalid_file_format)) {
+    n_consumed_LOCAL += _consume_string(&registers[0], read.sequence);
+    total_reads_LOCAL++;
+  }
+
+  for (size_t i = 0; i < registers.size(); i++) {
+    uint8_t rank = registers[i];
+    uint8_t current;
+    do {
+      current = _registers[i];
+    } while (rank > current &&
+	     !__sync_bool_compare_and_swap(&_registers[i], current, rank));
+  }
+
+  __sync_add_and_fetch(&total_reads, total_reads_LOCAL);
+  __sync_add_and_fetch(&n_consumed, n_consumed_LOCAL);
+
+  if (invalid_file_format) {
+    throw InvalidReadFileFormat();
+  }
+}
+
+void HLLCounter::merge(const HLLCounter &other)
+{
+  assert(_ksize == other._ksize && _p == other._p);
+
+  for (size_t i = 0; i < _registers.size(); i++) {
+    if (other._registers[i] > _registers[i]) {
+      _registers[i] = other._registers[i];
+    }
+  }
+}
+
+HashIntoType HLLCounter::estimate_cardinality() const
+{
+  double m = _registers.size();
+  double alpha;
+
+  switch (_registers.size()) {
+  case 16: alpha = 0.673; break;
+  case 32: alpha = 0.697; break;
+  case 64: alpha = 0.709; break;
+  default: alpha = 0.7213 / (1 + 1.079 / m);
+  }
+
+  double sum = 0;
+  unsigned int n_zeros = 0;
+  for (size_t i = 0; i < _registers.size(); i++) {
+    sum += ldexp(1.0, -_registers[i]);
+    if (!_registers[i]) { n_zeros++; }
+  }
+
+  double estimate = alpha * m * m / sum;
+
+  // small counts are better estimated from the empty registers.
+  if (estimate <= 2.5 * m && n_zeros) {
+    estimate = m * log(m / n_zeros);
+  }
+
+  return (HashIntoType) (estimate + 0.5);
+}
+
+static double _fp_rate(double n_kmers, double table_size, unsigned int n_tables)
+{
+  return pow(1 - exp(-n_kmers / table_size), n_tables);
+}
+
+std::vector<HashIntoType> khmer::get_table_sizes_for_fp_rate(
+  HashIntoType n_kmers, double fp_rate
+)
+{
+  assert(fp_rate > 0 && fp_rate < 1);
+
+  double n = n_kmers ? n_kmers : 1;
+
+  // the total is smallest with about log2(1 / fp_rate) tables, each half
+  // full; try either side of it.
+  unsigned int most = (unsigned int) ceil(log(1 / fp_rate) / log(2.0)) + 1;
+  unsigned int best_n_tables = 1;
+  double best_size = 0;
+
+  for (unsigned int z = 1; z <= most; z++) {
+    double size = ceil(-n / log(1 - pow(fp_rate, 1.0 / z)));
+    if (!best_size || z * size < best_n_tables * best_size) {
+      best_n_tables = z;
+      best_size = size;
+    }
+  }
+
+  std::vector<HashIntoType> sizes;
+  Primes primes((HashIntoType) best_size);
+  for (unsigned int i = 0; i < best_n_tables; i++) {
+    sizes.push_back(primes.get_next_prime());
+  }
+
+  return sizes;
+}
+
+std::vector<HashIntoType> khmer::get_table_sizes_for_memory(
+  HashIntoType n_kmers, HashIntoType max_entries
+)
+{
+  double n = n_kmers ? n_kmers : 1;
+
+  // the rate is lowest with about (max_entries / n) ln 2 tables.
+  unsigned int best_n_tables = 1;
+  double best_rate = 1;
+
+  for (unsigned int z = 1; z <= SIZED_MAX_TABLES; z++) {
+    if (max_entries / z < 2) { break; }
+
+    double rate = _fp_rate(n, max_entries / z, z);
+    if (rate < best_rate) {
+      best_n_tables = z;
+      best_rate = rate;
+    }
+  }
+
+  // primes below the size, so that the total is within max_entries.
+  std::vector<HashIntoType> sizes;
+  HashIntoType size = max_entries / best_n_tables;
+  while (sizes.size() < best_n_tables && size > 1) {
+    if (Primes::is_prime(size)) {
+      sizes.push_back(size);
+    }
+    size--;
+  }
+  assert(sizes.size() == best_n_tables);
+
+  return sizes;
+}
+
+// vim: set sts=2 sw=2:
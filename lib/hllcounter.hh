@@ -0,0 +1,70 @@
+#ifndef HLLCOUNTER_HH
+#define HLLCOUNTER_HH
+
+#include <string>
+#include <vector>
+#include "khmer.hh"
+#include "read_parsers.hh"
+
+#   define HLL_DEFAULT_ERROR_RATE 0.01
+#   define HLL_MIN_PRECISION 4
+#   define HLL_MAX_PRECISION 18
+
+namespace khmer {
+
+  // A HyperLogLog estimate of the number of distinct k-mers in some
+  // sequences, in 2^p one-byte registers (16KB at the default 1% error).
+  // A k-mer goes to the register picked by the first p bits of a mix of
+  // its forward/reverse hash, which keeps the longest run of leading
+  // zeros it has seen in the rest of the bits.
+  //
+  // consume_fasta() may be called from several threads sharing an
+  // IParser.  Each keeps its own registers, and takes the maximum into
+  // the shared ones at the end, even if it then throws
+  // InvalidReadFileFormat.
+  class HLLCounter {
+  protected:
+    WordLength		      _ksize;
+    unsigned int	      _p;
+    std::vector<uint8_t>      _registers;
+
+    void _add(uint8_t * registers, HashIntoType kmer) const;
+    unsigned long long _consume_string(uint8_t * registers,
+				       const std::string &s) const;
+
+  public:
+    HLLCounter(WordLength ksize, double error_rate = HLL_DEFAULT_ERROR_RATE);
+
+    WordLength ksize() const { return _ksize; }
+    unsigned int precision() const { return _p; }
+
+    // Add the k-mers in s, and return the number added.
+    unsigned long long consume_string(const std::string &s);
+    void consume_fasta(read_parsers:: IParser * parser,
+		       unsigned int &total_reads,
+		       unsigned long long &n_consumed);
+
+    // Take in the k-mers another counter with the same k and p has seen.
+    void merge(const HLLCounter &other);
+
+    HashIntoType estimate_cardinality() const;
+  };
+
+  // Table sizes for a Bloom filter or count-min sketch over n_kmers
+  // distinct k-mers, as distinct primes, one per table.  With z tables of
+  // size x, a k-mer that isn't there is reported present with
+  // probability (1 - e^(-n/x))^z.
+  //
+  // The first is the smallest total size for which that is at most
+  // fp_rate; the second, the number of tables that makes it lowest for
+  // a total of at most max_entries.
+  std::vector<HashIntoType> get_table_sizes_for_fp_rate(HashIntoType n_kmers,
+							double fp_rate);
+  std::vector<HashIntoType> get_table_sizes_for_memory(
+    HashIntoType n_kmers, HashIntoType max_entries
+  );
+};
+
+#endif // HLLCOUNTER_HH
+
+// vim: set sts=2 sw=2:
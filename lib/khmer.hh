@@ -24,17 +24,28 @@ extern "C"
 #   define MAX_COUNT 255
 #   define MAX_BIGCOUNT 65535
 #   define DEFAULT_TAG_DENSITY 40   // must be even
+#   define COUNTING_BLOCK_SIZE 64    // bytes per block; one cache line
+#   define KMER_BATCH_SIZE 256	    // k-mers handed to count_batch at once
+#   define PREFETCH_DISTANCE 8	    // k-mers to prefetch ahead in a batch
+#   define CONSERVATIVE_UPDATE_LOCKS 1024 // k-mer locks for conservative counting
 
 #   define MAX_CIRCUM 3		// @CTB remove
 #   define CIRCUM_RADIUS 2	// @CTB remove
 #   define CIRCUM_MAX_VOL 200	// @CTB remove
 
-#   define SAVED_FORMAT_VERSION 3
+#   define SAVED_FORMAT_VERSION 7
+#   define SAVED_FORMAT_MIN_VERSION 3 // oldest version we can still load
 #   define SAVED_COUNTING_HT 1
 #   define SAVED_HASHBITS 2
 #   define SAVED_TAGS 3
 #   define SAVED_STOPTAGS 4
 #   define SAVED_SUBSET 5
+#   define SAVED_BLOCKED_COUNTING_HT 6
+#   define SAVED_EXACT_COUNTING_HT 7
+#   define SAVED_PAGED_HASHBITS 8 // SAVED_HASHBITS, tables page-aligned
+#   define SAVED_BLOCKED_HASHBITS 9 // blocked Hashbits, blocks page-aligned
+#   define SAVED_PAGE_SIZE 4096	// v6+ counting tables start on this boundary
+#   define MERGE_WINDOW_SIZE (1024 * 1024) // bytes of each table merged at once
 
 #   define VERBOSE_REPARTITION 0
 
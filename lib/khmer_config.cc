@@ -36,7 +36,10 @@ Config( )
     _number_of_threads( 1 ),
     _reads_input_buffer_size( 512U*1024*1024 ),
     _ibmgr_trace_level( 255U ),
-    _rparser_trace_level( 255U )
+    _rparser_trace_level( 255U ),
+    _table_huge_pages( TABLE_PAGES_NORMAL ),
+    _table_numa_interleave( false ),
+    _table_zero_threads( 1 )
 { }
 
 
@@ -119,6 +122,52 @@ set_reads_parser_trace_level( uint8_t trace_level )
 { _rparser_trace_level = trace_level; }
 
 
+uint8_t const
+Config::
+get_table_huge_pages( void ) const
+{ return _table_huge_pages; }
+
+
+void
+Config::
+set_table_huge_pages( uint8_t const huge_pages )
+{
+    if (huge_pages > TABLE_PAGES_EXPLICIT)
+	throw InvalidTableHugePages( );
+
+    _table_huge_pages = huge_pages;
+}
+
+
+bool const
+Config::
+get_table_numa_interleave( void ) const
+{ return _table_numa_interleave; }
+
+
+void
+Config::
+set_table_numa_interleave( bool const interleave )
+{ _table_numa_interleave = interleave; }
+
+
+uint32_t const
+Config::
+get_table_zero_threads( void ) const
+{ return _table_zero_threads; }
+
+
+void
+Config::
+set_table_zero_threads( uint32_t const zero_threads )
+{
+    if (0 == zero_threads)
+	throw InvalidTableZeroThreads( );
+
+    _table_zero_threads = zero_threads;
+}
+
+
 } // namespace khmer
 
 // vim: set ft=cpp sts=4 sw=4 tw=79:
@@ -6,6 +6,17 @@
 namespace khmer
 {
 
+// How the hash tables are backed (see allocate_table).
+#   define TABLE_PAGES_NORMAL	    0
+#   define TABLE_PAGES_TRANSPARENT  1
+#   define TABLE_PAGES_EXPLICIT	    2
+
+// Thrown by the setters for the table placement.
+struct InvalidTableHugePages : public std:: exception
+{ };
+struct InvalidTableZeroThreads : public std:: exception
+{ };
+
 // Special class for holding configuration values 
 // and providing accessors to them.
 // There is no need for there to be a singleton.
@@ -29,6 +40,14 @@ struct Config
     uint8_t const get_reads_parser_trace_level( void ) const;
     void set_reads_parser_trace_level( uint8_t const );
 
+    // Placement of hash tables allocated from here on.
+    uint8_t const get_table_huge_pages( void ) const;
+    void set_table_huge_pages( uint8_t const );
+    bool const get_table_numa_interleave( void ) const;
+    void set_table_numa_interleave( bool const );
+    uint32_t const get_table_zero_threads( void ) const;
+    void set_table_zero_threads( uint32_t const );
+
 private:
     
     bool	_has_extra_sanity_checks;
@@ -40,6 +59,10 @@ private:
     uint8_t	_ibmgr_trace_level;
     uint8_t	_rparser_trace_level;
 
+    uint8_t	_table_huge_pages;
+    bool	_table_numa_interleave;
+    uint32_t	_table_zero_threads;
+
 };
 
 // Get and set default configuration instance.
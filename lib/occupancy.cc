@@ -0,0 +1,585 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "occupancy.hh"
+#include "threads.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KHMER_OCCUPANCY_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace khmer;
+
+// Below this many bins (bytes, for combine_bits()) to a thread, threads
+// cost more than they save.
+#define OCCUPANCY_MIN_CHUNK (1 << 20)
+
+// each counter's low bit, across a word.
+static inline uint64_t _low_bits(unsigned int counter_bits)
+{
+  return ~0ULL / ((1ULL << counter_bits) - 1);
+}
+
+// Set each counter's low bit if any of its bits are, and clear the rest.
+static inline uint64_t _fold_counters(uint64_t x, unsigned int counter_bits)
+{
+  for (unsigned int s = counter_bits / 2; s; s /= 2) {
+    x |= x >> s;
+  }
+  return x & _low_bits(counter_bits);
+}
+
+static inline unsigned int _popcount(uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (unsigned int) ((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Nonzero counters in n whole bytes, 8 at a time.
+static inline uint64_t _count_words(const Byte * bytes, size_t n,
+				    unsigned int counter_bits)
+{
+  uint64_t count = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    uint64_t x;
+    memcpy(&x, bytes + i, 8);
+    count += _popcount(_fold_counters(x, counter_bits));
+  }
+  for (; i < n; i++) {
+    count += _popcount(_fold_counters(bytes[i], counter_bits));
+  }
+  return count;
+}
+
+static uint64_t _count_portable(const Byte * bytes, size_t n,
+				unsigned int counter_bits)
+{
+  return _count_words(bytes, n, counter_bits);
+}
+
+static inline uint64_t _bit_op(uint64_t x, uint64_t y, BitOp op)
+{
+  switch (op) {
+  case BIT_OR:	return x | y;
+  case BIT_AND:	return x & y;
+  default:	return x & ~y;
+  }
+}
+
+// dest = a op b for n bytes, 8 at a time, unless dest is NULL; returns
+// the set bits of a op b.
+static inline uint64_t _combine_words(Byte * dest, const Byte * a,
+				      const Byte * b, size_t n, BitOp op)
+{
+  uint64_t count = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    uint64_t z = _bit_op(x, y, op);
+    if (dest) {
+      memcpy(dest + i, &z, 8);
+    }
+    count += _popcount(z);
+  }
+  for (; i < n; i++) {
+    Byte z = (Byte) _bit_op(a[i], b[i], op);
+    if (dest) {
+      dest[i] = z;
+    }
+    count += _popcount(z);
+  }
+  return count;
+}
+
+static uint64_t _combine_portable(Byte * dest, const Byte * a, const Byte * b,
+				  size_t n, BitOp op)
+{
+  return _combine_words(dest, a, b, n, op);
+}
+
+#ifdef KHMER_OCCUPANCY_DISPATCH
+
+// The same code, where __builtin_popcountll is one instruction.
+__attribute__((target("popcnt")))
+static uint64_t _count_popcnt(const Byte * bytes, size_t n,
+			      unsigned int counter_bits)
+{
+  return _count_words(bytes, n, counter_bits);
+}
+
+__attribute__((target("popcnt")))
+static uint64_t _combine_popcnt(Byte * dest, const Byte * a, const Byte * b,
+				size_t n, BitOp op)
+{
+  return _combine_words(dest, a, b, n, op);
+}
+
+// The set bits in each 64-bit lane of x: popcount each byte by looking
+// its two nibbles up with a shuffle, and sum the bytes.
+__attribute__((target("avx2")))
+static inline __m256i _popcount_avx2(__m256i x)
+{
+  const __m256i nibble_counts = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+  );
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+
+  __m256i lo = _mm256_and_si256(x, low_nibbles);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibbles);
+  __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(nibble_counts, lo),
+				   _mm256_shuffle_epi8(nibble_counts, hi));
+  return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t _sum_lanes_avx2(__m256i x)
+{
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *) lanes, x);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// 32 bytes at a time: fold and mask as above, and popcount.
+__attribute__((target("avx2")))
+static uint64_t _count_avx2(const Byte * bytes, size_t n,
+			    unsigned int counter_bits)
+{
+  const __m256i low_bits =
+    _mm256_set1_epi8((char) (Byte) _low_bits(counter_bits));
+  __m256i totals = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *) (bytes + i));
+
+    // 16-bit shifts carry bits across bytes, but only into bits that
+    // are masked off: a counter never straddles a byte.
+    for (unsigned int s = counter_bits / 2; s; s /= 2) {
+      x = _mm256_or_si256(x, _mm256_srl_epi16(x, _mm_cvtsi32_si128(s)));
+    }
+    x = _mm256_and_si256(x, low_bits);
+    totals = _mm256_add_epi64(totals, _popcount_avx2(x));
+  }
+
+  return _sum_lanes_avx2(totals) +
+    _count_words(bytes + i, n - i, counter_bits);
+}
+
+__attribute__((target("avx2")))
+static uint64_t _combine_avx2(Byte * dest, const Byte * a, const Byte * b,
+			      size_t n, BitOp op)
+{
+  __m256i totals = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+    __m256i z;
+
+    switch (op) {
+    case BIT_OR:  z = _mm256_or_si256(x, y); break;
+    case BIT_AND: z = _mm256_and_si256(x, y); break;
+    default:	  z = _mm256_andnot_si256(y, x); break;
+    }
+    if (dest) {
+      _mm256_storeu_si256((__m256i *) (dest + i), z);
+    }
+    totals = _mm256_add_epi64(totals, _popcount_avx2(z));
+  }
+
+  return _sum_lanes_avx2(totals) +
+    _combine_words(dest ? dest + i : NULL, a + i, b + i, n - i, op);
+}
+
+#endif // KHMER_OCCUPANCY_DISPATCH
+
+typedef uint64_t (*CountKernel)(const Byte *, size_t, unsigned int);
+typedef uint64_t (*CombineKernel)(Byte *, const Byte *, const Byte *, size_t,
+				  BitOp);
+
+struct OccupancyKernels {
+  const char *	name;
+  CountKernel	count;
+  CombineKernel	combine;
+};
+
+static OccupancyKernels _pick_kernels()
+{
+  OccupancyKernels kernels = { "portable", _count_portable, _combine_portable };
+
+#ifdef KHMER_OCCUPANCY_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    OccupancyKernels avx2 = { "avx2", _count_avx2, _combine_avx2 };
+    kernels = avx2;
+  } else if (__builtin_cpu_supports("popcnt")) {
+    OccupancyKernels popcnt = { "popcnt", _count_popcnt, _combine_popcnt };
+    kernels = popcnt;
+  }
+#endif
+
+  return kernels;
+}
+
+const char * khmer::occupancy_kernel_name()
+{
+  return _pick_kernels().name;
+}
+
+// Nonzero counters among counters [start, stop) of table; those in
+// partly-covered bytes at either end are looked at one by one.
+static uint64_t _count_range(CountKernel kernel, const Byte * table,
+			     unsigned int counter_bits,
+			     HashIntoType start, HashIntoType stop)
+{
+  const unsigned int per_byte = 8 / counter_bits;
+  const Byte mask = (Byte) ((1 << counter_bits) - 1);
+  uint64_t count = 0;
+
+  for (; start < stop && start % per_byte; start++) {
+    HashIntoType bitpos = start * counter_bits;
+    count += ((table[bitpos >> 3] >> (bitpos & 7)) & mask) ? 1 : 0;
+  }
+  for (; stop > start && stop % per_byte; stop--) {
+    HashIntoType bitpos = (stop - 1) * counter_bits;
+    count += ((table[bitpos >> 3] >> (bitpos & 7)) & mask) ? 1 : 0;
+  }
+  if (start < stop) {
+    count += kernel(table + start / per_byte, (stop - start) / per_byte,
+		    counter_bits);
+  }
+  return count;
+}
+
+// One thread's share of a count: items [start, stop) of whatever the
+// count is over.
+struct OccupancyChunk {
+  uint64_t (*count)(const OccupancyChunk &chunk);
+
+  CountKernel kernel;
+  const Byte * table;
+  unsigned int counter_bits;
+  HashIntoType start;
+  HashIntoType stop;
+
+  // blocked layout only
+  unsigned int block_stride;
+  unsigned int slice;
+
+  // combine_bits() only: table and other are combined, a byte at a time.
+  CombineKernel combine;
+  Byte * dest;
+  const Byte * other;
+  BitOp op;
+
+  uint64_t result;
+};
+
+static void _count_chunk(void * chunks, uint32_t thread_n)
+{
+  OccupancyChunk &c = ((OccupancyChunk *) chunks)[thread_n];
+  c.result = c.count(c);
+}
+
+// Split [start, stop) into chunks that start on multiples of grain,
+// count them on up to number_of_threads threads, and add them up.
+static uint64_t _count_in_parallel(const OccupancyChunk &whole,
+				   HashIntoType grain,
+				   uint32_t number_of_threads)
+{
+  HashIntoType n = whole.stop - whole.start;
+  HashIntoType n_threads = n / OCCUPANCY_MIN_CHUNK;
+
+  if (n_threads > number_of_threads) {
+    n_threads = number_of_threads;
+  }
+  if (n_threads <= 1) {
+    return whole.count(whole);
+  }
+
+  HashIntoType per_thread = (n / n_threads + grain - 1) / grain * grain;
+  vector<OccupancyChunk> chunks(n_threads, whole);
+  for (HashIntoType i = 0; i < n_threads; i++) {
+    chunks[i].start = min(whole.stop, whole.start + i * per_thread);
+    chunks[i].stop = min(whole.stop, chunks[i].start + per_thread);
+  }
+  chunks[n_threads - 1].stop = whole.stop;
+
+  run_on_threads(_count_chunk, &chunks[0], n_threads);
+
+  uint64_t count = 0;
+  for (HashIntoType i = 0; i < n_threads; i++) {
+    count += chunks[i].result;
+  }
+  return count;
+}
+
+static uint64_t _count_table_chunk(const OccupancyChunk &c)
+{
+  return _count_range(c.kernel, c.table, c.counter_bits, c.start, c.stop);
+}
+
+static uint64_t _count_blocked_chunk(const OccupancyChunk &c)
+{
+  const HashIntoType stride = c.block_stride;
+  const HashIntoType base = (HashIntoType) c.slice * stride;
+  uint64_t count = 0;
+
+  for (HashIntoType bin = c.start; bin < c.stop; ) {
+    HashIntoType block = bin / stride;
+    HashIntoType first = bin % stride;
+    HashIntoType last = min(stride, first + (c.stop - bin));
+
+    count += _count_range(c.kernel, c.table + block * COUNTING_BLOCK_SIZE,
+			  c.counter_bits, base + first, base + last);
+    bin += last - first;
+  }
+  return count;
+}
+
+// Count bins i % tablesize for i in [start, stop), a lap of the table at
+// a time.
+static HashIntoType _count_wrapped(OccupancyChunk whole,
+				   HashIntoType tablesize,
+				   HashIntoType grain,
+				   uint32_t number_of_threads)
+{
+  HashIntoType start = whole.start, stop = whole.stop;
+  HashIntoType count = 0;
+
+  if (stop == 0) {
+    stop = tablesize;
+  }
+  while (start < stop) {
+    HashIntoType bin = start % tablesize;
+    HashIntoType n = min(stop - start, tablesize - bin);
+
+    whole.start = bin;
+    whole.stop = bin + n;
+    count += _count_in_parallel(whole, grain, number_of_threads);
+    start += n;
+  }
+  return count;
+}
+
+HashIntoType khmer::count_nonzero_counters(const Byte * table,
+					   unsigned int counter_bits,
+					   HashIntoType tablesize,
+					   HashIntoType start,
+					   HashIntoType stop,
+					   uint32_t number_of_threads)
+{
+  assert(counter_bits == 1 || counter_bits == 2 || counter_bits == 4 ||
+	 counter_bits == 8);
+  assert(number_of_threads > 0);
+
+  OccupancyChunk whole;
+  memset(&whole, 0, sizeof(whole));
+  whole.count = _count_table_chunk;
+  whole.kernel = _pick_kernels().count;
+  whole.table = table;
+  whole.counter_bits = counter_bits;
+  whole.start = start;
+  whole.stop = stop;
+
+  // chunks start on cache lines.
+  HashIntoType grain = 64 * (8 / counter_bits);
+  return _count_wrapped(whole, tablesize, grain, number_of_threads);
+}
+
+HashIntoType khmer::count_nonzero_counters_blocked(const Byte * blocks,
+						   HashIntoType n_blocks,
+						   unsigned int counter_bits,
+						   unsigned int block_stride,
+						   unsigned int slice,
+						   HashIntoType start,
+						   HashIntoType stop,
+						   uint32_t number_of_threads)
+{
+  assert(counter_bits == 1 || counter_bits == 2 || counter_bits == 4 ||
+	 counter_bits == 8);
+  assert(number_of_threads > 0);
+  assert((slice + 1) * block_stride * counter_bits <= COUNTING_BLOCK_SIZE * 8);
+
+  OccupancyChunk whole;
+  memset(&whole, 0, sizeof(whole));
+  whole.count = _count_blocked_chunk;
+  whole.kernel = _pick_kernels().count;
+  whole.table = blocks;
+  whole.counter_bits = counter_bits;
+  whole.start = start;
+  whole.stop = stop;
+  whole.block_stride = block_stride;
+  whole.slice = slice;
+
+  // chunks start on blocks.
+  return _count_wrapped(whole, n_blocks * block_stride, block_stride,
+			number_of_threads);
+}
+
+// One thread's share of blocked_fp_rate(): blocks [start, stop).
+struct BlockedFpChunk {
+  CountKernel kernel;
+  const Byte * blocks;
+  unsigned int counter_bits;
+  unsigned int block_stride;
+  unsigned int n_slices;
+  HashIntoType start;
+  HashIntoType stop;
+
+  double sum;
+};
+
+static void _blocked_fp_chunk(void * chunks, uint32_t thread_n)
+{
+  BlockedFpChunk &c = ((BlockedFpChunk *) chunks)[thread_n];
+  const HashIntoType stride = c.block_stride;
+
+  c.sum = 0;
+  for (HashIntoType block = c.start; block < c.stop; block++) {
+    const Byte * counters = c.blocks + block * COUNTING_BLOCK_SIZE;
+    double rate = 1.0;
+
+    for (unsigned int i = 0; i < c.n_slices && rate > 0; i++) {
+      rate *= double(_count_range(c.kernel, counters, c.counter_bits,
+				  i * stride, (i + 1) * stride)) / stride;
+    }
+    c.sum += rate;
+  }
+}
+
+double khmer::blocked_fp_rate(const Byte * blocks, HashIntoType n_blocks,
+			      unsigned int counter_bits,
+			      unsigned int block_stride,
+			      unsigned int n_slices,
+			      uint32_t number_of_threads)
+{
+  assert(n_slices * block_stride * counter_bits <= COUNTING_BLOCK_SIZE * 8);
+  assert(number_of_threads > 0);
+
+  if (!n_blocks) {
+    return 0;
+  }
+
+  HashIntoType n_threads =
+    n_blocks * COUNTING_BLOCK_SIZE / OCCUPANCY_MIN_CHUNK;
+  if (n_threads > number_of_threads) {
+    n_threads = number_of_threads;
+  }
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+
+  BlockedFpChunk whole = { _pick_kernels().count, blocks, counter_bits,
+			   block_stride, n_slices, 0, n_blocks, 0 };
+  HashIntoType per_thread = (n_blocks + n_threads - 1) / n_threads;
+  vector<BlockedFpChunk> chunks(n_threads, whole);
+  for (HashIntoType i = 0; i < n_threads; i++) {
+    chunks[i].start = min(n_blocks, i * per_thread);
+    chunks[i].stop = min(n_blocks, chunks[i].start + per_thread);
+  }
+
+  run_on_threads(_blocked_fp_chunk, &chunks[0], n_threads);
+
+  double sum = 0;
+  for (HashIntoType i = 0; i < n_threads; i++) {
+    sum += chunks[i].sum;
+  }
+  return sum / n_blocks;
+}
+
+static uint64_t _combine_chunk(const OccupancyChunk &c)
+{
+  return c.combine(c.dest ? c.dest + c.start : NULL, c.table + c.start,
+		   c.other + c.start, c.stop - c.start, c.op);
+}
+
+HashIntoType khmer::combine_bits(Byte * dest, const Byte * a, const Byte * b,
+				 HashIntoType n_bytes, BitOp op,
+				 uint32_t number_of_threads)
+{
+  assert(number_of_threads > 0);
+
+  OccupancyChunk whole;
+  memset(&whole, 0, sizeof(whole));
+  whole.count = _combine_chunk;
+  whole.combine = _pick_kernels().combine;
+  whole.dest = dest;
+  whole.table = a;
+  whole.other = b;
+  whole.op = op;
+  whole.start = 0;
+  whole.stop = n_bytes;
+
+  // chunks start on cache lines.
+  return _count_in_parallel(whole, 64, number_of_threads);
+}
+
+double TableOccupancy::get_fp_rate() const
+{
+  if (blocked_fp_rate >= 0) {
+    return blocked_fp_rate;
+  }
+
+  double rate = 1.0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    rate *= double(occupied[i]) / double(sizes[i]);
+  }
+  return rate;
+}
+
+double TableOccupancy::estimate_n_kmers() const
+{
+  if (sizes.empty()) {
+    return 0;
+  }
+
+  double total = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    double m = double(sizes[i]);
+    total += -m * log(1.0 - double(occupied[i]) / m);
+  }
+  return total / sizes.size();
+}
+
+double SetComparison::estimate_n_intersection() const
+{
+  double n = first.estimate_n_kmers() + second.estimate_n_kmers() -
+    either.estimate_n_kmers();
+  return n > 0 ? n : 0;
+}
+
+double SetComparison::estimate_n_difference() const
+{
+  double n = either.estimate_n_kmers() - second.estimate_n_kmers();
+  return n > 0 ? n : 0;
+}
+
+double SetComparison::get_jaccard() const
+{
+  double n_union = estimate_n_union();
+  if (!(n_union > 0)) {
+    return 0;
+  }
+  double jaccard = estimate_n_intersection() / n_union;
+  return jaccard < 1 ? jaccard : 1;
+}
+
+// vim: set sts=2 sw=2:
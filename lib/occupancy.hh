@@ -0,0 +1,115 @@
+#ifndef OCCUPANCY_HH
+#define OCCUPANCY_HH
+
+#include <vector>
+#include "khmer.hh"
+
+namespace khmer {
+
+  // Counting the occupied bins of Hashbits and CountingHash tables a word
+  // at a time, rather than a bin at a time, and combining Hashbits tables
+  // the same way.
+  //
+  // Counters are 1, 2, 4, or 8 bits wide, packed from the low bits of each
+  // byte up, as in both tables.  Each word of counters is folded so that
+  // the low bit of each counter is set if any of its bits are (shift down
+  // by half a counter and OR, then a quarter, ...), the other bits are
+  // masked off, and the word is popcounted; 1-bit counters are popcounted
+  // as they are.  This runs 32 bytes at a time with AVX2, or 8 at a time
+  // with the POPCNT instruction or, on other machines, a portable popcount;
+  // which is picked at run time from what the CPU supports.  Tables are
+  // combined, and the result popcounted, the same ways.
+  //
+  // Big ranges are split into chunks of whole cache lines, one to a
+  // thread; the calling thread is one of them.
+
+  // The number of nonzero counter_bits-wide counters in bins
+  // i % tablesize of table, for i in [start, stop), or all of them if
+  // stop is 0.
+  HashIntoType count_nonzero_counters(const Byte * table,
+				      unsigned int counter_bits,
+				      HashIntoType tablesize,
+				      HashIntoType start = 0,
+				      HashIntoType stop = 0,
+				      uint32_t number_of_threads = 1);
+
+  // The same, for one slice of a blocked CountingHash or Hashbits: bin b
+  // of the slice is counter slice * block_stride + b % block_stride of
+  // block b / block_stride, and there are n_blocks * block_stride bins.
+  HashIntoType count_nonzero_counters_blocked(const Byte * blocks,
+					      HashIntoType n_blocks,
+					      unsigned int counter_bits,
+					      unsigned int block_stride,
+					      unsigned int slice,
+					      HashIntoType start = 0,
+					      HashIntoType stop = 0,
+					      uint32_t number_of_threads = 1);
+
+  // The false positive rate of a blocked Bloom filter or count-min
+  // sketch with n_slices slices: the mean, over the blocks, of the product
+  // of the occupied fractions of the block's slices.  Blocks fill
+  // unevenly, and the fuller ones are both hit as often and worse, so
+  // this is higher than the product of the slices' overall occupancy.
+  double blocked_fp_rate(const Byte * blocks, HashIntoType n_blocks,
+			 unsigned int counter_bits, unsigned int block_stride,
+			 unsigned int n_slices, uint32_t number_of_threads = 1);
+
+  // Set operations on the tables of two Bloom filters built alike, a
+  // byte at a time.
+  enum BitOp { BIT_OR, BIT_AND, BIT_AND_NOT };
+
+  // dest = a op b, for n_bytes bytes, unless dest is NULL; dest may be a
+  // or b.  Returns the number of bits set in a op b.
+  HashIntoType combine_bits(Byte * dest, const Byte * a, const Byte * b,
+			    HashIntoType n_bytes, BitOp op,
+			    uint32_t number_of_threads = 1);
+
+  // the kernels count_nonzero_counters() and combine_bits() use on this
+  // CPU: "avx2", "popcnt", or "portable".
+  const char * occupancy_kernel_name();
+
+  // The occupied bins of each table of a Bloom filter or count-min
+  // sketch, and what follows from them.
+  struct TableOccupancy {
+    std::vector<HashIntoType> sizes;
+    std::vector<HashIntoType> occupied;
+
+    // For a blocked table, its blocked_fp_rate(); otherwise negative.
+    double blocked_fp_rate;
+
+    TableOccupancy() : blocked_fp_rate(-1) { }
+
+    // The chance that a k-mer never added is found in all of the tables:
+    // the product of their occupied fractions, or blocked_fp_rate.
+    double get_fp_rate() const;
+
+    // An estimate of the number of distinct k-mers added.  n k-mers leave
+    // about m * (1 - e^(-n/m)) of m bins occupied, so each table gives
+    // n = -m * ln(1 - occupied/m); this is the mean over the tables.  It
+    // is infinite if a table is full.
+    double estimate_n_kmers() const;
+  };
+
+  // How the k-mers in two Bloom filters built alike overlap, from the
+  // occupancy of each and of their union, the OR of their tables.  With
+  // n() estimated as in TableOccupancy, n(A and B) = n(A) + n(B) -
+  // n(A or B), and so on.
+  struct SetComparison {
+    TableOccupancy first;
+    TableOccupancy second;
+    TableOccupancy either;
+
+    double estimate_n_union() const { return either.estimate_n_kmers(); }
+    double estimate_n_intersection() const;
+
+    // the k-mers in first but not in second.
+    double estimate_n_difference() const;
+
+    // the intersection over the union, or 0 if both are empty.
+    double get_jaccard() const;
+  };
+};
+
+#endif // OCCUPANCY_HH
+
+// vim: set sts=2 sw=2:
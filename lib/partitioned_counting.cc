@@ -0,0 +1,417 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <sstream>
+
+#include "partitioned_counting.hh"
+#include "exact_counting.hh"
+#include "hashtable.hh"
+
+using namespace std;
+using namespace khmer;
+using namespace khmer:: read_parsers;
+
+// The saved ExactCountingHash header: version, type, k, and the number
+// of k-mers.
+#define DB_N_KMERS_OFFSET   (2 + sizeof(unsigned int))
+#define DB_HEADER_SIZE	    (DB_N_KMERS_OFFSET + sizeof(HashIntoType))
+
+PartitionedCountingEngine::PartitionedCountingEngine(
+  WordLength ksize, unsigned int n_ranges, const std::string &tmp_prefix,
+  uint32_t const number_of_threads
+) :
+  _ksize(ksize), _bounds(get_range_bounds(ksize, n_ranges)),
+  _tmp_prefix(tmp_prefix), _number_of_threads(number_of_threads),
+  _parser(NULL), _invalid_file_format(false), _range(0), _range_file(NULL),
+  _range_ht(NULL), _n_reads(0), _n_kmers(0), _n_super_kmers(0),
+  _n_unique_kmers(0)
+{
+  assert(_ksize > 0 && _ksize <= 32);
+  assert(_number_of_threads > 0);
+
+  _spill_locks = new pthread_mutex_t[n_ranges];
+  for (unsigned int i = 0; i < n_ranges; i++) {
+    pthread_mutex_init(&_spill_locks[i], NULL);
+  }
+  pthread_mutex_init(&_lock, NULL);
+}
+
+PartitionedCountingEngine::~PartitionedCountingEngine()
+{
+  for (unsigned int i = 0; i + 1 < _bounds.size(); i++) {
+    pthread_mutex_destroy(&_spill_locks[i]);
+  }
+  delete [] _spill_locks;
+  pthread_mutex_destroy(&_lock);
+}
+
+std::vector<HashIntoType> PartitionedCountingEngine::get_range_bounds(
+  WordLength ksize, unsigned int n_ranges
+)
+{
+  assert(n_ranges > 0);
+
+  long double n_hashes = ldexpl(1.0, 2 * ksize);
+  std::vector<HashIntoType> bounds(n_ranges + 1);
+
+  bounds[0] = 0;
+  for (unsigned int i = 1; i < n_ranges; i++) {
+    long double quantile = (long double) i / n_ranges;
+    bounds[i] = (HashIntoType) (n_hashes * (1 - sqrtl(1 - quantile)));
+  }
+
+  // no canonical 32-mer hashes to all ones; its reverse complement is 0.
+  bounds[n_ranges] = ksize == 32 ? ~((HashIntoType) 0) :
+    ((HashIntoType) 1) << (2 * ksize);
+
+  return bounds;
+}
+
+std::string PartitionedCountingEngine::_spill_filename(unsigned int range)
+  const
+{
+  std::ostringstream name;
+  name << _tmp_prefix << ".range" << range;
+  return name.str();
+}
+
+inline unsigned int PartitionedCountingEngine::_range_of(HashIntoType kmer)
+  const
+{
+  return std::upper_bound(_bounds.begin(), _bounds.end(), kmer) -
+    _bounds.begin() - 1;
+}
+
+void PartitionedCountingEngine::count(
+  const std::vector<std::string> &infilenames, const std::string &outfilename
+)
+{
+  Config &the_config = get_active_config( );
+  const unsigned int n_ranges = _bounds.size() - 1;
+
+  _n_reads = _n_kmers = _n_super_kmers = _n_unique_kmers = 0;
+  _invalid_file_format = false;
+
+  // pass 1: spill the super-k-mers of every read to their ranges' files.
+  _spill_files.resize(n_ranges);
+  for (unsigned int i = 0; i < n_ranges; i++) {
+    _spill_files[i] = fopen(_spill_filename(i).c_str(), "wb");
+    assert(_spill_files[i] != NULL);
+  }
+
+  for (size_t i = 0; i < infilenames.size() && !_invalid_file_format; i++) {
+    _parser = IParser::get_parser(
+      infilenames[i], _number_of_threads,
+      the_config.get_reads_input_buffer_size( ),
+      the_config.get_reads_parser_trace_level( )
+    );
+    run_on_threads(_run_spill_thread, this, _number_of_threads);
+    delete _parser;
+    _parser = NULL;
+  }
+
+  for (unsigned int i = 0; i < n_ranges; i++) {
+    fclose(_spill_files[i]);
+  }
+  _spill_files.clear();
+
+  if (_invalid_file_format) {
+    for (unsigned int i = 0; i < n_ranges; i++) {
+      unlink(_spill_filename(i).c_str());
+    }
+    throw InvalidReadFileFormat();
+  }
+
+  // pass 2: count each range, and write its k-mers out in order.  The
+  // counts go to a file of their own until all of the k-mers are out.
+  std::string counts_filename = _tmp_prefix + ".counts";
+  FILE * outfile = fopen(outfilename.c_str(), "wb");
+  FILE * countsfile = fopen(counts_filename.c_str(), "w+b");
+  assert(outfile != NULL && countsfile != NULL);
+
+  unsigned char version = SAVED_FORMAT_VERSION;
+  unsigned char ht_type = SAVED_EXACT_COUNTING_HT;
+  unsigned int save_ksize = _ksize;
+  HashIntoType n_unique_kmers = 0;
+
+  fwrite(&version, 1, 1, outfile);
+  fwrite(&ht_type, 1, 1, outfile);
+  fwrite(&save_ksize, sizeof(save_ksize), 1, outfile);
+  fwrite(&n_unique_kmers, sizeof(n_unique_kmers), 1, outfile);
+
+  for (_range = 0; _range < n_ranges; _range++) {
+    std::string spill_filename = _spill_filename(_range);
+
+    _range_file = fopen(spill_filename.c_str(), "rb");
+    assert(_range_file != NULL);
+    _range_ht = new ExactCountingHash(_ksize, 0, _number_of_threads);
+
+    run_on_threads(_run_count_thread, this, _number_of_threads);
+
+    fclose(_range_file);
+    _range_file = NULL;
+    unlink(spill_filename.c_str());
+
+    std::vector<HashIntoType> kmers;
+    std::vector<BoundedCounterType> counts;
+    _range_ht->get_sorted(kmers, counts);
+    delete _range_ht;
+    _range_ht = NULL;
+
+    if (!kmers.empty()) {
+      fwrite(&kmers[0], sizeof(HashIntoType), kmers.size(), outfile);
+      fwrite(&counts[0], sizeof(BoundedCounterType), counts.size(),
+	     countsfile);
+    }
+    n_unique_kmers += kmers.size();
+  }
+
+  std::vector<char> buffer(PARTITIONED_SPILL_BUFFER_SIZE);
+  size_t n;
+  rewind(countsfile);
+  while ((n = fread(&buffer[0], 1, buffer.size(), countsfile)) > 0) {
+    fwrite(&buffer[0], 1, n, outfile);
+  }
+  fclose(countsfile);
+  unlink(counts_filename.c_str());
+
+  fseek(outfile, DB_N_KMERS_OFFSET, SEEK_SET);
+  fwrite(&n_unique_kmers, sizeof(n_unique_kmers), 1, outfile);
+  fclose(outfile);
+
+  _n_unique_kmers = n_unique_kmers;
+}
+
+void PartitionedCountingEngine::_run_spill_thread(void * engine,
+						  uint32_t thread_n)
+{
+  ((PartitionedCountingEngine *) engine)->_spill_reads();
+}
+
+// Upper-case the read, and say whether it is all ACGT and at least k long.
+static bool _normalize(std::string &seq, WordLength ksize)
+{
+  if (seq.length() < ksize) {
+    return false;
+  }
+
+  for (size_t i = 0; i < seq.length(); i++) {
+    seq[i] &= 0xdf;
+    if (!is_valid_dna(seq[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PartitionedCountingEngine::_spill_reads()
+{
+  std::vector<std::string> buffers(_bounds.size() - 1);
+  Read		      read;
+  unsigned long long  n_reads	      = 0;
+  unsigned long long  n_kmers	      = 0;
+  unsigned long long  n_super_kmers   = 0;
+
+  while (next_read_or_done(_parser, read, !n_reads, _invalid_file_format)) {
+    n_reads++;
+    std::string &seq = read.sequence;
+    if (!_normalize(seq, _ksize)) {
+      continue;
+    }
+
+    // k-mer i starts at base i; a super-k-mer of k-mers start..i-1 is
+    // bases start..i+k-2.
+    KMerIterator kmers(seq.c_str(), _ksize);
+    unsigned int range = _range_of(kmers.next());
+    unsigned int start = 0, i = 1;
+
+    for (; !kmers.done(); i++) {
+      unsigned int next_range = _range_of(kmers.next());
+      if (next_range != range) {
+	_spill(buffers, range, seq.data() + start, i - start + _ksize - 1);
+	n_super_kmers++;
+	range = next_range;
+	start = i;
+      }
+    }
+    _spill(buffers, range, seq.data() + start, i - start + _ksize - 1);
+    n_super_kmers++;
+    n_kmers += i;
+  }
+
+  for (unsigned int i = 0; i < buffers.size(); i++) {
+    _flush(buffers, i);
+  }
+
+  pthread_mutex_lock(&_lock);
+  _n_reads += n_reads;
+  _n_kmers += n_kmers;
+  _n_super_kmers += n_super_kmers;
+  pthread_mutex_unlock(&_lock);
+}
+
+// A spilled super-k-mer is its length in bases (4 bytes), then the bases,
+// four to a byte, the first in the low bits.
+void PartitionedCountingEngine::_spill(std::vector<std::string> &buffers,
+				       unsigned int range,
+				       const char * bases,
+				       unsigned int n_bases)
+{
+  std::string &buffer = buffers[range];
+
+  buffer.append((const char *) &n_bases, sizeof(n_bases));
+  for (unsigned int i = 0; i < n_bases; i += 4) {
+    unsigned char packed = 0;
+    for (unsigned int j = i; j < n_bases && j < i + 4; j++) {
+      packed |= twobit_repr(bases[j]) << (2 * (j - i));
+    }
+    buffer += (char) packed;
+  }
+
+  if (buffer.length() >= PARTITIONED_SPILL_BUFFER_SIZE) {
+    _flush(buffers, range);
+  }
+}
+
+void PartitionedCountingEngine::_flush(std::vector<std::string> &buffers,
+				       unsigned int range)
+{
+  std::string &buffer = buffers[range];
+
+  pthread_mutex_lock(&_spill_locks[range]);
+  fwrite(buffer.data(), 1, buffer.length(), _spill_files[range]);
+  pthread_mutex_unlock(&_spill_locks[range]);
+
+  buffer.clear();
+}
+
+void PartitionedCountingEngine::_run_count_thread(void * engine,
+						  uint32_t thread_n)
+{
+  ((PartitionedCountingEngine *) engine)->_count_range();
+}
+
+// Take a buffer's worth of super-k-mers at a time from the range's spill
+// file, and count them; they are all in the range, so the bounds only
+// make sure of it.
+void PartitionedCountingEngine::_count_range()
+{
+  const HashIntoType lower_bound = _bounds[_range];
+  const HashIntoType upper_bound = _bounds[_range + 1];
+  std::vector<unsigned char> buffer;
+  std::string seq;
+
+  while (true) {
+    buffer.clear();
+
+    pthread_mutex_lock(&_lock);
+    unsigned int n_bases;
+    while (buffer.size() < PARTITIONED_SPILL_BUFFER_SIZE &&
+	   fread(&n_bases, sizeof(n_bases), 1, _range_file) == 1) {
+      size_t n_bytes = (n_bases + 3) / 4;
+      size_t at = buffer.size();
+
+      buffer.resize(at + sizeof(n_bases) + n_bytes);
+      memcpy(&buffer[at], &n_bases, sizeof(n_bases));
+      size_t n_read = fread(&buffer[at + sizeof(n_bases)], 1, n_bytes,
+			    _range_file);
+      assert(n_read == n_bytes);
+    }
+    pthread_mutex_unlock(&_lock);
+
+    if (buffer.empty()) {
+      break;
+    }
+
+    size_t at = 0;
+    while (at < buffer.size()) {
+      memcpy(&n_bases, &buffer[at], sizeof(n_bases));
+      at += sizeof(n_bases);
+
+      seq.resize(n_bases);
+      for (unsigned int i = 0; i < n_bases; i++) {
+	seq[i] = revtwobit_repr((buffer[at + i / 4] >> (2 * (i % 4))) & 3);
+      }
+      at += (n_bases + 3) / 4;
+
+      _range_ht->consume_string(seq, lower_bound, upper_bound);
+    }
+  }
+}
+
+//
+// KmerCountDatabase
+//
+
+KmerCountDatabase::KmerCountDatabase(const std::string &filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  assert(fd >= 0);
+
+  struct stat st;
+  int stat_rc = fstat(fd, &st);
+  assert(stat_rc == 0);
+  assert((size_t) st.st_size >= DB_HEADER_SIZE);
+
+  _length = st.st_size;
+  _base = mmap(NULL, _length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  assert(_base != MAP_FAILED);
+
+  // lookups land all over the file; don't read ahead.
+  madvise(_base, _length, MADV_RANDOM);
+
+  const Byte * start = (const Byte *) _base;
+  unsigned int save_ksize = 0;
+
+  assert(start[0] == SAVED_FORMAT_VERSION);
+  assert(start[1] == SAVED_EXACT_COUNTING_HT);
+  memcpy(&save_ksize, start + 2, sizeof(save_ksize));
+  memcpy(&_n_kmers, start + DB_N_KMERS_OFFSET, sizeof(_n_kmers));
+
+  _ksize = (WordLength) save_ksize;
+  _kmers = start + DB_HEADER_SIZE;
+  _counts = _kmers + _n_kmers * sizeof(HashIntoType);
+  assert(_counts + _n_kmers * sizeof(BoundedCounterType) <= start + _length);
+}
+
+KmerCountDatabase::~KmerCountDatabase()
+{
+  munmap(_base, _length);
+}
+
+// The header leaves the arrays unaligned; read them a value at a time.
+BoundedCounterType KmerCountDatabase::get_count(HashIntoType khash) const
+{
+  HashIntoType lo = 0, hi = _n_kmers;
+
+  while (lo < hi) {
+    HashIntoType mid = lo + (hi - lo) / 2;
+    HashIntoType kmer;
+    memcpy(&kmer, _kmers + mid * sizeof(HashIntoType), sizeof(kmer));
+
+    if (kmer < khash) {
+      lo = mid + 1;
+    } else if (kmer > khash) {
+      hi = mid;
+    } else {
+      BoundedCounterType count;
+      memcpy(&count, _counts + mid * sizeof(BoundedCounterType),
+	     sizeof(count));
+      return count;
+    }
+  }
+  return 0;
+}
+
+BoundedCounterType KmerCountDatabase::get_count(const char * kmer) const
+{
+  return get_count(_hash(kmer, _ksize));
+}
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,133 @@
+#ifndef PARTITIONED_COUNTING_HH
+#define PARTITIONED_COUNTING_HH
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <pthread.h>
+#include "khmer.hh"
+#include "khmer_config.hh"
+#include "threads.hh"
+#include "read_parsers.hh"
+
+#   define PARTITIONED_SPILL_BUFFER_SIZE (64 * 1024) // per thread and range
+
+namespace khmer {
+
+  class ExactCountingHash;
+
+  // Exact counts for more distinct k-mers than fit in memory at once.
+  //
+  // The canonical k-mer hashes are split into n_ranges ranges, [lower,
+  // upper), of the kind consume_string() and consume_fasta() take bounds
+  // for.  One pass over the reads breaks each read into super-k-mers --
+  // runs of consecutive k-mers that fall into the same range -- and
+  // spills them, 2 bits a base, to a temporary file per range.  Then the
+  // ranges are counted one at a time in an ExactCountingHash, and written
+  // out in order, so that only one range's distinct k-mers need fit in
+  // memory.
+  //
+  // The output has the same format as a saved ExactCountingHash: the
+  // k-mers, sorted, then their counts.  Query it in place with a
+  // KmerCountDatabase, or load it whole with ExactCountingHash::load().
+  //
+  // Both passes run on number_of_threads threads: the first sharing a
+  // parser per input file, the second sharing each range's spill file.
+  class PartitionedCountingEngine {
+  protected:
+    WordLength		      _ksize;
+    std::vector<HashIntoType> _bounds;	// range i is [_bounds[i], _bounds[i+1])
+    std::string		      _tmp_prefix;
+    uint32_t		      _number_of_threads;
+
+    // state for the spilling pass
+    read_parsers:: IParser *  _parser;
+    std::vector<FILE *>	      _spill_files;
+    pthread_mutex_t *	      _spill_locks;
+    bool		      _invalid_file_format;
+
+    // state for the counting pass
+    unsigned int	      _range;
+    FILE *		      _range_file;
+    ExactCountingHash *	      _range_ht;
+
+    pthread_mutex_t	      _lock;	// the counters, and _range_file
+
+    unsigned long long	      _n_reads;
+    unsigned long long	      _n_kmers;
+    unsigned long long	      _n_super_kmers;
+    unsigned long long	      _n_unique_kmers;
+
+    std::string _spill_filename(unsigned int range) const;
+
+    inline unsigned int _range_of(HashIntoType kmer) const;
+
+    static void _run_spill_thread(void * engine, uint32_t thread_n);
+    void _spill_reads();
+    void _spill(std::vector<std::string> &buffers, unsigned int range,
+		const char * bases, unsigned int n_bases);
+    void _flush(std::vector<std::string> &buffers, unsigned int range);
+
+    static void _run_count_thread(void * engine, uint32_t thread_n);
+    void _count_range();
+
+  public:
+    // The spill files are named tmp_prefix ".range" N.
+    PartitionedCountingEngine(
+      WordLength ksize, unsigned int n_ranges, const std::string &tmp_prefix,
+      uint32_t const number_of_threads =
+      get_active_config( ).get_number_of_threads( )
+    );
+    ~PartitionedCountingEngine();
+
+    // Bounds for n_ranges ranges that each get about as many of the
+    // canonical k-mers of random sequence.  A canonical k-mer is the
+    // lesser of two hashes, and so is more likely to be small: for
+    // 4^k hashes, range i starts at 4^k (1 - sqrt(1 - i / n_ranges)).
+    static std::vector<HashIntoType> get_range_bounds(WordLength ksize,
+						      unsigned int n_ranges);
+
+    const std::vector<HashIntoType> &get_bounds() const { return _bounds; }
+
+    // Count the k-mers in the reads in infilenames, and write them and
+    // their counts to outfilename.  The counts are for this call.
+    void count(const std::vector<std::string> &infilenames,
+	       const std::string &outfilename);
+
+    unsigned long long get_n_reads() const { return _n_reads; }
+    unsigned long long get_n_kmers() const { return _n_kmers; }
+    unsigned long long get_n_super_kmers() const { return _n_super_kmers; }
+    unsigned long long get_n_unique_kmers() const { return _n_unique_kmers; }
+  };
+
+  // Counts looked up in an uncompressed saved ExactCountingHash (or the
+  // output of a PartitionedCountingEngine) without loading it: the file is
+  // mapped, and each lookup is a binary search of the sorted k-mers.
+  class KmerCountDatabase {
+  protected:
+    WordLength		_ksize;
+    HashIntoType	_n_kmers;
+    void *		_base;
+    size_t		_length;
+    const Byte *	_kmers;
+    const Byte *	_counts;
+
+  private:
+    KmerCountDatabase(const KmerCountDatabase &);
+    KmerCountDatabase &operator=(const KmerCountDatabase &);
+
+  public:
+    KmerCountDatabase(const std::string &filename);
+    ~KmerCountDatabase();
+
+    WordLength ksize() const { return _ksize; }
+    HashIntoType n_unique_kmers() const { return _n_kmers; }
+
+    BoundedCounterType get_count(HashIntoType khash) const;
+    BoundedCounterType get_count(const char * kmer) const;
+  };
+};
+
+#endif // PARTITIONED_COUNTING_HH
+
+// vim: set sts=2 sw=2:
@@ -14,6 +14,13 @@ namespace khmer {
 
             /* Returns true if n is prime, false otherwise */
             bool is_prime()
+            {
+                return is_prime(n);
+            }
+
+        public:
+            /* Returns true if n is prime, false otherwise */
+            static bool is_prime(HashIntoType n)
             {
                 if (n < 2)
                     return false;
@@ -29,7 +36,6 @@ namespace khmer {
                 return true;
             }
 
-        public:
             Primes(HashIntoType num)
             {
                 /* Make sure that the initial number to start from is odd
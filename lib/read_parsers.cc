@@ -1191,6 +1191,7 @@ IParser(
     _number_of_threads( number_of_threads ),
     _thread_id_map( ThreadIDMap( number_of_threads ) ),
     _unithreaded( 1 == number_of_threads ),
+    _keep_reads_with_n( false ),
     _states( new ParserState *[ number_of_threads ] )
 { for (uint32_t i = 0; i < number_of_threads; ++i) _states[ i ] = NULL; }
 
@@ -1571,7 +1572,8 @@ get_next_read( )
 #endif
 
 	// Discard invalid read.
-	if (std:: string:: npos != the_read.sequence.find_first_of( "Nn" ))
+	if (    !_keep_reads_with_n
+	    &&  (std:: string:: npos != the_read.sequence.find_first_of( "Nn" )))
 	{
 	    trace_logger(
 		TraceLogger:: TLVL_DEBUG6,
@@ -1602,6 +1604,35 @@ get_next_read( )
 }
 
 
+bool
+next_read_or_done(
+    IParser * const	parser,
+    Read		&read,
+    bool const		nothing_read,
+    bool		&invalid_file_format
+)
+{
+    if (parser->is_complete( )) return false;
+
+    try
+    {
+	read = parser->get_next_read( );
+    }
+    catch (NoMoreReadsAvailable &exc)
+    {
+	return false;
+    }
+    catch (InvalidReadFileFormat &exc)
+    {
+	if (!(parser->is_complete( ) && nothing_read))
+	    invalid_file_format = true;
+	return false;
+    }
+
+    return true;
+}
+
+
 } // namespace read_parsers
 
 
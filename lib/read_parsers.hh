@@ -358,6 +358,10 @@ struct IParser
 
     virtual Read	get_next_read( );
 
+    // Reads containing Ns are discarded, unless this is set.
+    inline void		set_keep_reads_with_n( bool const keep )
+    { _keep_reads_with_n = keep; }
+
 protected:
     
     struct ParserState
@@ -395,6 +399,7 @@ protected:
     uint32_t		_number_of_threads;
     ThreadIDMap		_thread_id_map;
     bool		_unithreaded;
+    bool		_keep_reads_with_n;
 
     ParserState **	_states;
 
@@ -455,6 +460,18 @@ struct FastqParser : public IParser
 };
 
 
+// Get the next read from a parser that threads share, into read.  False
+// at the end of the reads, and for a file that doesn't parse, which sets
+// invalid_file_format -- unless the file is empty, which doesn't parse
+// either, as the calling thread can tell if it has read nothing yet.
+bool	next_read_or_done(
+    IParser * const	parser,
+    Read		&read,
+    bool const		nothing_read,
+    bool		&invalid_file_format
+);
+
+
 } // namespace read_parsers
 
 
@@ -292,6 +292,53 @@ unsigned int SubsetPartition::find_unpart(const std::string infilename,
 
 ///
 
+// Collects the tags connected to a start, for find_all_tags().
+struct TagFindingVisitor : public TraversalVisitor {
+  const Hashbits &ht;
+  SeenSet &tagged_kmers;
+  const SeenSet &all_tags;
+  const bool break_on_stop_tags;
+  const bool stop_big_traversals;
+  const unsigned int max_breadth;
+
+  TagFindingVisitor(const Hashbits &ht_, SeenSet &tagged_kmers_,
+		    const SeenSet &all_tags_, bool break_on_stop_tags_,
+		    bool stop_big_traversals_, unsigned int max_breadth_) :
+    ht(ht_), tagged_kmers(tagged_kmers_), all_tags(all_tags_),
+    break_on_stop_tags(break_on_stop_tags_),
+    stop_big_traversals(stop_big_traversals_), max_breadth(max_breadth_) { }
+
+  bool stop(unsigned int breadth, size_t n_visited) {
+    if (stop_big_traversals && n_visited > (size_t) BIG_TRAVERSALS_ARE) {
+      tagged_kmers.clear();
+      return true;
+    }
+    return false;
+  }
+
+  // Do we want to traverse through this k-mer?  If not, skip.
+  bool enter(HashIntoType kmer, unsigned int breadth) {
+    return !(break_on_stop_tags && set_contains(ht.stop_tags, kmer));
+  }
+
+  TraversalAction visit(HashIntoType kmer,
+			HashIntoType kmer_f, HashIntoType kmer_r,
+			unsigned int breadth, size_t n_visited) {
+    // Is this a kmer-to-tag, and have we put this tag in a partition
+    // already?  Search no further in this direction.  (This is where we
+    // connect partitions.)
+    if (n_visited > 1 && set_contains(all_tags, kmer)) {
+      tagged_kmers.insert(kmer);
+      return TRAVERSE_DONT_EXPAND;
+    }
+
+    if (breadth >= max_breadth) { // truncate search @CTB exit?
+      return TRAVERSE_DONT_EXPAND;
+    }
+    return TRAVERSE_EXPAND;
+  }
+};
+
 // find_all_tags: the core of the partitioning code.  finds all tagged k-mers
 //    connected to kmer_f/kmer_r in the graph.
 
@@ -302,142 +349,11 @@ void SubsetPartition::find_all_tags(HashIntoType kmer_f,
 				    bool break_on_stop_tags,
 				    bool stop_big_traversals)
 {
-  const HashIntoType bitmask = _ht->bitmask;
-
-  HashIntoType f, r;
-  bool first = true;
-  NodeQueue node_q;
-  std::queue<unsigned int> breadth_q;
-  unsigned int cur_breadth = 0;
-  unsigned int breadth = 0;
   const unsigned int max_breadth = (2 * _ht->_tag_density) + 1;
 
-  const unsigned int rc_left_shift = _ht->ksize()*2 - 2;
-  unsigned int total = 0;
-
-  SeenSet keeper;		// keep track of traversed kmers
-
-  // start breadth-first search.
-
-  node_q.push(kmer_f);
-  node_q.push(kmer_r);
-  breadth_q.push(0);
-
-  while(!node_q.empty()) {
-    if (stop_big_traversals && keeper.size() > BIG_TRAVERSALS_ARE) {
-      tagged_kmers.clear();
-      break;
-    }
-
-    kmer_f = node_q.front();
-    node_q.pop();
-    kmer_r = node_q.front();
-    node_q.pop();
-    breadth = breadth_q.front();
-    breadth_q.pop();
-
-    HashIntoType kmer = uniqify_rc(kmer_f, kmer_r);
-
-    // Have we already seen this k-mer?  If so, skip.
-    if (set_contains(keeper, kmer)) {
-      continue;
-    }
-
-    // Do we want to traverse through this k-mer?  If not, skip.
-    if (break_on_stop_tags && set_contains(_ht->stop_tags, kmer)) {
-      // @CTB optimize by inserting into keeper set?
-      continue;
-    }
-
-    // keep track of seen kmers
-    keeper.insert(kmer);
-    total++;
-
-    // Is this a kmer-to-tag, and have we put this tag in a partition already?
-    // Search no further in this direction.  (This is where we connect
-    // partitions.)
-    if (!first && set_contains(all_tags, kmer)) {
-      tagged_kmers.insert(kmer);
-      continue;
-    }
-
-    assert(breadth >= cur_breadth); // keep track of watermark, for debugging.
-    if (breadth > cur_breadth) { cur_breadth = breadth; }
-
-    if (breadth >= max_breadth) { continue; } // truncate search @CTB exit?
-
-    //
-    // Enqueue next set of nodes.
-    //
-
-    // NEXT
-    f = next_f(kmer_f, 'A');
-    r = next_r(kmer_r, 'A');
-    if (_ht->get_count(uniqify_rc(f,r)) &&
-	!set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'C');
-    r = next_r(kmer_r, 'C');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'G');
-    r = next_r(kmer_r, 'G');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    f = next_f(kmer_f, 'T');
-    r = next_r(kmer_r, 'T');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    // PREVIOUS.
-    r = prev_r(kmer_r, 'A');
-    f = prev_f(kmer_f, 'A');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'C');
-    f = prev_f(kmer_f, 'C');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-    
-    r = prev_r(kmer_r, 'G');
-    f = prev_f(kmer_f, 'G');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    r = prev_r(kmer_r, 'T');
-    f = prev_f(kmer_f, 'T');
-    if (_ht->get_count(uniqify_rc(f,r)) && 
-        !set_contains(keeper, uniqify_rc(f,r))) {
-      node_q.push(f); node_q.push(r);
-      breadth_q.push(breadth + 1);
-    }
-
-    first = false;
-  }
+  TagFindingVisitor visitor(*_ht, tagged_kmers, all_tags, break_on_stop_tags,
+			    stop_big_traversals, max_breadth);
+  _ht->traverse_breadth_first(kmer_f, kmer_r, visitor);
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -456,17 +372,19 @@ void SubsetPartition::do_partition(HashIntoType first_kmer,
   SeenSet tagged_kmers;
   const unsigned char ksize = _ht->ksize();
 
-  SeenSet::const_iterator si, end;
+  // the tags from first_kmer up to last_kmer, in order.
+  const SortedSeenSet &tags = _ht->get_sorted_tags();
+  SortedSeenSet::const_iterator si, end;
 
   if (first_kmer) {
-    si = _ht->all_tags.find(first_kmer);
+    si = tags.lower_bound(first_kmer);
   } else {
-    si = _ht->all_tags.begin();
+    si = tags.begin();
   }
   if (last_kmer) {
-    end = _ht->all_tags.find(last_kmer);
+    end = tags.lower_bound(last_kmer);
   } else {
-    end = _ht->all_tags.end();
+    end = tags.end();
   }
 
   for (; si != end; si++) {
@@ -559,13 +477,14 @@ PartitionID * SubsetPartition::_join_partitions_by_tags(
   SeenSet::const_iterator it = tagged_kmers.begin();
   unsigned int * this_partition_p = NULL;
 
-  // find first assigned partition ID in tagged set
-  while (it != tagged_kmers.end()) {
-    this_partition_p = partition_map[*it];
-    if (this_partition_p != NULL) {
-      break;
+  // find the lowest assigned partition ID in tagged set, so that which
+  // one the others join doesn't depend on the order the set is kept in.
+  for (; it != tagged_kmers.end(); ++it) {
+    PartitionMap::const_iterator pi = partition_map.find(*it);
+    if (pi != partition_map.end() && pi->second != NULL &&
+	(this_partition_p == NULL || *pi->second < *this_partition_p)) {
+      this_partition_p = pi->second;
     }
-    it++;
   }
 
   // no partition ID? allocate new!
@@ -605,7 +524,8 @@ PartitionID * SubsetPartition::_join_partitions_by_tags(
 // _merge_two_partitions merges the 'merge_pp' partition into the
 // 'the_pp' partition.  It does this by joining the reverse pointer
 // map structures for two partitions and resetting each partition
-// pointer individually.
+// pointer individually.  The partition with more pointers keeps its
+// ID, or on a tie, the one with the lower ID; the survivor is returned.
 
 PartitionID * SubsetPartition::_merge_two_partitions(PartitionID *the_pp,
 						     PartitionID *merge_pp)
@@ -614,7 +534,8 @@ PartitionID * SubsetPartition::_merge_two_partitions(PartitionID *the_pp,
   PartitionPtrSet * t = reverse_pmap[*merge_pp];
 
   // Choose the smaller of two sets to loop over.
-  if (s->size() < t->size()) {
+  if (s->size() < t->size() ||
+      (s->size() == t->size() && *merge_pp < *the_pp)) {
     PartitionPtrSet * tmp = s;  s = t; t = tmp;
     PartitionID * tmp2 = the_pp; the_pp = merge_pp; merge_pp = tmp2;
   }
@@ -651,9 +572,7 @@ PartitionID SubsetPartition::join_partitions(PartitionID orig, PartitionID join)
   PartitionID * orig_pp = *(reverse_pmap[orig]->begin());
   PartitionID * join_pp = *(reverse_pmap[join]->begin());
 
-  _merge_two_partitions(orig_pp, join_pp);
-
-  return orig;
+  return *_merge_two_partitions(orig_pp, join_pp);
 }
 
 PartitionID SubsetPartition::get_partition_id(std::string kmer_s)
@@ -758,7 +677,8 @@ void SubsetPartition::merge_from_disk(string other_filename)
 
   infile.read((char *) &version, 1);
   infile.read((char *) &ht_type, 1);
-  assert(version == SAVED_FORMAT_VERSION);
+  assert(version >= SAVED_FORMAT_MIN_VERSION &&
+	 version <= SAVED_FORMAT_VERSION);
   assert(ht_type == SAVED_SUBSET);
 
   infile.read((char *) &save_ksize, sizeof(save_ksize));
@@ -1005,7 +925,7 @@ const
 unsigned int SubsetPartition::repartition_largest_partition(unsigned int distance,
 						    unsigned int threshold,
 						    unsigned int frequency,
-						    CountingHash &counting)
+						    Hashtable &counting)
 {
   PartitionCountMap cm;
   unsigned int n_unassigned = 0;
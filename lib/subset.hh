@@ -4,7 +4,6 @@
 #include "hashtable.hh"
 
 namespace khmer {
-  class CountingHash;
   class Hashbits;
 
   struct pre_partition_info {
@@ -40,6 +39,7 @@ namespace khmer {
 
     void set_partition_id(HashIntoType kmer, PartitionID p);
     void set_partition_id(std::string kmer_s, PartitionID p);
+    // Join two partitions, and return the ID they now share.
     PartitionID join_partitions(PartitionID orig, PartitionID join);
     PartitionID get_partition_id(std::string kmer_s);
     PartitionID get_partition_id(HashIntoType kmer);
@@ -94,7 +94,7 @@ namespace khmer {
 				    unsigned int& n_unassigned) const;
 
     unsigned int repartition_largest_partition(unsigned int, unsigned int,
-					       unsigned int, CountingHash&);
+					       unsigned int, Hashtable&);
 
     void repartition_a_partition(const SeenSet& partition_tags);
     void _clear_partition(PartitionID, SeenSet& partition_tags);
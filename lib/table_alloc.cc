@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <map>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#  include <sys/syscall.h>
+#endif
+
+#include "table_alloc.hh"
+#include "khmer_config.hh"
+#include "threads.hh"
+
+#ifndef MPOL_INTERLEAVE
+#   define MPOL_INTERLEAVE 3
+#endif
+
+using namespace khmer;
+
+// Tables that were mapped rather than malloc'd, by the address handed
+// out: where the mapping starts, and how long it is.
+typedef std::map< Byte *, std::pair<void *, size_t> > MappedTables;
+
+static MappedTables	_mapped_tables;
+static pthread_mutex_t	_mapped_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The online NUMA nodes as a bit mask, from a list like "0-3,5".
+static std::vector<unsigned long> _online_nodes(unsigned int &n_nodes)
+{
+  std::vector<unsigned long> mask;
+  n_nodes = 0;
+
+  FILE * fp = fopen("/sys/devices/system/node/online", "r");
+  if (!fp) {
+    return mask;
+  }
+
+  unsigned int first, last;
+  char sep;
+  while (fscanf(fp, "%u", &first) == 1) {
+    last = first;
+    sep = fgetc(fp);
+    if (sep == '-') {
+      if (fscanf(fp, "%u", &last) != 1) {
+	break;
+      }
+      sep = fgetc(fp);
+    }
+
+    for (unsigned int node = first; node <= last; node++) {
+      size_t word = node / (8 * sizeof(unsigned long));
+      if (mask.size() <= word) {
+	mask.resize(word + 1, 0);
+      }
+      mask[word] |= 1UL << (node % (8 * sizeof(unsigned long)));
+      n_nodes++;
+    }
+
+    if (sep != ',') {
+      break;
+    }
+  }
+  fclose(fp);
+
+  return mask;
+}
+
+static void _interleave(void * addr, size_t length)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  unsigned int n_nodes;
+  std::vector<unsigned long> mask = _online_nodes(n_nodes);
+
+  if (n_nodes > 1) {
+    // failing that, the pages go where they are first touched.
+    syscall(SYS_mbind, addr, length, MPOL_INTERLEAVE, &mask[0],
+	    mask.size() * 8 * sizeof(unsigned long) + 1, 0);
+  }
+#endif
+}
+
+// Map length bytes of anonymous memory, starting on a huge page boundary
+// when huge pages are asked for; returns NULL on failure.
+static void * _map(size_t length, uint8_t huge_pages, void *& base,
+		   size_t &mapped_length)
+{
+  void * table;
+
+#if defined(MAP_HUGETLB)
+  if (huge_pages == TABLE_PAGES_EXPLICIT) {
+    mapped_length = length;
+    table = mmap(NULL, mapped_length, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (table != MAP_FAILED) {
+      base = table;
+      return table;
+    }
+    // none reserved; fall back to transparent huge pages.
+  }
+#endif
+
+  if (huge_pages == TABLE_PAGES_NORMAL) {
+    mapped_length = length;
+    table = mmap(NULL, mapped_length, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+      return NULL;
+    }
+    base = table;
+    return table;
+  }
+
+  // Over-map by a huge page, and trim to a huge page boundary either side,
+  // so that the kernel can back all of it with huge pages.
+  mapped_length = length + TABLE_HUGE_PAGE_SIZE;
+  base = mmap(NULL, mapped_length, PROT_READ | PROT_WRITE,
+	      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  size_t head = (TABLE_HUGE_PAGE_SIZE -
+		 (size_t) base % TABLE_HUGE_PAGE_SIZE) % TABLE_HUGE_PAGE_SIZE;
+  if (head) {
+    munmap(base, head);
+  }
+  if (mapped_length - head > length) {
+    munmap((Byte *) base + head + length, mapped_length - head - length);
+  }
+  base = (Byte *) base + head;
+  mapped_length = length;
+  table = base;
+
+#if defined(MADV_HUGEPAGE)
+  madvise(table, length, MADV_HUGEPAGE);
+#endif
+
+  return table;
+}
+
+struct ZeroPass {
+  Byte *  table;
+  size_t  length;
+  size_t  per_thread;	// a whole number of pages
+};
+
+static void _zero_range(void * arg, uint32_t thread_n)
+{
+  ZeroPass &pass = *(ZeroPass *) arg;
+  size_t start = MIN(thread_n * pass.per_thread, pass.length);
+
+  memset(pass.table + start, 0, MIN(pass.per_thread, pass.length - start));
+}
+
+// Touch every page, from n_threads threads at once, each taking its own
+// run of whole pages.
+static void _zero(Byte * table, size_t length, unsigned int n_threads)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t n_pages = (length + page - 1) / page;
+
+  if (n_threads > n_pages) {
+    n_threads = n_pages ? n_pages : 1;
+  }
+  if (n_threads <= 1) {
+    memset(table, 0, length);
+    return;
+  }
+
+  ZeroPass pass;
+  pass.table = table;
+  pass.length = length;
+  pass.per_thread = ((n_pages + n_threads - 1) / n_threads) * page;
+
+  run_on_threads(_zero_range, &pass, n_threads);
+}
+
+Byte * khmer::allocate_table(size_t bytes)
+{
+  Config &config = get_active_config();
+  uint8_t huge_pages = config.get_table_huge_pages();
+  bool interleave = config.get_table_numa_interleave();
+  unsigned int zero_threads = config.get_table_zero_threads();
+
+  if (!bytes) {
+    bytes = 1;
+  }
+
+  if (huge_pages == TABLE_PAGES_NORMAL && !interleave && zero_threads <= 1) {
+    void * table;
+    if (posix_memalign(&table, TABLE_ALIGNMENT, bytes)) {
+      throw std::bad_alloc();
+    }
+    memset(table, 0, bytes);
+    return (Byte *) table;
+  }
+
+  size_t page = huge_pages == TABLE_PAGES_NORMAL ?
+    (size_t) sysconf(_SC_PAGESIZE) : TABLE_HUGE_PAGE_SIZE;
+  size_t length = ((bytes + page - 1) / page) * page;
+  void * base;
+  size_t mapped_length;
+
+  Byte * table = (Byte *) _map(length, huge_pages, base, mapped_length);
+  if (!table) {
+    throw std::bad_alloc();
+  }
+
+  // the policy has to be in place before the pages are first touched.
+  if (interleave) {
+    _interleave(table, length);
+  }
+  _zero(table, length, zero_threads);
+
+  pthread_mutex_lock(&_mapped_tables_lock);
+  _mapped_tables[table] = std::make_pair(base, mapped_length);
+  pthread_mutex_unlock(&_mapped_tables_lock);
+
+  return table;
+}
+
+void khmer::free_table(Byte * table)
+{
+  if (!table) {
+    return;
+  }
+
+  pthread_mutex_lock(&_mapped_tables_lock);
+  MappedTables::iterator found = _mapped_tables.find(table);
+  bool mapped = (found != _mapped_tables.end());
+  std::pair<void *, size_t> mapping;
+  if (mapped) {
+    mapping = found->second;
+    _mapped_tables.erase(found);
+  }
+  pthread_mutex_unlock(&_mapped_tables_lock);
+
+  if (mapped) {
+    munmap(mapping.first, mapping.second);
+  } else {
+    free(table);
+  }
+}
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,35 @@
+#ifndef TABLE_ALLOC_HH
+#define TABLE_ALLOC_HH
+
+#include <stddef.h>
+#include "khmer.hh"
+
+#   define TABLE_ALIGNMENT 64			// a cache line
+#   define TABLE_HUGE_PAGE_SIZE (2U*1024*1024)	// x86-64 default huge page
+
+namespace khmer {
+
+  // Zeroed memory for the counter and bit tables, placed as the active
+  // Config asks (see Config::set_table_huge_pages and friends):
+  //
+  //  - huge pages, so that random probes into a large table miss the TLB
+  //	far less often: transparent ones (madvise), or explicit ones
+  //	(MAP_HUGETLB), falling back to transparent when none are reserved;
+  //  - interleaved page by page across the NUMA nodes (mbind), so that
+  //	threads on every socket see the same mix of near and far memory
+  //	instead of all of it being on the node that zeroed it;
+  //  - zeroed by several threads, which faults the pages in in parallel.
+  //
+  // With none of those set, this is an aligned malloc and memset, as
+  // before.  Memory is TABLE_ALIGNMENT-aligned in any case.  Anything the
+  // system refuses (no huge pages, no NUMA) quietly falls back; only
+  // running out of memory throws std::bad_alloc.
+  Byte * allocate_table(size_t bytes);
+
+  // Free memory from allocate_table.
+  void free_table(Byte * table);
+};
+
+#endif // TABLE_ALLOC_HH
+
+// vim: set sts=2 sw=2:
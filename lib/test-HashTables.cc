@@ -33,7 +33,7 @@ using namespace khmer;
 using namespace khmer:: read_parsers;
 
 
-static const char *	    SHORT_OPTS		= "k:N:x:s:";
+static const char *	    SHORT_OPTS		= "k:N:x:s:P:IZ:";
 
 
 int main( int argc, char * argv[ ] )
@@ -42,6 +42,9 @@ int main( int argc, char * argv[ ] )
     float		ht_size_FP	    = 1.0E6;
     unsigned long	ht_count	    = 4;
     uint64_t		cache_size	    = 4L * 1024 * 1024 * 1024;
+    uint8_t		huge_pages	    = TABLE_PAGES_NORMAL;
+    bool		numa_interleave	    = false;
+    unsigned long	zero_threads	    = 1;
 
     int			rc		    = 0;
     int			opt		    = -1;
@@ -80,6 +83,27 @@ int main( int argc, char * argv[ ] )
 		error( EINVAL, EINVAL, "Invalid cache size" );
 	    break;
 
+	case 'P':
+	    if (!strcmp( optarg, "normal" ))
+		huge_pages = TABLE_PAGES_NORMAL;
+	    else if (!strcmp( optarg, "transparent" ))
+		huge_pages = TABLE_PAGES_TRANSPARENT;
+	    else if (!strcmp( optarg, "explicit" ))
+		huge_pages = TABLE_PAGES_EXPLICIT;
+	    else
+		error( EINVAL, EINVAL, "Invalid page kind" );
+	    break;
+
+	case 'I':
+	    numa_interleave = true;
+	    break;
+
+	case 'Z':
+	    zero_threads = strtoul( optarg, &conv_residue, 10 );
+	    if (!strcmp( optarg, conv_residue ) || !zero_threads)
+		error( EINVAL, EINVAL, "Invalid number of zeroing threads" );
+	    break;
+
 	default:
 	    error( 0, 0, "Skipping unknown arg, '%c'", optopt );
 	}
@@ -103,9 +127,15 @@ int main( int argc, char * argv[ ] )
 
     Config		    &the_config		= get_active_config( );
     the_config.set_number_of_threads( omp_get_max_threads( ) );
+    the_config.set_table_huge_pages( huge_pages );
+    the_config.set_table_numa_interleave( numa_interleave );
+    the_config.set_table_zero_threads( zero_threads );
+
+    double		    start_time		= omp_get_wtime( );
 
 #if HASH_TYPE_TO_TEST == 1
     CountingHash ht( kmer_length, ht_sizes );
+    double		    allocated_time	= omp_get_wtime( );
     IParser * parser = IParser:: get_parser(
 	ifile_name, the_config.get_number_of_threads( ), cache_size
     );
@@ -115,9 +145,17 @@ int main( int argc, char * argv[ ] )
     }
 #elif HASH_TYPE_TO_TEST == 2
     Hashbits ht( kmer_length, ht_sizes );
+    double		    allocated_time	= omp_get_wtime( );
     ht.consume_fasta_and_tag( ifile_name, reads_total, n_consumed );
 #endif
 
+    double		    consumed_time	= omp_get_wtime( );
+    fprintf(
+	stderr, "allocate: %.3fs  consume: %.3fs  (%u reads, %llu k-mers)\n",
+	allocated_time - start_time, consumed_time - allocated_time,
+	reads_total, n_consumed
+    );
+
 #ifdef OUTPUT_HASHTABLE
 #if	HASH_TYPE_TO_TEST == 1
     ht.save( ofile_name + ".ht_count" );
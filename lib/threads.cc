@@ -0,0 +1,56 @@
+#include <assert.h>
+#include <pthread.h>
+#include <vector>
+
+#include "threads.hh"
+
+using namespace khmer;
+
+struct _ThreadStart {
+  ThreadFn	fn;
+  void *	arg;
+  uint32_t	thread_n;
+};
+
+static void * _start_thread(void * start)
+{
+  _ThreadStart * s = (_ThreadStart *) start;
+
+  s->fn(s->arg, s->thread_n);
+  return NULL;
+}
+
+void khmer::run_on_threads(ThreadFn fn, void * arg, uint32_t n_threads,
+			   void (*abort)(void *))
+{
+  assert(n_threads > 0);
+
+  std::vector<pthread_t> threads(n_threads);
+  std::vector<_ThreadStart> starts(n_threads);
+  for (uint32_t i = 1; i < n_threads; i++) {
+    starts[i].fn = fn;
+    starts[i].arg = arg;
+    starts[i].thread_n = i;
+
+    int rc = pthread_create(&threads[i], NULL, _start_thread, &starts[i]);
+    assert(rc == 0);
+  }
+
+  try {
+    fn(arg, 0);
+  } catch (...) {
+    if (abort) {
+      abort(arg);
+    }
+    for (uint32_t i = 1; i < n_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    throw;
+  }
+
+  for (uint32_t i = 1; i < n_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+// vim: set sts=2 sw=2:
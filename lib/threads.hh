@@ -0,0 +1,50 @@
+#ifndef THREADS_HH
+#define THREADS_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sched.h>
+
+namespace khmer {
+
+  // What runs on each thread of run_on_threads(), with the thread's
+  // number, from 0 to n_threads - 1.
+  typedef void (*ThreadFn)(void * arg, uint32_t thread_n);
+
+  // Run fn(arg, thread_n) on n_threads threads, and return when all of
+  // them have finished.  The calling thread is one of them, thread 0, so
+  // that it can do what the others mustn't, such as call back into Python.
+  //
+  // If fn throws on the calling thread, abort(arg), if given, is called
+  // to get the other threads to finish, and the exception is rethrown
+  // once they have.
+  void run_on_threads(ThreadFn fn, void * arg, uint32_t n_threads,
+		      void (*abort)(void *) = NULL);
+
+  // Spin locks, for sections a few instructions long.  A waiter pauses
+  // between tries at first, then yields, so that it doesn't burn the time
+  // slice of a holder that has been descheduled when threads outnumber
+  // cores.
+  inline void spin_lock(uint32_t * lock)
+  {
+    for (unsigned int tries = 0;
+	 !__sync_bool_compare_and_swap( lock, 0, 1 ); tries++) {
+      if (tries < 64) {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause( );
+#endif
+      } else {
+	sched_yield( );
+      }
+    }
+  }
+
+  inline void spin_unlock(uint32_t * lock)
+  {
+    __sync_lock_release( lock );
+  }
+};
+
+#endif // THREADS_HH
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,69 @@
+#include <pthread.h>
+#include <vector>
+
+#include "traversal.hh"
+
+using namespace std;
+using namespace khmer;
+
+// Each thread's scratch, one for each traversal in progress on it, kept
+// until the thread exits.
+struct _ScratchStack {
+  vector<TraversalScratch *>	scratch;
+  size_t			depth;
+
+  _ScratchStack() : depth(0) { }
+
+  ~_ScratchStack() {
+    for (size_t i = 0; i < scratch.size(); i++) {
+      delete scratch[i];
+    }
+  }
+};
+
+static pthread_key_t _scratch_key;
+static pthread_once_t _scratch_key_once = PTHREAD_ONCE_INIT;
+
+static void _delete_scratch_stack(void * stack)
+{
+  delete (_ScratchStack *) stack;
+}
+
+static void _make_scratch_key()
+{
+  pthread_key_create(&_scratch_key, _delete_scratch_stack);
+}
+
+static _ScratchStack * _get_scratch_stack()
+{
+  pthread_once(&_scratch_key_once, _make_scratch_key);
+
+  _ScratchStack * stack = (_ScratchStack *) pthread_getspecific(_scratch_key);
+  if (!stack) {
+    stack = new _ScratchStack;
+    pthread_setspecific(_scratch_key, stack);
+  }
+  return stack;
+}
+
+TraversalScratchLease::TraversalScratchLease()
+{
+  _ScratchStack * stack = _get_scratch_stack();
+
+  if (stack->depth == stack->scratch.size()) {
+    stack->scratch.push_back(new TraversalScratch);
+  }
+  _scratch = stack->scratch[stack->depth++];
+  _scratch->clear();
+}
+
+TraversalScratchLease::~TraversalScratchLease()
+{
+  _ScratchStack * stack =
+    (_ScratchStack *) pthread_getspecific(_scratch_key);
+
+  assert(stack && stack->depth && stack->scratch[stack->depth - 1] == _scratch);
+  stack->depth--;
+}
+
+// vim: set sts=2 sw=2:
@@ -0,0 +1,234 @@
+#ifndef TRAVERSAL_HH
+#define TRAVERSAL_HH
+
+#include <assert.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "khmer.hh"
+#include "flat_hash.hh"
+
+namespace khmer {
+
+  // Scratch space for breadth-first traversals of the k-mer graph, kept
+  // from one traversal to the next so that a traversal doesn't allocate
+  // once its thread has done a few.
+  //
+  // TraversalQueue is a ring buffer of the nodes waiting to be visited;
+  // it doubles when full, and keeps its slots when cleared.
+  //
+  // EpochSet is the set of k-mers visited: an open-addressing hash table,
+  // with linear probing, that stamps each slot with the epoch it was
+  // filled in.  Slots from earlier epochs are empty, so clear() only
+  // bumps the epoch, rather than wiping the table.
+  //
+  // The traversal itself, Hashbits::traverse_breadth_first(), is in
+  // hashbits.hh.
+
+  struct TraversalNode {
+    HashIntoType	kmer_f;
+    HashIntoType	kmer_r;
+    unsigned int	breadth;
+  };
+
+  class TraversalQueue {
+  protected:
+    std::vector<TraversalNode>	_nodes;
+    size_t			_head;
+    size_t			_size;
+
+    void _grow() {
+      std::vector<TraversalNode> nodes(std::max((size_t) 64,
+						_nodes.size() * 2));
+      for (size_t i = 0; i < _size; i++) {
+	nodes[i] = _nodes[(_head + i) & (_nodes.size() - 1)];
+      }
+      nodes.swap(_nodes);
+      _head = 0;
+    }
+
+  public:
+    TraversalQueue() : _head(0), _size(0) { }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    void clear() { _head = _size = 0; }
+
+    void push(HashIntoType kmer_f, HashIntoType kmer_r, unsigned int breadth)
+    {
+      if (_size == _nodes.size()) {
+	_grow();
+      }
+      TraversalNode &node = _nodes[(_head + _size) & (_nodes.size() - 1)];
+      node.kmer_f = kmer_f;
+      node.kmer_r = kmer_r;
+      node.breadth = breadth;
+      _size++;
+    }
+
+    TraversalNode pop() {
+      assert(_size);
+      TraversalNode node = _nodes[_head];
+      _head = (_head + 1) & (_nodes.size() - 1);
+      _size--;
+      return node;
+    }
+
+    size_t memory_used() const {
+      return _nodes.capacity() * sizeof(TraversalNode);
+    }
+  };
+
+  class EpochSet {
+  protected:
+    std::vector<HashIntoType>	_keys;
+    std::vector<uint32_t>	_epochs;
+    uint32_t			_epoch;
+    size_t			_size;
+
+    size_t _mask() const { return _keys.size() - 1; }
+
+    // The slot key is in, or the empty slot it would go in.
+    size_t _probe(HashIntoType key, bool &found) const {
+      size_t i = _flat_hash_mix(key) & _mask();
+
+      while (_epochs[i] == _epoch) {
+	if (_keys[i] == key) {
+	  found = true;
+	  return i;
+	}
+	i = (i + 1) & _mask();
+      }
+      found = false;
+      return i;
+    }
+
+    void _rehash(size_t capacity) {
+      std::vector<HashIntoType> keys(capacity);
+      std::vector<uint32_t> epochs(capacity, 0);
+      uint32_t epoch = _epoch;
+      keys.swap(_keys);
+      epochs.swap(_epochs);
+      _epoch = 1;
+
+      for (size_t i = 0; i < keys.size(); i++) {
+	if (epochs[i] == epoch) {
+	  bool found;
+	  size_t j = _probe(keys[i], found);
+	  _keys[j] = keys[i];
+	  _epochs[j] = _epoch;
+	}
+      }
+    }
+
+  public:
+    EpochSet() : _keys(16), _epochs(16, 0), _epoch(1), _size(0) { }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    bool contains(HashIntoType key) const {
+      bool found;
+      _probe(key, found);
+      return found;
+    }
+
+    // Add key; false if it was already there.
+    bool insert(HashIntoType key) {
+      if ((_size + 1) * 4 > _keys.size() * 3) {
+	_rehash(_keys.size() * 2);
+      }
+
+      bool found;
+      size_t i = _probe(key, found);
+      if (found) {
+	return false;
+      }
+      _keys[i] = key;
+      _epochs[i] = _epoch;
+      _size++;
+      return true;
+    }
+
+    // Empty the set.  A set much bigger than what it held gives its slots
+    // back, as FlatSet does, so that one big traversal doesn't pin them.
+    void clear() {
+      if (_keys.size() > (1 << 20) && _size * 8 < _keys.size()) {
+	std::vector<HashIntoType>(16).swap(_keys);
+	std::vector<uint32_t>(16, 0).swap(_epochs);
+	_epoch = 0;
+      } else if (_epoch == (uint32_t) -1) {
+	std::fill(_epochs.begin(), _epochs.end(), 0);
+	_epoch = 0;
+      }
+      _epoch++;
+      _size = 0;
+    }
+
+    size_t memory_used() const {
+      return _keys.capacity() * sizeof(HashIntoType) +
+	_epochs.capacity() * sizeof(uint32_t);
+    }
+  };
+
+  struct TraversalScratch {
+    TraversalQueue	queue;
+    EpochSet		visited;
+
+    void clear() { queue.clear(); visited.clear(); }
+  };
+
+  // Lends the calling thread's scratch for as long as it is in scope.
+  // Each thread keeps a stack of them, so a traversal started from a
+  // visitor of another gets its own.
+  class TraversalScratchLease {
+    TraversalScratch *	_scratch;
+
+    TraversalScratchLease(const TraversalScratchLease &);
+    TraversalScratchLease &operator=(const TraversalScratchLease &);
+
+  public:
+    TraversalScratchLease();
+    ~TraversalScratchLease();
+
+    TraversalScratch &operator*() const { return *_scratch; }
+    TraversalScratch *operator->() const { return _scratch; }
+  };
+
+  // What a traversal visitor tells the traversal to do after visiting a
+  // k-mer.
+  enum TraversalAction {
+    TRAVERSE_EXPAND,		// go on to its neighbors
+    TRAVERSE_DONT_EXPAND,	// search no further this way
+    TRAVERSE_STOP		// end the traversal
+  };
+
+  // The hooks a visitor of Hashbits::traverse_breadth_first() has, and
+  // what they do by default.  Visitors derive from this and hide those
+  // they need; the calls are resolved at compile time.
+  struct TraversalVisitor {
+    // Called with each node as it comes off the queue, before anything
+    // else, and with the number of k-mers visited so far; true ends the
+    // traversal.
+    bool stop(unsigned int, size_t) { return false; }
+
+    // Called with each k-mer not yet visited, and its breadth; false
+    // skips it, without counting it as visited.
+    bool enter(HashIntoType, unsigned int) { return true; }
+
+    // Called with each k-mer as it is visited -- its hash, its forward
+    // and reverse hashes, its breadth, and n_visited, which counts it.
+    TraversalAction visit(HashIntoType, HashIntoType, HashIntoType,
+			  unsigned int, size_t) {
+      return TRAVERSE_EXPAND;
+    }
+
+    // Called after the neighbors of a k-mer are queued, with whether the
+    // queue is empty; false ends the traversal.
+    bool expanded(bool) { return true; }
+  };
+};
+
+#endif // TRAVERSAL_HH
+
+// vim: set sts=2 sw=2:
@@ -3,6 +3,7 @@
 //
 
 #include <iostream>
+#include <algorithm>
 
 #include "Python.h"
 #include "khmer.hh"
@@ -11,6 +12,12 @@
 #include "hashtable.hh"
 #include "hashbits.hh"
 #include "counting.hh"
+#include "diginorm.hh"
+#include "filter_abund.hh"
+#include "abundance_stats.hh"
+#include "hllcounter.hh"
+#include "exact_counting.hh"
+#include "partitioned_counting.hh"
 #include "storage.hh"
 
 //
@@ -311,6 +318,99 @@ config_set_reads_parser_trace_level( PyObject * self, PyObject * args )
 }
 
 
+static
+PyObject *
+config_get_table_huge_pages( PyObject * self, PyObject * args )
+{
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  return PyInt_FromSize_t( (size_t)config->get_table_huge_pages( ) );
+}
+
+
+static
+PyObject *
+config_set_table_huge_pages( PyObject * self, PyObject * args )
+{
+  unsigned char huge_pages;
+
+  if (!PyArg_ParseTuple( args, "B", &huge_pages )) return NULL;
+
+  if (huge_pages > TABLE_PAGES_EXPLICIT) {
+    PyErr_SetString( PyExc_ValueError,
+		     "expected TABLE_PAGES_NORMAL, _TRANSPARENT or _EXPLICIT" );
+    return NULL;
+  }
+
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  config->set_table_huge_pages( (uint8_t)huge_pages );
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
+static
+PyObject *
+config_get_table_numa_interleave( PyObject * self, PyObject * args )
+{
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  if (config->get_table_numa_interleave( )) Py_RETURN_TRUE;
+  Py_RETURN_FALSE;
+}
+
+
+static
+PyObject *
+config_set_table_numa_interleave( PyObject * self, PyObject * args )
+{
+  PyObject * interleave;
+
+  if (!PyArg_ParseTuple( args, "O", &interleave )) return NULL;
+
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  config->set_table_numa_interleave( PyObject_IsTrue( interleave ) );
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
+static
+PyObject *
+config_get_table_zero_threads( PyObject * self, PyObject * args )
+{
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  return PyInt_FromSize_t( (size_t)config->get_table_zero_threads( ) );
+}
+
+
+static
+PyObject *
+config_set_table_zero_threads( PyObject * self, PyObject * args )
+{
+  int	  zero_threads;
+
+  if (!PyArg_ParseTuple( args, "i", &zero_threads )) return NULL;
+
+  if (zero_threads < 1) {
+    PyErr_SetString( PyExc_ValueError, "need at least one thread" );
+    return NULL;
+  }
+
+  khmer_ConfigObject *	  me	    = (khmer_ConfigObject *) self;
+  khmer::Config *	  config    = me->config;
+  config->set_table_zero_threads( (uint32_t)zero_threads );
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+
 static PyMethodDef khmer_config_methods[] = {
   { "has_extra_sanity_checks", config_has_extra_sanity_checks,
     METH_VARARGS, "Compiled with extra sanity checking?" },
@@ -330,6 +430,18 @@ static PyMethodDef khmer_config_methods[] = {
     METH_VARARGS, "Get the trace level of the reads file parser." },
   { "set_reads_parser_trace_level", config_set_reads_parser_trace_level,
     METH_VARARGS, "Set the trace level of the reads file parser." },
+  { "get_table_huge_pages", config_get_table_huge_pages,
+    METH_VARARGS, "Get the kind of pages new hash tables are backed by." },
+  { "set_table_huge_pages", config_set_table_huge_pages,
+    METH_VARARGS, "Back new hash tables with normal, transparent huge, or explicit huge pages." },
+  { "get_table_numa_interleave", config_get_table_numa_interleave,
+    METH_VARARGS, "Are new hash tables interleaved across NUMA nodes?" },
+  { "set_table_numa_interleave", config_set_table_numa_interleave,
+    METH_VARARGS, "Interleave new hash tables across NUMA nodes." },
+  { "get_table_zero_threads", config_get_table_zero_threads,
+    METH_VARARGS, "Get the number of threads that zero new hash tables." },
+  { "set_table_zero_threads", config_set_table_zero_threads,
+    METH_VARARGS, "Set the number of threads that zero new hash tables." },
   {NULL, NULL, 0, NULL}           /* sentinel */
 };
 
@@ -1105,6 +1217,50 @@ static PyTypeObject khmer_KHashbitsType = {
 
 #define is_hashbits_obj(v)  ((v)->ob_type == &khmer_KHashbitsType)
 
+typedef struct {
+  PyObject_HEAD
+  khmer::ExactCountingHash * exact;
+} khmer_KExactCountingHashObject;
+
+static void khmer_exact_counting_dealloc(PyObject *);
+static PyObject * khmer_exact_counting_getattr(PyObject * obj, char * name);
+
+static PyTypeObject khmer_KExactCountingHashType = {
+    PyObject_HEAD_INIT(NULL)
+    0,
+    "KExactCountingHash", sizeof(khmer_KExactCountingHashObject),
+    0,
+    khmer_exact_counting_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    khmer_exact_counting_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+    0,				/*tp_as_number*/
+    0,				/*tp_as_sequence*/
+    0,				/*tp_as_mapping*/
+    0,				/*tp_hash */
+    0,				/*tp_call*/
+    0,				/*tp_str*/
+    0,				/*tp_getattro*/
+    0,				/*tp_setattro*/
+    0,				/*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,		/*tp_flags*/
+    "exact counting hash object",           /* tp_doc */
+};
+
+#define is_exact_counting_obj(v)  ((v)->ob_type == &khmer_KExactCountingHashType)
+
+// The table behind a counting hash or an exact counting hash; the
+// methods that need only a Hashtable are shared by both types.
+static khmer::Hashtable * _counting_table(PyObject * obj)
+{
+  if (is_exact_counting_obj(obj)) {
+    return ((khmer_KExactCountingHashObject *) obj)->exact;
+  }
+  return ((khmer_KCountingHashObject *) obj)->counting;
+}
+
 typedef struct {
   PyObject_HEAD
   khmer::MinMaxTable * mmt;
@@ -1175,22 +1331,168 @@ static PyObject * hash_get_use_bigcount(PyObject * self, PyObject * args)
   return PyBool_FromLong((int)val);
 }
 
+static PyObject * hash_set_overflow_size(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  PY_LONG_LONG size;
+  if (!PyArg_ParseTuple(args, "L", &size)) {
+    return NULL;
+  }
+
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "overflow size must not be negative");
+    return NULL;
+  }
+
+  counting->set_overflow_size(size);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hash_get_overflow_size(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(counting->get_overflow_size());
+}
+
+static PyObject * hash_set_use_conservative(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  PyObject * x;
+  if (!PyArg_ParseTuple(args, "O", &x)) {
+    return NULL;
+  }
+
+  bool setme = PyObject_IsTrue(x);
+  counting->set_use_conservative(setme);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hash_get_use_conservative(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong((int)counting->get_use_conservative());
+}
+
+static PyObject * hash_is_blocked(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong((int)counting->is_blocked());
+}
+
+static PyObject * hash_get_counter_bits(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(counting->get_counter_bits());
+}
+
+// the occupancy of a table's bins, and the estimates made from it.
+static PyObject * _occupancy_to_dict(const khmer::TableOccupancy &occupancy)
+{
+  PyObject * occupied = PyList_New(occupancy.occupied.size());
+  for (size_t i = 0; i < occupancy.occupied.size(); i++) {
+    PyList_SET_ITEM(occupied, i,
+		    PyLong_FromUnsignedLongLong(occupancy.occupied[i]));
+  }
+
+  return Py_BuildValue("{s:N,s:d,s:d}",
+		       "occupied", occupied,
+		       "fp_rate", occupancy.get_fp_rate(),
+		       "n_kmers", occupancy.estimate_n_kmers());
+}
+
+static PyObject * hash_is_mmapped(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong((int)counting->is_mmapped());
+}
+
 static PyObject * hash_n_occupied(PyObject * self, PyObject * args)
 {
   khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
   khmer::CountingHash * counting = me->counting;
 
   khmer::HashIntoType start = 0, stop = 0;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "|LL", &start, &stop)) {
+  if (!PyArg_ParseTuple(args, "|LLI", &start, &stop, &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
     return NULL;
   }
 
-  khmer::HashIntoType n = counting->n_occupied(start, stop);
+  khmer::HashIntoType n;
+
+  Py_BEGIN_ALLOW_THREADS
+  n = counting->n_occupied(start, stop, n_threads);
+  Py_END_ALLOW_THREADS
 
   return PyInt_FromLong(n);
 }
 
+static PyObject * hash_occupancy(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "|I", &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
+    return NULL;
+  }
+
+  khmer::TableOccupancy occupancy;
+
+  Py_BEGIN_ALLOW_THREADS
+  occupancy = counting->get_occupancy(n_threads);
+  Py_END_ALLOW_THREADS
+
+  return _occupancy_to_dict(occupancy);
+}
+
 static PyObject * hash_n_entries(PyObject * self, PyObject * args)
 {
   khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
@@ -1205,8 +1507,7 @@ static PyObject * hash_n_entries(PyObject * self, PyObject * args)
 
 static PyObject * hash_count(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * kmer;
 
@@ -1274,8 +1575,7 @@ static PyObject * hash_fasta_file_to_minmax(PyObject * self, PyObject *args)
 
 static PyObject * hash_consume_fasta(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me  = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting  = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * filename;
   khmer::HashIntoType lower_bound = 0, upper_bound = 0;
@@ -1305,8 +1605,7 @@ static PyObject * hash_consume_fasta_with_reads_parser(
   PyObject * self, PyObject * args
 )
 {
-  khmer_KCountingHashObject * me  = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting  = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   PyObject * rparser_obj = NULL;
   khmer::HashIntoType lower_bound = 0, upper_bound = 0;
@@ -1342,8 +1641,7 @@ static PyObject * hash_consume_fasta_with_reads_parser(
 
 static PyObject * hash_consume(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * long_str;
   khmer::HashIntoType lower_bound = 0, upper_bound = 0;
@@ -1418,8 +1716,7 @@ static PyObject * hash_get_max_count(PyObject * self, PyObject * args)
 
 static PyObject * hash_get_median_count(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * long_str;
 
@@ -1505,8 +1802,7 @@ static PyObject * hash_get_kmer_abund_abs_deviation(PyObject * self, PyObject *
 
 static PyObject * hash_get(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   PyObject * arg;
 
@@ -1545,8 +1841,7 @@ static PyObject * hash_max_hamming1_count(PyObject * self, PyObject * args)
 
 static PyObject * count_trim_on_abundance(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * seq = NULL;
   unsigned int min_count_i = 0;
@@ -1572,8 +1867,7 @@ static PyObject * count_trim_on_abundance(PyObject * self, PyObject * args)
 }
 static PyObject * count_trim_below_abundance(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * seq = NULL;
   unsigned int max_count_i = 0;
@@ -1600,8 +1894,7 @@ static PyObject * count_trim_below_abundance(PyObject * self, PyObject * args)
 
 static PyObject * hash_abundance_distribution(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * filename = NULL;
   PyObject * tracking_obj = NULL;
@@ -1611,11 +1904,12 @@ static PyObject * hash_abundance_distribution(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  assert(is_hashbits_obj(tracking_obj));
-
-  khmer_KHashbitsObject * tracking_o = (khmer_KHashbitsObject *) tracking_obj;
-  khmer::Hashbits * hashbits = tracking_o->hashbits;
-
+  // None for no tracking table.
+  khmer::Hashbits * hashbits = NULL;
+  if (tracking_obj != Py_None) {
+    assert(is_hashbits_obj(tracking_obj));
+    hashbits = ((khmer_KHashbitsObject *) tracking_obj)->hashbits;
+  }
 
   khmer::HashIntoType * dist;
   dist = counting->abundance_distribution(filename, hashbits,
@@ -1626,45 +1920,285 @@ static PyObject * hash_abundance_distribution(PyObject * self, PyObject * args)
     PyList_SET_ITEM(x, i, PyInt_FromLong(dist[i]));
   }
 
-  delete dist;
+  delete [] dist;
 
   return x;
 }
 
-static PyObject * hash_fasta_count_kmers_by_position(PyObject * self, PyObject * args)
+static PyObject * hash_abundance_distribution_with_reads_parser(
+  PyObject * self, PyObject * args
+)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
-
-  char * inputfile;
-  int max_read_len;
-  int limit_by = 0;
-  PyObject * callback_obj = NULL;
+  khmer::Hashtable * counting = _counting_table(self);
 
-  if (!PyArg_ParseTuple(args, "sii|O", &inputfile, &max_read_len, &limit_by,
-			&callback_obj)) {
+  PyObject * rparser_obj = NULL;
+  PyObject * tracking_obj = NULL;
+  unsigned int n_threads = 1;
+  if (!PyArg_ParseTuple(args, "OO|I", &rparser_obj, &tracking_obj,
+			&n_threads)) {
     return NULL;
   }
 
-  unsigned long long * counts;
-  counts = counting->fasta_count_kmers_by_position(inputfile, max_read_len,
-						    limit_by, 
-						    _report_fn, callback_obj);
-					 
-  PyObject * x = PyList_New(max_read_len);
-  for (int i = 0; i < max_read_len; i++) {
-    PyList_SET_ITEM(x, i, PyInt_FromLong(counts[i]));
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
+    return NULL;
   }
 
-  delete counts;
+  // TODO: Add type-checking.
+  khmer:: read_parsers::IParser * rparser =
+    ((khmer_ReadParserObject *) rparser_obj)->parser;
 
-  return x;
-}
+  // None for no tracking table.
+  khmer::Hashbits * hashbits = NULL;
+  if (tracking_obj != Py_None) {
+    assert(is_hashbits_obj(tracking_obj));
+    hashbits = ((khmer_KHashbitsObject *) tracking_obj)->hashbits;
+  }
 
-static PyObject * hash_fasta_dump_kmers_by_abundance(PyObject * self, PyObject * args)
-{
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  std::vector<khmer::HashIntoType> dist(MAX_BIGCOUNT + 1, 0);
+
+  Py_BEGIN_ALLOW_THREADS
+  counting->abundance_distribution(rparser, hashbits, &dist[0], n_threads);
+  Py_END_ALLOW_THREADS
+
+  PyObject * x = PyList_New(MAX_BIGCOUNT + 1);
+  for (int i = 0; i < MAX_BIGCOUNT + 1; i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(dist[i]));
+  }
+
+  return x;
+}
+
+static PyObject * hash_normalize_by_median(PyObject * self, PyObject * args)
+{
+  khmer::Hashtable * counting = _counting_table(self);
+
+  char * infilename = NULL;
+  char * outfilename = NULL;
+  unsigned int cutoff = 0;
+  PyObject * paired_o = NULL;
+  unsigned int n_threads = 1;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "ssI|OIO", &infilename, &outfilename, &cutoff,
+			&paired_o, &n_threads, &callback_obj)) {
+    return NULL;
+  }
+
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  bool paired = paired_o && PyObject_IsTrue(paired_o);
+  khmer::DiginormEngine engine(*counting, cutoff, paired, n_threads);
+
+  bool improperly_paired = false;
+  bool invalid_file_format = false;
+
+  // with a callback, this thread calls back, and keeps the GIL for it;
+  // the other threads don't call back, and so don't need it.
+  PyThreadState * thread_state = NULL;
+  if (!callback_obj) {
+    thread_state = PyEval_SaveThread();
+  }
+
+  try {
+    engine.normalize(infilename, outfilename,
+		     callback_obj ? _report_fn : NULL, callback_obj);
+  } catch (khmer::ImproperlyPairedReads &exc) {
+    improperly_paired = true;
+  } catch (khmer:: read_parsers:: InvalidReadFileFormat &exc) {
+    invalid_file_format = true;
+  } catch (_khmer_signal &e) {
+    return NULL;
+  }
+
+  if (thread_state) {
+    PyEval_RestoreThread(thread_state);
+  }
+
+  if (improperly_paired) {
+    PyErr_SetString(PyExc_ValueError, "improperly interleaved pairs");
+    return NULL;
+  }
+  if (invalid_file_format) {
+    PyErr_SetString(PyExc_ValueError, "invalid FASTA or FASTQ file");
+    return NULL;
+  }
+
+  return Py_BuildValue("KKK", engine.get_n_reads(), engine.get_n_kept(),
+		       engine.get_n_unpaired());
+}
+
+static PyObject * hash_filter_abund(PyObject * self, PyObject * args)
+{
+  khmer::Hashtable * counting = _counting_table(self);
+
+  char * infilename = NULL;
+  char * outfilename = NULL;
+  unsigned int cutoff = 0;
+  unsigned int n_threads = 1;
+  PyObject * ordered_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "ssI|IO", &infilename, &outfilename, &cutoff,
+			&n_threads, &ordered_o)) {
+    return NULL;
+  }
+
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  bool ordered = !ordered_o || PyObject_IsTrue(ordered_o);
+  khmer::AbundanceFilterEngine engine(*counting, cutoff, n_threads, ordered);
+
+  bool invalid_file_format = false;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    engine.filter(infilename, outfilename);
+  } catch (khmer:: read_parsers:: InvalidReadFileFormat &exc) {
+    invalid_file_format = true;
+  }
+  Py_END_ALLOW_THREADS
+
+  if (invalid_file_format) {
+    PyErr_SetString(PyExc_ValueError, "invalid FASTA or FASTQ file");
+    return NULL;
+  }
+
+  return Py_BuildValue("KKKK", engine.get_n_reads(), engine.get_n_kept(),
+		       engine.get_n_bp_read(), engine.get_n_bp_kept());
+}
+
+static PyObject * _counts_to_list(const std::vector<unsigned long long> &v)
+{
+  PyObject * x = PyList_New(v.size());
+  for (size_t i = 0; i < v.size(); i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(v[i]));
+  }
+
+  return x;
+}
+
+static PyObject * hash_abundance_stats(PyObject * self, PyObject * args)
+{
+  khmer::Hashtable * counting = _counting_table(self);
+
+  char * infilename = NULL;
+  unsigned int max_read_len = 0;
+  unsigned int limit_by = 0;
+  unsigned int n_threads = 1;
+  PyObject * quantiles_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "s|IIIO", &infilename, &max_read_len,
+			&limit_by, &n_threads, &quantiles_o)) {
+    return NULL;
+  }
+
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  std::vector<double> quantiles;
+  if (quantiles_o) {
+    PyObject * seq = PySequence_Fast(quantiles_o,
+				     "quantiles must be a sequence");
+    if (!seq) {
+      return NULL;
+    }
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+      double q = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+      if (!(q > 0 && q <= 1)) {
+	Py_DECREF(seq);
+	if (!PyErr_Occurred()) {
+	  PyErr_SetString(PyExc_ValueError,
+			  "quantiles must be greater than 0 and at most 1");
+	}
+	return NULL;
+      }
+      quantiles.push_back(q);
+    }
+    Py_DECREF(seq);
+  }
+
+  khmer::AbundanceStatsEngine engine(*counting, max_read_len, limit_by,
+				     n_threads);
+
+  bool invalid_file_format = false;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    engine.gather(infilename);
+  } catch (khmer:: read_parsers:: InvalidReadFileFormat &exc) {
+    invalid_file_format = true;
+  }
+  Py_END_ALLOW_THREADS
+
+  if (invalid_file_format) {
+    PyErr_SetString(PyExc_ValueError, "invalid FASTA or FASTQ file");
+    return NULL;
+  }
+
+  PyObject * quantiles_list = PyList_New(quantiles.size());
+  for (size_t i = 0; i < quantiles.size(); i++) {
+    PyList_SET_ITEM(quantiles_list, i,
+		    PyInt_FromLong(engine.get_quantile(quantiles[i])));
+  }
+
+  return Py_BuildValue("{s:K,s:K,s:K,s:d,s:d,s:d,s:i,s:I,s:N,s:N,s:N}",
+		       "n_reads", engine.get_n_reads(),
+		       "n_kmers", engine.get_n_kmers(),
+		       "total", engine.get_total(),
+		       "mean", engine.get_mean(),
+		       "variance", engine.get_variance(),
+		       "abs_deviation", engine.get_abs_deviation(),
+		       "median", (int) engine.get_median(),
+		       "median_abs_deviation",
+		       engine.get_median_abs_deviation(),
+		       "quantiles", quantiles_list,
+		       "histogram", _counts_to_list(engine.get_histogram()),
+		       "by_position",
+		       _counts_to_list(engine.get_by_position()));
+}
+
+static PyObject * hash_fasta_count_kmers_by_position(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
+
+  char * inputfile;
+  int max_read_len;
+  int limit_by = 0;
+  PyObject * callback_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "sii|O", &inputfile, &max_read_len, &limit_by,
+			&callback_obj)) {
+    return NULL;
+  }
+
+  unsigned long long * counts;
+  counts = counting->fasta_count_kmers_by_position(inputfile, max_read_len,
+						    limit_by, 
+						    _report_fn, callback_obj);
+					 
+  PyObject * x = PyList_New(max_read_len);
+  for (int i = 0; i < max_read_len; i++) {
+    PyList_SET_ITEM(x, i, PyInt_FromLong(counts[i]));
+  }
+
+  delete counts;
+
+  return x;
+}
+
+static PyObject * hash_fasta_dump_kmers_by_abundance(PyObject * self, PyObject * args)
+{
+  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
+  khmer::CountingHash * counting = me->counting;
 
   char * inputfile;
   int limit_by = 0;
@@ -1721,12 +2255,15 @@ static PyObject * hash_load(PyObject * self, PyObject * args)
   khmer::CountingHash * counting = me->counting;
 
   char * filename = NULL;
+  PyObject * use_mmap_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &use_mmap_o)) {
     return NULL;
   }
 
-  counting->load(filename);
+  bool use_mmap = use_mmap_o && PyObject_IsTrue(use_mmap_o);
+
+  counting->load(filename, use_mmap);
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -1734,8 +2271,7 @@ static PyObject * hash_load(PyObject * self, PyObject * args)
 
 static PyObject * hash_save(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   char * filename = NULL;
 
@@ -1751,8 +2287,7 @@ static PyObject * hash_save(PyObject * self, PyObject * args)
 
 static PyObject * hash_get_ksize(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+  khmer::Hashtable * counting = _counting_table(self);
 
   if (!PyArg_ParseTuple(args, "")) {
     return NULL;
@@ -1791,7 +2326,15 @@ static PyMethodDef khmer_counting_methods[] = {
   { "hashsizes", hash_get_hashsizes, METH_VARARGS, "" },
   { "set_use_bigcount", hash_set_use_bigcount, METH_VARARGS, "" },
   { "get_use_bigcount", hash_get_use_bigcount, METH_VARARGS, "" },
+  { "set_overflow_size", hash_set_overflow_size, METH_VARARGS, "Count past a full counter in this many 16-bit overflow counters" },
+  { "get_overflow_size", hash_get_overflow_size, METH_VARARGS, "" },
+  { "set_use_conservative", hash_set_use_conservative, METH_VARARGS, "Only increment a k-mer's smallest counters?" },
+  { "get_use_conservative", hash_get_use_conservative, METH_VARARGS, "" },
+  { "is_blocked", hash_is_blocked, METH_VARARGS, "Are all of a k-mer's counters in one cache-line block?" },
+  { "get_counter_bits", hash_get_counter_bits, METH_VARARGS, "Width of each counter, in bits" },
+  { "is_mmapped", hash_is_mmapped, METH_VARARGS, "Were the counters mapped from the file they were loaded from?" },
   { "n_occupied", hash_n_occupied, METH_VARARGS, "Count the number of occupied bins" },
+  { "occupancy", hash_occupancy, METH_VARARGS, "Occupied bins of each table, the false positive rate, and an estimate of the number of distinct k-mers" },
   { "n_entries", hash_n_entries, METH_VARARGS, "" },
   { "count", hash_count, METH_VARARGS, "Count the given kmer" },
   { "consume", hash_consume, METH_VARARGS, "Count all k-mers in the given string" },
@@ -1809,6 +2352,15 @@ static PyMethodDef khmer_counting_methods[] = {
   { "trim_on_abundance", count_trim_on_abundance, METH_VARARGS, "Trim on >= abundance" },
   { "trim_below_abundance", count_trim_below_abundance, METH_VARARGS, "Trim on >= abundance" },
   { "abundance_distribution", hash_abundance_distribution, METH_VARARGS, "" },
+  { "abundance_distribution_with_reads_parser",
+    hash_abundance_distribution_with_reads_parser, METH_VARARGS,
+    "Count k-mers by abundance from a parser that threads can share" },
+  { "normalize_by_median", hash_normalize_by_median, METH_VARARGS,
+    "Keep the reads with a median k-mer count below the cutoff, on N threads" },
+  { "filter_abund", hash_filter_abund, METH_VARARGS,
+    "Trim reads at k-mers below the cutoff, on N threads" },
+  { "abundance_stats", hash_abundance_stats, METH_VARARGS,
+    "Get statistics of the counts of the k-mers in a file, in one pass on N threads" },
   { "fasta_count_kmers_by_position", hash_fasta_count_kmers_by_position, METH_VARARGS, "" },
   { "fasta_dump_kmers_by_abundance", hash_fasta_dump_kmers_by_abundance, METH_VARARGS, "" },
   { "load", hash_load, METH_VARARGS, "" },
@@ -1816,7 +2368,8 @@ static PyMethodDef khmer_counting_methods[] = {
   { "get_kmer_abund_abs_deviation", hash_get_kmer_abund_abs_deviation, METH_VARARGS, "" },
   { "get_kmer_abund_mean", hash_get_kmer_abund_mean, METH_VARARGS, "" },
   { "collect_high_abundance_kmers", hash_collect_high_abundance_kmers,
-    METH_VARARGS, "" },
+    METH_VARARGS,
+    "Collect the k-mers at or above lower_count, counting until one reaches upper_count, on N threads" },
 
   {NULL, NULL, 0, NULL}           /* sentinel */
 };
@@ -1883,8 +2436,20 @@ static PyObject* _new_counting_hash(PyObject * self, PyObject * args)
   unsigned int k = 0;
   PyObject* sizes_list_o = NULL;
   unsigned int n_threads = 1;
+  PyObject* blocked_o = NULL;
+  unsigned int counter_bits = 8;
+  PyObject* conservative_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "IO|IOIO", &k, &sizes_list_o, &n_threads,
+			&blocked_o, &counter_bits, &conservative_o)) {
+    return NULL;
+  }
+
+  bool blocked = blocked_o && PyObject_IsTrue(blocked_o);
+  bool conservative = conservative_o && PyObject_IsTrue(conservative_o);
 
-  if (!PyArg_ParseTuple(args, "IO|I", &k, &sizes_list_o, &n_threads)) {
+  if (counter_bits != 8 && counter_bits != 4 && counter_bits != 2) {
+    PyErr_SetString(PyExc_ValueError, "counter_bits must be 8, 4, or 2");
     return NULL;
   }
 
@@ -1897,11 +2462,111 @@ static PyObject* _new_counting_hash(PyObject * self, PyObject * args)
   khmer_KCountingHashObject * kcounting_obj = (khmer_KCountingHashObject *) \
     PyObject_New(khmer_KCountingHashObject, &khmer_KCountingHashType);
 
-  kcounting_obj->counting = new khmer::CountingHash(k, sizes, n_threads);
+  kcounting_obj->counting = new khmer::CountingHash(k, sizes, n_threads,
+						    blocked, counter_bits,
+						    conservative);
 
   return (PyObject *) kcounting_obj;
 }
 
+//
+// exact counting hash stuff
+//
+
+static PyObject * exact_n_unique_kmers(PyObject * self, PyObject * args)
+{
+  khmer_KExactCountingHashObject * me = (khmer_KExactCountingHashObject *) self;
+  khmer::ExactCountingHash * exact = me->exact;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(exact->n_unique_kmers());
+}
+
+static PyObject * exact_load(PyObject * self, PyObject * args)
+{
+  khmer_KExactCountingHashObject * me = (khmer_KExactCountingHashObject *) self;
+  khmer::ExactCountingHash * exact = me->exact;
+
+  char * filename = NULL;
+
+  if (!PyArg_ParseTuple(args, "s", &filename)) {
+    return NULL;
+  }
+
+  exact->load(filename);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyMethodDef khmer_exact_counting_methods[] = {
+  { "ksize", hash_get_ksize, METH_VARARGS, "" },
+  { "n_unique_kmers", exact_n_unique_kmers, METH_VARARGS, "Count the distinct k-mers counted" },
+  { "count", hash_count, METH_VARARGS, "Count the given kmer" },
+  { "consume", hash_consume, METH_VARARGS, "Count all k-mers in the given string" },
+  { "consume_fasta", hash_consume_fasta, METH_VARARGS, "Count all k-mers in a given file" },
+  { "consume_fasta_with_reads_parser", hash_consume_fasta_with_reads_parser, 
+    METH_VARARGS, "Count all k-mers in a given file" },
+  { "get", hash_get, METH_VARARGS, "Get the count for the given k-mer" },
+  { "get_median_count", hash_get_median_count, METH_VARARGS, "Get the median, average, and stddev of the k-mer counts in the string" },
+  { "trim_on_abundance", count_trim_on_abundance, METH_VARARGS, "Trim on >= abundance" },
+  { "trim_below_abundance", count_trim_below_abundance, METH_VARARGS, "Trim on >= abundance" },
+  { "abundance_distribution", hash_abundance_distribution, METH_VARARGS, "" },
+  { "abundance_distribution_with_reads_parser",
+    hash_abundance_distribution_with_reads_parser, METH_VARARGS,
+    "Count k-mers by abundance from a parser that threads can share" },
+  { "normalize_by_median", hash_normalize_by_median, METH_VARARGS,
+    "Keep the reads with a median k-mer count below the cutoff, on N threads" },
+  { "filter_abund", hash_filter_abund, METH_VARARGS,
+    "Trim reads at k-mers below the cutoff, on N threads" },
+  { "abundance_stats", hash_abundance_stats, METH_VARARGS,
+    "Get statistics of the counts of the k-mers in a file, in one pass on N threads" },
+  { "load", exact_load, METH_VARARGS, "" },
+  { "save", hash_save, METH_VARARGS, "" },
+  { "collect_high_abundance_kmers", hash_collect_high_abundance_kmers,
+    METH_VARARGS, "" },
+
+  {NULL, NULL, 0, NULL}           /* sentinel */
+};
+
+static PyObject *
+khmer_exact_counting_getattr(PyObject * obj, char * name)
+{
+  return Py_FindMethod(khmer_exact_counting_methods, obj, name);
+}
+
+//
+// new_exact_counting_hash
+//
+
+static PyObject* new_exact_counting_hash(PyObject * self, PyObject * args)
+{
+  unsigned int k = 0;
+  unsigned long long expected_kmers = 0;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "I|KI", &k, &expected_kmers, &n_threads)) {
+    return NULL;
+  }
+
+  if (k < 1 || k > 32) {
+    PyErr_SetString(PyExc_ValueError, "k-mer size must be from 1 to 32");
+    return NULL;
+  }
+
+  khmer_KExactCountingHashObject * kexact_obj =
+    (khmer_KExactCountingHashObject *) \
+    PyObject_New(khmer_KExactCountingHashObject, &khmer_KExactCountingHashType);
+
+  kexact_obj->exact = new khmer::ExactCountingHash(k, expected_kmers,
+						   n_threads);
+
+  return (PyObject *) kexact_obj;
+}
+
 //
 // hashbits stuff
 //
@@ -1975,77 +2640,247 @@ static PyObject * hashbits_n_occupied(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   khmer::HashIntoType start = 0, stop = 0;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "|LL", &start, &stop)) {
+  if (!PyArg_ParseTuple(args, "|LLI", &start, &stop, &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
     return NULL;
   }
 
-  khmer::HashIntoType n = hashbits->n_occupied(start, stop);
+  khmer::HashIntoType n;
+
+  Py_BEGIN_ALLOW_THREADS
+  n = hashbits->n_occupied(start, stop, n_threads);
+  Py_END_ALLOW_THREADS
 
   return PyInt_FromLong(n);
 }
 
-static PyObject * hashbits_n_tags(PyObject * self, PyObject * args)
+static PyObject * hashbits_occupancy(PyObject * self, PyObject * args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
   khmer::Hashbits * hashbits = me->hashbits;
 
-  if (!PyArg_ParseTuple(args, "")) {
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "|I", &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
     return NULL;
   }
 
-  return PyInt_FromLong(hashbits->n_tags());
-}
+  khmer::TableOccupancy occupancy;
 
-static PyObject * hashbits_count(PyObject * self, PyObject * args)
-{
-  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
-  khmer::Hashbits * hashbits = me->hashbits;
+  Py_BEGIN_ALLOW_THREADS
+  occupancy = hashbits->get_occupancy(n_threads);
+  Py_END_ALLOW_THREADS
 
-  char * kmer;
+  return _occupancy_to_dict(occupancy);
+}
 
-  if (!PyArg_ParseTuple(args, "s", &kmer)) {
+// The Hashbits other_o is, if it can be combined with me bit by bit;
+// otherwise NULL, with an exception set.
+static khmer::Hashbits * _compatible_hashbits(khmer::Hashbits * me,
+					      PyObject * other_o)
+{
+  if (!is_hashbits_obj(other_o)) {
+    PyErr_SetString(PyExc_TypeError, "expected a Hashbits");
     return NULL;
   }
 
-  if (strlen(kmer) != hashbits->ksize()) {
+  khmer::Hashbits * other = ((khmer_KHashbitsObject *) other_o)->hashbits;
+  if (!me->is_compatible(*other)) {
     PyErr_SetString(PyExc_ValueError,
-		    "k-mer length must be the same as the hashbits k-size");
+		    "hashbits must have the same k-mer size and table sizes");
     return NULL;
   }
-
-  hashbits->count(kmer);
-
-  return PyInt_FromLong(1);
+  return other;
 }
 
-static PyObject * hashbits_consume(PyObject * self, PyObject * args)
+// A new Hashbits of me op other.
+static PyObject * _hashbits_combine(PyObject * self, PyObject * args,
+				    khmer::BitOp op)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
   khmer::Hashbits * hashbits = me->hashbits;
 
-  char * long_str;
-  khmer::HashIntoType lower_bound = 0, upper_bound = 0;
+  PyObject * other_o;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "s|ll", &long_str, &lower_bound, &upper_bound)) {
+  if (!PyArg_ParseTuple(args, "O|I", &other_o, &n_threads)) {
     return NULL;
   }
-  
-  if (strlen(long_str) < hashbits->ksize()) {
-    PyErr_SetString(PyExc_ValueError,
-		    "string length must >= the hashbits k-mer size");
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
     return NULL;
   }
 
-  unsigned int n_consumed;
-  n_consumed = hashbits->consume_string(long_str, lower_bound, upper_bound);
+  khmer::Hashbits * other = _compatible_hashbits(hashbits, other_o);
+  if (!other) {
+    return NULL;
+  }
 
-  return PyInt_FromLong(n_consumed);
-}
+  std::vector<khmer::HashIntoType> sizes = hashbits->get_tablesizes();
+  khmer::Hashbits * result = new khmer::Hashbits(hashbits->ksize(), sizes,
+						 hashbits->is_blocked());
 
-static PyObject * hashbits_print_stop_tags(PyObject * self, PyObject * args)
-{
-  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  Py_BEGIN_ALLOW_THREADS
+  result->combine(*hashbits, *other, op, n_threads);
+  Py_END_ALLOW_THREADS
+
+  khmer_KHashbitsObject * result_obj = (khmer_KHashbitsObject *) \
+    PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
+  result_obj->hashbits = result;
+
+  return (PyObject *) result_obj;
+}
+
+static PyObject * hashbits_union(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, khmer::BIT_OR);
+}
+
+static PyObject * hashbits_intersection(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, khmer::BIT_AND);
+}
+
+static PyObject * hashbits_difference(PyObject * self, PyObject * args)
+{
+  return _hashbits_combine(self, args, khmer::BIT_AND_NOT);
+}
+
+static PyObject * hashbits_update(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * other_o;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "O|I", &other_o, &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
+    return NULL;
+  }
+
+  khmer::Hashbits * other = _compatible_hashbits(hashbits, other_o);
+  if (!other) {
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  hashbits->combine(*hashbits, *other, khmer::BIT_OR, n_threads);
+  Py_END_ALLOW_THREADS
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hashbits_compare(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  PyObject * other_o;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "O|I", &other_o, &n_threads)) {
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "n_threads must be at least 1");
+    return NULL;
+  }
+
+  khmer::Hashbits * other = _compatible_hashbits(hashbits, other_o);
+  if (!other) {
+    return NULL;
+  }
+
+  khmer::SetComparison comparison;
+
+  Py_BEGIN_ALLOW_THREADS
+  comparison = hashbits->compare(*other, n_threads);
+  Py_END_ALLOW_THREADS
+
+  return Py_BuildValue("{s:d,s:d,s:d,s:d,s:d,s:d}",
+		       "n_kmers", comparison.first.estimate_n_kmers(),
+		       "other_n_kmers", comparison.second.estimate_n_kmers(),
+		       "union", comparison.estimate_n_union(),
+		       "intersection", comparison.estimate_n_intersection(),
+		       "difference", comparison.estimate_n_difference(),
+		       "jaccard", comparison.get_jaccard());
+}
+
+static PyObject * hashbits_n_tags(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(hashbits->n_tags());
+}
+
+static PyObject * hashbits_count(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * kmer;
+
+  if (!PyArg_ParseTuple(args, "s", &kmer)) {
+    return NULL;
+  }
+
+  if (strlen(kmer) != hashbits->ksize()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "k-mer length must be the same as the hashbits k-size");
+    return NULL;
+  }
+
+  hashbits->count(kmer);
+
+  return PyInt_FromLong(1);
+}
+
+static PyObject * hashbits_consume(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  char * long_str;
+  khmer::HashIntoType lower_bound = 0, upper_bound = 0;
+
+  if (!PyArg_ParseTuple(args, "s|ll", &long_str, &lower_bound, &upper_bound)) {
+    return NULL;
+  }
+  
+  if (strlen(long_str) < hashbits->ksize()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "string length must >= the hashbits k-mer size");
+    return NULL;
+  }
+
+  unsigned int n_consumed;
+  n_consumed = hashbits->consume_string(long_str, lower_bound, upper_bound);
+
+  return PyInt_FromLong(n_consumed);
+}
+
+static PyObject * hashbits_print_stop_tags(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
@@ -2128,7 +2963,7 @@ static PyObject * hashbits_traverse_from_tags(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
+  khmer::Hashtable * counting = _counting_table(counting_o);
 
   hashbits->traverse_from_tags(distance, threshold, frequency, *counting);
 
@@ -2156,7 +2991,7 @@ static PyObject * hashbits_repartition_largest_partition(PyObject * self, PyObje
     subset_p = hashbits->partition;
   }
 
-  khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
+  khmer::Hashtable * counting = _counting_table(counting_o);
 
   unsigned int next_largest = subset_p->repartition_largest_partition(distance, threshold, frequency, *counting);
 
@@ -2176,7 +3011,7 @@ static PyObject * hashbits_hitraverse_to_stoptags(PyObject * self, PyObject * ar
     return NULL;
   }
 
-  khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
+  khmer::Hashtable * counting = _counting_table(counting_o);
 
   hashbits->hitraverse_to_stoptags(filename, *counting, cutoff);
   
@@ -2228,8 +3063,9 @@ static PyObject * hashbits_calc_connected_graph_size(PyObject * self, PyObject *
   unsigned long long size = 0;
 
   Py_BEGIN_ALLOW_THREADS
-  khmer::SeenSet keeper;
-  hashbits->calc_connected_graph_size(_kmer, size, keeper, max_size,
+  khmer::HashIntoType kmer_f, kmer_r;
+  khmer::_hash(_kmer, hashbits->ksize(), kmer_f, kmer_r);
+  hashbits->calc_connected_graph_size(kmer_f, kmer_r, size, max_size,
 				      break_on_circum);
   Py_END_ALLOW_THREADS
 
@@ -2502,7 +3338,7 @@ static PyObject * hashbits_traverse_from_reads(PyObject * self, PyObject * args)
     return NULL;
   }
 
-  khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
+  khmer::Hashtable * counting = _counting_table(counting_o);
 
   hashbits->traverse_from_reads(filename, radius, big_threshold,
 				transfer_threshold, *counting);
@@ -2527,7 +3363,7 @@ static PyObject * hashbits_consume_fasta_and_traverse(PyObject * self, PyObject
     return NULL;
   }
 
-  khmer::CountingHash * counting = ((khmer_KCountingHashObject *) counting_o)->counting;
+  khmer::Hashtable * counting = _counting_table(counting_o);
 
   hashbits->consume_fasta_and_traverse(filename, radius, big_threshold,
 				       transfer_threshold, *counting);
@@ -2549,19 +3385,26 @@ static PyObject * hashbits_consume_fasta_and_tag(PyObject * self, PyObject * arg
 
   char * filename;
   PyObject * callback_obj = NULL;
+  unsigned int n_threads = 1;
 
-  if (!PyArg_ParseTuple(args, "s|O", &filename, &callback_obj)) {
+  if (!PyArg_ParseTuple(args, "s|OI", &filename, &callback_obj, &n_threads)) {
     return NULL;
   }
 
-  // call the C++ function, and trap signals => Python
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  // call the C++ function, and trap signals => Python.  The other threads
+  // don't call back, and so don't need the GIL.
 
   unsigned long long n_consumed;
   unsigned int total_reads;
 
   try {
     hashbits->consume_fasta_and_tag(filename, total_reads, n_consumed,
-				     _report_fn, callback_obj);
+				     _report_fn, callback_obj, n_threads);
   } catch (_khmer_signal &e) {
     return NULL;
   }
@@ -2730,11 +3573,13 @@ static PyObject * hashbits_get_stop_tags(PyObject * self, PyObject * args)
   }
 
   khmer::WordLength k = hashbits->ksize();
-  khmer::SeenSet::const_iterator si;
+  khmer::SortedSeenSet stop_tags(hashbits->stop_tags.begin(),
+				 hashbits->stop_tags.end());
+  khmer::SortedSeenSet::const_iterator si;
 
-  PyObject * x = PyList_New(hashbits->stop_tags.size());
+  PyObject * x = PyList_New(stop_tags.size());
   unsigned long long i = 0;
-  for (si = hashbits->stop_tags.begin(); si != hashbits->stop_tags.end(); si++)
+  for (si = stop_tags.begin(); si != stop_tags.end(); si++)
     {
       std::string s = khmer::_revhash(*si, k);
       PyList_SET_ITEM(x, i, Py_BuildValue("s", s.c_str()));
@@ -2754,11 +3599,12 @@ static PyObject * hashbits_get_tagset(PyObject * self, PyObject * args)
   }
 
   khmer::WordLength k = hashbits->ksize();
-  khmer::SeenSet::const_iterator si;
+  const khmer::SortedSeenSet &tags = hashbits->get_sorted_tags();
+  khmer::SortedSeenSet::const_iterator si;
 
-  PyObject * x = PyList_New(hashbits->all_tags.size());
+  PyObject * x = PyList_New(tags.size());
   unsigned long long i = 0;
-  for (si = hashbits->all_tags.begin(); si != hashbits->all_tags.end(); si++) {
+  for (si = tags.begin(); si != tags.end(); si++) {
     std::string s = khmer::_revhash(*si, k);
     PyList_SET_ITEM(x, i, Py_BuildValue("s", s.c_str()));
     i++;
@@ -2978,17 +3824,32 @@ static PyObject * hashbits_load(PyObject * self, PyObject * args)
   khmer::Hashbits * hashbits = me->hashbits;
 
   char * filename = NULL;
+  PyObject * use_mmap_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s", &filename)) {
+  if (!PyArg_ParseTuple(args, "s|O", &filename, &use_mmap_o)) {
     return NULL;
   }
 
-  hashbits->load(filename);
+  bool use_mmap = use_mmap_o && PyObject_IsTrue(use_mmap_o);
+
+  hashbits->load(filename, use_mmap);
 
   Py_INCREF(Py_None);
   return Py_None;
 }
 
+static PyObject * hashbits_is_mmapped(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong((int)hashbits->is_mmapped());
+}
+
 static PyObject * hashbits_save(PyObject * self, PyObject * args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
@@ -3006,15 +3867,20 @@ static PyObject * hashbits_save(PyObject * self, PyObject * args)
   return Py_None;
 }
 
-static PyObject * hashbits_load_tagset(PyObject * self, PyObject * args)
+static PyObject * hashbits_load_tagset(PyObject * self, PyObject * args,
+				       PyObject * kwds)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
   khmer::Hashbits * hashbits = me->hashbits;
 
+  static char * kwlist[] = { (char *) "filename", (char *) "clear_tags",
+			     (char *) "use_mmap", NULL };
   char * filename = NULL;
   PyObject * clear_tags_o = NULL;
+  PyObject * use_mmap_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "s|O", &filename, &clear_tags_o)) {
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|OO", kwlist, &filename,
+				   &clear_tags_o, &use_mmap_o)) {
     return NULL;
   }
 
@@ -3022,7 +3888,9 @@ static PyObject * hashbits_load_tagset(PyObject * self, PyObject * args)
   if (clear_tags_o && !PyObject_IsTrue(clear_tags_o)) {
     clear_tags = false;
   }
-  hashbits->load_tagset(filename, clear_tags);
+  bool use_mmap = use_mmap_o && PyObject_IsTrue(use_mmap_o);
+
+  hashbits->load_tagset(filename, clear_tags, use_mmap);
 
   Py_INCREF(Py_None);
   return Py_None;
@@ -3273,14 +4141,12 @@ static PyObject * hashbits_divide_tags_into_subsets(PyObject * self, PyObject *
     return NULL;
   }
 
-  khmer::SeenSet divvy;
+  std::vector<khmer::HashIntoType> divvy;
   hashbits->divide_tags_into_subsets(subset_size, divvy);
 
   PyObject * x = PyList_New(divvy.size());
-  unsigned int i = 0;
-  for (khmer::SeenSet::const_iterator si = divvy.begin(); si != divvy.end();
-       si++, i++) {
-    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(*si));
+  for (unsigned int i = 0; i < divvy.size(); i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(divvy[i]));
   }
 
   return x;
@@ -3427,6 +4293,18 @@ static PyObject * hashbits_get_hashsizes(PyObject * self, PyObject * args)
   return x;
 }
 
+static PyObject * hashbits_is_blocked(PyObject * self, PyObject * args)
+{
+  khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
+  khmer::Hashbits * hashbits = me->hashbits;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyBool_FromLong((int)hashbits->is_blocked());
+}
+
 static PyObject * hashbits_extract_unique_paths(PyObject * self, PyObject * args)
 {
   khmer_KHashbitsObject * me = (khmer_KHashbitsObject *) self;
@@ -3479,7 +4357,14 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "extract_unique_paths", hashbits_extract_unique_paths, METH_VARARGS, "" },
   { "ksize", hashbits_get_ksize, METH_VARARGS, "" },
   { "hashsizes", hashbits_get_hashsizes, METH_VARARGS, "" },
+  { "is_blocked", hashbits_is_blocked, METH_VARARGS, "Are all of a k-mer's bits in one cache-line block?" },
   { "n_occupied", hashbits_n_occupied, METH_VARARGS, "Count the number of occupied bins" },
+  { "occupancy", hashbits_occupancy, METH_VARARGS, "Occupied bins of each table, the false positive rate, and an estimate of the number of distinct k-mers" },
+  { "union", hashbits_union, METH_VARARGS, "A new hashbits of the k-mers in either, from the tables" },
+  { "intersection", hashbits_intersection, METH_VARARGS, "A new hashbits of the k-mers in both, from the tables" },
+  { "difference", hashbits_difference, METH_VARARGS, "A new hashbits of the k-mers in this but not the other, from the tables" },
+  { "update", hashbits_update, METH_VARARGS, "Add the k-mers of another hashbits, from its tables" },
+  { "compare", hashbits_compare, METH_VARARGS, "Estimate the k-mers in each, their union, intersection and difference, and the Jaccard index" },
   { "n_unique_kmers", hashbits_n_unique_kmers,  METH_VARARGS, "Count the number of unique kmers" },
   { "count", hashbits_count, METH_VARARGS, "Count the given kmer" },
   { "count_overlap", hashbits_count_overlap,METH_VARARGS,"Count overlap kmers in two datasets" },
@@ -3507,8 +4392,10 @@ static PyMethodDef khmer_hashbits_methods[] = {
   { "get_stop_tags", hashbits_get_stop_tags, METH_VARARGS, "" },
   { "get_tagset", hashbits_get_tagset, METH_VARARGS, "" },
   { "load", hashbits_load, METH_VARARGS, "" },
+  { "is_mmapped", hashbits_is_mmapped, METH_VARARGS, "Were the tables mapped from the file they were loaded from?" },
   { "save", hashbits_save, METH_VARARGS, "" },
-  { "load_tagset", hashbits_load_tagset, METH_VARARGS, "" },
+  { "load_tagset", (PyCFunction) hashbits_load_tagset,
+    METH_VARARGS | METH_KEYWORDS, "" },
   { "save_tagset", hashbits_save_tagset, METH_VARARGS, "" },
   { "n_tags", hashbits_n_tags, METH_VARARGS, "" },
   { "divide_tags_into_subsets", hashbits_divide_tags_into_subsets, METH_VARARGS, "" },
@@ -3563,11 +4450,14 @@ static PyObject* _new_hashbits(PyObject * self, PyObject * args)
 {
   unsigned int k = 0;
   PyObject* sizes_list_o = NULL;
+  PyObject* blocked_o = NULL;
 
-  if (!PyArg_ParseTuple(args, "IO", &k, &sizes_list_o)) {
+  if (!PyArg_ParseTuple(args, "IO|O", &k, &sizes_list_o, &blocked_o)) {
     return NULL;
   }
 
+  bool blocked = blocked_o && PyObject_IsTrue(blocked_o);
+
   std::vector<khmer::HashIntoType> sizes;
   for (int i = 0; i < PyObject_Length(sizes_list_o); i++) {
     PyObject * size_o = PyList_GET_ITEM(sizes_list_o, i);
@@ -3577,102 +4467,295 @@ static PyObject* _new_hashbits(PyObject * self, PyObject * args)
   khmer_KHashbitsObject * khashbits_obj = (khmer_KHashbitsObject *) \
     PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
 
-  khashbits_obj->hashbits = new khmer::Hashbits(k, sizes);
+  khashbits_obj->hashbits = new khmer::Hashbits(k, sizes, blocked);
 
   return (PyObject *) khashbits_obj;
 }
 
-static PyObject * hash_collect_high_abundance_kmers(PyObject * self, PyObject * args)
-{
-  khmer_KCountingHashObject * me = (khmer_KCountingHashObject *) self;
-  khmer::CountingHash * counting = me->counting;
+//
+// KmerSet object
+//
 
-  char * filename = NULL;
-  unsigned int lower_count, upper_count;
+typedef struct {
+  PyObject_HEAD
+  std::vector<khmer::HashIntoType> * kmers;	// sorted, each once
+  khmer::WordLength ksize;
+} khmer_KmerSetObject;
 
-  if (!PyArg_ParseTuple(args, "sII", &filename, &lower_count, &upper_count)) {
-    return NULL;
+static void khmer_kmer_set_dealloc(PyObject* self);
+static PyObject * khmer_kmer_set_getattr(PyObject *, char *);
+
+// The k-mer hash for a k-mer string or hash; -1 on error.
+static int _kmer_set_hash(khmer_KmerSetObject * me, PyObject * arg,
+			  khmer::HashIntoType &khash)
+{
+  if (PyInt_Check(arg) || PyLong_Check(arg)) {
+    khash = (khmer::HashIntoType) PyLong_AsUnsignedLongLongMask(arg);
+  } else if (PyString_Check(arg)) {
+    if ((unsigned int) PyString_Size(arg) != me->ksize) {
+      PyErr_SetString(PyExc_ValueError,
+		      "k-mer length must be the same as the set's k-size");
+      return -1;
+    }
+    khash = khmer::_hash(PyString_AsString(arg), me->ksize);
+  } else {
+    PyErr_SetString(PyExc_TypeError, "expected a k-mer or k-mer hash");
+    return -1;
   }
 
-  khmer::SeenSet found_kmers;
-  counting->collect_high_abundance_kmers(filename, lower_count, upper_count,
-					 found_kmers);
+  return 0;
+}
 
-  // create a new hashbits object...
-  std::vector<khmer::HashIntoType> sizes;
-  sizes.push_back(1);
+static Py_ssize_t kmer_set__len__(PyObject * self)
+{
+  khmer_KmerSetObject * me = (khmer_KmerSetObject *) self;
+  return me->kmers->size();
+}
 
-  khmer_KHashbitsObject * khashbits_obj = (khmer_KHashbitsObject *) \
-    PyObject_New(khmer_KHashbitsObject, &khmer_KHashbitsType);
+static int kmer_set__contains__(PyObject * self, PyObject * val)
+{
+  khmer_KmerSetObject * me = (khmer_KmerSetObject *) self;
+  khmer::HashIntoType khash;
 
-  // ...and set the collected kmers as the stoptags.
-  khashbits_obj->hashbits = new khmer::Hashbits(counting->ksize(), sizes);
-  khashbits_obj->hashbits->stop_tags.swap(found_kmers);
+  if (_kmer_set_hash(me, val, khash) < 0) {
+    return -1;
+  }
 
-  return (PyObject *) khashbits_obj;
+  return std::binary_search(me->kmers->begin(), me->kmers->end(), khash);
 }
 
-//
-// khmer_counting_dealloc -- clean up a counting hash object.
-//
+static PySequenceMethods khmer_KmerSet_SequenceMethods = {
+  kmer_set__len__,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  kmer_set__contains__,
+  0,
+  0
+};
 
-static void khmer_counting_dealloc(PyObject* self)
+static PyTypeObject khmer_KmerSetType = {
+    PyObject_HEAD_INIT(NULL)
+    0,
+    "KmerSet", sizeof(khmer_KmerSetObject),
+    0,
+    khmer_kmer_set_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    khmer_kmer_set_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+    0,				/*tp_as_number*/
+    &khmer_KmerSet_SequenceMethods, /*tp_as_sequence*/
+    0,				/*tp_as_mapping*/
+    0,				/*tp_hash */
+    0,				/*tp_call*/
+    0,				/*tp_str*/
+    0,				/*tp_getattro*/
+    0,				/*tp_setattro*/
+    0,				/*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,		/*tp_flags*/
+    "sorted array of k-mer hashes",	/* tp_doc */
+};
+
+static PyObject * kmer_set_ksize(PyObject * self, PyObject * args)
 {
-  khmer_KCountingHashObject * obj = (khmer_KCountingHashObject *) self;
-  delete obj->counting;
-  obj->counting = NULL;
-  
-  PyObject_Del((PyObject *) obj);
-}
+  khmer_KmerSetObject * me = (khmer_KmerSetObject *) self;
 
-//
-// khmer_hashbits_dealloc -- clean up a hashbits object.
-//
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
 
-static void khmer_hashbits_dealloc(PyObject* self)
-{
-  khmer_KHashbitsObject * obj = (khmer_KHashbitsObject *) self;
-  delete obj->hashbits;
-  obj->hashbits = NULL;
-  
-  PyObject_Del((PyObject *) obj);
+  return PyInt_FromLong(me->ksize);
 }
 
-//
-// MinMaxTable object
-//
-
-static PyObject * minmax_clear(PyObject * self, PyObject * args)
+static PyObject * kmer_set_contains(PyObject * self, PyObject * args)
 {
-  khmer_MinMaxObject * me = (khmer_MinMaxObject *) self;
-  khmer::MinMaxTable * mmt = me->mmt;
+  PyObject * arg;
 
-  unsigned int index;
+  if (!PyArg_ParseTuple(args, "O", &arg)) {
+    return NULL;
+  }
 
-  if (!PyArg_ParseTuple(args, "I", &index)) {
+  int found = kmer_set__contains__(self, arg);
+  if (found < 0) {
     return NULL;
   }
 
-  mmt->clear(index);
-  
-  Py_INCREF(Py_None);
-  return Py_None;
+  return PyBool_FromLong(found);
 }
 
-static PyObject * minmax_get_min(PyObject * self, PyObject * args)
+static PyObject * kmer_set_kmers(PyObject * self, PyObject * args)
 {
-  khmer_MinMaxObject * me = (khmer_MinMaxObject *) self;
-  khmer::MinMaxTable * mmt = me->mmt;
+  khmer_KmerSetObject * me = (khmer_KmerSetObject *) self;
+  const std::vector<khmer::HashIntoType> &kmers = *me->kmers;
 
-  unsigned int index;
-
-  if (!PyArg_ParseTuple(args, "I", &index)) {
+  if (!PyArg_ParseTuple(args, "")) {
     return NULL;
   }
 
-  unsigned int val = mmt->get_min(index);
+  PyObject * x = PyList_New(kmers.size());
+  for (size_t i = 0; i < kmers.size(); i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(kmers[i]));
+  }
 
-  return PyInt_FromLong(val);
+  return x;
+}
+
+static PyObject * kmer_set_save_stop_tags(PyObject * self, PyObject * args)
+{
+  khmer_KmerSetObject * me = (khmer_KmerSetObject *) self;
+
+  char * filename = NULL;
+
+  if (!PyArg_ParseTuple(args, "s", &filename)) {
+    return NULL;
+  }
+
+  khmer::write_stop_tags(filename, me->ksize, *me->kmers);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyMethodDef khmer_kmer_set_methods[] = {
+  { "ksize", kmer_set_ksize, METH_VARARGS, "" },
+  { "contains", kmer_set_contains, METH_VARARGS,
+    "Is the given k-mer or k-mer hash in the set?" },
+  { "kmers", kmer_set_kmers, METH_VARARGS,
+    "Get the k-mer hashes, sorted, as a list" },
+  { "save_stop_tags", kmer_set_save_stop_tags, METH_VARARGS,
+    "Save the k-mers as stop tags, for Hashbits.load_stop_tags" },
+  {NULL, NULL, 0, NULL}           /* sentinel */
+};
+
+static PyObject *
+khmer_kmer_set_getattr(PyObject * obj, char * name)
+{
+  return Py_FindMethod(khmer_kmer_set_methods, obj, name);
+}
+
+static void khmer_kmer_set_dealloc(PyObject* self)
+{
+  khmer_KmerSetObject * obj = (khmer_KmerSetObject *) self;
+  delete obj->kmers;
+  obj->kmers = NULL;
+
+  PyObject_Del((PyObject *) obj);
+}
+
+static PyObject * hash_collect_high_abundance_kmers(PyObject * self, PyObject * args)
+{
+  khmer::Hashtable * counting = _counting_table(self);
+
+  char * filename = NULL;
+  unsigned int lower_count, upper_count;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "sII|I", &filename, &lower_count, &upper_count,
+			&n_threads)) {
+    return NULL;
+  }
+
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  std::vector<khmer::HashIntoType> * kmers =
+    new std::vector<khmer::HashIntoType>();
+
+  Py_BEGIN_ALLOW_THREADS
+  counting->collect_high_abundance_kmers(filename, lower_count, upper_count,
+					 *kmers, n_threads);
+  Py_END_ALLOW_THREADS
+
+  khmer_KmerSetObject * kset_obj = (khmer_KmerSetObject *) \
+    PyObject_New(khmer_KmerSetObject, &khmer_KmerSetType);
+
+  kset_obj->kmers = kmers;
+  kset_obj->ksize = counting->ksize();
+
+  return (PyObject *) kset_obj;
+}
+
+//
+// khmer_counting_dealloc -- clean up a counting hash object.
+//
+
+static void khmer_counting_dealloc(PyObject* self)
+{
+  khmer_KCountingHashObject * obj = (khmer_KCountingHashObject *) self;
+  delete obj->counting;
+  obj->counting = NULL;
+  
+  PyObject_Del((PyObject *) obj);
+}
+
+//
+// khmer_exact_counting_dealloc -- clean up an exact counting hash object.
+//
+
+static void khmer_exact_counting_dealloc(PyObject* self)
+{
+  khmer_KExactCountingHashObject * obj = (khmer_KExactCountingHashObject *) self;
+  delete obj->exact;
+  obj->exact = NULL;
+  
+  PyObject_Del((PyObject *) obj);
+}
+
+//
+// khmer_hashbits_dealloc -- clean up a hashbits object.
+//
+
+static void khmer_hashbits_dealloc(PyObject* self)
+{
+  khmer_KHashbitsObject * obj = (khmer_KHashbitsObject *) self;
+  delete obj->hashbits;
+  obj->hashbits = NULL;
+  
+  PyObject_Del((PyObject *) obj);
+}
+
+//
+// MinMaxTable object
+//
+
+static PyObject * minmax_clear(PyObject * self, PyObject * args)
+{
+  khmer_MinMaxObject * me = (khmer_MinMaxObject *) self;
+  khmer::MinMaxTable * mmt = me->mmt;
+
+  unsigned int index;
+
+  if (!PyArg_ParseTuple(args, "I", &index)) {
+    return NULL;
+  }
+
+  mmt->clear(index);
+  
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * minmax_get_min(PyObject * self, PyObject * args)
+{
+  khmer_MinMaxObject * me = (khmer_MinMaxObject *) self;
+  khmer::MinMaxTable * mmt = me->mmt;
+
+  unsigned int index;
+
+  if (!PyArg_ParseTuple(args, "I", &index)) {
+    return NULL;
+  }
+
+  unsigned int val = mmt->get_min(index);
+
+  return PyInt_FromLong(val);
 }
 
 static PyObject * minmax_get_max(PyObject * self, PyObject * args)
@@ -3843,6 +4926,399 @@ static void khmer_minmax_dealloc(PyObject* self)
 }
 
 
+//
+// HLLCounter object
+//
+
+typedef struct {
+  PyObject_HEAD
+  khmer::HLLCounter * hllcounter;
+} khmer_HLLCounterObject;
+
+#define is_hllcounter_obj(v)  ((v)->ob_type == &khmer_HLLCounterType)
+
+static void khmer_hllcounter_dealloc(PyObject* self);
+static PyObject * khmer_hllcounter_getattr(PyObject *, char *);
+
+static PyTypeObject khmer_HLLCounterType = {
+    PyObject_HEAD_INIT(NULL)
+    0,
+    "HLLCounter", sizeof(khmer_HLLCounterObject),
+    0,
+    khmer_hllcounter_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    khmer_hllcounter_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+    0,				/*tp_as_number*/
+    0,				/*tp_as_sequence*/
+    0,				/*tp_as_mapping*/
+    0,				/*tp_hash */
+    0,				/*tp_call*/
+    0,				/*tp_str*/
+    0,				/*tp_getattro*/
+    0,				/*tp_setattro*/
+    0,				/*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,		/*tp_flags*/
+    "HyperLogLog k-mer cardinality estimator",	/* tp_doc */
+};
+
+static PyObject * hllcounter_ksize(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(me->hllcounter->ksize());
+}
+
+static PyObject * hllcounter_consume(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hllcounter = me->hllcounter;
+
+  char * seq;
+
+  if (!PyArg_ParseTuple(args, "s", &seq)) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(hllcounter->consume_string(seq));
+}
+
+static PyObject * hllcounter_consume_fasta_with_reads_parser(
+  PyObject * self, PyObject * args
+)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  khmer::HLLCounter * hllcounter = me->hllcounter;
+
+  PyObject * rparser_obj = NULL;
+
+  if (!PyArg_ParseTuple(args, "O", &rparser_obj)) {
+    return NULL;
+  }
+
+  khmer_ReadParserObject * my_rparser =
+    (khmer_ReadParserObject *) rparser_obj;
+  khmer:: read_parsers::IParser * rparser = my_rparser->parser;
+
+  unsigned long long  n_consumed    = 0;
+  unsigned int	      total_reads   = 0;
+  bool		      invalid_file_format = false;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    hllcounter->consume_fasta(rparser, total_reads, n_consumed);
+  } catch (khmer:: read_parsers:: InvalidReadFileFormat &exc) {
+    invalid_file_format = true;
+  }
+  Py_END_ALLOW_THREADS
+
+  if (invalid_file_format) {
+    PyErr_SetString(PyExc_ValueError, "invalid FASTA or FASTQ file");
+    return NULL;
+  }
+
+  return Py_BuildValue("iL", total_reads, n_consumed);
+}
+
+static PyObject * hllcounter_merge(PyObject * self, PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+  PyObject * other_py_obj;
+
+  if (!PyArg_ParseTuple(args, "O", &other_py_obj)) {
+    return NULL;
+  }
+
+  if (!is_hllcounter_obj(other_py_obj)) {
+    PyErr_SetString(PyExc_TypeError, "expected an HLLCounter");
+    return NULL;
+  }
+
+  khmer::HLLCounter * other =
+    ((khmer_HLLCounterObject *) other_py_obj)->hllcounter;
+
+  if (other->ksize() != me->hllcounter->ksize() ||
+      other->precision() != me->hllcounter->precision()) {
+    PyErr_SetString(PyExc_ValueError,
+		    "counters must have the same k-mer size and error rate");
+    return NULL;
+  }
+
+  me->hllcounter->merge(*other);
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * hllcounter_estimate_cardinality(PyObject * self,
+						  PyObject * args)
+{
+  khmer_HLLCounterObject * me = (khmer_HLLCounterObject *) self;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(me->hllcounter->estimate_cardinality());
+}
+
+static PyMethodDef khmer_hllcounter_methods[] = {
+  { "ksize", hllcounter_ksize, METH_VARARGS, "" },
+  { "consume", hllcounter_consume, METH_VARARGS,
+    "Add the k-mers in a sequence" },
+  { "consume_fasta_with_reads_parser",
+    hllcounter_consume_fasta_with_reads_parser, METH_VARARGS,
+    "Add the k-mers in the reads from a parser; thread-safe" },
+  { "merge", hllcounter_merge, METH_VARARGS,
+    "Add the k-mers another counter has seen" },
+  { "estimate_cardinality", hllcounter_estimate_cardinality, METH_VARARGS,
+    "Estimate the number of distinct k-mers seen" },
+  {NULL, NULL, 0, NULL}           /* sentinel */
+};
+
+static PyObject *
+khmer_hllcounter_getattr(PyObject * obj, char * name)
+{
+  return Py_FindMethod(khmer_hllcounter_methods, obj, name);
+}
+
+//
+// new_hllcounter
+//
+
+static PyObject* new_hllcounter(PyObject * self, PyObject * args)
+{
+  unsigned int k = 0;
+  double error_rate = HLL_DEFAULT_ERROR_RATE;
+
+  if (!PyArg_ParseTuple(args, "I|d", &k, &error_rate)) {
+    return NULL;
+  }
+
+  if (k < 1 || k > 32) {
+    PyErr_SetString(PyExc_ValueError, "k-mer size must be from 1 to 32");
+    return NULL;
+  }
+  if (error_rate <= 0 || error_rate >= 1) {
+    PyErr_SetString(PyExc_ValueError, "error rate must be between 0 and 1");
+    return NULL;
+  }
+
+  khmer_HLLCounterObject * hllcounter_obj = (khmer_HLLCounterObject *) \
+    PyObject_New(khmer_HLLCounterObject, &khmer_HLLCounterType);
+
+  hllcounter_obj->hllcounter = new khmer::HLLCounter(k, error_rate);
+
+  return (PyObject *) hllcounter_obj;
+}
+
+//
+// khmer_hllcounter_dealloc -- clean up an HLLCounter object.
+//
+
+static void khmer_hllcounter_dealloc(PyObject* self)
+{
+  khmer_HLLCounterObject * obj = (khmer_HLLCounterObject *) self;
+  delete obj->hllcounter;
+  obj->hllcounter = NULL;
+
+  PyObject_Del((PyObject *) obj);
+}
+
+//
+// KmerCountDatabase object
+//
+
+typedef struct {
+  PyObject_HEAD
+  khmer::KmerCountDatabase * db;
+} khmer_KmerCountDatabaseObject;
+
+static void khmer_kmer_count_db_dealloc(PyObject* self);
+static PyObject * khmer_kmer_count_db_getattr(PyObject *, char *);
+
+static PyTypeObject khmer_KmerCountDatabaseType = {
+    PyObject_HEAD_INIT(NULL)
+    0,
+    "KmerCountDatabase", sizeof(khmer_KmerCountDatabaseObject),
+    0,
+    khmer_kmer_count_db_dealloc,	/*tp_dealloc*/
+    0,				/*tp_print*/
+    khmer_kmer_count_db_getattr,	/*tp_getattr*/
+    0,				/*tp_setattr*/
+    0,				/*tp_compare*/
+    0,				/*tp_repr*/
+    0,				/*tp_as_number*/
+    0,				/*tp_as_sequence*/
+    0,				/*tp_as_mapping*/
+    0,				/*tp_hash */
+    0,				/*tp_call*/
+    0,				/*tp_str*/
+    0,				/*tp_getattro*/
+    0,				/*tp_setattro*/
+    0,				/*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,		/*tp_flags*/
+    "sorted k-mer counts, looked up on disk",	/* tp_doc */
+};
+
+static PyObject * kmer_count_db_ksize(PyObject * self, PyObject * args)
+{
+  khmer_KmerCountDatabaseObject * me = (khmer_KmerCountDatabaseObject *) self;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyInt_FromLong(me->db->ksize());
+}
+
+static PyObject * kmer_count_db_n_unique_kmers(PyObject * self,
+					       PyObject * args)
+{
+  khmer_KmerCountDatabaseObject * me = (khmer_KmerCountDatabaseObject *) self;
+
+  if (!PyArg_ParseTuple(args, "")) {
+    return NULL;
+  }
+
+  return PyLong_FromUnsignedLongLong(me->db->n_unique_kmers());
+}
+
+static PyObject * kmer_count_db_get(PyObject * self, PyObject * args)
+{
+  khmer_KmerCountDatabaseObject * me = (khmer_KmerCountDatabaseObject *) self;
+  khmer::KmerCountDatabase * db = me->db;
+
+  PyObject * arg;
+
+  if (!PyArg_ParseTuple(args, "O", &arg)) {
+    return NULL;
+  }
+
+  unsigned long count = 0;
+
+  if (PyInt_Check(arg) || PyLong_Check(arg)) {
+    count = db->get_count(
+      (khmer::HashIntoType) PyLong_AsUnsignedLongLongMask(arg)
+    );
+  } else if (PyString_Check(arg)) {
+    if ((unsigned int) PyString_Size(arg) != db->ksize()) {
+      PyErr_SetString(PyExc_ValueError,
+		      "k-mer length must be the same as the database k-size");
+      return NULL;
+    }
+    count = db->get_count(PyString_AsString(arg));
+  }
+
+  return PyInt_FromLong(count);
+}
+
+static PyMethodDef khmer_kmer_count_db_methods[] = {
+  { "ksize", kmer_count_db_ksize, METH_VARARGS, "" },
+  { "n_unique_kmers", kmer_count_db_n_unique_kmers, METH_VARARGS,
+    "Count the distinct k-mers in the database" },
+  { "get", kmer_count_db_get, METH_VARARGS,
+    "Get the count for the given k-mer or k-mer hash" },
+  {NULL, NULL, 0, NULL}           /* sentinel */
+};
+
+static PyObject *
+khmer_kmer_count_db_getattr(PyObject * obj, char * name)
+{
+  return Py_FindMethod(khmer_kmer_count_db_methods, obj, name);
+}
+
+//
+// open_kmer_count_database
+//
+
+static PyObject* open_kmer_count_database(PyObject * self, PyObject * args)
+{
+  char * filename = NULL;
+
+  if (!PyArg_ParseTuple(args, "s", &filename)) {
+    return NULL;
+  }
+
+  khmer_KmerCountDatabaseObject * db_obj =
+    (khmer_KmerCountDatabaseObject *) \
+    PyObject_New(khmer_KmerCountDatabaseObject, &khmer_KmerCountDatabaseType);
+
+  db_obj->db = new khmer::KmerCountDatabase(filename);
+
+  return (PyObject *) db_obj;
+}
+
+//
+// khmer_kmer_count_db_dealloc -- clean up a KmerCountDatabase object.
+//
+
+static void khmer_kmer_count_db_dealloc(PyObject* self)
+{
+  khmer_KmerCountDatabaseObject * obj = (khmer_KmerCountDatabaseObject *) self;
+  delete obj->db;
+  obj->db = NULL;
+
+  PyObject_Del((PyObject *) obj);
+}
+
+static PyObject * _table_sizes_to_list(
+  const std::vector<khmer::HashIntoType> &sizes
+)
+{
+  PyObject * x = PyList_New(sizes.size());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    PyList_SET_ITEM(x, i, PyLong_FromUnsignedLongLong(sizes[i]));
+  }
+
+  return x;
+}
+
+static PyObject * get_table_sizes_for_fp_rate(PyObject * self, PyObject * args)
+{
+  khmer::HashIntoType n_kmers;
+  double fp_rate;
+
+  if (!PyArg_ParseTuple(args, "Kd", &n_kmers, &fp_rate)) {
+    return NULL;
+  }
+
+  if (fp_rate <= 0 || fp_rate >= 1) {
+    PyErr_SetString(PyExc_ValueError,
+		    "false positive rate must be between 0 and 1");
+    return NULL;
+  }
+
+  return _table_sizes_to_list(
+    khmer::get_table_sizes_for_fp_rate(n_kmers, fp_rate)
+  );
+}
+
+static PyObject * get_table_sizes_for_memory(PyObject * self, PyObject * args)
+{
+  khmer::HashIntoType n_kmers;
+  khmer::HashIntoType max_entries;
+
+  if (!PyArg_ParseTuple(args, "KK", &n_kmers, &max_entries)) {
+    return NULL;
+  }
+
+  if (max_entries < 2) {
+    PyErr_SetString(PyExc_ValueError, "need room for at least two entries");
+    return NULL;
+  }
+
+  return _table_sizes_to_list(
+    khmer::get_table_sizes_for_memory(n_kmers, max_entries)
+  );
+}
+
 //////////////////////////////
 // standalone functions
 
@@ -3923,6 +5399,109 @@ static PyObject * set_reporting_callback(PyObject * self, PyObject * args)
 // Module machinery.
 //
 
+static PyObject * merge_counting_hash_files(PyObject * self, PyObject * args)
+{
+  char * outfilename = NULL;
+  PyObject * infilenames_o = NULL;
+
+  if (!PyArg_ParseTuple(args, "sO", &outfilename, &infilenames_o)) {
+    return NULL;
+  }
+
+  PyObject * seq = PySequence_Fast(infilenames_o, "input files must be a list");
+  if (seq == NULL) {
+    return NULL;
+  }
+
+  std::vector<std::string> infilenames;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+    PyObject * name_o = PySequence_Fast_GET_ITEM(seq, i);
+    if (!PyString_Check(name_o)) {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_TypeError, "input file names must be strings");
+      return NULL;
+    }
+    infilenames.push_back(PyString_AsString(name_o));
+  }
+  Py_DECREF(seq);
+
+  if (infilenames.empty()) {
+    PyErr_SetString(PyExc_ValueError, "need at least one input file");
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  khmer::CountingHashFileMerger(infilenames, outfilename);
+  Py_END_ALLOW_THREADS
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject * count_kmers_partitioned(PyObject * self, PyObject * args)
+{
+  unsigned int k = 0;
+  PyObject * infilenames_o = NULL;
+  char * outfilename = NULL;
+  unsigned int n_ranges = 0;
+  char * tmp_prefix = NULL;
+  unsigned int n_threads = 1;
+
+  if (!PyArg_ParseTuple(args, "IOsIs|I", &k, &infilenames_o, &outfilename,
+			&n_ranges, &tmp_prefix, &n_threads)) {
+    return NULL;
+  }
+
+  if (k < 1 || k > 32) {
+    PyErr_SetString(PyExc_ValueError, "k-mer size must be from 1 to 32");
+    return NULL;
+  }
+  if (n_ranges < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one range");
+    return NULL;
+  }
+  if (n_threads < 1) {
+    PyErr_SetString(PyExc_ValueError, "need at least one thread");
+    return NULL;
+  }
+
+  PyObject * seq = PySequence_Fast(infilenames_o, "input files must be a list");
+  if (seq == NULL) {
+    return NULL;
+  }
+
+  std::vector<std::string> infilenames;
+  for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+    PyObject * name_o = PySequence_Fast_GET_ITEM(seq, i);
+    if (!PyString_Check(name_o)) {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_TypeError, "input file names must be strings");
+      return NULL;
+    }
+    infilenames.push_back(PyString_AsString(name_o));
+  }
+  Py_DECREF(seq);
+
+  khmer::PartitionedCountingEngine engine(k, n_ranges, tmp_prefix, n_threads);
+  bool invalid_file_format = false;
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    engine.count(infilenames, outfilename);
+  } catch (khmer:: read_parsers:: InvalidReadFileFormat &exc) {
+    invalid_file_format = true;
+  }
+  Py_END_ALLOW_THREADS
+
+  if (invalid_file_format) {
+    PyErr_SetString(PyExc_ValueError, "invalid FASTA or FASTQ file");
+    return NULL;
+  }
+
+  return Py_BuildValue("KKK", engine.get_n_reads(), engine.get_n_kmers(),
+		       engine.get_n_unique_kmers());
+}
+
 static PyMethodDef KhmerMethods[] = {
   /* { "new_config", new_config, METH_VARARGS, "Create a default internals config" }, */
   { "get_config", get_config, METH_VARARGS, "Get active khmer configuration object" },
@@ -3931,12 +5510,19 @@ static PyMethodDef KhmerMethods[] = {
   { "new_ktable", new_ktable, METH_VARARGS, "Create an empty ktable" },
   { "new_hashtable", new_hashtable, METH_VARARGS, "Create an empty single-table counting hash" },
   { "_new_counting_hash", _new_counting_hash, METH_VARARGS, "Create an empty counting hash" },
+  { "new_exact_counting_hash", new_exact_counting_hash, METH_VARARGS, "Create an empty exact counting hash" },
   { "_new_hashbits", _new_hashbits, METH_VARARGS, "Create an empty hashbits table" },
   { "new_minmax", new_minmax, METH_VARARGS, "Create a new min/max value table" },
+  { "new_hllcounter", new_hllcounter, METH_VARARGS, "Create a new HyperLogLog k-mer counter" },
+  { "get_table_sizes_for_fp_rate", get_table_sizes_for_fp_rate, METH_VARARGS, "Table sizes for N k-mers at a false positive rate" },
+  { "get_table_sizes_for_memory", get_table_sizes_for_memory, METH_VARARGS, "Table sizes for N k-mers in at most M entries" },
   { "forward_hash", forward_hash, METH_VARARGS, "", },
   { "forward_hash_no_rc", forward_hash_no_rc, METH_VARARGS, "", },
   { "reverse_hash", reverse_hash, METH_VARARGS, "", },
   { "set_reporting_callback", set_reporting_callback, METH_VARARGS, "" },
+  { "merge_counting_hash_files", merge_counting_hash_files, METH_VARARGS, "Sum saved counting hashes into one" },
+  { "_count_kmers_partitioned", count_kmers_partitioned, METH_VARARGS, "Count k-mers exactly, one hash range at a time, into a sorted file" },
+  { "open_kmer_count_database", open_kmer_count_database, METH_VARARGS, "Look up k-mer counts in a sorted file without loading it" },
   { NULL, NULL, 0, NULL }
 };
 
@@ -3947,6 +5533,10 @@ DL_EXPORT(void) init_khmer(void)
   khmer_ReadParserType.ob_type	  = &PyType_Type;
   khmer_KTableType.ob_type	  = &PyType_Type;
   khmer_KCountingHashType.ob_type = &PyType_Type;
+  khmer_KExactCountingHashType.ob_type = &PyType_Type;
+  khmer_HLLCounterType.ob_type	  = &PyType_Type;
+  khmer_KmerCountDatabaseType.ob_type = &PyType_Type;
+  khmer_KmerSetType.ob_type = &PyType_Type;
 
   PyObject * m;
   m = Py_InitModule("_khmer", KhmerMethods);
@@ -3955,6 +5545,11 @@ DL_EXPORT(void) init_khmer(void)
   Py_INCREF(KhmerError);
 
   PyModule_AddObject(m, "error", KhmerError);
+
+  PyModule_AddIntConstant(m, "TABLE_PAGES_NORMAL", TABLE_PAGES_NORMAL);
+  PyModule_AddIntConstant(m, "TABLE_PAGES_TRANSPARENT",
+			  TABLE_PAGES_TRANSPARENT);
+  PyModule_AddIntConstant(m, "TABLE_PAGES_EXPLICIT", TABLE_PAGES_EXPLICIT);
 }
 
 // vim: set sts=2 sw=2:
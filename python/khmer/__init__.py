@@ -1,7 +1,10 @@
 __version__ = "0.4"
 
+import threading
 import _khmer
 from _khmer import get_config
+from _khmer import TABLE_PAGES_NORMAL, TABLE_PAGES_TRANSPARENT, \
+    TABLE_PAGES_EXPLICIT
 try:  # CPython API
     # from _khmer import Read
     from _khmer import new_read_parser as ReadParser
@@ -18,36 +21,157 @@ from _khmer import _new_hashbits
 from _khmer import new_minmax
 from _khmer import forward_hash, forward_hash_no_rc, reverse_hash
 from _khmer import set_reporting_callback
+from _khmer import merge_counting_hash_files
+from _khmer import _count_kmers_partitioned, open_kmer_count_database
+from _khmer import new_hllcounter
+from _khmer import new_exact_counting_hash
+from _khmer import get_table_sizes_for_fp_rate, get_table_sizes_for_memory
+
+DEFAULT_FP_RATE = 0.05
 
 ###
 
 
-def new_hashbits(k, starting_size, n_tables=2):
-    primes = get_n_primes_above_x(n_tables, starting_size)
+def new_hashbits(k, starting_size=None, n_tables=2, n_kmers=None,
+                 fp_rate=DEFAULT_FP_RATE, max_memory=None, blocked=False):
+    """
+    Make a Hashbits with n_tables tables of at least starting_size, or,
+    given the number of distinct k-mers it will hold, sized as in
+    get_table_sizes.  With blocked, all of a k-mer's bits are in one
+    cache line, in the same memory; lookups are faster, and the false
+    positive rate is a little higher.
+    """
+    primes = _get_primes(starting_size, n_tables, n_kmers, fp_rate,
+                         max_memory, 1 / 8.)
+
+    return _new_hashbits(k, primes, blocked)
+
+
+def new_counting_hash(k, starting_size=None, n_tables=2, n_threads=1,
+                      blocked=False, counter_bits=8, conservative=False,
+                      n_kmers=None, fp_rate=DEFAULT_FP_RATE, max_memory=None,
+                      overflow_size=0):
+    """
+    Make a CountingHash with n_tables tables of at least starting_size,
+    or, given the number of distinct k-mers it will hold, sized as in
+    get_table_sizes.  With overflow_size, counts go on past a full
+    counter, up to 65535, in that many shared 16-bit counters.
+    """
+    primes = _get_primes(starting_size, n_tables, n_kmers, fp_rate,
+                         max_memory, counter_bits / 8.)
+
+    ht = _new_counting_hash(k, primes, n_threads, blocked, counter_bits,
+                            conservative)
+    if overflow_size:
+        ht.set_overflow_size(overflow_size)
+
+    return ht
+
+
+def _get_primes(starting_size, n_tables, n_kmers, fp_rate, max_memory,
+                bytes_per_entry):
+    if n_kmers is not None:
+        return get_table_sizes(n_kmers, fp_rate, max_memory, bytes_per_entry)
+    if starting_size is None:
+        raise ValueError("need a table size, or a number of k-mers")
+
+    return get_n_primes_above_x(n_tables, starting_size)
+
 
-    return _new_hashbits(k, primes)
+def get_table_sizes(n_kmers, fp_rate=DEFAULT_FP_RATE, max_memory=None,
+                    bytes_per_entry=1):
+    """
+    Table sizes (distinct primes) for n_kmers distinct k-mers: the least
+    memory with a false positive rate of at most fp_rate or, given
+    max_memory in bytes, the lowest false positive rate in that much.
+    """
+    if max_memory is not None:
+        return get_table_sizes_for_memory(
+            n_kmers, int(max_memory / bytes_per_entry))
+
+    return get_table_sizes_for_fp_rate(n_kmers, fp_rate)
 
 
-def new_counting_hash(k, starting_size, n_tables=2, n_threads=1):
-    primes = get_n_primes_above_x(n_tables, starting_size)
+def estimate_kmer_cardinality(k, filenames, n_threads=1, error_rate=0.01):
+    """
+    Estimate the number of distinct k-mers in the reads in filenames,
+    with a HyperLogLog counter, n_threads threads sharing a read parser.
+    """
+    hll = new_hllcounter(k, error_rate)
 
-    return _new_counting_hash(k, primes, n_threads)
+    for filename in filenames:
+        rparser = ReadParser(filename, n_threads)
+        threads = []
+        for tnum in xrange(n_threads):
+            t = threading.Thread(
+                target=hll.consume_fasta_with_reads_parser, args=(rparser,))
+            threads.append(t)
+            t.start()
 
+        for t in threads:
+            t.join()
 
-def load_hashbits(filename):
+    return hll.estimate_cardinality()
+
+
+def count_kmers_partitioned(k, filenames, outfilename, n_ranges=16,
+                            tmp_prefix=None, n_threads=1):
+    """
+    Count the k-mers in the reads in filenames exactly, into a sorted
+    file of k-mers and counts at outfilename, holding only one of
+    n_ranges hash ranges' distinct k-mers in memory at a time.  The
+    reads are spilled to files named tmp_prefix (by default, outfilename)
+    ".rangeN" on the way.
+
+    Returns the number of reads, k-mers, and distinct k-mers.  Look up
+    counts with open_kmer_count_database(outfilename), or load the whole
+    thing with load_exact_counting_hash(outfilename).
+    """
+    if tmp_prefix is None:
+        tmp_prefix = outfilename
+
+    return _count_kmers_partitioned(k, filenames, outfilename, n_ranges,
+                                    tmp_prefix, n_threads)
+
+
+def load_hashbits(filename, use_mmap=False):
     ht = _new_hashbits(1, [1])
-    ht.load(filename)
+    ht.load(filename, use_mmap)
 
     return ht
 
 
-def load_counting_hash(filename):
+def load_counting_hash(filename, use_mmap=False):
     ht = _new_counting_hash(1, [1])
+    ht.load(filename, use_mmap)
+
+    return ht
+
+
+def load_exact_counting_hash(filename):
+    ht = new_exact_counting_hash(1)
     ht.load(filename)
 
     return ht
 
 
+def abundance_distribution(ht, filename, tracking=None, n_threads=1):
+    """
+    Count the distinct k-mers in filename at each abundance in ht, with
+    n_threads threads sharing one read parser.
+
+    With a tracking Hashbits, each k-mer is counted the first time it is
+    seen.  Without one, every occurrence is counted and the count at
+    abundance n is divided by n; that takes no extra memory, but is
+    approximate, since collisions inflate the counts in ht and, without
+    bigcount, they saturate at 255.
+    """
+    rparser = ReadParser(filename, n_threads)
+
+    return ht.abundance_distribution_with_reads_parser(rparser, tracking,
+                                                       n_threads)
+
+
 def _default_reporting_callback(info, n_reads, other):
     print '...', info, n_reads, other
 
@@ -58,19 +182,21 @@ def reset_reporting_callback():
 reset_reporting_callback()
 
 
-def calc_expected_collisions(ht):
+def calc_expected_collisions(ht, n_threads=1):
     """
-    A quick & dirty expected collision rate calculation
+    The expected false positive rate of ht: the chance that a k-mer never
+    added is found in every table, from the occupied bins of each.  The
+    tables are counted on n_threads threads.
     """
-    sizes = ht.hashsizes()
-    n_ht = float(len(sizes))
-    occupancy = float(ht.n_occupied())
-    min_size = min(sizes)
+    return ht.occupancy(n_threads)['fp_rate']
 
-    fp_one = occupancy / min_size
-    fp_all = fp_one ** n_ht
 
-    return fp_all
+def estimate_table_cardinality(ht, n_threads=1):
+    """
+    Estimate the number of distinct k-mers added to ht from how many bins
+    of its tables are occupied; infinite if a table is full.
+    """
+    return ht.occupancy(n_threads)['n_kmers']
 
 ###
 
@@ -1,6 +1,8 @@
 import os
 import argparse
 
+from khmer import DEFAULT_FP_RATE
+
 DEFAULT_K = 32
 DEFAULT_N_HT = 4
 DEFAULT_MIN_HASHSIZE = 1e6
@@ -26,5 +28,18 @@ def build_construct_args():
     parser.add_argument('--hashsize', '-x', type=float, dest='min_hashsize',
                         default=env_hashsize,
                         help='lower bound on hashsize to use')
+    parser.add_argument('--auto-size', dest='auto_size', default=False,
+                        action='store_true',
+                        help='estimate the number of distinct k-mers in the '
+                        'input first, and size the tables for it '
+                        '(instead of -N and -x)')
+    parser.add_argument('--max-fp-rate', type=float, dest='max_fp_rate',
+                        default=DEFAULT_FP_RATE,
+                        help='false positive rate to size the tables for, '
+                        'with --auto-size')
+    parser.add_argument('--max-memory', '-M', type=float, dest='max_memory',
+                        default=None,
+                        help='with --auto-size, use at most this many bytes '
+                        'for the tables instead')
 
     return parser
@@ -12,9 +12,8 @@ ht = khmer.new_counting_hash(32, HASHTABLE_SIZE, N_HASHTABLES)
 filename = sys.argv[1]
 
 ht.consume_fasta(filename)
-total, count, mean = ht.get_kmer_abund_mean(filename)
-abs_dev = ht.get_kmer_abund_abs_deviation(filename, mean)
+stats = ht.abundance_stats(filename)
 
-print total, count, mean, abs_dev
+print stats['total'], stats['n_kmers'], stats['mean'], stats['abs_deviation']
 
 # vim: set ft=python ts=4 sts=4 sw=4 et tw=79:
@@ -20,6 +20,9 @@ def main():
                         default=DEFAULT_LOWER_CUTOFF)
     parser.add_argument('-u', '--upper-cutoff', type=int, dest='upper_cutoff',
                         default=DEFAULT_UPPER_CUTOFF)
+    parser.add_argument('--threads', '-T', dest='n_threads', type=int,
+                        default=1,
+                        help='Number of simultaneous threads to execute')
 
     parser.add_argument('output_filename')
     parser.add_argument('input_filename')
@@ -62,12 +65,13 @@ def main():
     ht.set_use_bigcount(True)
 
     print 'consuming input', input
-    hb = ht.collect_high_abundance_kmers(input,
-                                         args.lower_cutoff,
-                                         args.upper_cutoff)
+    kmers = ht.collect_high_abundance_kmers(input,
+                                            args.lower_cutoff,
+                                            args.upper_cutoff,
+                                            args.n_threads)
 
     print 'saving stoptags', output
-    hb.save_stop_tags(output)
+    kmers.save_stop_tags(output)
 
 if __name__ == '__main__':
     main()
@@ -2,7 +2,7 @@
 """
 Produce the k-mer abundance distribution for the given file.
 
-% python scripts/abundance-dist.py [ -z -s ] <htname> <data> <histout>
+% python scripts/abundance-dist.py [ -z -s -T <n> --no-tracking ] <htname> <data> <histout>
 
 Use '-h' for parameter help.
 """
@@ -10,6 +10,11 @@ import sys
 import khmer
 import argparse
 import os
+from khmer.threading_args import add_threading_args
+
+# the k-mers in <data> the tracking table wrongly reports as already seen
+# are left out of the histogram.
+TRACKING_FP_RATE = 0.001
 
 
 def main():
@@ -26,6 +31,12 @@ def main():
     parser.add_argument('-s', '--squash', dest='squash_output', default=False,
                         action='store_true',
                         help='Overwrite output file if it exists')
+    parser.add_argument('--no-tracking', dest='tracking', default=True,
+                        action='store_false',
+                        help='Do not allocate a table to track the k-mers '
+                        'already seen; faster and smaller, but only right '
+                        'if <htname> was built from exactly <data>')
+    add_threading_args(parser)
 
     args = parser.parse_args()
     hashfile = args.hashname
@@ -37,10 +48,20 @@ def main():
 
     K = ht.ksize()
     sizes = ht.hashsizes()
-    tracking = khmer._new_hashbits(K, sizes)
+    n_threads = int(args.n_threads)
 
     print 'K:', K
     print 'HT sizes:', sizes
+
+    # the tracking table only has to hold the distinct k-mers in <data>,
+    # which may be far fewer than the counting table was sized for.
+    tracking = None
+    if args.tracking:
+        n_kmers = khmer.estimate_kmer_cardinality(K, [datafile], n_threads)
+        tracking = khmer.new_hashbits(K, n_kmers=n_kmers,
+                                      fp_rate=TRACKING_FP_RATE)
+        print 'tracking %d distinct k-mers in sizes %s' % \
+            (n_kmers, tracking.hashsizes())
     print 'outputting to', histout
 
     if os.path.exists(histout):
@@ -51,7 +72,7 @@ def main():
         print '** squashing existing file %s' % histout
 
     print 'preparing hist...'
-    z = ht.abundance_distribution(datafile, tracking)
+    z = khmer.abundance_distribution(ht, datafile, tracking, n_threads)
     total = sum(z)
 
     if 0 == total:
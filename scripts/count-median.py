@@ -36,7 +36,7 @@ def main():
     output_filename = args.output
 
     print 'loading counting hash from', htfile
-    ht = khmer.load_counting_hash(htfile)
+    ht = khmer.load_counting_hash(htfile, use_mmap=True)
     K = ht.ksize()
 
     print 'writing to', output_filename
@@ -126,9 +126,9 @@ def main():
 
     for n, filename in enumerate(filenames):
         print 'consuming input', filename
-        ht.consume_fasta_and_tag(filename)
+        ht.consume_fasta_and_tag(filename, None, int(args.n_threads))
 
-    fp_rate = khmer.calc_expected_collisions(ht)
+    fp_rate = khmer.calc_expected_collisions(ht, int(args.n_threads))
     print 'fp rate estimated to be %1.3f' % fp_rate
     if fp_rate > 0.15:          # 0.18 is ACTUAL MAX. Do not change.
         print >>sys.stderr, "**"
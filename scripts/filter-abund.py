@@ -8,12 +8,11 @@ hash table.  Output sequences will be placed in 'infile.abundfilt'.
 Use '-h' for parameter help.
 """
 import sys
-import screed.fasta
 import os
 import khmer
-from khmer.thread_utils import ThreadedSequenceProcessor, verbose_loader
 
 from khmer.counting_args import build_counting_multifile_args
+from khmer.threading_args import add_threading_args
 
 ###
 
@@ -25,6 +24,10 @@ def main():
     parser.add_argument('--cutoff', '-C', dest='cutoff',
                         default=DEFAULT_CUTOFF, type=int,
                         help="Trim at k-mers below this abundance.")
+    parser.add_argument('--unordered', dest='unordered', default=False,
+                        action='store_true',
+                        help="Don't keep the reads in input order.")
+    add_threading_args(parser)
     args = parser.parse_args()
 
     counting_ht = args.input_table
@@ -33,33 +36,33 @@ def main():
     print 'file with ht: %s' % counting_ht
 
     print 'loading hashtable'
-    ht = khmer.load_counting_hash(counting_ht)
+    ht = khmer.load_counting_hash(counting_ht, use_mmap=True)
     K = ht.ksize()
 
     print "K:", K
 
-    ### the filtering function.
-    def process_fn(record):
-        name = record['name']
-        seq = record['sequence']
-        if 'N' in seq:
-            return None, None
-
-        trim_seq, trim_at = ht.trim_on_abundance(seq, args.cutoff)
-
-        if trim_at >= K:
-            return name, trim_seq
-
-        return None, None
+    n_threads = int(args.n_threads)
 
     ### the filtering loop
     for infile in infiles:
         print 'filtering', infile
         outfile = os.path.basename(infile) + '.abundfilt'
-        outfp = open(outfile, 'w')
 
-        tsp = ThreadedSequenceProcessor(process_fn)
-        tsp.start(verbose_loader(infile), outfp)
+        try:
+            n_reads, n_kept, n_bp_read, n_bp_kept = \
+                ht.filter_abund(infile, outfile, args.cutoff, n_threads,
+                                not args.unordered)
+        except ValueError, e:
+            print >>sys.stderr, 'Error: %s in %s' % (e, infile)
+            sys.exit(-1)
+
+        print 'processed %d / wrote %d / removed %d' % \
+            (n_reads, n_kept, n_reads - n_kept)
+        print 'processed %d bp / wrote %d bp / removed %d bp' % \
+            (n_bp_read, n_bp_kept, n_bp_read - n_bp_kept)
+        if n_bp_read:
+            print 'discarded %.1f%%' % \
+                ((n_bp_read - n_bp_kept) / float(n_bp_read) * 100)
 
         print 'output in', outfile
 
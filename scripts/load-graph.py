@@ -18,6 +18,7 @@ import sys
 import screed
 import khmer
 from khmer.hashbits_args import build_construct_args, DEFAULT_MIN_HASHSIZE
+from khmer.threading_args import add_threading_args
 
 
 def main():
@@ -25,13 +26,14 @@ def main():
     parser.add_argument('--no-build-tagset', '-n', default=False,
                         action='store_true', dest='no_build_tagset',
                         help='Do NOT construct tagset while loading sequences')
+    add_threading_args(parser)
     parser.add_argument('output_filename')
     parser.add_argument('input_filenames', nargs='+')
 
     args = parser.parse_args()
 
     if not args.quiet:
-        if args.min_hashsize == DEFAULT_MIN_HASHSIZE:
+        if args.min_hashsize == DEFAULT_MIN_HASHSIZE and not args.auto_size:
             print >>sys.stderr, \
                 "** WARNING: hashsize is default!  " \
                 "You absodefly want to increase this!\n** " \
@@ -65,15 +67,27 @@ def main():
 
     ###
 
+    n_kmers = None
+    if args.auto_size:
+        print 'estimating the number of distinct k-mers'
+        n_kmers = khmer.estimate_kmer_cardinality(K, filenames,
+                                                   int(args.n_threads))
+        print '... about %d' % n_kmers
+
     print 'making hashtable'
-    ht = khmer.new_hashbits(K, HT_SIZE, N_HT)
+    ht = khmer.new_hashbits(K, HT_SIZE, N_HT, n_kmers=n_kmers,
+                            fp_rate=args.max_fp_rate,
+                            max_memory=args.max_memory)
+    if args.auto_size:
+        print '... %d tables, %d bytes' % (len(ht.hashsizes()),
+                                            sum(ht.hashsizes()) / 8)
 
     for n, filename in enumerate(filenames):
         print 'consuming input', filename
         if args.no_build_tagset:
             ht.consume_fasta(filename)
         else:
-            ht.consume_fasta_and_tag(filename)
+            ht.consume_fasta_and_tag(filename, None, int(args.n_threads))
 
     print 'saving hashtable in', base + '.ht'
     ht.save(base + '.ht')
@@ -85,7 +99,7 @@ def main():
     info_fp = open(base + '.info', 'w')
     info_fp.write('%d unique k-mers' % ht.n_unique_kmers())
 
-    fp_rate = khmer.calc_expected_collisions(ht)
+    fp_rate = khmer.calc_expected_collisions(ht, int(args.n_threads))
     print 'fp rate estimated to be %1.3f' % fp_rate
     if fp_rate > 0.15:          # 0.18 is ACTUAL MAX. Do not change.
         print >>sys.stderr, "**"
@@ -6,7 +6,8 @@ Build a counting Bloom filter from the given sequences, save in <htname>.
 
 Use '-h' for parameter help.
 
-@CTB enable/disable bigcount via command-line parameters.
+Counts past 255 are kept in the bigcount store, or, with --overflow-size,
+in that many shared 16-bit overflow counters, which take fixed memory.
 """
 
 import sys
@@ -22,13 +23,17 @@ from khmer.threading_args import add_threading_args
 def main():
     parser = build_construct_args()
     add_threading_args(parser)
+    parser.add_argument('--overflow-size', type=float, dest='overflow_size',
+                        default=0,
+                        help='count past 255 in this many 16-bit overflow '
+                        'counters, instead of in the bigcount store')
     parser.add_argument('output_filename')
     parser.add_argument('input_filenames', nargs='+')
 
     args = parser.parse_args()
 
     if not args.quiet:
-        if args.min_hashsize == DEFAULT_MIN_HASHSIZE:
+        if args.min_hashsize == DEFAULT_MIN_HASHSIZE and not args.auto_size:
             print >>sys.stderr, \
                 "** WARNING: hashsize is default!  " \
                 "You absodefly want to increase this!\n** " \
@@ -39,6 +44,10 @@ def main():
         print >>sys.stderr, ' - n hashes =     %d \t\t(-N)' % args.n_hashes
         print >>sys.stderr, \
             ' - min hashsize = %-5.2g \t(-x)' % args.min_hashsize
+        if args.overflow_size:
+            print >>sys.stderr, \
+                ' - overflow size = %-5.2g \t(--overflow-size)' \
+                % args.overflow_size
         print >>sys.stderr, ''
         print >>sys.stderr, \
             'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize)' \
@@ -58,9 +67,22 @@ def main():
 
     ###
 
+    n_kmers = None
+    if args.auto_size:
+        print 'estimating the number of distinct k-mers'
+        n_kmers = khmer.estimate_kmer_cardinality(K, filenames, n_threads)
+        print '... about %d' % n_kmers
+
     print 'making hashtable'
-    ht = khmer.new_counting_hash(K, HT_SIZE, N_HT, n_threads)
-    ht.set_use_bigcount(True)
+    ht = khmer.new_counting_hash(K, HT_SIZE, N_HT, n_threads,
+                                 n_kmers=n_kmers, fp_rate=args.max_fp_rate,
+                                 max_memory=args.max_memory,
+                                 overflow_size=int(args.overflow_size))
+    if args.auto_size:
+        print '... %d tables, %d bytes' % (len(ht.hashsizes()),
+                                            sum(ht.hashsizes()))
+    if not args.overflow_size:
+        ht.set_use_bigcount(True)
 
     for n, filename in enumerate(filenames):
 
@@ -92,7 +114,7 @@ def main():
     info_fp.write('through end: %s\n' % filename)
 
     # Change 0.2 only if you really grok it.  HINT: You don't.
-    fp_rate = khmer.calc_expected_collisions(ht)
+    fp_rate = khmer.calc_expected_collisions(ht, n_threads)
     print 'fp rate estimated to be %1.3f' % fp_rate
     print >>info_fp, 'fp rate estimated to be %1.3f' % fp_rate
 
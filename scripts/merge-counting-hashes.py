@@ -0,0 +1,41 @@
+#! /usr/bin/env python
+"""
+Sum counting hashes built from separate pieces of the input into one.
+
+% python scripts/merge-counting-hashes.py <output.kh> <in1.kh> <in2.kh> [ ... ]
+
+The inputs must have been built with the same k-mer size, number of
+tables, and table size.  Use '-h' for parameter help.
+"""
+
+import sys
+import os
+import argparse
+import khmer
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Sum counting hashes built with the same parameters.")
+
+    parser.add_argument('output_filename')
+    parser.add_argument('input_filenames', nargs='+')
+
+    args = parser.parse_args()
+
+    for filename in args.input_filenames:
+        if not os.path.exists(filename):
+            print >>sys.stderr, "** ERROR: cannot find %s" % filename
+            sys.exit(-1)
+
+    print 'merging %s' % repr(args.input_filenames)
+    khmer.merge_counting_hash_files(args.output_filename,
+                                    args.input_filenames)
+    print 'saved', args.output_filename
+
+    print 'DONE.'
+
+if __name__ == '__main__':
+    main()
+
+# vim: set ft=python ts=4 sts=4 sw=4 et tw=79:
@@ -9,31 +9,14 @@ Use '-h' for parameter help.
 """
 
 import sys
-import screed
 import os
 import khmer
-from itertools import izip
 from khmer.counting_args import build_construct_args, DEFAULT_MIN_HASHSIZE
+from khmer.threading_args import add_threading_args
 import argparse
 
 DEFAULT_DESIRED_COVERAGE = 5
 
-# Iterate a collection in arbitrary batches
-# from: http://stackoverflow.com/questions/4628290/pairs-from-single-list
-
-
-def batchwise(t, size):
-    it = iter(t)
-    return izip(*[it] * size)
-
-# Returns true if the pair of records are properly pairs
-
-
-def validpair(r0, r1):
-    return r0.name[-1] == "1" and \
-        r1.name[-1] == "2" and \
-        r0.name[0:-1] == r1.name[0:-1]
-
 
 def main():
     parser = build_construct_args()
@@ -45,6 +28,7 @@ def main():
                         default='')
     parser.add_argument('-R', '--report-to-file', dest='report_file',
                         type=argparse.FileType('w'))
+    add_threading_args(parser)
     parser.add_argument('input_filenames', nargs='+')
 
     args = parser.parse_args()
@@ -62,6 +46,7 @@ def main():
         print >>sys.stderr, \
             ' - min hashsize = %-5.2g \t(-x)' % args.min_hashsize
         print >>sys.stderr, ' - paired =	      %s \t\t(-p)' % args.paired
+        print >>sys.stderr, ' - n threads =    %s \t\t(-T)' % args.n_threads
         print >>sys.stderr, ''
         print >>sys.stderr, \
             'Estimated memory usage is %.2g bytes (n_hashes x min_hashsize)' \
@@ -75,78 +60,50 @@ def main():
     report_fp = args.report_file
     filenames = args.input_filenames
 
-    # In paired mode we read two records at a time
-    batch_size = 1
-    if args.paired:
-        batch_size = 2
+    n_threads = int(args.n_threads)
 
     if args.loadhash:
         print 'loading hashtable from', args.loadhash
         ht = khmer.load_counting_hash(args.loadhash)
     else:
         print 'making hashtable'
-        ht = khmer.new_counting_hash(K, HT_SIZE, N_HT)
+        ht = khmer.new_counting_hash(K, HT_SIZE, N_HT, n_threads)
 
     total = 0
     discarded = 0
 
+    def report(info, n_reads, n_kept):
+        so_far = total + n_reads
+        discarded_so_far = discarded + n_reads - n_kept
+        print '... kept', so_far - discarded_so_far, 'of', so_far, \
+            ', or', int(100. - discarded_so_far / float(so_far) * 100.), \
+            '%'
+        print '... in file', input_filename
+
+        if report_fp:
+            print>>report_fp, so_far, so_far - discarded_so_far, \
+                1. - (discarded_so_far / float(so_far))
+            report_fp.flush()
+
     for input_filename in filenames:
         output_name = os.path.basename(input_filename) + '.keep'
-        outfp = open(output_name, 'w')
-
-        n = -1
-        for n, batch in enumerate(batchwise(screed.open(
-                input_filename), batch_size)):
-            if n > 0 and n % 100000 == 0:
-                print '... kept', total - discarded, 'of', total, ', or', \
-                    int(100. - discarded / float(total) * 100.), '%'
-                print '... in file', input_filename
-
-                if report_fp:
-                    print>>report_fp, total, total - discarded, \
-                        1. - (discarded / float(total))
-                    report_fp.flush()
-
-            total += batch_size
-
-            # If in paired mode, check that the reads are properly interleaved
-            if args.paired:
-                if not validpair(batch[0], batch[1]):
-                    print >>sys.stderr, \
-                        'Error: Improperly interleaved pairs %s %s' \
-                        % (batch[0].name, batch[1].name)
-                    sys.exit(-1)
-
-            # Emit the batch of reads if any read passes the filter
-            # and all reads are longer than K
-            passed_filter = False
-            passed_length = True
-            for record in batch:
-                if len(record.sequence) < K:
-                    passed_length = False
-                    continue
-
-                seq = record.sequence.replace('N', 'A')
-                med, _, _ = ht.get_median_count(seq)
-
-                if med < DESIRED_COVERAGE:
-                    ht.consume(seq)
-                    passed_filter = True
-
-            # Emit records if any passed
-            if passed_length and passed_filter:
-                for record in batch:
-                    if hasattr(record, 'accuracy'):
-                        outfp.write('@%s\n%s\n+\n%s\n' % (record.name,
-                                                          record.sequence,
-                                                          record.accuracy))
-                    else:
-                        outfp.write(
-                            '>%s\n%s\n' % (record.name, record.sequence))
-            else:
-                discarded += batch_size
-
-        if -1 < n:
+
+        try:
+            n_reads, n_kept, n_unpaired = \
+                ht.normalize_by_median(input_filename, output_name,
+                                       DESIRED_COVERAGE, args.paired,
+                                       n_threads, report)
+        except ValueError, e:
+            print >>sys.stderr, 'Error: %s in %s' % (e, input_filename)
+            sys.exit(-1)
+
+        total += n_reads
+        discarded += n_reads - n_kept
+
+        if n_unpaired:
+            print '... skipped', n_unpaired, 'reads without mates'
+
+        if n_reads:
             print \
                 'DONE with', input_filename, '; kept', total - discarded, \
                 'of', total, 'or', \
@@ -161,7 +118,7 @@ def main():
         ht.save(args.savehash)
 
     # Change 0.2 only if you really grok it.  HINT: You don't.
-    fp_rate = khmer.calc_expected_collisions(ht)
+    fp_rate = khmer.calc_expected_collisions(ht, n_threads)
     print 'fp rate estimated to be %1.3f' % fp_rate
 
     if fp_rate > 0.20:
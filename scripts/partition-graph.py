@@ -89,9 +89,11 @@ def main():
         print 'stoptag file:', args.stoptags
     print '--'
 
+    # map the graph rather than reading it in, so that the partitioning
+    # processes on a machine share one copy of it.
     print 'loading ht %s.ht' % basename
-    ht = khmer.load_hashbits(basename + '.ht')
-    ht.load_tagset(basename + '.tagset')
+    ht = khmer.load_hashbits(basename + '.ht', use_mmap=True)
+    ht.load_tagset(basename + '.tagset', clear_tags=True, use_mmap=True)
 
     # retrieve K
     K = ht.ksize()
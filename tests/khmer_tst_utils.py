@@ -1,5 +1,8 @@
 import tempfile, os, shutil
 
+import khmer
+import screed
+
 thisdir = os.path.dirname(__file__)
 thisdir = os.path.abspath(thisdir)
 
@@ -23,3 +26,21 @@ def cleanup():
     for path in cleanup_list:
         shutil.rmtree(path, ignore_errors=True)
     cleanup_list = []
+
+def kmer_counts(filenames, K, skip_n=False):
+    """
+    Count the k-mers in filenames in Python, keyed by canonical hash, as
+    the tables see them.  With skip_n, reads containing Ns are left out,
+    as the read parsers leave them out.
+    """
+    counts = {}
+    for filename in filenames:
+        for record in screed.open(filename):
+            seq = record.sequence.upper()
+            if skip_n and 'N' in seq:
+                continue
+            for i in range(len(seq) - K + 1):
+                kmer = khmer.forward_hash(seq[i:i + K], K)
+                counts[kmer] = counts.get(kmer, 0) + 1
+
+    return counts
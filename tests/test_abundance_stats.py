@@ -0,0 +1,117 @@
+import math
+
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def _counts_in_python(ht, filename):
+    # the count of each k-mer of each read that isn't skipped, in order.
+    K = ht.ksize()
+    counts = []
+    for record in screed.open(filename):
+        seq = record.sequence.upper()
+        if len(seq) < K or 'N' in seq:
+            continue
+        counts.append([ ht.get(seq[i:i + K])
+                        for i in range(len(seq) - K + 1) ])
+
+    return counts
+
+def _load(filename, K=17):
+    ht = khmer.new_counting_hash(K, 1e7, 4)
+    ht.consume_fasta(filename)
+    return ht
+
+def test_abundance_stats():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    ht = _load(inpath)
+
+    by_read = _counts_in_python(ht, inpath)
+    counts = sorted(sum(by_read, []))
+    n = len(counts)
+    mean = sum(counts) / float(n)
+    median = counts[int(math.ceil(0.5 * n)) - 1]
+
+    stats = ht.abundance_stats(inpath, 0, 0, 1, (0.25, 0.5, 1.0))
+    assert stats['n_reads'] == len(list(screed.open(inpath)))
+    assert stats['n_kmers'] == n
+    assert stats['total'] == sum(counts)
+    assert round(stats['mean'], 6) == round(mean, 6)
+    assert round(stats['variance'], 6) == \
+        round(sum([ (c - mean) ** 2 for c in counts ]) / n, 6)
+    assert round(stats['abs_deviation'], 6) == \
+        round(sum([ abs(c - mean) for c in counts ]) / n, 6)
+    assert stats['median'] == median
+    assert stats['median_abs_deviation'] == \
+        sorted([ abs(c - median) for c in counts ])[int(math.ceil(0.5 * n)) - 1]
+    assert stats['quantiles'] == \
+        [ counts[int(math.ceil(0.25 * n)) - 1], median, counts[-1] ]
+
+    assert sum(stats['histogram']) == n
+    for count, n_kmers in enumerate(stats['histogram']):
+        assert n_kmers == counts.count(count)
+
+def test_same_as_single_statistics():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    ht = _load(inpath)
+
+    total, count, mean = ht.get_kmer_abund_mean(inpath)
+    abs_dev = ht.get_kmer_abund_abs_deviation(inpath, mean)
+
+    stats = ht.abundance_stats(inpath)
+    assert (stats['total'], stats['n_kmers']) == (total, count)
+    assert round(stats['mean'], 4) == round(mean, 4)
+    assert round(stats['abs_deviation'], 4) == round(abs_dev, 4)
+
+def test_by_position():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    ht = _load(inpath)
+
+    for limit_by in (0, 1, 2):
+        stats = ht.abundance_stats(inpath, 50, limit_by)
+        assert stats['by_position'] == \
+            ht.fasta_count_kmers_by_position(inpath, 50, limit_by)
+
+def test_abundance_stats_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+    ht = _load(inpath, 20)
+
+    single = ht.abundance_stats(inpath, 100, 0, 1, (0.1, 0.9))
+    for n_threads in (2, 4):
+        assert ht.abundance_stats(inpath, 100, 0, n_threads, (0.1, 0.9)) == \
+            single
+
+def test_abundance_stats_exact():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    exact = khmer.new_exact_counting_hash(17)
+    exact.consume_fasta(inpath)
+
+    counting = khmer.new_counting_hash(17, 1e7, 4)
+    counting.set_use_bigcount(True)
+    counting.consume_fasta(inpath)
+
+    assert exact.abundance_stats(inpath, 50) == \
+        counting.abundance_stats(inpath, 50)
+
+def test_abundance_stats_empty():
+    inpath = utils.get_test_data('test-empty.fa')
+    stats = khmer.new_counting_hash(17, 1e4, 4).abundance_stats(inpath, 10)
+
+    assert (stats['n_reads'], stats['n_kmers'], stats['mean'],
+            stats['median']) == (0, 0, 0, 0)
+    assert stats['histogram'] == []
+    assert stats['by_position'] == [0] * 10
+
+def test_abundance_stats_bad_quantile():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    ht = _load(inpath)
+
+    try:
+        ht.abundance_stats(inpath, 0, 0, 1, (0.5, 0))
+        assert 0, "should fail"
+    except ValueError:
+        pass
@@ -1,7 +1,9 @@
 import os
 import gzip
+import struct
 
 import khmer
+import screed
 import khmer_tst_utils as utils
 
 MAX_COUNT=255
@@ -482,6 +484,42 @@ def test_bigcount_abund_dist_2():
     pdist = [ (i, dist[i]) for i in range(len(dist)) if dist[i] ]
     assert dist[1001] == 1, pdist
 
+def test_abund_dist_threaded():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    kh = khmer.new_counting_hash(12, 1e6, 3)
+    kh.consume_fasta(inpath)
+    kh.consume_fasta(inpath)
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    x = kh.abundance_distribution(inpath, tracking)
+    assert sum(x) == 3966, sum(x)
+
+    for n_threads in (1, 4):
+        tracking = khmer.new_hashbits(12, 1e6, 3)
+        y = khmer.abundance_distribution(kh, inpath, tracking, n_threads)
+        assert x == y, (n_threads, x[:10], y[:10])
+
+def test_abund_dist_no_tracking():
+    # each k-mer was counted once for each time it occurs in the file, so
+    # its occurrences add up to one k-mer at its abundance.
+    seqpath = utils.get_test_data('test-abund-read-2.fa')
+
+    kh = khmer.new_counting_hash(18, 1e7, 4)
+    kh.set_use_bigcount(True)
+    kh.consume_fasta(seqpath)
+
+    tracking = khmer.new_hashbits(18, 1e7, 4)
+    x = kh.abundance_distribution(seqpath, tracking)
+    assert x[1001] == 1, x[1001]
+
+    y = kh.abundance_distribution(seqpath, None)
+    assert x == y
+
+    for n_threads in (1, 3):
+        z = khmer.abundance_distribution(kh, seqpath, None, n_threads)
+        assert x == z
+
 def test_bigcount_overflow():
     kh = khmer.new_counting_hash(18, 1e7, 4)
     kh.set_use_bigcount(True)
@@ -499,8 +537,911 @@ def test_get_hashsizes():
     kh = khmer.new_counting_hash(22, 100, 4)
     assert kh.hashsizes() == [101, 103, 107, 109], kh.hashsizes()
 
-#def test_collect_high_abundance_kmers():
-#    seqpath = utils.get_test_data('test-abund-read-2.fa')
-#
-#    kh = khmer.new_counting_hash(18, 1e6, 4)
-#    hb = kh.collect_high_abundance_kmers(seqpath, 2, 4)
+def test_blocked_get_hashsizes():
+    kh = khmer.new_counting_hash(22, 100, 4, 1, True)
+    assert kh.is_blocked()
+
+    # 4 tables of ~100 bytes => 7 blocks (prime), 16 counters per table
+    assert kh.hashsizes() == [112, 112, 112, 112], kh.hashsizes()
+
+def test_blocked_simple_median():
+    hi = khmer.new_counting_hash(6, 1e6, 4, 1, True)
+
+    hi.consume("AAAAAA")
+    hi.consume("AAAAAA")
+    hi.consume("AAAAAT")
+    (median, average, stddev) = hi.get_median_count("AAAAAAT")
+    assert median == 2
+    assert average == 1.5
+
+def test_blocked_maxcount():
+    kh = khmer.new_counting_hash(4, 4**4, 4, 1, True)
+    kh.set_use_bigcount(False)
+
+    for i in range(0, 1000):
+        kh.count('AAAA')
+
+    assert kh.get('AAAA') == MAX_COUNT
+
+def test_blocked_maxcount_with_bigcount():
+    kh = khmer.new_counting_hash(4, 4**4, 4, 1, True)
+    kh.set_use_bigcount(True)
+
+    for i in range(0, 1000):
+        kh.count('AAAA')
+
+    assert kh.get('AAAA') == 1000, kh.get('AAAA')
+
+def _do_blocked_save_load(savepath):
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    hi = khmer.new_counting_hash(12, 1e6, 3, 1, True)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.load_counting_hash(savepath)
+    assert ht.is_blocked()
+    assert ht.hashsizes() == hi.hashsizes()
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    x = hi.abundance_distribution(inpath, tracking)
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    y = ht.abundance_distribution(inpath, tracking)
+
+    assert sum(x) == 3966, sum(x)
+    assert x == y, (x,y)
+
+def test_blocked_save_load():
+    _do_blocked_save_load(utils.get_temp_filename('blockedsave.kh'))
+
+def test_blocked_save_load_gz():
+    _do_blocked_save_load(utils.get_temp_filename('blockedsave.kh.gz'))
+
+def test_blocked_save_load_kz():
+    _do_blocked_save_load(utils.get_temp_filename('blockedsave.kh.kz'))
+
+def test_blocked_false_positive_rate():
+    # the blocked layout trades some accuracy for one cache line per k-mer;
+    # make sure it stays in the same ballpark as independent tables.
+    inpath = utils.get_test_data('random-20-a.fa')
+    otherpath = utils.get_test_data('random-20-b.fa')
+    K = 12
+
+    present = set()
+    for record in screed.open(inpath):
+        seq = record.sequence
+        for i in range(len(seq) - K + 1):
+            present.add(seq[i:i + K])
+
+    absent = set()
+    for record in screed.open(otherpath):
+        seq = record.sequence
+        for i in range(len(seq) - K + 1):
+            if seq[i:i + K] not in present:
+                absent.add(seq[i:i + K])
+
+    rates = []
+    for blocked in (False, True):
+        kh = khmer.new_counting_hash(K, 4000, 4, 1, blocked)
+        kh.consume_fasta(inpath)
+
+        for kmer in present:
+            assert kh.get(kmer) >= 1
+
+        n_fp = len([ kmer for kmer in absent if kh.get(kmer) ])
+        rates.append(n_fp / float(len(absent)))
+
+    tables_fp, blocked_fp = rates
+    print tables_fp, blocked_fp
+    assert tables_fp < 0.2, tables_fp
+    assert blocked_fp < 1.5 * tables_fp, rates
+
+def _collect_in_python(seqpath, K, lower_count, upper_count):
+    counts = {}
+    for record in screed.open(seqpath):
+        seq = record.sequence.upper()
+        if 'N' in seq:
+            continue
+
+        done = False
+        for i in range(len(seq) - K + 1):
+            kmer = khmer.forward_hash(seq[i:i + K], K)
+            counts[kmer] = counts.get(kmer, 0) + 1
+            if counts[kmer] >= upper_count:
+                done = True
+        if done:
+            break
+
+    return sorted([ kmer for kmer, count in counts.iteritems()
+                    if count >= lower_count ])
+
+def test_collect_high_abundance_kmers():
+    seqpath = utils.get_test_data('test-abund-read-2.fa')
+    expected = _collect_in_python(seqpath, 18, 2, 4)
+    assert expected
+
+    kh = khmer.new_counting_hash(18, 1e6, 4)
+    kset = kh.collect_high_abundance_kmers(seqpath, 2, 4)
+    assert kset.ksize() == 18
+    assert kset.kmers() == expected
+    assert len(kset) == len(expected)
+
+    for kmer in expected:
+        assert kmer in kset
+        assert kset.contains(kmer)
+
+    record = iter(screed.open(seqpath)).next()
+    assert (record.sequence[:18] in kset) == \
+        (khmer.forward_hash(record.sequence[:18], 18) in expected)
+
+def test_collect_high_abundance_kmers_threaded():
+    seqpath = utils.get_test_data('test-reads.fa')
+
+    kh = khmer.new_counting_hash(20, 1e7, 4)
+    kset = kh.collect_high_abundance_kmers(seqpath, 2, 50, 4)
+    kmers = kset.kmers()
+
+    # sorted, each once, and all at or above the lower count.
+    assert kmers
+    assert kmers == sorted(set(kmers))
+    for kmer in kmers:
+        assert kh.get(khmer.reverse_hash(kmer, 20)) >= 2
+
+def test_collect_high_abundance_kmers_stoptags():
+    seqpath = utils.get_test_data('test-abund-read-2.fa')
+    savepath = utils.get_temp_filename('high.stoptags')
+
+    exact = khmer.new_exact_counting_hash(18)
+    kset = exact.collect_high_abundance_kmers(seqpath, 2, 4)
+    kset.save_stop_tags(savepath)
+
+    hb = khmer.new_hashbits(18, 1, 1)
+    hb.load_stop_tags(savepath)
+    stop_tags = [ khmer.forward_hash(kmer, 18) for kmer in hb.get_stop_tags() ]
+    assert sorted(stop_tags) == kset.kmers()
+
+def test_counter_bits_maxcount():
+    for counter_bits in (4, 2):
+        kh = khmer.new_counting_hash(4, 4**4, 4, 1, False, counter_bits)
+        assert kh.get_counter_bits() == counter_bits
+        kh.set_use_bigcount(False)
+
+        for i in range(0, 1000):
+            kh.count('AAAA')
+
+        assert kh.get('AAAA') == (1 << counter_bits) - 1, kh.get('AAAA')
+        assert kh.get('AAAT') == 0
+
+def test_counter_bits_maxcount_with_bigcount():
+    for blocked in (False, True):
+        kh = khmer.new_counting_hash(4, 4**4, 4, 1, blocked, 4)
+        kh.set_use_bigcount(True)
+
+        for i in range(0, 1000):
+            kh.count('AAAA')
+
+        assert kh.get('AAAA') == 1000, kh.get('AAAA')
+
+def test_counter_bits_bad_width():
+    try:
+        khmer.new_counting_hash(4, 4**4, 4, 1, False, 3)
+        assert 0, "should not accept 3-bit counters"
+    except ValueError:
+        pass
+
+def test_counter_bits_neighbors():
+    # packed counters share bytes; incrementing one must not touch the rest.
+    kh = khmer.new_counting_hash(4, 4**4, 1, 1, False, 2)
+
+    kh.count('AAAA')
+    for i in range(0, 10):
+        kh.count('AAAC')
+
+    assert kh.get('AAAA') == 1
+    assert kh.get('AAAC') == 3
+    assert kh.get('AAAG') == 0
+    assert kh.n_occupied() == 2
+
+def _do_counter_bits_save_load(savepath, blocked):
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    hi = khmer.new_counting_hash(12, 1e6, 3, 1, blocked, 4)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.new_counting_hash(1, 1, 1)
+    ht.load(savepath)
+    assert ht.get_counter_bits() == 4
+    assert ht.is_blocked() == blocked
+    assert ht.hashsizes() == hi.hashsizes()
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    x = hi.abundance_distribution(inpath, tracking)
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    y = ht.abundance_distribution(inpath, tracking)
+
+    assert sum(x) == 3966, sum(x)
+    assert x == y, (x,y)
+
+def test_counter_bits_save_load():
+    _do_counter_bits_save_load(utils.get_temp_filename('nibblesave.kh'),
+                               False)
+
+def test_counter_bits_save_load_gz():
+    _do_counter_bits_save_load(utils.get_temp_filename('nibblesave.kh.gz'),
+                               False)
+
+def test_counter_bits_save_load_kz():
+    _do_counter_bits_save_load(utils.get_temp_filename('nibblesave.kh.kz'),
+                               False)
+
+def test_counter_bits_blocked_save_load():
+    _do_counter_bits_save_load(utils.get_temp_filename('nibblesave2.kh'),
+                               True)
+
+def test_load_version_3():
+    # version 3 files predate counter widths; they're all 8-bit.
+    kh = khmer.new_counting_hash(4, 4**4, 1)
+    kh.count('AAAC')
+    kh.count('AAAC')
+
+    tablesize = kh.hashsizes()[0]
+    table = [0] * tablesize
+    table[khmer.forward_hash('AAAC', 4) % tablesize] = 2
+
+    savepath = utils.get_temp_filename('version3.kh')
+    fp = open(savepath, 'wb')
+    fp.write(struct.pack('<BBBIBQ', 3, 1, 0, 4, 1, tablesize))
+    fp.write(struct.pack('<%dB' % tablesize, *table))
+    fp.write(struct.pack('<Q', 0))
+    fp.close()
+
+    ht = khmer.new_counting_hash(1, 1, 1)
+    ht.load(savepath)
+    assert ht.get_counter_bits() == 8
+    assert ht.hashsizes() == kh.hashsizes()
+    assert ht.get('AAAC') == 2
+    assert ht.get('AAAA') == 0
+
+def test_bigcount_many_kmers_save_load():
+    # enough saturated k-mers to make the bigcount shards grow.
+    K = 8
+    kh = khmer.new_counting_hash(K, 4**K, 2)
+    kh.set_use_bigcount(True)
+
+    kmers = []
+    seen = set()
+    for i in range(0, 4**K, 37):
+        kmer = khmer.reverse_hash(i, K)
+        if khmer.forward_hash(kmer, K) in seen:   # reverse complement
+            continue
+        seen.add(khmer.forward_hash(kmer, K))
+
+        for j in range(0, 300 + len(kmers) % 7):
+            kh.count(kmer)
+        kmers.append(kmer)
+
+    for n, kmer in enumerate(kmers):
+        assert kh.get(kmer) == 300 + n % 7, (kmer, kh.get(kmer))
+
+    savepath = utils.get_temp_filename('manybigcounts.kh')
+    kh.save(savepath)
+
+    ht = khmer.new_counting_hash(1, 1, 1)
+    ht.load(savepath)
+    for n, kmer in enumerate(kmers):
+        assert ht.get(kmer) == 300 + n % 7, (kmer, ht.get(kmer))
+
+def test_load_version_3_bigcounts():
+    # version 3 and 4 files interleave bigcount k-mers and counts.
+    tablesize = khmer.new_counting_hash(4, 4**4, 1).hashsizes()[0]
+    table = [0] * tablesize
+    table[khmer.forward_hash('AAAC', 4) % tablesize] = 255
+
+    savepath = utils.get_temp_filename('version3big.kh')
+    fp = open(savepath, 'wb')
+    fp.write(struct.pack('<BBBIBQ', 3, 1, 1, 4, 1, tablesize))
+    fp.write(struct.pack('<%dB' % tablesize, *table))
+    fp.write(struct.pack('<Q', 1))
+    fp.write(struct.pack('<QH', khmer.forward_hash('AAAC', 4), 1000))
+    fp.close()
+
+    ht = khmer.new_counting_hash(1, 1, 1)
+    ht.load(savepath)
+    assert ht.get('AAAC') == 1000, ht.get('AAAC')
+
+def test_conservative_overestimate():
+    inpath = utils.get_test_data('random-20-a.fa')
+    K = 12
+    exact = utils.kmer_counts([inpath], K)
+
+    errors = []
+    for conservative in (False, True):
+        for blocked in (False, True):
+            kh = khmer.new_counting_hash(K, 2000, 4, 1, blocked, 8,
+                                         conservative)
+            assert kh.get_use_conservative() == conservative
+            kh.consume_fasta(inpath)
+
+            error = 0
+            for h, n in exact.items():
+                c = kh.get(khmer.reverse_hash(h, K))
+                assert c >= n, (c, n)
+                error += c - n
+            errors.append(error)
+
+    plain, plain_blocked, cu, cu_blocked = errors
+    print errors
+    assert cu < plain / 2, errors
+    assert cu_blocked < plain_blocked / 2, errors
+
+def test_conservative_threaded():
+    # threads counting the same k-mers at once never lose a count.
+    import threading
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    K = 17
+    exact = utils.kmer_counts([inpath], K)
+
+    for blocked in (False, True):
+        kh = khmer.new_counting_hash(K, 1e5, 4, 4, blocked, 8, True)
+        kh.set_use_bigcount(True)
+
+        rparser = khmer.ReadParser(inpath, 4)
+        threads = [ threading.Thread(target=kh.consume_fasta_with_reads_parser,
+                                     args=(rparser,)) for i in range(4) ]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        for h, n in exact.items():
+            c = kh.get(khmer.reverse_hash(h, K))
+            assert c >= n, (c, n)
+
+def test_conservative_maxcount():
+    for counter_bits in (8, 4, 2):
+        kh = khmer.new_counting_hash(4, 4**4, 4, 1, False, counter_bits,
+                                     True)
+        kh.set_use_bigcount(False)
+
+        for i in range(0, 1000):
+            kh.count('AAAA')
+
+        expected = (counter_bits == 8) and MAX_COUNT or (1 << counter_bits) - 1
+        assert kh.get('AAAA') == expected, kh.get('AAAA')
+
+def test_conservative_maxcount_with_bigcount():
+    for blocked in (False, True):
+        kh = khmer.new_counting_hash(4, 4**4, 4, 1, blocked, 4, True)
+        kh.set_use_bigcount(True)
+
+        for i in range(0, 1000):
+            kh.count('AAAA')
+
+        assert kh.get('AAAA') == 1000, kh.get('AAAA')
+
+def test_conservative_packed_neighbors():
+    kh = khmer.new_counting_hash(4, 4**4, 2, 1, False, 2, True)
+
+    kh.count('AAAA')
+    for i in range(0, 10):
+        kh.count('AAAC')
+
+    assert kh.get('AAAA') == 1
+    assert kh.get('AAAC') == 3
+    assert kh.get('AAAG') == 0
+
+def test_set_use_conservative():
+    kh = khmer.new_counting_hash(4, 4**4, 4)
+    assert not kh.get_use_conservative()
+
+    kh.set_use_conservative(True)
+    assert kh.get_use_conservative()
+    kh.count('AAAA')
+    kh.count('AAAA')
+    assert kh.get('AAAA') == 2
+
+def test_batched_consume_matches_count():
+    # consume() counts in batches of prefetched k-mers; it must agree with
+    # counting one k-mer at a time, across several batches.
+    inpath = utils.get_test_data('random-20-a.fa')
+    seq = "".join([ record.sequence for record in screed.open(inpath) ])
+    K = 12
+    assert len(seq) - K + 1 > 256
+
+    for blocked in (False, True):
+        for conservative in (False, True):
+            kh = khmer.new_counting_hash(K, 1000, 4, 1, blocked, 8,
+                                         conservative)
+            kh2 = khmer.new_counting_hash(K, 1000, 4, 1, blocked, 8,
+                                          conservative)
+            kh.consume(seq)
+            for i in range(0, len(seq) - K + 1):
+                kh2.count(seq[i:i+K])
+
+            for i in range(0, len(seq) - K + 1):
+                kmer = seq[i:i+K]
+                assert kh.get(kmer) == kh2.get(kmer), kmer
+
+            assert kh.get_median_count(seq) == kh2.get_median_count(seq)
+
+def test_bins_any_tablesize():
+    # bins are k-mer hash % table size, whatever the size: prime, a power
+    # of two, or 1.
+    inpath = utils.get_test_data('random-20-a.fa')
+    seq = "".join([ record.sequence for record in screed.open(inpath) ])
+    K = 12
+    kmers = [ seq[i:i + K] for i in range(0, 200) ]  # under MAX_COUNT
+
+    for size in (1, 2, 3, 64, 97, 2**20, 2**20 + 7):
+        kh = khmer._new_counting_hash(K, [size])
+
+        expected = {}
+        for kmer in kmers:
+            kh.count(kmer)
+            bin = khmer.forward_hash(kmer, K) % size
+            expected[bin] = expected.get(bin, 0) + 1
+
+        for kmer in kmers:
+            bin = khmer.forward_hash(kmer, K) % size
+            assert kh.get(kmer) == expected[bin], (size, kmer)
+
+def _do_mmap_load(blocked, counter_bits):
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('mmap.kh')
+
+    hi = khmer.new_counting_hash(12, 1e5, 3, 1, blocked, counter_bits)
+    hi.set_use_bigcount(True)
+    hi.consume_fasta(inpath)
+    for i in range(0, 1000):
+        hi.count('GGGGGGGGGGGG')
+    hi.save(savepath)
+
+    ht = khmer.load_counting_hash(savepath, use_mmap=True)
+    assert ht.is_mmapped()
+    assert ht.is_blocked() == blocked
+    assert ht.get_counter_bits() == counter_bits
+    assert ht.hashsizes() == hi.hashsizes()
+    assert ht.get('GGGGGGGGGGGG') == 1000
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        for i in range(len(seq) - 12 + 1):
+            assert ht.get(seq[i:i + 12]) == hi.get(seq[i:i + 12])
+
+    # counting into a mapped table leaves the file alone.
+    ht.count('ACGTACGTACGT')
+    assert ht.get('ACGTACGTACGT') == hi.get('ACGTACGTACGT') + 1
+
+    again = khmer.load_counting_hash(savepath)
+    assert not again.is_mmapped()
+    assert again.get('ACGTACGTACGT') == hi.get('ACGTACGTACGT')
+
+    # loading over a mapped table unmaps it.
+    ht.load(savepath)
+    assert not ht.is_mmapped()
+    assert ht.get('ACGTACGTACGT') == hi.get('ACGTACGTACGT')
+
+def test_mmap_load():
+    _do_mmap_load(False, 8)
+
+def test_mmap_load_narrow():
+    _do_mmap_load(False, 4)
+
+def test_mmap_load_blocked():
+    _do_mmap_load(True, 8)
+
+def test_mmap_load_tables_page_aligned():
+    kh = khmer.new_counting_hash(12, 1e4, 2)
+    savepath = utils.get_temp_filename('aligned.kh')
+    kh.save(savepath)
+
+    data = open(savepath, 'rb').read()
+    version, ht_type = struct.unpack('<BB', data[:2])
+    assert version == 7
+
+    # header, then the first table size, then padding.
+    offset = struct.calcsize('<BBBBIB')
+    for size in kh.hashsizes():
+        assert struct.unpack('<Q', data[offset:offset + 8])[0] == size
+        offset += 8
+        offset += (4096 - offset % 4096) % 4096
+        assert offset % 4096 == 0
+        offset += size
+
+def test_mmap_load_gz_reads_in():
+    kh = khmer.new_counting_hash(12, 1e4, 2)
+    kh.count('ACGTACGTACGT')
+    savepath = utils.get_temp_filename('mmap.kh.gz')
+    kh.save(savepath)
+
+    ht = khmer.load_counting_hash(savepath, use_mmap=True)
+    assert not ht.is_mmapped()
+    assert ht.get('ACGTACGTACGT') == 1
+
+def test_mmap_load_version_5_reads_in():
+    # version 5 files don't have page-aligned tables.
+    kh = khmer.new_counting_hash(4, 4**4, 1)
+    tablesize = kh.hashsizes()[0]
+    table = [0] * tablesize
+    table[khmer.forward_hash('AAAC', 4) % tablesize] = 2
+
+    savepath = utils.get_temp_filename('version5.kh')
+    fp = open(savepath, 'wb')
+    fp.write(struct.pack('<BBBBIBQ', 5, 1, 0, 8, 4, 1, tablesize))
+    fp.write(struct.pack('<%dB' % tablesize, *table))
+    fp.write(struct.pack('<Q', 0))
+    fp.close()
+
+    ht = khmer.load_counting_hash(savepath, use_mmap=True)
+    assert not ht.is_mmapped()
+    assert ht.get('AAAC') == 2
+
+def test_save_load_kz():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('tempcountingsave.kh.kz')
+
+    hi = khmer.new_counting_hash(12, 1e6, 3)
+    hi.set_use_bigcount(True)
+    hi.consume_fasta(inpath)
+    for i in range(300):
+        hi.count('ACGTACGTACGT')
+    hi.save(savepath)
+
+    data = open(savepath, 'rb').read()
+    assert data[:7] == 'khmerkz'
+    assert data[-8:-1] == 'khmerkz'
+
+    ht = khmer.load_counting_hash(savepath)
+    assert ht.hashsizes() == hi.hashsizes()
+    assert ht.get('ACGTACGTACGT') == hi.get('ACGTACGTACGT')
+    assert ht.get('ACGTACGTACGT') >= 300
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    x = hi.abundance_distribution(inpath, tracking)
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    y = ht.abundance_distribution(inpath, tracking)
+
+    assert sum(x) == 3966, sum(x)
+    assert x == y, (x,y)
+
+def test_save_load_kz_many_chunks():
+    # tables several chunks long, so that reads cross chunk boundaries
+    # and the page padding is skipped by seeking.
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('bigsave.kh.kz')
+
+    hi = khmer.new_counting_hash(12, 3e6, 3)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.load_counting_hash(savepath)
+    assert ht.hashsizes() == hi.hashsizes()
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        for i in range(0, len(seq) - 12 + 1, 7):
+            kmer = seq[i:i + 12]
+            assert ht.get(kmer) == hi.get(kmer), kmer
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    x = hi.abundance_distribution(inpath, tracking)
+
+    tracking = khmer.new_hashbits(12, 1e6, 3)
+    y = ht.abundance_distribution(inpath, tracking)
+    assert x == y, (x,y)
+
+def _do_merge(blocked, counter_bits, ext='.kh'):
+    # counting each half of the reads and summing should match counting
+    # them all at once.
+    inpath = utils.get_test_data('random-20-a.fa')
+    reads = [ record.sequence for record in screed.open(inpath) ]
+    half = len(reads) / 2
+
+    whole = khmer.new_counting_hash(12, 1.5e6, 3, 1, blocked, counter_bits)
+    a = khmer.new_counting_hash(12, 1.5e6, 3, 1, blocked, counter_bits)
+    b = khmer.new_counting_hash(12, 1.5e6, 3, 1, blocked, counter_bits)
+    for seq in reads:
+        whole.consume(seq)
+    for seq in reads[:half]:
+        a.consume(seq)
+    for seq in reads[half:]:
+        b.consume(seq)
+
+    apath = utils.get_temp_filename('merge-a' + ext)
+    bpath = utils.get_temp_filename('merge-b' + ext)
+    outpath = utils.get_temp_filename('merged' + ext)
+    a.save(apath)
+    b.save(bpath)
+
+    khmer.merge_counting_hash_files(outpath, [apath, bpath])
+    merged = khmer.load_counting_hash(outpath)
+
+    assert merged.hashsizes() == whole.hashsizes()
+    assert merged.is_blocked() == blocked
+    assert merged.get_counter_bits() == counter_bits
+    assert merged.n_occupied() == whole.n_occupied()
+
+    for seq in reads:
+        for i in range(0, len(seq) - 12 + 1):
+            kmer = seq[i:i + 12]
+            assert merged.get(kmer) == whole.get(kmer), kmer
+
+def test_merge():
+    _do_merge(False, 8)
+
+def test_merge_blocked():
+    _do_merge(True, 8)
+
+def test_merge_narrow():
+    _do_merge(False, 4)
+    _do_merge(True, 2)
+
+def test_merge_kz():
+    _do_merge(False, 8, '.kh.kz')
+
+def test_merge_saturates():
+    for counter_bits in (8, 4, 2):
+        a = khmer.new_counting_hash(4, 4**4, 4, 1, False, counter_bits)
+        b = khmer.new_counting_hash(4, 4**4, 4, 1, False, counter_bits)
+
+        max_count = (1 << counter_bits) - 1
+        for i in range(max_count - 1):
+            a.count('AAAA')
+            b.count('AAAA')
+        a.count('CCCA')
+        b.count('CCCA')
+
+        apath = utils.get_temp_filename('saturate-a.kh')
+        bpath = utils.get_temp_filename('saturate-b.kh')
+        outpath = utils.get_temp_filename('saturated.kh')
+        a.save(apath)
+        b.save(bpath)
+
+        khmer.merge_counting_hash_files(outpath, [apath, bpath, bpath])
+        merged = khmer.load_counting_hash(outpath)
+
+        assert merged.get('AAAA') == max_count, merged.get('AAAA')
+        assert merged.get('CCCA') == min(3, max_count), merged.get('CCCA')
+        assert merged.get('GGGA') == 0
+
+def test_merge_bigcount():
+    a = khmer.new_counting_hash(4, 4**4, 4)
+    b = khmer.new_counting_hash(4, 4**4, 4)
+    c = khmer.new_counting_hash(4, 4**4, 4)
+    a.set_use_bigcount(True)
+    c.set_use_bigcount(True)
+
+    for i in range(300):
+        a.count('AAAA')
+    for i in range(100):
+        b.count('AAAA')
+        b.count('AAAC')
+    for i in range(300):
+        c.count('AAAC')
+    for i in range(150):
+        b.count('AAAG')
+        c.count('AAAG')
+
+    paths = []
+    for name, ht in (('a', a), ('b', b), ('c', c)):
+        paths.append(utils.get_temp_filename('bigcount-%s.kh' % name))
+        ht.save(paths[-1])
+
+    outpath = utils.get_temp_filename('bigcount-merged.kh')
+    khmer.merge_counting_hash_files(outpath, paths)
+    merged = khmer.load_counting_hash(outpath)
+
+    assert merged.get_use_bigcount()
+    assert merged.get('AAAA') == 400, merged.get('AAAA')
+    assert merged.get('AAAC') == 400, merged.get('AAAC')
+
+    # no input knew AAAG was over the counter maximum, so the sum can't
+    # go past it.
+    assert merged.get('AAAG') == 255, merged.get('AAAG')
+
+def test_overflow_counts():
+    for counter_bits in (8, 4):
+        for blocked in (False, True):
+            kh = khmer.new_counting_hash(12, 1e4, 3, 1, blocked, counter_bits,
+                                         overflow_size=1000)
+            assert kh.get_overflow_size() == 1000
+
+            for i in range(1000):
+                kh.count('AAAAAAAAAAAA')
+            kh.count('ACGTACGTACGT')
+            assert kh.get('AAAAAAAAAAAA') == 1000, kh.get('AAAAAAAAAAAA')
+            assert kh.get('ACGTACGTACGT') == 1
+
+def test_overflow_saturates():
+    kh = khmer.new_counting_hash(4, 4**4, 2, overflow_size=10)
+    for i in range(MAX_BIGCOUNT + 10):
+        kh.count('AAAA')
+    assert kh.get('AAAA') == MAX_BIGCOUNT
+
+def test_overflow_off():
+    kh = khmer.new_counting_hash(4, 4**4, 2, overflow_size=10)
+    kh.set_overflow_size(0)
+    for i in range(300):
+        kh.count('AAAA')
+    assert kh.get('AAAA') == MAX_COUNT
+
+def test_overflow_conservative():
+    kh = khmer.new_counting_hash(4, 4**4, 2, 1, False, 8, True,
+                                 overflow_size=1000)
+    for i in range(400):
+        kh.count('AAAA')
+    for i in range(300):
+        kh.count('AAAC')
+    assert kh.get('AAAA') == 400, kh.get('AAAA')
+    assert kh.get('AAAC') == 300, kh.get('AAAC')
+
+    # with one overflow counter, everything past full shares it; counts
+    # come out high, never low.
+    kh = khmer.new_counting_hash(4, 4**4, 2, 1, False, 8, True,
+                                 overflow_size=1)
+    for i in range(400):
+        kh.count('AAAA')
+    for i in range(300):
+        kh.count('AAAC')
+    assert kh.get('AAAA') >= 400
+    assert kh.get('AAAC') >= 300
+
+def test_overflow_abundance_distribution():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+
+    kh = khmer.new_counting_hash(12, 1e6, 2, overflow_size=1000)
+    for i in range(300):
+        kh.consume_fasta(inpath)
+
+    tracking = khmer.new_hashbits(12, 1e6, 2)
+    dist = kh.abundance_distribution(inpath, tracking)
+    assert sum(dist[:300]) == 0
+    assert sum(dist[300:]) == sum(dist)
+
+def _do_overflow_save_load(ext, use_mmap=False):
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('overflow' + ext)
+
+    hi = khmer.new_counting_hash(12, 1e5, 3, overflow_size=5000)
+    hi.consume_fasta(inpath)
+    for i in range(1000):
+        hi.count('GGGGGGGGGGGG')
+    hi.save(savepath)
+
+    ht = khmer.load_counting_hash(savepath, use_mmap=use_mmap)
+    assert ht.get_overflow_size() == 5000
+    assert ht.get('GGGGGGGGGGGG') == 1000
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        for i in range(len(seq) - 12 + 1):
+            assert ht.get(seq[i:i + 12]) == hi.get(seq[i:i + 12])
+
+    ht.count('GGGGGGGGGGGG')
+    assert ht.get('GGGGGGGGGGGG') == 1001
+
+def test_overflow_save_load():
+    _do_overflow_save_load('.kh')
+
+def test_overflow_save_load_gz():
+    _do_overflow_save_load('.kh.gz')
+
+def test_overflow_save_load_kz():
+    _do_overflow_save_load('.kh.kz')
+
+def test_overflow_save_load_mmap():
+    _do_overflow_save_load('.kh', True)
+
+def test_overflow_load_clears():
+    # a file saved without an overflow tier loads without one.
+    savepath = utils.get_temp_filename('no-overflow.kh')
+    khmer.new_counting_hash(4, 4**4, 2).save(savepath)
+
+    kh = khmer.new_counting_hash(4, 4**4, 2, overflow_size=10)
+    kh.load(savepath)
+    assert kh.get_overflow_size() == 0
+
+def test_merge_overflow():
+    for blocked in (False, True):
+        paths = []
+        for name, n in (('a', 200), ('b', 100), ('c', 300)):
+            kh = khmer.new_counting_hash(4, 4**4, 2, 1, blocked,
+                                         overflow_size=100)
+            for i in range(n):
+                kh.count('AAAA')
+            kh.count('AAAC')
+            paths.append(utils.get_temp_filename('overflow-%s.kh' % name))
+            kh.save(paths[-1])
+
+        outpath = utils.get_temp_filename('overflow-merged.kh')
+        khmer.merge_counting_hash_files(outpath, paths)
+        merged = khmer.load_counting_hash(outpath)
+
+        assert merged.get_overflow_size() == 100
+        assert merged.get('AAAA') == 600, merged.get('AAAA')
+        assert merged.get('AAAC') == 3
+
+def test_occupancy():
+    inpath = utils.get_test_data('random-20-a.fa')
+    hashes = set(utils.kmer_counts([inpath], 20))
+
+    for counter_bits in (8, 4, 2):
+        kh = khmer.new_counting_hash(20, 10007, 3, 1, False, counter_bits)
+        kh.consume_fasta(inpath)
+        sizes = kh.hashsizes()
+
+        occupancy = kh.occupancy()
+        occupied = [ len(set([ h % size for h in hashes ])) for size in sizes ]
+        assert occupancy['occupied'] == occupied, counter_bits
+        assert kh.n_occupied() == occupied[0]
+
+        fp_rate = 1.0
+        for n, size in zip(occupied, sizes):
+            fp_rate *= float(n) / size
+        assert round(occupancy['fp_rate'], 10) == round(fp_rate, 10)
+        assert khmer.calc_expected_collisions(kh) == occupancy['fp_rate']
+
+        # about 3,100 distinct k-mers.
+        assert abs(occupancy['n_kmers'] - len(hashes)) < 0.05 * len(hashes), \
+            (occupancy['n_kmers'], len(hashes))
+
+def test_n_occupied_ranges():
+    inpath = utils.get_test_data('random-20-a.fa')
+    hashes = set(utils.kmer_counts([inpath], 20))
+
+    for counter_bits in (8, 4, 2):
+        kh = khmer.new_counting_hash(20, 10007, 1, 1, False, counter_bits)
+        kh.consume_fasta(inpath)
+        size = kh.hashsizes()[0]
+        bins = set([ h % size for h in hashes ])
+
+        # ranges that start and stop inside bytes and words, and wrap.
+        for start, stop in ((0, 1), (1, 7), (3, 70), (5, 4093), (13, size),
+                            (size - 3, size + 9), (0, 2 * size + 1)):
+            n = sum([ 1 for i in range(start, stop) if i % size in bins ])
+            assert kh.n_occupied(start, stop) == n, (counter_bits, start, stop)
+
+def test_occupancy_blocked():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for counter_bits in (8, 4, 2):
+        kh = khmer.new_counting_hash(20, 10007, 3, 1, True, counter_bits)
+        kh.consume_fasta(inpath)
+        size = kh.hashsizes()[0]
+
+        occupied = kh.occupancy()['occupied']
+        assert len(occupied) == 3
+        assert occupied[0] == kh.n_occupied()
+        assert kh.n_occupied(0, 2 * size) == 2 * occupied[0]
+
+        # splitting a range anywhere, even within a block, adds up.
+        for split in (1, 17, 1000, size - 5):
+            assert kh.n_occupied(0, split) + kh.n_occupied(split, size) == \
+                occupied[0], (counter_bits, split)
+
+def test_occupancy_threaded():
+    # big enough to be split among threads.
+    inpath = utils.get_test_data('test-reads.fa')
+
+    for blocked, counter_bits in ((False, 8), (False, 2), (True, 4)):
+        kh = khmer.new_counting_hash(20, 5e6, 2, 1, blocked, counter_bits)
+        kh.consume_fasta(inpath)
+        size = kh.hashsizes()[0]
+
+        single = kh.occupancy()
+        for n_threads in (2, 3, 8):
+            assert kh.occupancy(n_threads) == single
+            assert kh.n_occupied(7, size - 7, n_threads) == \
+                kh.n_occupied(7, size - 7)
+
+def test_occupancy_bad_threads():
+    kh = khmer.new_counting_hash(4, 4**4, 2)
+    try:
+        kh.occupancy(0)
+        assert 0, "should fail"
+    except ValueError:
+        pass
@@ -0,0 +1,204 @@
+import gzip
+
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def _normalize_in_python(ht, filename, cutoff):
+    # what scripts/normalize-by-median.py used to do, one read at a time.
+    kept = []
+    for record in screed.open(filename):
+        seq = record.sequence.replace('N', 'A')
+        if len(seq) < ht.ksize():
+            continue
+
+        med, _, _ = ht.get_median_count(seq)
+        if med < cutoff:
+            ht.consume(seq)
+            kept.append(record.name)
+
+    return kept
+
+def test_normalize_matches_python():
+    inpath = utils.get_test_data('random-20-a.fa')
+    outpath = utils.get_temp_filename('random-20-a.fa.keep')
+
+    for cutoff in (1, 2, 5):
+        ht = khmer.new_counting_hash(12, 1e5, 2)
+        expected = _normalize_in_python(ht, inpath, cutoff)
+        expected.extend(_normalize_in_python(ht, inpath, cutoff))
+
+        ht2 = khmer.new_counting_hash(12, 1e5, 2)
+        n_reads, n_kept, n_unpaired = \
+            ht2.normalize_by_median(inpath, outpath, cutoff)
+        kept = [ r.name for r in screed.open(outpath) ]
+        n_reads2, n_kept2, _ = ht2.normalize_by_median(inpath, outpath, cutoff)
+        kept.extend([ r.name for r in screed.open(outpath) ])
+
+        assert n_reads == n_reads2 == 99
+        assert n_unpaired == 0
+        assert n_kept + n_kept2 == len(kept)
+        assert kept == expected, (cutoff, len(kept), len(expected))
+
+        for record in screed.open(inpath):
+            seq = record.sequence
+            assert ht.get_median_count(seq) == ht2.get_median_count(seq)
+
+def test_normalize_threaded():
+    # with several threads the reads kept depend on timing, but a read is
+    # only thrown away once its median has reached the cutoff, and counts
+    # only go up.
+    inpath = utils.get_test_data('test-reads.fa')
+    outpath = utils.get_temp_filename('test-reads.fa.keep')
+    cutoff = 5
+
+    ht = khmer.new_counting_hash(17, 1e6, 4, 4)
+    n_reads, n_kept, n_unpaired = \
+        ht.normalize_by_median(inpath, outpath, cutoff, False, 4)
+
+    names = set()
+    for record in screed.open(inpath):
+        names.add(record.name)
+    kept = set([ r.name for r in screed.open(outpath) ])
+
+    assert n_reads > n_kept > 0, (n_reads, n_kept)
+    assert len(kept) == n_kept
+    assert kept <= names
+
+    for record in screed.open(inpath):
+        if record.name not in kept:
+            seq = record.sequence.replace('N', 'A')
+            med, _, _ = ht.get_median_count(seq)
+            assert med >= cutoff, (record.name, med)
+
+def test_normalize_paired():
+    inpath = utils.get_temp_filename('paired.fa')
+    outpath = utils.get_temp_filename('paired.fa.keep')
+
+    seq = 'GGTTGACGGGGCTCAGGGGGCGGCTGACTCCGAGAGACAGCAGCCGCAG'
+    other = 'ACCGTTAGCGGCAAATTCCGGAACTAGCCTTAGGCCGAATGCAACGTTA'
+    third = 'GCTAAAGACAATTACATAACATACACGTCAGCACGAAACTTGTTGGCCC'
+    with_n = third[:20] + 'N' + third[21:]
+    fp = open(inpath, 'w')
+    fp.write('>a/1\n%s\n>a/2\n%s\n' % (seq, other))
+    # b/2 has an N, which is counted as an A; b is thrown away as a pair.
+    fp.write('>b/1\n%s\n>b/2\n%sN\n' % (other, seq))
+    # e/2 has no mate next to it.
+    fp.write('>e/2\n%s\n' % (third,))
+    # f/1 is new, and is written out with its N.
+    fp.write('>f/1\n%s\n>f/2\n%s\n' % (with_n, seq))
+    fp.write('>c/1\n%s\n>c/2\n%s\n' % (seq, seq))
+    fp.close()
+
+    ht = khmer.new_counting_hash(17, 1e5, 2)
+    n_reads, n_kept, n_unpaired = \
+        ht.normalize_by_median(inpath, outpath, 1, True)
+
+    assert n_unpaired == 1, n_unpaired
+    assert n_reads == 8, n_reads
+    assert n_kept == 4, n_kept
+
+    records = [ (r.name, r.sequence) for r in screed.open(outpath) ]
+    assert records == [('a/1', seq), ('a/2', other), ('f/1', with_n),
+                       ('f/2', seq)], records
+
+def test_normalize_paired_threaded():
+    # enough pairs, and a small enough read buffer, that the file is
+    # parsed in many pieces; no pair may be split between two of them.
+    import random
+    rng = random.Random(1)
+
+    inpath = utils.get_temp_filename('many-paired.fa')
+    outpath = utils.get_temp_filename('many-paired.fa.keep')
+
+    n_pairs = 20000
+    fp = open(inpath, 'w')
+    for i in xrange(n_pairs):
+        for end in (1, 2):
+            seq = ''.join([ rng.choice('ACGT') for _ in range(50) ])
+            fp.write('>%d/%d\n%s\n' % (i, end, seq))
+    fp.close()
+
+    config = khmer.get_config()
+    buffer_size = config.get_reads_input_buffer_size()
+    config.set_reads_input_buffer_size(4 * 65536)
+    try:
+        ht = khmer.new_counting_hash(17, 1e6, 4, 4)
+        n_reads, n_kept, n_unpaired = \
+            ht.normalize_by_median(inpath, outpath, 20, True, 4)
+    finally:
+        config.set_reads_input_buffer_size(buffer_size)
+
+    assert n_unpaired == 0, n_unpaired
+    assert n_reads == n_kept == 2 * n_pairs, (n_reads, n_kept)
+
+    names = [ r.name for r in screed.open(outpath) ]
+    assert len(names) == 2 * n_pairs
+    for i in range(0, len(names), 2):
+        assert names[i].endswith('/1'), names[i]
+        assert names[i + 1] == names[i][:-1] + '2', names[i:i + 2]
+    assert len(set(names)) == len(names)
+
+def test_normalize_callback():
+    inpath = utils.get_temp_filename('many.fa')
+    outpath = utils.get_temp_filename('many.fa.keep')
+
+    seq = 'GGTTGACGGGGCTCAGGGGGCGGCTGACTCCGAGAGACAGCAGCCGCAG'
+    fp = open(inpath, 'w')
+    for i in xrange(250000):
+        fp.write('>%d\n%s\n' % (i, seq))
+    fp.close()
+
+    calls = []
+
+    def callback(info, n_reads, n_kept):
+        calls.append((info, n_reads, n_kept))
+
+    ht = khmer.new_counting_hash(17, 1e5, 2)
+    n_reads, n_kept, n_unpaired = \
+        ht.normalize_by_median(inpath, outpath, 2, False, 1, callback)
+
+    assert (n_reads, n_kept) == (250000, 2), (n_reads, n_kept)
+    assert calls == [('normalize_by_median', 100000, 2),
+                     ('normalize_by_median', 200000, 2)], calls
+
+def test_normalize_improperly_paired():
+    inpath = utils.get_test_data('test-abund-read-impaired.fa')
+    outpath = utils.get_temp_filename('impaired.fa.keep')
+
+    ht = khmer.new_counting_hash(17, 1e5, 2)
+    try:
+        ht.normalize_by_median(inpath, outpath, 1, True)
+        assert 0, "should fail"
+    except ValueError:
+        pass
+
+def test_normalize_fastq():
+    inpath = utils.get_test_data('100-reads.fq.gz')
+    outpath = utils.get_temp_filename('100-reads.fq.keep')
+
+    ht = khmer.new_counting_hash(17, 1e5, 2)
+    n_reads, n_kept, n_unpaired = ht.normalize_by_median(inpath, outpath, 1)
+    assert n_kept > 0
+
+    lines = open(outpath).read().split('\n')
+    assert len(lines) == 4 * n_kept + 1
+    assert lines[0].startswith('@895:1:1:')
+    assert ' ' not in lines[0]
+    assert lines[2] == '+'
+    assert len(lines[3]) == len(lines[1])
+
+    records = set()
+    fp = gzip.open(inpath)
+    for line in fp:
+        name = line[1:].split()[0]
+        seq = fp.next().strip()
+        fp.next()
+        records.add((name, seq, fp.next().strip()))
+
+    for i in range(0, len(lines) - 1, 4):
+        assert (lines[i][1:], lines[i + 1], lines[i + 3]) in records
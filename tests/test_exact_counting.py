@@ -0,0 +1,142 @@
+import threading
+
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def _check_counts(ht, filename, expected):
+    K = ht.ksize()
+    for record in screed.open(filename):
+        seq = record.sequence
+        for i in range(len(seq) - K + 1):
+            kmer = seq[i:i + K]
+            assert ht.get(kmer) == expected[khmer.forward_hash(kmer, K)]
+
+def test_exact_counts():
+    inpath = utils.get_test_data('test-reads.fa')
+    expected = utils.kmer_counts([inpath], 20)
+
+    ht = khmer.new_exact_counting_hash(20)
+    ht.consume_fasta(inpath)
+
+    assert ht.n_unique_kmers() == len(expected)
+    _check_counts(ht, inpath, expected)
+
+    # nothing else is there.
+    for kmer in ('A' * 20, 'ACGT' * 5, 'CAGT' * 5):
+        assert ht.get(kmer) == expected.get(khmer.forward_hash(kmer, 20), 0)
+
+def test_count_and_get():
+    ht = khmer.new_exact_counting_hash(4)
+    ht.count('AAAA')
+    ht.count('TTTT')                    # the same canonical k-mer
+    ht.count('ACGT')
+
+    assert ht.get('AAAA') == 2
+    assert ht.get('ACGT') == 1
+    assert ht.get('CCCC') == 0
+    assert ht.n_unique_kmers() == 2
+
+def test_saturates():
+    ht = khmer.new_exact_counting_hash(4)
+    for i in range(70000):
+        ht.count('AAAA')
+
+    assert ht.get('AAAA') == 65535
+
+def test_grows():
+    # from a few slots to hold every 10-mer in the file.
+    inpath = utils.get_test_data('random-20-a.fa')
+    expected = utils.kmer_counts([inpath], 10)
+
+    ht = khmer.new_exact_counting_hash(10)
+    ht.consume_fasta(inpath)
+    assert ht.n_unique_kmers() == len(expected)
+    _check_counts(ht, inpath, expected)
+
+    sized = khmer.new_exact_counting_hash(10, len(expected))
+    sized.consume_fasta(inpath)
+    _check_counts(sized, inpath, expected)
+
+def test_consume_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+    expected = utils.kmer_counts([inpath], 20)
+
+    ht = khmer.new_exact_counting_hash(20, 0, 4)
+    rparser = khmer.ReadParser(inpath, 4)
+
+    threads = []
+    for tnum in xrange(4):
+        t = threading.Thread(target=ht.consume_fasta_with_reads_parser,
+                             args=(rparser,))
+        threads.append(t)
+        t.start()
+
+    for t in threads:
+        t.join()
+
+    assert ht.n_unique_kmers() == len(expected)
+    _check_counts(ht, inpath, expected)
+
+def test_save_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+    ht = khmer.new_exact_counting_hash(12)
+    ht.consume_fasta(inpath)
+    expected = utils.kmer_counts([inpath], 12)
+
+    for ext in ('', '.kz'):
+        savepath = utils.get_temp_filename('exact.ct' + ext)
+        ht.save(savepath)
+
+        loaded = khmer.load_exact_counting_hash(savepath)
+        assert loaded.ksize() == 12
+        assert loaded.n_unique_kmers() == ht.n_unique_kmers()
+        _check_counts(loaded, inpath, expected)
+
+        # counting goes on from where it was.
+        loaded.consume_fasta(inpath)
+        record = iter(screed.open(inpath)).next()
+        assert loaded.get(record.sequence[:12]) == \
+            2 * ht.get(record.sequence[:12])
+
+def test_matches_counting_hash():
+    # a count-min sketch big enough not to collide gives the same answers.
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+
+    exact = khmer.new_exact_counting_hash(17)
+    exact.consume_fasta(inpath)
+    counting = khmer.new_counting_hash(17, 1e7, 4)
+    counting.set_use_bigcount(True)
+    counting.consume_fasta(inpath)
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        if 'N' in seq:
+            continue
+
+        assert exact.get_median_count(seq) == counting.get_median_count(seq)
+        assert exact.trim_on_abundance(seq, 2) == \
+            counting.trim_on_abundance(seq, 2)
+        assert exact.trim_below_abundance(seq, 2) == \
+            counting.trim_below_abundance(seq, 2)
+
+    tracking = khmer.new_hashbits(17, 1e7, 4)
+    dist = exact.abundance_distribution(inpath, tracking)
+    tracking = khmer.new_hashbits(17, 1e7, 4)
+    assert dist == counting.abundance_distribution(inpath, tracking)
+    assert sum(dist) == exact.n_unique_kmers()
+
+def test_normalize_and_filter():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    outpath = utils.get_temp_filename('out.fa')
+
+    exact = khmer.new_exact_counting_hash(17)
+    counting = khmer.new_counting_hash(17, 1e7, 4)
+    assert exact.normalize_by_median(inpath, outpath, 5) == \
+        counting.normalize_by_median(inpath, outpath, 5)
+    assert exact.filter_abund(inpath, outpath, 2) == \
+        counting.filter_abund(inpath, outpath, 2)
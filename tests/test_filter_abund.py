@@ -0,0 +1,82 @@
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def _filter_in_python(ht, filename, cutoff):
+    # what scripts/filter-abund.py used to do, one read at a time.
+    kept = []
+    for record in screed.open(filename):
+        seq = record.sequence
+        if 'N' in seq:
+            continue
+
+        trim_seq, trim_at = ht.trim_on_abundance(seq, cutoff)
+        if trim_at >= ht.ksize():
+            kept.append((record.name, trim_seq))
+
+    return kept
+
+def _make_counting(filename, K=12):
+    ht = khmer.new_counting_hash(K, 1e5, 2)
+    ht.consume_fasta(filename)
+    return ht
+
+def test_filter_matches_python():
+    inpath = utils.get_test_data('test-abund-read-2.fa')
+    outpath = utils.get_temp_filename('test-abund-read-2.fa.abundfilt')
+
+    ht = _make_counting(inpath, K=17)
+    for cutoff in (1, 2, 5):
+        expected = _filter_in_python(ht, inpath, cutoff)
+
+        n_reads, n_kept, n_bp_read, n_bp_kept = \
+            ht.filter_abund(inpath, outpath, cutoff)
+        kept = [ (r.name, r.sequence) for r in screed.open(outpath) ]
+
+        assert kept == expected, (cutoff, len(kept), len(expected))
+        assert n_reads == 1001
+        assert n_kept == len(expected)
+        assert n_bp_kept == sum([ len(seq) for _, seq in expected ])
+
+def test_filter_threaded_in_order():
+    # many batches, so that the workers finish them out of order.
+    inpath = utils.get_test_data('test-reads.fa')
+    outpath = utils.get_temp_filename('test-reads.fa.abundfilt')
+
+    ht = _make_counting(inpath)
+    expected = _filter_in_python(ht, inpath, 2)
+    assert len(expected) > 4096 * 2
+
+    n_reads, n_kept, _, _ = ht.filter_abund(inpath, outpath, 2, 4)
+    kept = [ (r.name, r.sequence) for r in screed.open(outpath) ]
+
+    assert n_reads == 25000
+    assert n_kept == len(expected)
+    assert kept == expected
+
+def test_filter_threaded_unordered():
+    inpath = utils.get_test_data('test-reads.fa')
+    outpath = utils.get_temp_filename('test-reads.fa.abundfilt')
+
+    ht = _make_counting(inpath)
+    expected = _filter_in_python(ht, inpath, 2)
+
+    n_reads, n_kept, _, _ = ht.filter_abund(inpath, outpath, 2, 4, False)
+    kept = [ (r.name, r.sequence) for r in screed.open(outpath) ]
+
+    assert n_reads == 25000
+    assert n_kept == len(expected)
+    assert sorted(kept) == sorted(expected)
+
+def test_filter_empty():
+    inpath = utils.get_test_data('test-empty.fa')
+    outpath = utils.get_temp_filename('test-empty.fa.abundfilt')
+
+    ht = khmer.new_counting_hash(12, 1e5, 2)
+    for ordered in (True, False):
+        assert ht.filter_abund(inpath, outpath, 2, 2, ordered) == (0, 0, 0, 0)
+        assert open(outpath).read() == ''
@@ -25,6 +25,19 @@ class Test_ExactGraphFu(object):
         x = ht.calc_connected_graph_size(kmer)
         assert x == 36, x
 
+    def test_counts_threshold(self):
+        ht = self.ht
+        ht.consume_fasta(utils.get_test_data('test-graph.fa'))
+
+        # the search stops as soon as it has counted threshold k-mers.
+        kmer = "TTAGGACTGCAC"
+        for threshold in (1, 10, 68, 69):
+            x = ht.calc_connected_graph_size(kmer, threshold)
+            assert x == threshold, (x, threshold)
+
+        x = ht.calc_connected_graph_size(kmer, 1000)
+        assert x == 69, x
+
     def test_graph_links_next_a(self):
         ht = self.ht
         word = "TGCGTTTCAATC"
@@ -270,6 +283,38 @@ class Test_Partitioning(object):
         x = ht.subset_count_partitions(subset)
         assert x == (1, 0)             # connected @ K = 31
 
+    def test_threaded_tagging(self):
+        # the tags can differ, but not the partitions.
+        for name, K, expected in (('random-20-a.fa', 21, (99, 0)),
+                                  ('random-20-a.fa', 20, (1, 0)),
+                                  ('random-31-c.fa', 32, (999, 0)),
+                                  ('random-31-c.fa', 31, (1, 0))):
+            filename = utils.get_test_data(name)
+
+            ht = khmer.new_hashbits(K, 1e6, 4)
+            single = ht.consume_fasta_and_tag(filename)
+
+            ht = khmer.new_hashbits(K, 1e6, 4)
+            assert ht.consume_fasta_and_tag(filename, None, 4) == single
+
+            subset = ht.do_subset_partition(0, 0)
+            x = ht.subset_count_partitions(subset)
+            assert x == expected, (name, K, x)
+
+    def test_threaded_tagging_partitions(self):
+        filename = utils.get_test_data('test-reads.fa')
+        n_partitions = []
+
+        for n_threads in (1, 4):
+            ht = khmer.new_hashbits(20, 1e7, 4)
+            ht.consume_fasta_and_tag(filename, None, n_threads)
+            assert ht.n_tags()
+
+            subset = ht.do_subset_partition(0, 0)
+            n_partitions.append(ht.subset_count_partitions(subset))
+
+        assert n_partitions[0] == n_partitions[1], n_partitions
+
 ###
 
 class Test_PythonAPI(object):
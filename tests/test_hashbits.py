@@ -1,3 +1,5 @@
+import struct
+
 import khmer
 
 import screed
@@ -158,6 +160,21 @@ def test_combine_pe():
    assert pid1 == pid2
    assert ht.count_partitions() == (1, 0)
 
+def test_join_partitions_keeps_lower_id():
+   # two partitions of one tag each: the lower ID is kept, whichever
+   # way round they are joined.
+   inpfile = utils.get_test_data('combine_parts_1.fa')
+   s1 = "CATGCAGAAGTTCCGCAACCATACCGTTCAGT"
+   s2 = "CAAATGTACATGCACTTAAAATCATCCAGCCG"
+
+   for first, second in ((2, 80293), (80293, 2)):
+      ht = khmer.new_hashbits(32, 1, 1)
+      ht.consume_partitioned_fasta(inpfile)
+
+      assert ht.join_partitions(first, second) == 2
+      assert ht.get_partition_id(s1) == 2
+      assert ht.get_partition_id(s2) == 2
+
 def test_load_partitioned():
    inpfile = utils.get_test_data('combine_parts_1.fa')
    ht = khmer.new_hashbits(32, 1, 1)
@@ -369,6 +386,102 @@ def test_get_hashsizes():
    kh = khmer.new_hashbits(22, 100, 4)
    assert kh.hashsizes() == [101, 103, 107, 109], kh.hashsizes()
 
+def test_blocked_get_hashsizes():
+    kh = khmer.new_hashbits(22, 100, 4, blocked=True)
+    assert kh.is_blocked()
+    assert not khmer.new_hashbits(22, 100, 4).is_blocked()
+
+    # 4 tables of ~100 bits => 3 blocks (prime), 128 bits per table
+    assert kh.hashsizes() == [384, 384, 384, 384], kh.hashsizes()
+
+def test_blocked_false_positive_rate():
+    # every k-mer added is found, and the false positive rate
+    # calc_expected_collisions reports is the one measured, which is
+    # higher than the tables' occupancy alone would give.
+    inpath = utils.get_test_data('random-20-a.fa')
+    otherpath = utils.get_test_data('test-reads.fa')
+    K = 12
+
+    present = set(utils.kmer_counts([inpath], K))
+    absent = set(utils.kmer_counts([otherpath], K)) - present
+
+    ht = khmer.new_hashbits(K, 8000, 4, blocked=True)
+    ht.consume_fasta(inpath)
+
+    for kmer in present:
+        assert ht.get(khmer.reverse_hash(kmer, K))
+
+    n_fp = len([ kmer for kmer in absent
+                 if ht.get(khmer.reverse_hash(kmer, K)) ])
+    measured = n_fp / float(len(absent))
+    reported = khmer.calc_expected_collisions(ht)
+    assert reported == khmer.calc_expected_collisions(ht, 4)
+    assert abs(reported - measured) < 0.1 * measured, (reported, measured)
+
+    from_tables = 1.0
+    for n, size in zip(ht.occupancy()['occupied'], ht.hashsizes()):
+        from_tables *= n / float(size)
+    assert reported > from_tables, (reported, from_tables)
+
+def _do_blocked_save_load(savepath, use_mmap=False):
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    hi = khmer.new_hashbits(20, 1e5, 3, blocked=True)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.load_hashbits(savepath, use_mmap=use_mmap)
+    assert ht.is_blocked()
+    assert ht.hashsizes() == hi.hashsizes()
+    assert ht.occupancy() == hi.occupancy()
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        assert ht.get(seq[:20]) == 1
+        assert ht.get_median_count(seq) == hi.get_median_count(seq)
+
+    return ht
+
+def test_blocked_save_load():
+    savepath = utils.get_temp_filename('blocked.ht')
+    assert not _do_blocked_save_load(savepath).is_mmapped()
+
+    data = open(savepath, 'rb').read()
+    version, ht_type = struct.unpack('<BB', data[:2])
+    assert ht_type == 9
+
+def test_blocked_save_load_kz():
+    _do_blocked_save_load(utils.get_temp_filename('blocked.ht.kz'))
+
+def test_blocked_mmap_load():
+    savepath = utils.get_temp_filename('blocked-mmap.ht')
+    assert _do_blocked_save_load(savepath, True).is_mmapped()
+
+def test_blocked_set_algebra():
+    a = utils.get_test_data('random-20-a.fa')
+    b = utils.get_test_data('random-20-b.fa')
+
+    def load(filenames):
+        ht = khmer.new_hashbits(20, 1e5, 3, blocked=True)
+        for filename in filenames:
+            ht.consume_fasta(filename)
+        return ht
+
+    ha, hb, both = load([a]), load([b]), load([a, b])
+    union = ha.union(hb)
+    assert union.is_blocked()
+    assert union.occupancy() == both.occupancy()
+
+    n_union = len(utils.kmer_counts([a, b], 20))
+    assert abs(ha.compare(hb)['union'] - n_union) < 0.02 * n_union
+
+    # a blocked and an unblocked table can't be combined.
+    try:
+        ha.union(khmer.new_hashbits(20, 1e5, 3))
+        assert 0, "should fail"
+    except ValueError:
+        pass
+
 def test_extract_unique_paths_0():
    kh = khmer.new_hashbits(10, 1e5, 4)
    
@@ -495,3 +608,320 @@ def test_simple_median():
     assert median == 1
     assert average == 1.0
     assert stddev == 0.0
+
+def test_save_load_kz():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('hashbitssave.ht.kz')
+
+    hi = khmer.new_hashbits(20, 1e7, 3)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    assert open(savepath, 'rb').read(7) == 'khmerkz'
+
+    ht = khmer.new_hashbits(20, 1, 1)
+    ht.load(savepath)
+    assert ht.hashsizes() == hi.hashsizes()
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        assert ht.get(seq[:20]) == 1
+        assert ht.get_median_count(seq) == hi.get_median_count(seq)
+
+def test_mmap_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('mmap.ht')
+
+    hi = khmer.new_hashbits(20, 1e5, 3)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.load_hashbits(savepath, use_mmap=True)
+    assert ht.is_mmapped()
+    assert ht.ksize() == 20
+    assert ht.hashsizes() == hi.hashsizes()
+
+    for record in screed.open(inpath):
+        seq = record.sequence
+        assert ht.get_median_count(seq) == hi.get_median_count(seq)
+
+    # counting into a mapped table leaves the file alone.
+    kmer = 'ACGTACGTACGTACGTACGT'
+    if not hi.get(kmer):
+        ht.count(kmer)
+        assert ht.get(kmer)
+        assert not khmer.load_hashbits(savepath).get(kmer)
+
+    # loading over a mapped table unmaps it.
+    ht.load(savepath)
+    assert not ht.is_mmapped()
+    assert ht.get(kmer) == hi.get(kmer)
+
+def test_mmap_load_tables_page_aligned():
+    hi = khmer.new_hashbits(12, 1e4, 2)
+    savepath = utils.get_temp_filename('aligned.ht')
+    hi.save(savepath)
+
+    data = open(savepath, 'rb').read()
+    version, ht_type = struct.unpack('<BB', data[:2])
+    assert ht_type == 8
+
+    # header, then each table size, padding, and table.
+    offset = struct.calcsize('<BBIB')
+    for size in hi.hashsizes():
+        assert struct.unpack('<Q', data[offset:offset + 8])[0] == size
+        offset += 8
+        offset += (4096 - offset % 4096) % 4096
+        offset += size / 8 + 1
+    assert offset == len(data)
+
+def test_mmap_load_unaligned_reads_in():
+    # SAVED_HASHBITS files don't have page-aligned tables.
+    hi = khmer.new_hashbits(4, 4**4, 1)
+    tablesize = hi.hashsizes()[0]
+    table = [0] * (tablesize / 8 + 1)
+    bin = khmer.forward_hash('AAAC', 4) % tablesize
+    table[bin / 8] = 1 << (bin % 8)
+
+    savepath = utils.get_temp_filename('unaligned.ht')
+    fp = open(savepath, 'wb')
+    fp.write(struct.pack('<BBIBQ', 7, 2, 4, 1, tablesize))
+    fp.write(struct.pack('<%dB' % len(table), *table))
+    fp.close()
+
+    ht = khmer.load_hashbits(savepath, use_mmap=True)
+    assert not ht.is_mmapped()
+    assert ht.get('AAAC') == 1
+    assert ht.get('AAAA') == 0
+
+def test_mmap_load_kz_reads_in():
+    hi = khmer.new_hashbits(12, 1e4, 2)
+    hi.count('ACGTACGTACGT')
+    savepath = utils.get_temp_filename('mmap.ht.kz')
+    hi.save(savepath)
+
+    ht = khmer.load_hashbits(savepath, use_mmap=True)
+    assert not ht.is_mmapped()
+    assert ht.get('ACGTACGTACGT') == 1
+
+def test_mmap_load_tagset_and_partition():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('graph.ht')
+    tagpath = utils.get_temp_filename('graph.tagset')
+
+    hi = khmer.new_hashbits(20, 1e5, 3)
+    hi.consume_fasta_and_tag(inpath)
+    hi.save(savepath)
+    hi.save_tagset(tagpath)
+
+    ht = khmer.load_hashbits(savepath, use_mmap=True)
+    ht.load_tagset(tagpath, True, True)
+    assert ht.get_tagset() == hi.get_tagset()
+
+    hi.merge_subset(hi.do_subset_partition(0, 0))
+    ht.merge_subset(ht.do_subset_partition(0, 0))
+    assert ht.count_partitions() == hi.count_partitions()
+
+    # without clearing, the tags are added to the ones there.
+    ht.add_tag('A' * 20)
+    ht.load_tagset(tagpath, clear_tags=False, use_mmap=True)
+    assert len(ht.get_tagset()) == len(hi.get_tagset()) + 1
+
+def _kmer_bins(filename, K, size):
+    bins = set()
+    for record in screed.open(filename):
+        seq = record.sequence
+        for i in range(len(seq) - K + 1):
+            bins.add(khmer.forward_hash(seq[i:i + K], K) % size)
+    return bins
+
+def test_occupancy():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    ht = khmer.new_hashbits(20, 10007, 3)
+    ht.consume_fasta(inpath)
+    sizes = ht.hashsizes()
+
+    occupied = [ len(_kmer_bins(inpath, 20, size)) for size in sizes ]
+    occupancy = ht.occupancy()
+    assert occupancy['occupied'] == occupied
+    assert ht.n_occupied() == sum(occupied) / len(occupied)
+
+    fp_rate = 1.0
+    for n, size in zip(occupied, sizes):
+        fp_rate *= float(n) / size
+    assert round(occupancy['fp_rate'], 10) == round(fp_rate, 10)
+
+    n_kmers = ht.n_unique_kmers()
+    assert abs(occupancy['n_kmers'] - n_kmers) < 0.05 * n_kmers
+    assert khmer.estimate_table_cardinality(ht) == occupancy['n_kmers']
+
+def test_n_occupied_ranges():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    ht = khmer.new_hashbits(20, 10007, 1)
+    ht.consume_fasta(inpath)
+    size = ht.hashsizes()[0]
+    bins = _kmer_bins(inpath, 20, size)
+
+    for start, stop in ((0, 1), (1, 7), (3, 70), (5, 4093), (13, size),
+                        (size - 3, size + 9), (0, 2 * size + 1)):
+        n = sum([ 1 for i in range(start, stop) if i % size in bins ])
+        assert ht.n_occupied(start, stop) == n, (start, stop)
+
+def test_n_occupied_after_load():
+    inpath = utils.get_test_data('random-20-a.fa')
+    savepath = utils.get_temp_filename('occupied.ht')
+
+    hi = khmer.new_hashbits(20, 1e5, 2)
+    hi.consume_fasta(inpath)
+    hi.save(savepath)
+
+    ht = khmer.new_hashbits(20, 1, 1)
+    ht.load(savepath)
+    assert ht.n_occupied() == hi.n_occupied()
+    assert ht.occupancy() == hi.occupancy()
+
+def test_occupancy_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+
+    ht = khmer.new_hashbits(20, 2e7, 2)
+    ht.consume_fasta(inpath)
+
+    single = ht.occupancy()
+    for n_threads in (2, 3, 8):
+        assert ht.occupancy(n_threads) == single
+        assert ht.n_occupied(0, 0, n_threads) == ht.n_occupied()
+
+def _load_hashbits(filenames, size=10007, n_tables=3):
+    ht = khmer.new_hashbits(20, size, n_tables)
+    for filename in filenames:
+        ht.consume_fasta(filename)
+    return ht
+
+def _saved_bytes(ht):
+    savepath = utils.get_temp_filename('saved.ht')
+    ht.save(savepath)
+    return open(savepath, 'rb').read()
+
+def test_union():
+    a = utils.get_test_data('random-20-a.fa')
+    b = utils.get_test_data('random-20-b.fa')
+    ha, hb = _load_hashbits([a]), _load_hashbits([b])
+
+    # exactly the filter of both files' k-mers.
+    both = _saved_bytes(_load_hashbits([a, b]))
+    assert _saved_bytes(ha.union(hb)) == both
+    assert _saved_bytes(hb.union(ha, 4)) == both
+
+    ha.update(hb)
+    assert _saved_bytes(ha) == both
+    assert abs(ha.n_unique_kmers() - len(utils.kmer_counts([a, b], 20))) < 200
+
+def test_intersection_and_difference():
+    a = utils.get_test_data('random-20-a.fa')
+    odd = utils.get_test_data('random-20-a.odd.fa')
+    b = utils.get_test_data('random-20-b.fa')
+    ha, hb = _load_hashbits([a, b]), _load_hashbits([odd])
+
+    inter = ha.intersection(hb)
+    diff = ha.difference(hb)
+    for record in screed.open(odd):
+        seq = record.sequence
+        for i in range(len(seq) - 20 + 1):
+            assert inter.get(seq[i:i + 20])
+            assert not diff.get(seq[i:i + 20])
+
+    occupancy = [ ht.occupancy()['occupied'] for ht in (ha, hb, inter, diff) ]
+    for n_a, n_b, n_inter, n_diff in zip(*occupancy):
+        assert n_inter <= min(n_a, n_b)
+        assert n_inter + n_diff == n_a
+
+def test_compare():
+    a = utils.get_test_data('random-20-a.fa')
+    odd = utils.get_test_data('random-20-a.odd.fa')
+    b = utils.get_test_data('random-20-b.fa')
+
+    ha, hb = _load_hashbits([a, b], 1e5), _load_hashbits([odd], 1e5)
+    in_a = set(utils.kmer_counts([a, b], 20))
+    in_b = set(utils.kmer_counts([odd], 20))
+    union, inter, diff = in_a | in_b, in_a & in_b, in_a - in_b
+
+    comparison = ha.compare(hb)
+    assert comparison == ha.compare(hb, 4)
+    assert abs(comparison['union'] - len(union)) < 0.02 * len(union)
+    assert abs(comparison['intersection'] - len(inter)) < 0.02 * len(union)
+    assert abs(comparison['difference'] - len(diff)) < 0.02 * len(union)
+    assert abs(comparison['jaccard'] - len(inter) / float(len(union))) < 0.02
+    assert hb.compare(ha)['difference'] < 0.02 * len(union)
+
+    empty = khmer.new_hashbits(20, 1e5, 3)
+    assert empty.compare(empty)['jaccard'] == 0
+
+def test_set_algebra_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+    odd = utils.get_test_data('random-20-a.fa')
+
+    ha = _load_hashbits([inpath], 2e7, 2)
+    hb = _load_hashbits([odd], 2e7, 2)
+    for n_threads in (2, 3, 8):
+        assert _saved_bytes(ha.union(hb, n_threads)) == \
+            _saved_bytes(ha.union(hb))
+        assert _saved_bytes(ha.difference(hb, n_threads)) == \
+            _saved_bytes(ha.difference(hb))
+        assert ha.compare(hb, n_threads) == ha.compare(hb)
+
+def test_set_algebra_incompatible():
+    ht = khmer.new_hashbits(20, 10007, 3)
+    for other in (khmer.new_hashbits(20, 10009, 3),
+                  khmer.new_hashbits(20, 10007, 2),
+                  khmer.new_hashbits(21, 10007, 3)):
+        for op in (ht.union, ht.intersection, ht.difference, ht.update,
+                   ht.compare):
+            try:
+                op(other)
+                assert 0, "should fail"
+            except ValueError:
+                pass
+
+    try:
+        ht.union(khmer.new_counting_hash(20, 10007, 3))
+        assert 0, "should fail"
+    except TypeError:
+        pass
+
+def test_traversals_reuse_scratch():
+    # each traversal starts from an empty queue and visited set, whatever
+    # the traversals before it left behind.
+    inpfile = utils.get_test_data('random-20-a.fa')
+    ht = khmer.new_hashbits(20, 1e6, 4)
+    ht.consume_fasta(inpfile)
+
+    kmer = 'CGCAGGCTGGATTCTAGAGG'
+    for i in range(3):
+        assert ht.count_kmers_within_radius(kmer, 1e6) == 3960
+        assert ht.count_kmers_within_radius(kmer, 1e6, 100) == 101
+        assert ht.count_kmers_within_radius(kmer, 0) == 1
+        assert ht.count_kmers_on_radius(kmer, 0, 0) == 1
+        assert ht.find_radius_for_volume(kmer, 1, 100) == 0
+
+def test_traversals_threaded():
+    import threading
+
+    inpfile = utils.get_test_data('random-20-a.fa')
+    ht = khmer.new_hashbits(20, 1e6, 4)
+    ht.consume_fasta(inpfile)
+
+    kmer = 'CGCAGGCTGGATTCTAGAGG'
+    counts = []
+    def traverse():
+        for i in range(5):
+            counts.append(ht.count_kmers_within_radius(kmer, 1e6))
+
+    threads = [ threading.Thread(target=traverse) for i in range(4) ]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    assert counts == [3960] * 20
@@ -0,0 +1,124 @@
+import math
+
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def test_estimate_small():
+    inpath = utils.get_test_data('random-20-a.fa')
+
+    for K in (12, 20, 31):
+        n = len(utils.kmer_counts([inpath], K))
+        estimate = khmer.estimate_kmer_cardinality(K, [inpath])
+        assert abs(estimate - n) < 0.03 * n, (K, estimate, n)
+
+def test_estimate_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+
+    n = len(utils.kmer_counts([inpath], 20))
+    estimate = khmer.estimate_kmer_cardinality(20, [inpath], 4)
+    assert abs(estimate - n) < 0.03 * n, (estimate, n)
+
+    # the same k-mers in the same registers, however the reads are split.
+    assert estimate == khmer.estimate_kmer_cardinality(20, [inpath], 1)
+
+def test_consume_and_merge():
+    inpath = utils.get_test_data('random-20-a.fa')
+    seqs = [ r.sequence for r in screed.open(inpath) ]
+
+    a = khmer.new_hllcounter(20)
+    b = khmer.new_hllcounter(20)
+    for n, seq in enumerate(seqs):
+        if n % 2:
+            assert a.consume(seq) == len(seq) - 19
+        else:
+            b.consume(seq.lower())
+
+    a.merge(b)
+    assert a.estimate_cardinality() == \
+        khmer.estimate_kmer_cardinality(20, [inpath])
+
+def test_merge_mismatch():
+    a = khmer.new_hllcounter(20)
+    try:
+        a.merge(khmer.new_hllcounter(21))
+        assert 0, "merge should fail"
+    except ValueError:
+        pass
+
+    try:
+        a.merge(khmer.new_hllcounter(20, 0.1))
+        assert 0, "merge should fail"
+    except ValueError:
+        pass
+
+def test_consume_skips_bad_reads():
+    hll = khmer.new_hllcounter(4)
+    assert hll.consume('ACGTN') == 0
+    assert hll.consume('ACG') == 0
+    assert hll.estimate_cardinality() == 0
+
+def test_consume_fasta_empty_and_invalid():
+    hll = khmer.new_hllcounter(20)
+    rparser = khmer.ReadParser(utils.get_test_data('test-empty.fa'))
+    assert hll.consume_fasta_with_reads_parser(rparser) == (0, 0)
+
+    # the second record's sequence isn't one.
+    badpath = utils.get_temp_filename('bad.fq')
+    open(badpath, 'w').write('@r1\nACGTACGTACGTACGTACGTA\n+\n' + 'I' * 21 +
+                             '\n@r2\n12345\n+\nIIIII\n')
+    try:
+        hll.consume_fasta_with_reads_parser(khmer.ReadParser(badpath))
+        assert 0, "should fail"
+    except ValueError:
+        pass
+
+def _fp_rate(n_kmers, sizes):
+    rate = 1.
+    for size in sizes:
+        rate *= 1 - math.exp(-float(n_kmers) / size)
+    return rate
+
+def test_table_sizes_for_fp_rate():
+    for fp_rate in (0.2, 0.05, 0.01, 0.001):
+        sizes = khmer.get_table_sizes_for_fp_rate(100000, fp_rate)
+        assert len(set(sizes)) == len(sizes)
+        assert all([ khmer.is_prime(x) for x in sizes ])
+        assert _fp_rate(100000, sizes) <= fp_rate
+
+        # about the least memory for that rate.
+        assert sum(sizes) < 1.1 * 100000 * math.log(1 / fp_rate) / \
+            math.log(2) ** 2
+
+def test_table_sizes_for_memory():
+    for max_entries in (10000, 100000, 1000000, 100000000):
+        sizes = khmer.get_table_sizes_for_memory(100000, max_entries)
+        assert len(set(sizes)) == len(sizes)
+        assert all([ khmer.is_prime(x) for x in sizes ])
+        assert sum(sizes) <= max_entries
+        assert sum(sizes) > 0.99 * max_entries
+
+    # the more memory, the more tables it pays to use.
+    assert len(khmer.get_table_sizes_for_memory(100000, 10000)) == 1
+    assert len(khmer.get_table_sizes_for_memory(100000, 1000000)) == 7
+
+def test_new_tables_sized():
+    ht = khmer.new_counting_hash(20, n_kmers=100000, fp_rate=0.01)
+    assert ht.hashsizes() == khmer.get_table_sizes_for_fp_rate(100000, 0.01)
+
+    ht = khmer.new_counting_hash(20, n_kmers=100000, max_memory=1e6,
+                                 counter_bits=4)
+    assert ht.hashsizes() == khmer.get_table_sizes_for_memory(100000, 2000000)
+
+    ht = khmer.new_hashbits(20, n_kmers=100000, max_memory=1e6)
+    assert ht.hashsizes() == khmer.get_table_sizes_for_memory(100000, 8000000)
+
+    try:
+        khmer.new_hashbits(20)
+        assert 0, "should fail without a size"
+    except ValueError:
+        pass
@@ -4,6 +4,7 @@
 
 
 import khmer
+import khmer_tst_utils as utils
 # NOTE: Currently the wrapper only supports a config singleton.
 #	In the future, manipulation of multiple configs may be allowed.
 #	The following alias is a hedge against the future.
@@ -85,4 +86,91 @@ def test_USE_set_reads_input_buffer_size( ):
     assert bufsz == config.get_reads_input_buffer_size( )
 
 
+def test_USE_set_table_placement( ):
+    """
+	Verify that the table placement settings are what is reported.
+    """
+    config = get_active_config( )
+    pages = config.get_table_huge_pages( )
+    interleave = config.get_table_numa_interleave( )
+    zero_threads = config.get_table_zero_threads( )
+    assert khmer.TABLE_PAGES_NORMAL == pages
+    assert not interleave
+    assert 1 == zero_threads
+
+    config.set_table_huge_pages( khmer.TABLE_PAGES_TRANSPARENT )
+    assert khmer.TABLE_PAGES_TRANSPARENT == config.get_table_huge_pages( )
+    config.set_table_numa_interleave( True )
+    assert config.get_table_numa_interleave( )
+    config.set_table_zero_threads( 4 )
+    assert 4 == config.get_table_zero_threads( )
+
+    try: config.set_table_huge_pages( 3 )
+    except ValueError: pass
+    else: assert False, "config.set_table_huge_pages( 3 )"
+    try: config.set_table_zero_threads( 0 )
+    except ValueError: pass
+    else: assert False, "config.set_table_zero_threads( 0 )"
+
+    config.set_table_huge_pages( pages )
+    config.set_table_numa_interleave( interleave )
+    config.set_table_zero_threads( zero_threads )
+
+
+def check_tables_with_placement( pages, interleave, zero_threads ):
+    """
+	Helper function: tables placed as given count, save, and load.
+    """
+    config = get_active_config( )
+    config.set_table_huge_pages( pages )
+    config.set_table_numa_interleave( interleave )
+    config.set_table_zero_threads( zero_threads )
+
+    try:
+	for blocked in (False, True):
+	    kh = khmer.new_counting_hash( 12, 3e6, 2, 1, blocked )
+	    assert 0 == kh.n_occupied( )
+	    kh.count( 'ACGTACGTACGT' )
+	    kh.count( 'ACGTACGTACGT' )
+	    assert 2 == kh.get( 'ACGTACGTACGT' )
+
+	    savepath = utils.get_temp_filename( 'placed.kh' )
+	    kh.save( savepath )
+	    kh = khmer.load_counting_hash( savepath )
+	    assert 2 == kh.get( 'ACGTACGTACGT' )
+
+	hb = khmer.new_hashbits( 12, 3e6, 2 )
+	assert 0 == hb.n_occupied( )
+	hb.count( 'ACGTACGTACGT' )
+	assert hb.get( 'ACGTACGTACGT' )
+
+	savepath = utils.get_temp_filename( 'placed.ht' )
+	hb.save( savepath )
+	hb.load( savepath )
+	assert hb.get( 'ACGTACGTACGT' )
+    finally:
+	config.set_table_huge_pages( khmer.TABLE_PAGES_NORMAL )
+	config.set_table_numa_interleave( False )
+	config.set_table_zero_threads( 1 )
+
+
+def test_USE_table_placement( ):
+    """
+	Verify that tables work however they are placed.  Where the system
+	has no huge pages or NUMA nodes to give, they fall back quietly.
+    """
+    for pages in \
+	[
+	    khmer.TABLE_PAGES_NORMAL, khmer.TABLE_PAGES_TRANSPARENT,
+	    khmer.TABLE_PAGES_EXPLICIT,
+	]:
+	for interleave in (False, True):
+	    yield check_tables_with_placement, pages, interleave, 1
+	yield check_tables_with_placement, pages, False, 4
+
+
+def teardown( ):
+    utils.cleanup( )
+
+
 # vim: set ft=python sts=4 sw=4 tw=79:
@@ -0,0 +1,102 @@
+import glob
+import os
+
+import khmer
+import screed
+
+import khmer_tst_utils as utils
+
+def teardown():
+    utils.cleanup()
+
+def _count_in_python(filenames, K):
+    n_reads = sum([ len(list(screed.open(f))) for f in filenames ])
+    return n_reads, utils.kmer_counts(filenames, K, skip_n=True)
+
+def _check_db(db, counts, K):
+    assert db.ksize() == K
+    assert db.n_unique_kmers() == len(counts)
+    for kmer, count in counts.iteritems():
+        assert db.get(kmer) == count
+
+def test_count_partitioned():
+    inpath = utils.get_test_data('test-reads.fa')
+    outpath = utils.get_temp_filename('test-reads.kmers')
+    n_reads, expected = _count_in_python([inpath], 20)
+
+    for n_ranges in (1, 4, 64):
+        result = khmer.count_kmers_partitioned(20, [inpath], outpath,
+                                               n_ranges)
+        assert result == (n_reads, sum(expected.values()), len(expected))
+        _check_db(khmer.open_kmer_count_database(outpath), expected, 20)
+
+        # the spill files are gone.
+        assert not glob.glob(outpath + '.*')
+
+def test_count_partitioned_threaded():
+    inpath = utils.get_test_data('test-reads.fa')
+    outpath = utils.get_temp_filename('test-reads.kmers')
+    tmp_prefix = utils.get_temp_filename('spill')
+    n_reads, expected = _count_in_python([inpath], 25)
+
+    result = khmer.count_kmers_partitioned(25, [inpath], outpath, 8,
+                                           tmp_prefix, n_threads=4)
+    assert result == (n_reads, sum(expected.values()), len(expected))
+    _check_db(khmer.open_kmer_count_database(outpath), expected, 25)
+    assert not glob.glob(tmp_prefix + '*')
+
+def test_count_partitioned_files():
+    inpaths = [ utils.get_test_data('random-20-a.fa'),
+                utils.get_test_data('random-20-b.fa'),
+                utils.get_test_data('test-abund-read-2.fa') ]
+    outpath = utils.get_temp_filename('out.kmers')
+    n_reads, expected = _count_in_python(inpaths, 12)
+
+    result = khmer.count_kmers_partitioned(12, inpaths, outpath, 5)
+    assert result[0] == n_reads
+    assert result[2] == len(expected)
+
+    db = khmer.open_kmer_count_database(outpath)
+    _check_db(db, expected, 12)
+    assert db.get('A' * 12) == expected.get(0, 0)
+    assert db.get('ACGTACGTACGA') == \
+        expected.get(khmer.forward_hash('ACGTACGTACGA', 12), 0)
+
+def test_same_as_exact_counting_hash():
+    # the output is a saved ExactCountingHash, and either reads the other.
+    inpath = utils.get_test_data('random-20-a.fa')
+    outpath = utils.get_temp_filename('random-20-a.kmers')
+    savepath = utils.get_temp_filename('random-20-a.ct')
+
+    khmer.count_kmers_partitioned(16, [inpath], outpath, 7)
+    ht = khmer.new_exact_counting_hash(16)
+    ht.consume_fasta(inpath)
+    ht.save(savepath)
+
+    assert open(outpath, 'rb').read() == open(savepath, 'rb').read()
+
+    loaded = khmer.load_exact_counting_hash(outpath)
+    db = khmer.open_kmer_count_database(savepath)
+    for record in screed.open(inpath):
+        kmer = record.sequence[:16]
+        assert loaded.get(kmer) == db.get(kmer) == ht.get(kmer)
+
+def test_count_partitioned_k32():
+    # the last range runs to the top of the 64-bit hashes.
+    inpath = utils.get_test_data('random-20-a.fa')
+    outpath = utils.get_temp_filename('random-20-a.kmers')
+    n_reads, expected = _count_in_python([inpath], 32)
+
+    result = khmer.count_kmers_partitioned(32, [inpath], outpath, 3)
+    assert result == (n_reads, sum(expected.values()), len(expected))
+    _check_db(khmer.open_kmer_count_database(outpath), expected, 32)
+
+def test_count_partitioned_empty():
+    inpath = utils.get_test_data('test-empty.fa')
+    outpath = utils.get_temp_filename('empty.kmers')
+
+    assert khmer.count_kmers_partitioned(20, [inpath], outpath, 4) == \
+        (0, 0, 0)
+    db = khmer.open_kmer_count_database(outpath)
+    assert db.n_unique_kmers() == 0
+    assert db.get('A' * 20) == 0
@@ -112,6 +112,44 @@ def test_load_into_counting_fail():
     assert status == -1
     assert "ERROR:" in err
 
+def test_load_into_counting_auto_size():
+    script = scriptpath('load-into-counting.py')
+    args = ['--auto-size', '--max-fp-rate', '0.01', '-k', '20']
+
+    outfile = utils.get_temp_filename('out.kh')
+    infile = utils.get_test_data('test-abund-read-2.fa')
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = runscript(script, args)
+    assert status == 0
+    assert 'WARNING' not in err
+
+    ht = khmer.load_counting_hash(outfile)
+    assert khmer.calc_expected_collisions(ht) <= 0.01
+    assert sum(ht.hashsizes()) < 1e5
+
+def test_load_into_counting_overflow():
+    script = scriptpath('load-into-counting.py')
+    args = ['-x', '1e5', '-N', '2', '-k', '17', '--overflow-size', '1e3']
+
+    outfile = utils.get_temp_filename('out.kh')
+    infile = utils.get_temp_filename('many.fa')
+    fp = open(infile, 'w')
+    for i in range(300):
+        fp.write('>%d\nGGTTGACGGGGCTCAGGGGG\n' % i)
+    fp.close()
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = runscript(script, args)
+    assert status == 0
+
+    ht = khmer.load_counting_hash(outfile)
+    assert ht.get_overflow_size() == 1000
+    assert not ht.get_use_bigcount()
+    assert ht.get('GGTTGACGGGGCTCAGG') == 300
+
 def _make_counting(infilename, SIZE=1e7, N=2, K=20):
     script = scriptpath('load-into-counting.py')
     args = ['-x', str(SIZE), '-N', str(N), '-k', str(K)]
@@ -164,6 +202,25 @@ def test_filter_abund_2():
     assert len(seqs) == 2, seqs
     assert 'GGTTGACGGGGCTCAGGG' in seqs
 
+def test_filter_abund_threaded_unordered():
+    infile = utils.get_temp_filename('test.fa')
+    in_dir = os.path.dirname(infile)
+
+    shutil.copyfile(utils.get_test_data('test-abund-read-2.fa'), infile)
+    counting_ht = _make_counting(infile, K=17)
+
+    script = scriptpath('filter-abund.py')
+    args = ['-T', '4', '--unordered', counting_ht, infile]
+    (status, out, err) = runscript(script, args, in_dir)
+    assert status == 0
+
+    outfile = infile + '.abundfilt'
+    assert os.path.exists(outfile), outfile
+
+    seqs = set([ r.sequence for r in screed.open(outfile) ])
+    assert len(seqs) == 1, seqs
+    assert 'GGTTGACGGGGCTCAGGG' in seqs
+
 def test_filter_stoptags():
     infile = utils.get_temp_filename('test.fa')
     in_dir = os.path.dirname(infile)
@@ -339,6 +396,21 @@ def test_load_graph():
     x = ht.subset_count_partitions(subset)
     assert x == (1, 0), x
 
+def test_load_graph_auto_size():
+    script = scriptpath('load-graph.py')
+    args = ['--auto-size', '-M', '1e4', '-k', '20']
+
+    outfile = utils.get_temp_filename('out')
+    infile = utils.get_test_data('random-20-a.fa')
+
+    args.extend([outfile, infile])
+
+    (status, out, err) = runscript(script, args)
+    assert status == 0
+
+    ht = khmer.load_hashbits(outfile + '.ht')
+    assert sum(ht.hashsizes()) <= 8e4
+
 def test_load_graph_fail():
     script = scriptpath('load-graph.py')
     args = ['-x', '1e3', '-N', '2', '-k', '20'] # use small HT
@@ -674,6 +746,26 @@ def test_abundance_dist():
     line = fp.next().strip()
     assert line == '1001 2 98 1.0', line
 
+def test_abundance_dist_threaded_no_tracking():
+    infile = utils.get_temp_filename('test.fa')
+    outfile = utils.get_temp_filename('test.dist')
+    in_dir = os.path.dirname(infile)
+
+    shutil.copyfile(utils.get_test_data('test-abund-read-2.fa'), infile)
+
+    htfile = _make_counting(infile, K=17)
+
+    script = scriptpath('abundance-dist.py')
+    args = ['-z', '-T', '4', '--no-tracking', htfile, infile, outfile]
+    (status, out, err) = runscript(script, args, in_dir)
+    assert status == 0
+
+    fp = iter(open(outfile))
+    line = fp.next().strip()
+    assert line == '1 96 96 0.98', line
+    line = fp.next().strip()
+    assert line == '1001 2 98 1.0', line
+
 def test_do_partition():
     seqfile = utils.get_test_data('random-20-a.fa')
     graphbase = utils.get_temp_filename('out')
@@ -711,3 +803,20 @@ def test_do_partition_2():
 
     assert len(parts) == 99, len(parts)
 
+
+def test_merge_counting_hashes():
+    infile = utils.get_test_data('test-abund-read-2.fa')
+    counting_a = _make_counting(infile, K=17)
+    counting_b = utils.get_temp_filename('out2.kh')
+    shutil.copyfile(counting_a, counting_b)
+
+    script = scriptpath('merge-counting-hashes.py')
+    outfile = utils.get_temp_filename('merged.kh')
+    (status, out, err) = runscript(script, [outfile, counting_a, counting_b])
+    assert status == 0
+
+    one = khmer.load_counting_hash(counting_a)
+    merged = khmer.load_counting_hash(outfile)
+    for record in screed.open(infile):
+        kmer = record.sequence[:17]
+        assert merged.get(kmer) == 2 * one.get(kmer), kmer
@@ -371,3 +371,26 @@ def test_small_real_partitions():
     assert set(parts) != set(['0'])
 
 test_small_real_partitions.runme = True
+
+def test_subsets_in_tag_order():
+    # subset ranges run over the tags in order, however they're stored.
+    filename = utils.get_test_data('random-20-a.fa')
+
+    ht = khmer.new_hashbits(20, 4**14+1)
+    ht.consume_fasta_and_tag(filename)
+
+    tags = [ khmer.forward_hash(t, 20) for t in ht.get_tagset() ]
+    assert tags == sorted(tags)
+
+    divvy = ht.divide_tags_into_subsets(7)
+    assert divvy == tags[::7]
+
+    whole = khmer.new_hashbits(20, 4**14+1)
+    whole.consume_fasta_and_tag(filename)
+    whole.merge_subset(whole.do_subset_partition(0, 0))
+
+    divvy.append(0)
+    for i in range(len(divvy) - 1):
+        ht.merge_subset(ht.do_subset_partition(divvy[i], divvy[i + 1]))
+
+    assert ht.count_partitions() == whole.count_partitions()